@@ -0,0 +1,67 @@
+//
+// Small client of the multiplication service started with main --serve
+//
+#include <errno.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define REQUEST_LENGTH 4096
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s SOCKET REQUEST...\n"
+                        "  LOAD <name> <path>\n"
+                        "  MUL <a> <b> <output> [impl 0, 1, 2, 3 or 6] [bin]\n"
+                        "  DROP <name>\n"
+                        "  STATS\n"
+                        "  SHUTDOWN\n", argv[0]);
+        return 2;
+    }
+    // the remaining arguments form a single request line
+    char request[REQUEST_LENGTH] = {0};
+    size_t length = 0;
+    for (int i = 2; i < argc; i++) {
+        int written = snprintf(request + length, sizeof(request) - length, "%s%s", i > 2 ? " " : "", argv[i]);
+        if (written < 0 || (size_t) written >= sizeof(request) - length - 1) {
+            error(2, 0, "Error: Request is too long");
+        }
+        length += (size_t) written;
+    }
+    request[length++] = '\n';
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+        error(2, 0, "Error: Socket path is too long: %s", argv[1]);
+    }
+    strcpy(address.sun_path, argv[1]);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        error(2, errno, "Error: Could not connect to %s", argv[1]);
+    }
+    if (write(server, request, length) != (ssize_t) length) {
+        error(2, errno, "Error: Could not send the request");
+    }
+    shutdown(server, SHUT_WR);
+
+    // print the answer, it succeeded if it starts with OK
+    char answer[REQUEST_LENGTH];
+    ssize_t got;
+    int first = 1;
+    int ok = 0;
+    while ((got = read(server, answer, sizeof(answer))) > 0) {
+        if (first) {
+            ok = got >= 2 && strncmp(answer, "OK", 2) == 0;
+            first = 0;
+        }
+        fwrite(answer, 1, (size_t) got, stdout);
+    }
+    close(server);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include "analyze.h"
+
+#include <stdint.h>
+
+#include "reorder.h"
+#include "scheduler.h"
+
+// rows whose output structure is counted exactly, the rest is extrapolated
+#define SAMPLE_ROWS 1024
+// padding up to this many stored entries per non zero keeps a format acceptable
+#define MAX_PADDING 1.5
+// output rows filling at least this share of the columns are accumulated densely
+#define DENSE_ACCUMULATOR_FILL (1.0 / 16)
+// index comparisons worth another thread
+#define WORK_PER_THREAD ((u_int64_t) 1 << 22)
+// matched products per output entry from which the vectorised merge pays off
+#define SIMD_PRODUCTS 8
+// index comparisons per product from which adding the rows of b beats merging against its transpose
+#define ROWWISE_MERGE_STEPS 16
+
+void matrix_stats(const struct EllpackMatrix *x, struct MatrixStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->min_row = x->height > 0 ? UINT64_MAX : 0;
+    u_int64_t sliced_entries = 0;
+    u_int64_t slice_width = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = rowlength_ellpack(x, row);
+        stats->nnz += length;
+        stats->min_row = length < stats->min_row ? length : stats->min_row;
+        stats->max_row = length > stats->max_row ? length : stats->max_row;
+        stats->empty_rows += length == 0;
+        stats->histogram[length == 0 ? 0 : 64 - __builtin_clzll(length)]++;
+        slice_width = length > slice_width ? length : slice_width;
+        if ((row + 1) % SLICE_HEIGHT == 0 || row + 1 == x->height) {
+            sliced_entries += slice_width * ((row % SLICE_HEIGHT) + 1);
+            slice_width = 0;
+        }
+    }
+    stats->bandwidth = bandwidth_ellpack(x);
+    stats->padding = stats->nnz > 0 ? (double) (x->height * x->width) / stats->nnz : 0.0;
+    stats->sliced_padding = stats->nnz > 0 ? (double) sliced_entries / stats->nnz : 0.0;
+}
+
+void product_stats(const struct EllpackMatrix *a, const struct EllpackMatrix *b, struct ProductStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    u_int64_t *b_lengths = calloc(b->height, sizeof(u_int64_t));
+    u_int64_t columns = b->real_width;
+    u_int64_t *stamps = calloc(columns, sizeof(u_int64_t)); // last sampled row touching each column, plus one
+    if ((!b_lengths && b->height > 0) || (!stamps && columns > 0)) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t b_nnz = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(b, b_row_i);
+        b_nnz += b_lengths[b_row_i];
+    }
+    u_int64_t a_nnz = 0;
+    for (u_int64_t a_row_i = 0; a_row_i < a->height; a_row_i++) {
+        u_int64_t length = rowlength_ellpack(a, a_row_i);
+        a_nnz += length;
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = a->indices[a_row_i * a->width + i];
+            stats->products += k < b->height ? b_lengths[k] : 0;
+        }
+    }
+    // every row of a is merged with every column of b
+    stats->merge_steps = a->height * b_nnz + columns * a_nnz;
+
+    stats->sampled_rows = a->height < SAMPLE_ROWS ? a->height : SAMPLE_ROWS;
+    u_int64_t sampled_nnz = 0;
+    for (u_int64_t s = 0; s < stats->sampled_rows; s++) {
+        u_int64_t a_row_i = s * a->height / stats->sampled_rows;
+        u_int64_t length = rowlength_ellpack(a, a_row_i);
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = a->indices[a_row_i * a->width + i];
+            for (u_int64_t j = 0; k < b->height && j < b_lengths[k]; j++) {
+                u_int64_t column = b->indices[k * b->width + j];
+                if (column < columns && stamps[column] != s + 1) {
+                    stamps[column] = s + 1;
+                    sampled_nnz++;
+                }
+            }
+        }
+    }
+    stats->output_nnz = stats->sampled_rows > 0 ? (double) sampled_nnz * a->height / stats->sampled_rows : 0.0;
+    stats->output_density = a->height * columns > 0 ? stats->output_nnz / ((double) a->height * columns) : 0.0;
+    free(b_lengths);
+    free(stamps);
+}
+
+static void print_matrix_stats(const char *name, const struct EllpackMatrix *x, const struct MatrixStats *stats) {
+    printf("[ANALYZE] Matrix %s: %lu x %lu (stored width %lu), nnz %lu, row length min %lu / avg %.1f / max %lu, %lu empty rows\n",
+           name, x->height, x->real_width, x->width, stats->nnz, stats->min_row,
+           x->height > 0 ? (double) stats->nnz / x->height : 0.0, stats->max_row, stats->empty_rows);
+    printf("[ANALYZE] Matrix %s: %.2f stored entries per nnz, %.2f in slices of %d rows, bandwidth %lu\n",
+           name, stats->padding, stats->sliced_padding, SLICE_HEIGHT, stats->bandwidth);
+    printf("[ANALYZE] Matrix %s row lengths:", name);
+    for (int i = 0; i < 65; i++) {
+        if (stats->histogram[i] == 0) {
+            continue;
+        }
+        if (i <= 1) {
+            printf(" [%d]", i);
+        } else {
+            printf(" [%llu-%llu]", 1ULL << (i - 1), (1ULL << i) - 1);
+        }
+        printf(" %lu (%.1f%%)", stats->histogram[i], 100.0 * stats->histogram[i] / x->height);
+    }
+    printf("\n");
+}
+
+enum MultVersion advise_implementation(const struct ProductStats *stats, u_int64_t threads) {
+    double products_per_entry = stats->output_nnz > 0 ? stats->products / stats->output_nnz : 0.0;
+    if (stats->products > 0 && stats->merge_steps >= ROWWISE_MERGE_STEPS * stats->products) {
+        return ROWWISE;
+    }
+    if (threads > 1) {
+        return PARALLEL;
+    }
+    return products_per_entry >= SIMD_PRODUCTS ? VECTORIZED : LINEAR;
+}
+
+void analyze_matrices(const struct EllpackMatrix *a, const struct EllpackMatrix *b) {
+    struct MatrixStats a_stats;
+    struct MatrixStats b_stats;
+    struct ProductStats p_stats;
+    matrix_stats(a, &a_stats);
+    matrix_stats(b, &b_stats);
+    product_stats(a, b, &p_stats);
+    print_matrix_stats("A", a, &a_stats);
+    print_matrix_stats("B", b, &b_stats);
+    printf("[ANALYZE] Product A * B: %lu multiply adds (%lu flops), %lu merge steps\n",
+           p_stats.products, 2 * p_stats.products, p_stats.merge_steps);
+    printf("[ANALYZE] Product A * B: about %.0f output entries (density %.2f%%, %s %lu rows)\n",
+           p_stats.output_nnz, 100 * p_stats.output_density,
+           p_stats.sampled_rows == a->height ? "counted in all" : "extrapolated from", p_stats.sampled_rows);
+
+    // the padding of the worse input decides the storage
+    double padding = a_stats.padding > b_stats.padding ? a_stats.padding : b_stats.padding;
+    double sliced_padding = a_stats.sliced_padding > b_stats.sliced_padding ? a_stats.sliced_padding : b_stats.sliced_padding;
+    const char *format = padding <= MAX_PADDING ? "ellpack" : sliced_padding <= MAX_PADDING ? "sliced-ellpack" : "csr";
+    const char *accumulator = p_stats.output_density >= DENSE_ACCUMULATOR_FILL ? "dense" : "hash";
+    u_int64_t threads = p_stats.merge_steps / WORK_PER_THREAD + 1;
+    if (threads > (u_int64_t) scheduler_threads()) {
+        threads = scheduler_threads();
+    }
+    double products_per_entry = p_stats.output_nnz > 0 ? p_stats.products / p_stats.output_nnz : 0.0;
+    enum MultVersion implementation = advise_implementation(&p_stats, threads);
+    printf("[ADVICE] Storage %s: padded ELLPACK stores %.2f entries per nnz, sliced ELLPACK %.2f\n", format, padding, sliced_padding);
+    printf("[ADVICE] Accumulator %s: output rows fill %.2f%% of the columns\n", accumulator, 100 * p_stats.output_density);
+    printf("[ADVICE] Implementation %d with %lu threads: %lu merge steps, %.1f products per output entry\n",
+           implementation, threads, p_stats.merge_steps, products_per_entry);
+    printf("[ADVICE] format=%s impl=%d accumulator=%s threads=%lu\n", format, implementation, accumulator, threads);
+}
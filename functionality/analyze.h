@@ -0,0 +1,42 @@
+#ifndef PROJEKTAUFGABE_ANALYZE_H
+#define PROJEKTAUFGABE_ANALYZE_H
+
+#include "ellpack_utility.h"
+#include "multiplication.h"
+
+/** structure of one matrix */
+struct MatrixStats {
+    u_int64_t nnz;
+    u_int64_t min_row, max_row; // row lengths
+    u_int64_t bandwidth;
+    u_int64_t empty_rows;
+    u_int64_t histogram[65]; // rows of length 0 and of length [2^(i-1), 2^i) in bucket i
+    double padding; // stored entries height * width per non zero
+    double sliced_padding; // the same for rows padded per slice of SLICE_HEIGHT rows
+};
+
+/** estimated work and result size of a * b */
+struct ProductStats {
+    u_int64_t products; // multiply adds of a row by row product
+    u_int64_t merge_steps; // index comparisons of the merging kernels
+    u_int64_t sampled_rows;
+    double output_nnz; // extrapolated from the structure of the sampled rows, cancellation is ignored
+    double output_density;
+};
+
+/** rows per slice of the sliced ELLPACK considered by the advisor */
+#define SLICE_HEIGHT 32
+
+void matrix_stats(const struct EllpackMatrix *x, struct MatrixStats *stats);
+void product_stats(const struct EllpackMatrix *a, const struct EllpackMatrix *b, struct ProductStats *stats);
+
+/** the implementation recommended for a product of these statistics computed by the given number of threads */
+enum MultVersion advise_implementation(const struct ProductStats *stats, u_int64_t threads);
+
+/**
+ * prints the statistics of a, b and a * b followed by a recommendation of storage format,
+ * implementation, accumulator and thread count, the last line "[ADVICE] key=value ..." is meant for scripts
+ */
+void analyze_matrices(const struct EllpackMatrix *a, const struct EllpackMatrix *b);
+
+#endif //PROJEKTAUFGABE_ANALYZE_H
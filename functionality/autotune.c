@@ -0,0 +1,180 @@
+#include "autotune.h"
+
+#include "analyze.h"
+#include "benchmarking.h"
+#include "fixed_width.h"
+#include "multiplication.h"
+#include "scheduler.h"
+
+// rows of the smaller sample, matrices of up to twice as many rows are timed whole
+#define SAMPLE_ROWS 256
+// runs of every measurement, the fastest counts
+#define REPEATS 2
+#define MODEL_LENGTH 128
+
+// the float implementations working on ELLPACK directly, the naive one is only a reference, the usually fastest come
+// first so the others drop out after their small sample
+static const enum MultVersion CANDIDATES[] = {ROWWISE, FIXED_WIDTH, PARALLEL, BATCHED, GENERIC_F32, LINEAR, VECTORIZED};
+
+static u_int64_t fnv1a(u_int64_t hash, u_int64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (8 * i)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+u_int64_t matrix_fingerprint(const struct EllpackMatrix *a, const struct EllpackMatrix *b) {
+    u_int64_t hash = 0xcbf29ce484222325ULL;
+    const struct EllpackMatrix *inputs[2] = {a, b};
+    for (int i = 0; i < 2; i++) {
+        struct MatrixStats stats;
+        matrix_stats(inputs[i], &stats);
+        hash = fnv1a(hash, inputs[i]->height);
+        hash = fnv1a(hash, inputs[i]->real_width);
+        hash = fnv1a(hash, inputs[i]->width);
+        hash = fnv1a(hash, stats.nnz);
+        for (int bucket = 0; bucket < 65; bucket++) {
+            hash = fnv1a(hash, stats.histogram[bucket]);
+        }
+    }
+    return hash;
+}
+
+void cpu_model(char *model, size_t size) {
+    snprintf(model, size, "unknown");
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (!cpuinfo) {
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), cpuinfo)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            colon += strspn(colon + 1, " \t") + 1;
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(model, size, "%s", colon);
+            break;
+        }
+    }
+    fclose(cpuinfo);
+}
+
+int autotune_lookup(const char *cache_path, u_int64_t fingerprint, int threads, const char *model) {
+    FILE *cache = fopen(cache_path, "r");
+    if (!cache) {
+        return -1;
+    }
+    int implementation = -1;
+    char line[64 + MODEL_LENGTH];
+    while (fgets(line, sizeof(line), cache)) {
+        u_int64_t found_fingerprint;
+        int found_threads;
+        int found_implementation;
+        int model_start = 0;
+        line[strcspn(line, "\n")] = '\0';
+        // the last decision for the same key counts
+        if (sscanf(line, "%lx %d %d %n", &found_fingerprint, &found_threads, &found_implementation, &model_start) == 3
+            && model_start > 0 && found_fingerprint == fingerprint && found_threads == threads
+            && strcmp(line + model_start, model) == 0) {
+            implementation = found_implementation;
+        }
+    }
+    fclose(cache);
+    for (size_t i = 0; i < sizeof(CANDIDATES) / sizeof(CANDIDATES[0]); i++) {
+        if ((int) CANDIDATES[i] == implementation) {
+            return implementation;
+        }
+    }
+    return -1;
+}
+
+int autotune_store(const char *cache_path, u_int64_t fingerprint, int threads, const char *model, int implementation) {
+    FILE *cache = fopen(cache_path, "a");
+    if (!cache) {
+        return 0;
+    }
+    fprintf(cache, "%016lx %d %d %s\n", fingerprint, threads, implementation, model);
+    int written = !ferror(cache);
+    return fclose(cache) == 0 && written;
+}
+
+// rows spread evenly over a
+static struct EllpackMatrix *sample_rows(const struct EllpackMatrix *a, u_int64_t rows) {
+    struct EllpackMatrix *sample = make_ellpack(a->real_width, rows, a->width, "");
+    for (u_int64_t i = 0; i < rows; i++) {
+        u_int64_t row = i * a->height / rows;
+        memcpy(sample->values + i * a->width, a->values + row * a->width, a->width * sizeof(float));
+        memcpy(sample->indices + i * a->width, a->indices + row * a->width, a->width * sizeof(u_int64_t));
+    }
+    return sample;
+}
+
+// the fastest of the repeated runs
+static double time_kernel(int implementation, const struct EllpackMatrix *a, const struct EllpackMatrix *b) {
+    double best = 0.0;
+    for (int run = 0; run < REPEATS; run++) {
+        struct EllpackMatrix *res = malloc(sizeof(*res));
+        if (!res) {
+            error(1, 0, "Error: Not enough memory for the autotuner");
+        }
+        double seconds = benchmark_once(implementation, a, b, res);
+        free_ellpack(res);
+        best = run == 0 || seconds < best ? seconds : best;
+    }
+    return best;
+}
+
+int autotune_implementation(const struct EllpackMatrix *a, const struct EllpackMatrix *b, const char *cache_path) {
+    char model[MODEL_LENGTH];
+    cpu_model(model, sizeof(model));
+    u_int64_t fingerprint = matrix_fingerprint(a, b);
+    int threads = scheduler_threads();
+    int implementation = autotune_lookup(cache_path, fingerprint, threads, model);
+    if (implementation != -1) {
+        printf("[AUTO] Implementation %d is cached in %s for these matrices with %d threads on %s\n",
+               implementation, cache_path, threads, model);
+        return implementation;
+    }
+
+    int whole = a->height <= 2 * SAMPLE_ROWS;
+    struct EllpackMatrix *small = whole ? NULL : sample_rows(a, SAMPLE_ROWS);
+    struct EllpackMatrix *large = whole ? NULL : sample_rows(a, 2 * SAMPLE_ROWS);
+    double best = 0.0;
+    for (size_t i = 0; i < sizeof(CANDIDATES) / sizeof(CANDIDATES[0]); i++) {
+        enum MultVersion candidate = CANDIDATES[i];
+        // without a kernel for the width of a the fixed width implementation is the parallel one
+        if (candidate == FIXED_WIDTH && !fixed_width_kernel(a)) {
+            continue;
+        }
+        double estimate;
+        if (whole) {
+            estimate = time_kernel(candidate, a, b);
+        } else {
+            // the estimate is at least the time of the small sample, a slower one is out already
+            double small_time = time_kernel(candidate, small, b);
+            if (implementation != -1 && small_time >= best) {
+                printf("[AUTO] Implementation %d: %f secs for %d rows, slower than implementation %d\n",
+                       candidate, small_time, SAMPLE_ROWS, implementation);
+                continue;
+            }
+            double large_time = time_kernel(candidate, large, b);
+            double per_row = large_time > small_time ? (large_time - small_time) / SAMPLE_ROWS : 0.0;
+            estimate = small_time + per_row * (double) (a->height - SAMPLE_ROWS);
+        }
+        printf("[AUTO] Implementation %d: about %f secs for all %lu rows\n", candidate, estimate, a->height);
+        if (implementation == -1 || estimate < best) {
+            implementation = candidate;
+            best = estimate;
+        }
+    }
+    if (!whole) {
+        free_all((struct EllpackMatrix *[]){small, large}, 2);
+    }
+    if (autotune_store(cache_path, fingerprint, threads, model, implementation)) {
+        printf("[AUTO] Picked implementation %d, stored in %s\n", implementation, cache_path);
+    } else {
+        printf("[AUTO] Picked implementation %d, the cache %s cannot be written\n", implementation, cache_path);
+    }
+    return implementation;
+}
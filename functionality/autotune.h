@@ -0,0 +1,31 @@
+#ifndef PROJEKTAUFGABE_AUTOTUNE_H
+#define PROJEKTAUFGABE_AUTOTUNE_H
+
+#include "ellpack_utility.h"
+
+/** the cache file of --auto in the working directory unless another one is given */
+#define AUTOTUNE_CACHE ".ellmul-autotune"
+
+/** a hash of the height, widths, non zeros and row length histogram of a and b */
+u_int64_t matrix_fingerprint(const struct EllpackMatrix *a, const struct EllpackMatrix *b);
+
+/** the model name of the cpu from /proc/cpuinfo, unknown if there is none */
+void cpu_model(char *model, size_t size);
+
+/**
+ * cache lines are "<fingerprint in hex> <threads> <implementation> <cpu model>", a decision holds for the same matrices,
+ * thread count and cpu, returns the cached implementation or -1
+ */
+int autotune_lookup(const char *cache_path, u_int64_t fingerprint, int threads, const char *model);
+/** appends a decision to the cache, returns 0 if the file cannot be written */
+int autotune_store(const char *cache_path, u_int64_t fingerprint, int threads, const char *model, int implementation);
+
+/**
+ * the float implementation to multiply a and b with: the cached decision if there is one, otherwise every float kernel
+ * multiplies two samples of evenly spread rows of a, one twice the size of the other, the time of all rows is
+ * extrapolated from both so the work done once per call like the transpose of b is not scaled with the rows,
+ * the fastest is stored in the cache
+ */
+int autotune_implementation(const struct EllpackMatrix *a, const struct EllpackMatrix *b, const char *cache_path);
+
+#endif //PROJEKTAUFGABE_AUTOTUNE_H
@@ -0,0 +1,376 @@
+#include "batch.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "scheduler.h"
+
+/** buffers of one thread, they only grow and are reused for every item the thread multiplies */
+struct BatchScratch {
+    u_int64_t *b_offsets; // the transpose of b in compressed rows, row j is [b_offsets[j], b_offsets[j + 1])
+    float *bt_values;
+    u_int64_t *bt_indices;
+    u_int64_t *r_offsets; // the compact result rows of the current item
+    float *r_values;
+    u_int64_t *r_indices;
+    u_int64_t b_offsets_size, bt_values_size, bt_indices_size, r_offsets_size, r_values_size, r_indices_size;
+};
+
+struct BatchContext {
+    struct MatrixBatch *batch;
+    struct BatchScratch *scratch;
+    int binary;
+    char **outputs;
+};
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return end.tv_sec - start->tv_sec + 1e-9 * (end.tv_nsec - start->tv_nsec);
+}
+
+// makes room for count elements, the content is kept
+static void *reserve(void *buffer, u_int64_t *capacity, u_int64_t count, size_t size) {
+    if (count <= *capacity) {
+        return buffer;
+    }
+    u_int64_t new_capacity = *capacity * 2 > count ? *capacity * 2 : count;
+    buffer = realloc(buffer, new_capacity * size);
+    if (!buffer) {
+        error(1, 0, "Error: Not enough memory for the batch");
+    }
+    *capacity = new_capacity;
+    return buffer;
+}
+
+struct MatrixBatch *make_batch(struct EllpackMatrix **a, struct EllpackMatrix **b, u_int64_t count) {
+    struct MatrixBatch *batch = calloc(1, sizeof(*batch));
+    if (!batch) {
+        error(1, 0, "Error: Not enough memory for the batch");
+    }
+    u_int64_t entries = 0;
+    for (u_int64_t i = 0; i < count; i++) {
+        if (!valid_ellpack(a[i]) || !valid_ellpack(b[i])) {
+            error(1, 0, "an argument matrix has wrong format");
+        }
+        entries += a[i]->height * a[i]->width + b[i]->height * b[i]->width;
+    }
+    batch->count = count;
+    batch->a = calloc(count, sizeof(struct EllpackMatrix));
+    batch->b = calloc(count, sizeof(struct EllpackMatrix));
+    batch->results = calloc(count, sizeof(struct EllpackMatrix *));
+    batch->values = malloc(entries * sizeof(float));
+    batch->indices = malloc(entries * sizeof(u_int64_t));
+    if ((!batch->a || !batch->b || !batch->results) && count > 0) {
+        error(1, 0, "Error: Not enough memory for the batch");
+    }
+    if ((!batch->values || !batch->indices) && entries > 0) {
+        error(1, 0, "Error: Not enough memory for the batch");
+    }
+    // a and b of an item are neighbours, so one item touches one contiguous part of the buffers
+    u_int64_t offset = 0;
+    for (u_int64_t i = 0; i < count; i++) {
+        struct EllpackMatrix *sources[2] = {a[i], b[i]};
+        struct EllpackMatrix *packed[2] = {&batch->a[i], &batch->b[i]};
+        for (int j = 0; j < 2; j++) {
+            u_int64_t size = sources[j]->height * sources[j]->width;
+            *packed[j] = *sources[j];
+            packed[j]->values = batch->values + offset;
+            packed[j]->indices = batch->indices + offset;
+            memcpy(packed[j]->values, sources[j]->values, size * sizeof(float));
+            memcpy(packed[j]->indices, sources[j]->indices, size * sizeof(u_int64_t));
+            offset += size;
+        }
+    }
+    return batch;
+}
+
+static void free_results(struct MatrixBatch *batch) {
+    for (u_int64_t i = 0; i < batch->count; i++) {
+        if (batch->results[i]) {
+            free_ellpack(batch->results[i]);
+            batch->results[i] = NULL;
+        }
+    }
+}
+
+void free_batch(struct MatrixBatch *batch) {
+    free_results(batch);
+    free(batch->results);
+    free(batch->a);
+    free(batch->b);
+    free(batch->values);
+    free(batch->indices);
+    free(batch);
+}
+
+// the merge of matr_mult_ellpack on one item, b is transposed by counting into the compressed rows of the scratch
+static struct EllpackMatrix *multiply_item(const struct EllpackMatrix *a, const struct EllpackMatrix *b, struct BatchScratch *s) {
+    // the transpose has a row up to the largest used column of b
+    u_int64_t bt_height = 0;
+    u_int64_t b_nnz = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        u_int64_t length = rowlength_ellpack(b, b_row_i);
+        for (u_int64_t b_col_i = 0; b_col_i < length; b_col_i++) {
+            if (b->indices[b_row_i * b->width + b_col_i] + 1 > bt_height) {
+                bt_height = b->indices[b_row_i * b->width + b_col_i] + 1;
+            }
+        }
+        b_nnz += length;
+    }
+    s->b_offsets = reserve(s->b_offsets, &s->b_offsets_size, bt_height + 1, sizeof(u_int64_t));
+    s->bt_values = reserve(s->bt_values, &s->bt_values_size, b_nnz, sizeof(float));
+    s->bt_indices = reserve(s->bt_indices, &s->bt_indices_size, b_nnz, sizeof(u_int64_t));
+    memset(s->b_offsets, 0, (bt_height + 1) * sizeof(u_int64_t));
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        for (u_int64_t b_col_i = 0; b_col_i < b->width && b->values[b_row_i * b->width + b_col_i] != 0; b_col_i++) {
+            s->b_offsets[b->indices[b_row_i * b->width + b_col_i] + 1]++;
+        }
+    }
+    for (u_int64_t bt_row_i = 0; bt_row_i < bt_height; bt_row_i++) {
+        s->b_offsets[bt_row_i + 1] += s->b_offsets[bt_row_i];
+    }
+    // b_offsets[j] moves to the end of row j while filling and is shifted back afterwards
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        for (u_int64_t b_col_i = 0; b_col_i < b->width && b->values[b_row_i * b->width + b_col_i] != 0; b_col_i++) {
+            u_int64_t position = s->b_offsets[b->indices[b_row_i * b->width + b_col_i]]++;
+            s->bt_values[position] = b->values[b_row_i * b->width + b_col_i];
+            s->bt_indices[position] = b_row_i;
+        }
+    }
+    for (u_int64_t bt_row_i = bt_height; bt_row_i > 0; bt_row_i--) {
+        s->b_offsets[bt_row_i] = s->b_offsets[bt_row_i - 1];
+    }
+    s->b_offsets[0] = 0;
+
+    s->r_offsets = reserve(s->r_offsets, &s->r_offsets_size, a->height + 1, sizeof(u_int64_t));
+    s->r_offsets[0] = 0;
+    u_int64_t max_width = 0;
+    for (u_int64_t r_row_i = 0; r_row_i < a->height; r_row_i++) {
+        u_int64_t used = s->r_offsets[r_row_i];
+        u_int64_t a_length = rowlength_ellpack(a, r_row_i);
+        const u_int64_t *a_row_indices = a->indices + r_row_i * a->width;
+        const float *a_row_values = a->values + r_row_i * a->width;
+        if (a_length > 0) {
+            s->r_values = reserve(s->r_values, &s->r_values_size, used + bt_height, sizeof(float));
+            s->r_indices = reserve(s->r_indices, &s->r_indices_size, used + bt_height, sizeof(u_int64_t));
+        }
+        for (u_int64_t bt_row_i = 0; bt_row_i < bt_height && a_length > 0; bt_row_i++) {
+            u_int64_t a_column_i = 0;
+            u_int64_t b_column_i = s->b_offsets[bt_row_i];
+            u_int64_t b_end = s->b_offsets[bt_row_i + 1];
+            float res_sum = 0.0F;
+            while (a_column_i < a_length && b_column_i < b_end) {
+                if (a_row_indices[a_column_i] == s->bt_indices[b_column_i]) {
+                    res_sum += a_row_values[a_column_i] * s->bt_values[b_column_i];
+                    a_column_i++;
+                    b_column_i++;
+                } else if (a_row_indices[a_column_i] > s->bt_indices[b_column_i]) {
+                    b_column_i++;
+                } else {
+                    a_column_i++;
+                }
+            }
+            if (res_sum != 0.0) {
+                s->r_values[used] = res_sum;
+                s->r_indices[used] = bt_row_i;
+                used++;
+            }
+        }
+        s->r_offsets[r_row_i + 1] = used;
+        if (used - s->r_offsets[r_row_i] > max_width) {
+            max_width = used - s->r_offsets[r_row_i];
+        }
+    }
+
+    struct EllpackMatrix *r = make_ellpack(b->real_width, a->height, max_width, "");
+    // an empty product has no storage to copy from
+    for (u_int64_t r_row_i = 0; r_row_i < a->height && max_width > 0; r_row_i++) {
+        u_int64_t begin = s->r_offsets[r_row_i];
+        u_int64_t length = s->r_offsets[r_row_i + 1] - begin;
+        memcpy(r->values + r_row_i * max_width, s->r_values + begin, length * sizeof(float));
+        memcpy(r->indices + r_row_i * max_width, s->r_indices + begin, length * sizeof(u_int64_t));
+        memset(r->values + r_row_i * max_width + length, 0, (max_width - length) * sizeof(float));
+        memset(r->indices + r_row_i * max_width + length, 0, (max_width - length) * sizeof(u_int64_t));
+    }
+    return r;
+}
+
+static void batch_task(void *context, const struct RowTask *task, int thread) {
+    struct BatchContext *c = context;
+    for (u_int64_t item = task->begin; item < task->end; item++) {
+        c->batch->results[item] = multiply_item(&c->batch->a[item], &c->batch->b[item], &c->scratch[thread]);
+    }
+}
+
+void matr_mult_ellpack_batch(struct MatrixBatch *batch) {
+    free_results(batch);
+    int threads = scheduler_threads();
+    struct BatchContext c = {batch, calloc(threads, sizeof(struct BatchScratch)), 0, NULL};
+    u_int64_t *costs = calloc(batch->count, sizeof(u_int64_t));
+    if (!c.scratch || (!costs && batch->count > 0)) {
+        error(1, 0, "Error: Not enough memory for the batch");
+    }
+    // every row of a is merged with every column of b
+    for (u_int64_t i = 0; i < batch->count; i++) {
+        u_int64_t a_nnz = 0;
+        for (u_int64_t a_row_i = 0; a_row_i < batch->a[i].height; a_row_i++) {
+            a_nnz += rowlength_ellpack(&batch->a[i], a_row_i);
+        }
+        costs[i] = (a_nnz + batch->a[i].height) * batch->b[i].real_width + batch->b[i].height * batch->b[i].width + 1;
+    }
+    schedule_rows(batch->count, costs, 1, batch_task, &c, "batch");
+    for (int i = 0; i < threads; i++) {
+        free(c.scratch[i].b_offsets);
+        free(c.scratch[i].bt_values);
+        free(c.scratch[i].bt_indices);
+        free(c.scratch[i].r_offsets);
+        free(c.scratch[i].r_values);
+        free(c.scratch[i].r_indices);
+    }
+    free(c.scratch);
+    free(costs);
+}
+
+void matr_mult_ellpack_batched(const void* a, const void* b, void* result) {
+    struct EllpackMatrix *pair[2] = {(struct EllpackMatrix *) a, (struct EllpackMatrix *) b};
+    struct MatrixBatch *batch = make_batch(&pair[0], &pair[1], 1);
+    matr_mult_ellpack_batch(batch);
+    // hand the arrays of the only result over to the caller
+    *(struct EllpackMatrix *) result = *batch->results[0];
+    free(batch->results[0]);
+    batch->results[0] = NULL;
+    free_batch(batch);
+}
+
+static void write_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct BatchContext *c = context;
+    for (u_int64_t item = task->begin; item < task->end; item++) {
+        if (c->binary) {
+            write_matrix_binary(c->batch->results[item], c->outputs[item]);
+        } else {
+            write_matrix(c->batch->results[item], c->outputs[item]);
+        }
+    }
+}
+
+int run_batch(char *manifest_path, int iterations, int binary) {
+    FILE *manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        error(1, 0, "Error while opening manifest %s", manifest_path);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    printf("[BATCH] Loading products of manifest %s ...\n", manifest_path);
+    set_parser_quiet(1);
+    struct EllpackMatrix **a = NULL;
+    struct EllpackMatrix **b = NULL;
+    char **outputs = NULL;
+    u_int64_t count = 0;
+    u_int64_t capacity = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    u_int64_t line_count = 0;
+    while (getline(&line, &line_size, manifest) != -1) {
+        line_count++;
+        char *paths[3] = {NULL, NULL, NULL};
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char *save_ptr;
+        int fields = 0;
+        for (char *token = strtok_r(line, " \t\r\n", &save_ptr); token; token = strtok_r(NULL, " \t\r\n", &save_ptr)) {
+            if (fields < 3) {
+                paths[fields] = token;
+            }
+            fields++;
+        }
+        if (fields == 0) {
+            continue;
+        }
+        if (fields != 3) {
+            error(1, 0, "Error while parsing manifest %s in line %lu: expected <a> <b> <output>", manifest_path, line_count);
+        }
+        if (access(paths[0], R_OK) != 0 || access(paths[1], R_OK) != 0) {
+            error(1, 0, "Error in manifest %s line %lu: input file does not exist or missing read permission", manifest_path, line_count);
+        }
+        FILE *out_file = fopen(paths[2], "w");
+        if (!out_file) {
+            error(1, 0, "Error in manifest %s line %lu: cannot open output %s", manifest_path, line_count, paths[2]);
+        }
+        fclose(out_file);
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            a = realloc(a, capacity * sizeof(*a));
+            b = realloc(b, capacity * sizeof(*b));
+            outputs = realloc(outputs, capacity * sizeof(*outputs));
+            if (!a || !b || !outputs) {
+                error(1, 0, "Error: Not enough memory for the batch");
+            }
+        }
+        a[count] = parse_matrix(paths[0]);
+        b[count] = parse_matrix(paths[1]);
+        // the same check as for a single multiplication
+        if (a[count]->height != b[count]->real_width) {
+            error(1, 0, "Error in manifest %s line %lu: Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu",
+                  manifest_path, line_count, a[count]->height, b[count]->real_width);
+        }
+        outputs[count] = strdup(paths[2]);
+        if (!outputs[count++]) {
+            error(1, 0, "Error: Not enough memory for the batch");
+        }
+    }
+    free(line);
+    fclose(manifest);
+    set_parser_quiet(0);
+
+    struct MatrixBatch *batch = make_batch(a, b, count);
+    for (u_int64_t i = 0; i < count; i++) {
+        free_ellpack(a[i]);
+        free_ellpack(b[i]);
+    }
+    free(a);
+    free(b);
+    u_int64_t entries = 0;
+    for (u_int64_t i = 0; i < count; i++) {
+        entries += batch->a[i].height * batch->a[i].width + batch->b[i].height * batch->b[i].width;
+    }
+    printf("[BATCH] Loaded %lu products in %f secs, %lu bytes packed\n", count, seconds_since(&start),
+           entries * (sizeof(float) + sizeof(u_int64_t)));
+
+    if (iterations < 1) {
+        iterations = 1;
+    }
+    double total = 0;
+    for (int i = 0; i < iterations; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        matr_mult_ellpack_batch(batch);
+        double time = seconds_since(&start);
+        total += time;
+        printf("[BATCH] Iteration %i / %i: %lu products in %f secs, %.1f products/sec\n",
+               i + 1, iterations, count, time, time > 0 ? count / time : 0.0);
+    }
+    printf("[BATCH] Average: %.1f products/sec\n", total > 0 ? count * iterations / total : 0.0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct BatchContext c = {batch, NULL, binary, outputs};
+    u_int64_t *costs = calloc(count, sizeof(u_int64_t));
+    if (!costs && count > 0) {
+        error(1, 0, "Error: Not enough memory for the batch");
+    }
+    for (u_int64_t i = 0; i < count; i++) {
+        costs[i] = batch->results[i]->height * batch->results[i]->width + 1;
+    }
+    schedule_rows(count, costs, 1, write_task, &c, "write");
+    printf("[SAVE] Wrote %lu result matrices in %f secs\n", count, seconds_since(&start));
+    for (u_int64_t i = 0; i < count; i++) {
+        free(outputs[i]);
+    }
+    free(outputs);
+    free(costs);
+    free_batch(batch);
+    return 0;
+}
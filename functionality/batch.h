@@ -0,0 +1,40 @@
+#ifndef PROJEKTAUFGABE_BATCH_H
+#define PROJEKTAUFGABE_BATCH_H
+
+#include "ellpack_utility.h"
+
+/**
+ * many small products multiplied in one call, the inputs of all items are packed item after item
+ * into one value and one index buffer, the headers a[i] and b[i] point into them and must not be freed on their own
+ */
+struct MatrixBatch {
+    u_int64_t count;
+    struct EllpackMatrix *a;
+    struct EllpackMatrix *b;
+    float *values;
+    u_int64_t *indices;
+    struct EllpackMatrix **results; // one standalone matrix per item, set by matr_mult_ellpack_batch
+};
+
+/** copies the count pairs a[i] * b[i] into a new batch, the given matrices stay owned by the caller */
+struct MatrixBatch *make_batch(struct EllpackMatrix **a, struct EllpackMatrix **b, u_int64_t count);
+
+/** deallocates the packed inputs and all results */
+void free_batch(struct MatrixBatch *batch);
+
+/**
+ * multiplies every item of the batch, the items are distributed by the work stealing scheduler
+ * and each thread reuses its transpose and row buffers for all of its items, earlier results are replaced
+ */
+void matr_mult_ellpack_batch(struct MatrixBatch *batch);
+
+/** multiplies a single pair as a batch of one, result is an EllpackMatrix like for matr_mult_ellpack */
+void matr_mult_ellpack_batched(const void* a, const void* b, void* result);
+
+/**
+ * loads every line "<a> <b> <output>" of the manifest (# starts a comment), multiplies all pairs as one batch
+ * iterations times and writes the results, the throughput is reported in products per second
+ */
+int run_batch(char *manifest_path, int iterations, int binary);
+
+#endif //PROJEKTAUFGABE_BATCH_H
@@ -10,9 +10,21 @@
 #include "benchmarking.h"
 #include "ellpack_utility.h"
 #include "multiplication.h"
+#include "half_precision.h"
+#include "precision.h"
+#include "batch.h"
+#include "compressed.h"
+#include "blocked.h"
+#include "fixed_width.h"
+#include "rowwise.h"
+#include "memory.h"
 #include "unistd.h"
 
-double benchmark_once(int version, struct EllpackMatrix * a, struct EllpackMatrix * b, struct EllpackMatrix *res) {
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+double benchmark_once(int version, const void * a, const void * b, void *res) {
     struct timespec start;
     clock_gettime(CLOCK_MONOTONIC, &start);
     switch (version) {
@@ -25,6 +37,37 @@ double benchmark_once(int version, struct EllpackMatrix * a, struct EllpackMatri
         case 2:
             matr_mult_ellpack_naive(a, b, res);
             break;
+        case 3:
+            matr_mult_ellpack_parallel(a, b, res);
+            break;
+        case 4:
+        case 5:
+            matr_mult_ellpack_half(a, b, res);
+            break;
+        case 6:
+            matr_mult_ellpack_f32(a, b, res);
+            break;
+        case 7:
+            matr_mult_ellpack_f64(a, b, res);
+            break;
+        case 8:
+            matr_mult_ellpack_f32_acc64(a, b, res);
+            break;
+        case 9:
+            matr_mult_ellpack_batched(a, b, res);
+            break;
+        case 10:
+            matr_mult_ellpack_compressed(a, b, res);
+            break;
+        case 11:
+            matr_mult_ellpack_blocked(a, b, res);
+            break;
+        case 12:
+            matr_mult_ellpack_fixed(a, b, res);
+            break;
+        case 13:
+            matr_mult_ellpack_rowwise(a, b, res);
+            break;
     }
     struct timespec end;
     clock_gettime(CLOCK_MONOTONIC, &end);
@@ -32,15 +75,51 @@ double benchmark_once(int version, struct EllpackMatrix * a, struct EllpackMatri
     return time;
 }
 
-void benchmark(int version, int iterations, struct EllpackMatrix *a, struct EllpackMatrix *b, struct EllpackMatrix *res) {
+// counts the data TLB load misses of this thread and the threads it starts, -1 if the kernel does not offer the counter
+static int open_tlb_counter(void) {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HW_CACHE;
+    attributes.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attributes.disabled = 1;
+    attributes.inherit = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+// the double precision versions return an EllpackMatrixF64
+static void free_result(int version, void *result) {
+    if (version == GENERIC_F64 || version == MIXED_F32_F64) {
+        free_ellpack_f64(result);
+    } else {
+        free_ellpack(result);
+    }
+}
+
+void benchmark(int version, int iterations, const void *a, const void *b, void *res) {
     printf("[BENCHMARK] Implementation %i with %i Iterations\n", version, iterations);
     double times[iterations];
     memset(times, 0, iterations * sizeof(double));
+    int tlb_counter = open_tlb_counter();
+    u_int64_t tlb_misses = 0;
     for (int i = 0; i < iterations; ++i) {
-        struct EllpackMatrix* result = malloc(sizeof(*result));
+        void* result = malloc(sizeof(struct EllpackMatrixF64));
+        if (tlb_counter >= 0) {
+            ioctl(tlb_counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(tlb_counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
         double ms_result = benchmark_once(version, a, b, result);
+        u_int64_t misses = 0;
+        if (tlb_counter >= 0) {
+            ioctl(tlb_counter, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(tlb_counter, &misses, sizeof(misses)) == sizeof(misses)) {
+                tlb_misses += misses;
+            }
+        }
         times[i] = ms_result;
-        free_ellpack(result);
+        free_result(version, result);
         int to_do = iterations - i;
         double eta = to_do + (to_do * ms_result);
         printf("[BENCHMARK] Implementation %i: Iteration %i / %i: %f (ETA: %f secs)\n", version, i + 1, iterations, ms_result, eta);
@@ -64,5 +143,12 @@ void benchmark(int version, int iterations, struct EllpackMatrix *a, struct Ellp
     printf("AVERAGE : %f\n", avg);
     printf("MAX : %f\n", max);
     printf("MIN : %f\n", min);
-    matr_mult_ellpack(a, b, res);
+    if (tlb_counter >= 0) {
+        printf("DTLB LOAD MISSES : %lu per iteration with %s pages\n", tlb_misses / iterations,
+               page_policy_name(get_page_policy()));
+        close(tlb_counter);
+    } else {
+        printf("DTLB LOAD MISSES : not counted, the perf event is not available\n");
+    }
+    benchmark_once(version, a, b, res);
 }
@@ -6,6 +6,14 @@
 #define PROJEKTAUFGABE_BENCHMARKING_H
 #include "ellpack_utility.h"
 
-void benchmark(int version, int iterations, struct EllpackMatrix * a, struct EllpackMatrix * b, struct EllpackMatrix *res);
+/**
+ * a and b are EllpackMatrixHalf for the half precision versions, EllpackMatrixF64 for the double version
+ * and CompressedEllpack or BlockedEllpack for the compressed and the blocked version,
+ * res is an EllpackMatrixF64 for the double and the double accumulating version, otherwise an EllpackMatrix
+ */
+void benchmark(int version, int iterations, const void * a, const void * b, void *res);
+
+/** a single multiplication with the given implementation and arguments like benchmark, returns the time in seconds */
+double benchmark_once(int version, const void * a, const void * b, void *res);
 
 #endif //PROJEKTAUFGABE_BENCHMARKING_H
@@ -0,0 +1,343 @@
+#include "blocked.h"
+
+#include <stdint.h>
+
+#include "scheduler.h"
+
+typedef void (*block_kernel)(const float *restrict a, const float *restrict b, float *restrict acc);
+
+// acc (R x C) += a (R x K) * b (K x C) with blocks in row major order, the trip counts are constants so
+// the compiler unrolls every loop, rows of 4 columns are combined with SSE, the products of every entry
+// are added in the order of k like in the merge of matr_mult_ellpack
+#define BLOCK_KERNEL(R, K, C) \
+static void block_mult_##R##x##K##x##C(const float *restrict a, const float *restrict b, float *restrict acc) { \
+    for (int i = 0; i < R; i++) { \
+        if (C == 4) { \
+            __m128 sum = _mm_loadu_ps(acc + i * 4); \
+            for (int k = 0; k < K; k++) { \
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * K + k]), _mm_loadu_ps(b + k * 4))); \
+            } \
+            _mm_storeu_ps(acc + i * 4, sum); \
+        } else { \
+            for (int j = 0; j < C; j++) { \
+                float sum = acc[i * C + j]; \
+                for (int k = 0; k < K; k++) { \
+                    sum += a[i * K + k] * b[k * C + j]; \
+                } \
+                acc[i * C + j] = sum; \
+            } \
+        } \
+    } \
+}
+
+#define BLOCK_KERNELS_RK(R, K) BLOCK_KERNEL(R, K, 1) BLOCK_KERNEL(R, K, 2) BLOCK_KERNEL(R, K, 3) BLOCK_KERNEL(R, K, 4)
+#define BLOCK_KERNELS_R(R) BLOCK_KERNELS_RK(R, 1) BLOCK_KERNELS_RK(R, 2) BLOCK_KERNELS_RK(R, 3) BLOCK_KERNELS_RK(R, 4)
+BLOCK_KERNELS_R(1)
+BLOCK_KERNELS_R(2)
+BLOCK_KERNELS_R(3)
+BLOCK_KERNELS_R(4)
+
+#define KERNEL_ROW(R, K) {block_mult_##R##x##K##x1, block_mult_##R##x##K##x2, block_mult_##R##x##K##x3, block_mult_##R##x##K##x4}
+#define KERNEL_PLANE(R) {KERNEL_ROW(R, 1), KERNEL_ROW(R, 2), KERNEL_ROW(R, 3), KERNEL_ROW(R, 4)}
+
+// indexed by the block shape minus one, [R - 1][K - 1][C - 1]
+static const block_kernel BLOCK_KERNELS[MAX_BLOCK][MAX_BLOCK][MAX_BLOCK] = {
+        KERNEL_PLANE(1), KERNEL_PLANE(2), KERNEL_PLANE(3), KERNEL_PLANE(4)
+};
+
+void free_blocked(struct BlockedEllpack *x) {
+    free(x->values);
+    free(x->indices);
+    free(x->lengths);
+    free(x);
+}
+
+// collects the distinct block columns of a row of blocks, stamps holds the last row of blocks plus one seen per block column
+static u_int64_t row_blocks(const struct EllpackMatrix *x, u_int64_t block_row, u_int64_t block_rows, u_int64_t block_cols,
+                            u_int64_t *stamps, u_int64_t *columns) {
+    u_int64_t count = 0;
+    for (u_int64_t row = block_row * block_rows; row < (block_row + 1) * block_rows && row < x->height; row++) {
+        u_int64_t length = rowlength_ellpack(x, row);
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t column = x->indices[row * x->width + i] / block_cols;
+            if (stamps[column] != block_row + 1) {
+                stamps[column] = block_row + 1;
+                if (columns) {
+                    columns[count] = column;
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static void check_shape(u_int64_t block_rows, u_int64_t block_cols) {
+    if (block_rows < 1 || block_rows > MAX_BLOCK || block_cols < 1 || block_cols > MAX_BLOCK) {
+        error(1, 0, "Error: There is no kernel for blocks of %lu x %lu", block_rows, block_cols);
+    }
+}
+
+u_int64_t blocked_bytes(const struct EllpackMatrix *x, u_int64_t block_rows, u_int64_t block_cols) {
+    check_shape(block_rows, block_cols);
+    u_int64_t block_height = (x->height + block_rows - 1) / block_rows;
+    u_int64_t *stamps = calloc(x->real_width / block_cols + 1, sizeof(u_int64_t));
+    if (!stamps) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t width = 0;
+    for (u_int64_t block_row = 0; block_row < block_height; block_row++) {
+        u_int64_t count = row_blocks(x, block_row, block_rows, block_cols, stamps, NULL);
+        width = count > width ? count : width;
+    }
+    free(stamps);
+    return block_height * width * (block_rows * block_cols * sizeof(float) + sizeof(u_int64_t));
+}
+
+struct BlockedEllpack *blocked_from_ellpack(const struct EllpackMatrix *x, u_int64_t block_rows, u_int64_t block_cols) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "an argument matrix has wrong format");
+    }
+    check_shape(block_rows, block_cols);
+    struct BlockedEllpack *r = calloc(1, sizeof(*r));
+    u_int64_t block_columns = x->real_width / block_cols + 1;
+    u_int64_t *stamps = calloc(block_columns, sizeof(u_int64_t));
+    u_int64_t *slots = calloc(block_columns, sizeof(u_int64_t)); // position of every block column in the current row of blocks
+    if (!r || !stamps || !slots) {
+        error(1, 0, "an allocation has failed");
+    }
+    r->real_width = x->real_width;
+    r->height = x->height;
+    r->block_rows = block_rows;
+    r->block_cols = block_cols;
+    r->block_height = (x->height + block_rows - 1) / block_rows;
+    r->lengths = calloc(r->block_height, sizeof(u_int64_t));
+    if (!r->lengths && r->block_height > 0) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t block_row = 0; block_row < r->block_height; block_row++) {
+        r->lengths[block_row] = row_blocks(x, block_row, block_rows, block_cols, stamps, NULL);
+        r->width = r->lengths[block_row] > r->width ? r->lengths[block_row] : r->width;
+    }
+    u_int64_t block_size = block_rows * block_cols;
+    r->values = calloc(r->block_height * r->width * block_size, sizeof(float));
+    r->indices = calloc(r->block_height * r->width, sizeof(u_int64_t));
+    if ((!r->values || !r->indices) && r->block_height * r->width > 0) {
+        error(1, 0, "Error: Not enough memory for the blocked matrix");
+    }
+    memset(stamps, 0, block_columns * sizeof(u_int64_t));
+    for (u_int64_t block_row = 0; block_row < r->block_height; block_row++) {
+        u_int64_t *columns = r->indices + block_row * r->width;
+        u_int64_t count = row_blocks(x, block_row, block_rows, block_cols, stamps, columns);
+        qsort(columns, count, sizeof(u_int64_t), compare_columns);
+        for (u_int64_t i = 0; i < count; i++) {
+            slots[columns[i]] = i;
+        }
+        float *blocks = r->values + block_row * r->width * block_size;
+        for (u_int64_t i = 0; i < block_rows && block_row * block_rows + i < x->height; i++) {
+            u_int64_t row = block_row * block_rows + i;
+            for (u_int64_t j = 0; j < rowlength_ellpack(x, row); j++) {
+                u_int64_t column = x->indices[row * x->width + j];
+                blocks[slots[column / block_cols] * block_size + i * block_cols + column % block_cols] = x->values[row * x->width + j];
+            }
+        }
+    }
+    free(stamps);
+    free(slots);
+    return r;
+}
+
+// the non zero entries of a row of the matrix, written to values and indices unless they are NULL
+static u_int64_t blocked_row(const struct BlockedEllpack *x, u_int64_t row, float *values, u_int64_t *indices) {
+    u_int64_t block_row = row / x->block_rows;
+    u_int64_t block_size = x->block_rows * x->block_cols;
+    u_int64_t length = 0;
+    for (u_int64_t i = 0; i < x->lengths[block_row]; i++) {
+        const float *block = x->values + (block_row * x->width + i) * block_size + row % x->block_rows * x->block_cols;
+        for (u_int64_t j = 0; j < x->block_cols; j++) {
+            if (block[j] != 0.0F) {
+                if (values) {
+                    values[length] = block[j];
+                    indices[length] = x->indices[block_row * x->width + i] * x->block_cols + j;
+                }
+                length++;
+            }
+        }
+    }
+    return length;
+}
+
+struct EllpackMatrix *ellpack_from_blocked(const struct BlockedEllpack *x) {
+    u_int64_t width = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = blocked_row(x, row, NULL, NULL);
+        width = length > width ? length : width;
+    }
+    struct EllpackMatrix *r = make_ellpack(x->real_width, x->height, width, "");
+    memset(r->values, 0, x->height * width * sizeof(float));
+    memset(r->indices, 0, x->height * width * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < x->height; row++) {
+        blocked_row(x, row, r->values + row * width, r->indices + row * width);
+    }
+    return r;
+}
+
+void block_shape_ellpack(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t shape[3]) {
+    u_int64_t a_bytes[MAX_BLOCK][MAX_BLOCK];
+    u_int64_t b_bytes[MAX_BLOCK][MAX_BLOCK];
+    for (u_int64_t i = 1; i <= MAX_BLOCK; i++) {
+        for (u_int64_t j = 1; j <= MAX_BLOCK; j++) {
+            a_bytes[i - 1][j - 1] = blocked_bytes(a, i, j);
+            b_bytes[i - 1][j - 1] = blocked_bytes(b, i, j);
+        }
+    }
+    // smaller blocks win ties, they waste no work on zeros
+    u_int64_t least = UINT64_MAX;
+    for (u_int64_t r = 1; r <= MAX_BLOCK; r++) {
+        for (u_int64_t k = 1; k <= MAX_BLOCK; k++) {
+            for (u_int64_t c = 1; c <= MAX_BLOCK; c++) {
+                u_int64_t bytes = a_bytes[r - 1][k - 1] + b_bytes[k - 1][c - 1];
+                if (bytes < least) {
+                    least = bytes;
+                    shape[0] = r;
+                    shape[1] = k;
+                    shape[2] = c;
+                }
+            }
+        }
+    }
+}
+
+struct BlockedContext {
+    const struct BlockedEllpack *a;
+    const struct BlockedEllpack *b;
+    block_kernel kernel;
+    float **accumulators; // a dense row of result blocks and its bookkeeping per thread
+    char **used;
+    u_int64_t **touched;
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+};
+
+static void blocked_task(void *context, const struct RowTask *task, int thread) {
+    struct BlockedContext *c = context;
+    const struct BlockedEllpack *a = c->a;
+    const struct BlockedEllpack *b = c->b;
+    float *accumulator = c->accumulators[thread];
+    char *used = c->used[thread];
+    u_int64_t *touched = c->touched[thread];
+    u_int64_t a_size = a->block_rows * a->block_cols;
+    u_int64_t b_size = b->block_rows * b->block_cols;
+    u_int64_t r_size = a->block_rows * b->block_cols;
+    for (u_int64_t block_row = task->begin; block_row < task->end; block_row++) {
+        u_int64_t touched_count = 0;
+        for (u_int64_t i = 0; i < a->lengths[block_row]; i++) {
+            u_int64_t b_block_row = a->indices[block_row * a->width + i];
+            if (b_block_row >= b->block_height) {
+                continue;
+            }
+            const float *a_block = a->values + (block_row * a->width + i) * a_size;
+            for (u_int64_t j = 0; j < b->lengths[b_block_row]; j++) {
+                u_int64_t column = b->indices[b_block_row * b->width + j];
+                if (!used[column]) {
+                    used[column] = 1;
+                    touched[touched_count++] = column;
+                }
+                c->kernel(a_block, b->values + (b_block_row * b->width + j) * b_size, accumulator + column * r_size);
+            }
+        }
+        qsort(touched, touched_count, sizeof(u_int64_t), compare_columns);
+        // the rows of the result blocks are split into the rows of the result, zeros are not stored
+        for (u_int64_t i = 0; i < a->block_rows && block_row * a->block_rows + i < a->height; i++) {
+            u_int64_t row = block_row * a->block_rows + i;
+            c->r_values[row] = malloc(sizeof(float) * touched_count * b->block_cols);
+            c->r_indices[row] = malloc(sizeof(u_int64_t) * touched_count * b->block_cols);
+            if ((!c->r_values[row] || !c->r_indices[row]) && touched_count > 0) {
+                error(1, 0, "Error: Not enough memory for result row %lu", row);
+            }
+            u_int64_t length = 0;
+            for (u_int64_t t = 0; t < touched_count; t++) {
+                const float *block_row_values = accumulator + touched[t] * r_size + i * b->block_cols;
+                for (u_int64_t j = 0; j < b->block_cols; j++) {
+                    if (block_row_values[j] != 0.0F) {
+                        c->r_values[row][length] = block_row_values[j];
+                        c->r_indices[row][length++] = touched[t] * b->block_cols + j;
+                    }
+                }
+            }
+            c->r_row_lengths[row] = length;
+        }
+        for (u_int64_t t = 0; t < touched_count; t++) {
+            memset(accumulator + touched[t] * r_size, 0, r_size * sizeof(float));
+            used[touched[t]] = 0;
+        }
+    }
+}
+
+void matr_mult_ellpack_blocked(const void* a, const void* b, void* result) {
+    const struct BlockedEllpack *ax = a;
+    const struct BlockedEllpack *bx = b;
+    struct EllpackMatrix *r = result;
+    if (!ax || !bx || (!ax->values && ax->block_height * ax->width > 0) || (!bx->values && bx->block_height * bx->width > 0)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    if (ax->block_cols != bx->block_rows) {
+        error(1, 0, "Error: Blocks of %lu x %lu cannot be multiplied with blocks of %lu x %lu",
+              ax->block_rows, ax->block_cols, bx->block_rows, bx->block_cols);
+    }
+    check_shape(ax->block_rows, ax->block_cols);
+    check_shape(bx->block_rows, bx->block_cols);
+    u_int64_t height = ax->height;
+    u_int64_t block_columns = bx->real_width / bx->block_cols + 1;
+    int threads = scheduler_threads();
+    struct BlockedContext c = {ax, bx, BLOCK_KERNELS[ax->block_rows - 1][ax->block_cols - 1][bx->block_cols - 1],
+                               NULL, NULL, NULL, NULL, NULL, NULL};
+    c.accumulators = calloc(threads, sizeof(float *));
+    c.used = calloc(threads, sizeof(char *));
+    c.touched = calloc(threads, sizeof(u_int64_t *));
+    c.r_values = calloc(height, sizeof(float *));
+    c.r_indices = calloc(height, sizeof(u_int64_t *));
+    c.r_row_lengths = calloc(height, sizeof(u_int64_t));
+    u_int64_t *costs = calloc(ax->block_height, sizeof(u_int64_t));
+    if (!c.accumulators || !c.used || !c.touched || ((!c.r_values || !c.r_indices || !c.r_row_lengths || !costs) && height > 0)) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (int i = 0; i < threads; i++) {
+        c.accumulators[i] = calloc(block_columns * ax->block_rows * bx->block_cols, sizeof(float));
+        c.used[i] = calloc(block_columns, 1);
+        c.touched[i] = malloc(block_columns * sizeof(u_int64_t));
+        if (!c.accumulators[i] || !c.used[i] || !c.touched[i]) {
+            error(1, 0, "Error: Not enough memory for the multiplication");
+        }
+    }
+    for (u_int64_t block_row = 0; block_row < ax->block_height; block_row++) {
+        costs[block_row] = ax->lengths[block_row] + 1;
+        for (u_int64_t i = 0; i < ax->lengths[block_row]; i++) {
+            u_int64_t b_block_row = ax->indices[block_row * ax->width + i];
+            costs[block_row] += b_block_row < bx->block_height ? bx->lengths[b_block_row] : 0;
+        }
+    }
+    schedule_rows(ax->block_height, costs, 1, blocked_task, &c, "blocked multiplication");
+
+    u_int64_t max_width = 0;
+    for (u_int64_t row = 0; row < height; row++) {
+        if (c.r_row_lengths[row] > max_width) {
+            max_width = c.r_row_lengths[row];
+        }
+    }
+    r->height = height;
+    r->width = max_width;
+    flatten_ellpack(r, c.r_values, c.r_indices, c.r_row_lengths);
+    r->real_width = bx->real_width;
+    for (int i = 0; i < threads; i++) {
+        free(c.accumulators[i]);
+        free(c.used[i]);
+        free(c.touched[i]);
+    }
+    free(c.accumulators);
+    free(c.used);
+    free(c.touched);
+    free(costs);
+}
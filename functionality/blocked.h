@@ -0,0 +1,49 @@
+#ifndef PROJEKTAUFGABE_BLOCKED_H
+#define PROJEKTAUFGABE_BLOCKED_H
+
+#include "ellpack_utility.h"
+
+/** the largest block edge, kernels exist for every block shape up to MAX_BLOCK x MAX_BLOCK */
+#define MAX_BLOCK 4
+
+/**
+ * block ELLPACK, the matrix is split into dense block_rows x block_cols blocks and every row of blocks stores
+ * its non zero blocks like the rows of an EllpackMatrix with one block column index per block,
+ * padding blocks are zero and have index 0
+ */
+struct BlockedEllpack {
+    u_int64_t real_width; // columns of the matrix
+    u_int64_t height; // rows of the matrix
+    u_int64_t block_rows;
+    u_int64_t block_cols;
+    u_int64_t block_height; // rows of blocks
+    u_int64_t width; // blocks per row of blocks
+    float *values; // block_height * width blocks of block_rows * block_cols values in row major order
+    u_int64_t *indices; // block column of every block
+    u_int64_t *lengths; // used blocks of every row of blocks
+};
+
+void free_blocked(struct BlockedEllpack *x);
+
+/** stores x in blocks of the given shape */
+struct BlockedEllpack *blocked_from_ellpack(const struct EllpackMatrix *x, u_int64_t block_rows, u_int64_t block_cols);
+/** the non zero entries of x as EllpackMatrix */
+struct EllpackMatrix *ellpack_from_blocked(const struct BlockedEllpack *x);
+
+/** bytes of values and indices x takes in blocks of the given shape, padding included */
+u_int64_t blocked_bytes(const struct EllpackMatrix *x, u_int64_t block_rows, u_int64_t block_cols);
+
+/**
+ * chooses the block shapes of a and b taking the least memory together, a gets shape[0] x shape[1]
+ * and b shape[1] x shape[2] so the blocks of a match the rows of blocks of b
+ */
+void block_shape_ellpack(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t shape[3]);
+
+/**
+ * a and b are BlockedEllpack with a->block_cols == b->block_rows, result is the EllpackMatrix of matr_mult_ellpack,
+ * every row of blocks of a is summed block by block of b into a dense row of blocks by the kernel of the block shapes,
+ * the rows of blocks are distributed by the work stealing scheduler
+ */
+void matr_mult_ellpack_blocked(const void* a, const void* b, void* result);
+
+#endif //PROJEKTAUFGABE_BLOCKED_H
@@ -0,0 +1,304 @@
+#include "compressed.h"
+
+#include "memory.h"
+#include "scheduler.h"
+
+// larger differences could not be read from one unaligned 8 byte word
+#define MAX_BITS 56
+
+u_int64_t compressed_row_bytes(u_int64_t length, u_int64_t bits) {
+    // a block of 8 differences of the given width takes exactly bits bytes
+    return length > 1 ? (length - 1 + 7) / 8 * bits : 0;
+}
+
+struct CompressedEllpack *make_compressed(u_int64_t real_width, u_int64_t height, u_int64_t width, char *file) {
+    struct CompressedEllpack *x = calloc(1, sizeof(*x));
+    if (!x) {
+        error(1, 0, "Error: Not enough memory to load matrix %s", file);
+    }
+    x->real_width = real_width;
+    x->height = height;
+    x->width = width;
+    x->values = alloc_array(height * width * sizeof(float), 1);
+    x->lengths = calloc(height, sizeof(u_int32_t));
+    x->bits = calloc(height, sizeof(u_int8_t));
+    x->bases = calloc(height, sizeof(u_int64_t));
+    if ((!x->values && height * width > 0) || ((!x->lengths || !x->bits || !x->bases) && height > 0)) {
+        error(1, 0, "Error: Not enough memory to load matrix %s", file);
+    }
+    return x;
+}
+
+void allocate_packed(struct CompressedEllpack *x) {
+    x->offsets = malloc((x->height + 1) * sizeof(u_int64_t));
+    if (!x->offsets) {
+        error(1, 0, "Error: Not enough memory for the compressed indices");
+    }
+    x->offsets[0] = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        if (x->lengths[row] > x->width || x->bits[row] > MAX_BITS) {
+            error(1, 0, "Error: Row %lu of the compressed indices is invalid", row);
+        }
+        x->offsets[row + 1] = x->offsets[row] + compressed_row_bytes(x->lengths[row], x->bits[row]);
+    }
+    x->packed = calloc(x->offsets[x->height] + COMPRESSED_SLACK, 1);
+    if (!x->packed) {
+        error(1, 0, "Error: Not enough memory for the compressed indices");
+    }
+}
+
+void free_compressed(struct CompressedEllpack *x) {
+    free(x->values);
+    free(x->lengths);
+    free(x->bits);
+    free(x->bases);
+    free(x->offsets);
+    free(x->packed);
+    free(x);
+}
+
+struct CompressedEllpack *compress_ellpack(const struct EllpackMatrix *x) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "an argument matrix has wrong format");
+    }
+    struct CompressedEllpack *c = make_compressed(x->real_width, x->height, x->width, "");
+    memcpy(c->values, x->values, x->height * x->width * sizeof(float));
+    for (u_int64_t row = 0; row < x->height; row++) {
+        const u_int64_t *indices = x->indices + row * x->width;
+        u_int64_t length = rowlength_ellpack(x, row);
+        u_int64_t largest = 0;
+        for (u_int64_t i = 1; i < length; i++) {
+            if (indices[i] < indices[i - 1]) {
+                error(1, 0, "Error: The indices of row %lu are not sorted and cannot be compressed", row);
+            }
+            largest = indices[i] - indices[i - 1] > largest ? indices[i] - indices[i - 1] : largest;
+        }
+        c->lengths[row] = length;
+        c->bits[row] = largest > 0 ? 64 - __builtin_clzll(largest) : 0;
+        c->bases[row] = length > 0 ? indices[0] : 0;
+    }
+    allocate_packed(c);
+    for (u_int64_t row = 0; row < x->height; row++) {
+        const u_int64_t *indices = x->indices + row * x->width;
+        unsigned char *block = c->packed + c->offsets[row];
+        u_int64_t bits = c->bits[row];
+        for (u_int64_t i = 1; i < c->lengths[row]; i++) {
+            // difference j of a block starts at bit j * bits of the block, little endian like the loads
+            u_int64_t bit = (i - 1) / 8 * bits * 8 + (i - 1) % 8 * bits;
+            u_int64_t word;
+            memcpy(&word, block + bit / 8, sizeof(word));
+            word |= (indices[i] - indices[i - 1]) << (bit % 8);
+            memcpy(block + bit / 8, &word, sizeof(word));
+        }
+    }
+    return c;
+}
+
+static void unpack_row_scalar(const unsigned char *packed, u_int64_t bits, u_int64_t base, u_int64_t length, u_int64_t *indices) {
+    u_int64_t mask = ((u_int64_t) 1 << bits) - 1;
+    indices[0] = base;
+    for (u_int64_t i = 1; i < length; i++) {
+        u_int64_t bit = (i - 1) / 8 * bits * 8 + (i - 1) % 8 * bits;
+        u_int64_t word;
+        memcpy(&word, packed + bit / 8, sizeof(word));
+        indices[i] = indices[i - 1] + ((word >> (bit % 8)) & mask);
+    }
+}
+
+// every block of 8 differences is read by two gathers of four 8 byte words, shifted into place and masked,
+// the running index is added by a prefix sum within the register
+__attribute__((target("avx2")))
+static void unpack_row_avx2(const unsigned char *packed, u_int64_t bits, u_int64_t base, u_int64_t length, u_int64_t *indices) {
+    indices[0] = base;
+    __m256i mask = _mm256_set1_epi64x((long long) (((u_int64_t) 1 << bits) - 1));
+    __m128i lane_bits[2] = {_mm_setr_epi32(0, bits, 2 * bits, 3 * bits), _mm_setr_epi32(4 * bits, 5 * bits, 6 * bits, 7 * bits)};
+    __m128i bytes[2];
+    __m256i shifts[2];
+    for (int half = 0; half < 2; half++) {
+        bytes[half] = _mm_srli_epi32(lane_bits[half], 3);
+        shifts[half] = _mm256_cvtepu32_epi64(_mm_and_si128(lane_bits[half], _mm_set1_epi32(7)));
+    }
+    __m256i running = _mm256_set1_epi64x((long long) base);
+    for (u_int64_t block = 0; block * 8 + 1 < length; block++) {
+        const long long *words = (const long long *) (packed + block * bits);
+        for (int half = 0; half < 2; half++) {
+            __m256i v = _mm256_i32gather_epi64(words, bytes[half], 1);
+            v = _mm256_and_si256(_mm256_srlv_epi64(v, shifts[half]), mask);
+            v = _mm256_add_epi64(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, 0x90), _mm256_setzero_si256(), 0x03));
+            v = _mm256_add_epi64(v, _mm256_permute2x128_si256(v, v, 0x08));
+            v = _mm256_add_epi64(v, running);
+            _mm256_storeu_si256((__m256i *) (indices + 1 + block * 8 + half * 4), v);
+            running = _mm256_permute4x64_epi64(v, 0xFF);
+        }
+    }
+}
+
+typedef void (*unpack_fn)(const unsigned char *packed, u_int64_t bits, u_int64_t base, u_int64_t length, u_int64_t *indices);
+
+static unpack_fn choose_unpack(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? unpack_row_avx2 : unpack_row_scalar;
+}
+
+static inline u_int64_t decode_row(unpack_fn unpack, const struct CompressedEllpack *x, u_int64_t row, u_int64_t *indices) {
+    u_int64_t length = x->lengths[row];
+    if (length > 0) {
+        unpack(x->packed + x->offsets[row], x->bits[row], x->bases[row], length, indices);
+    }
+    return length;
+}
+
+u_int64_t decode_row_compressed(const struct CompressedEllpack *x, u_int64_t row, u_int64_t *indices) {
+    return decode_row(choose_unpack(), x, row, indices);
+}
+
+struct EllpackMatrix *decompress_ellpack(const struct CompressedEllpack *x) {
+    struct EllpackMatrix *r = make_ellpack(x->real_width, x->height, x->width, "");
+    u_int64_t *indices = malloc((x->width + COMPRESSED_SLACK) * sizeof(u_int64_t));
+    if (!indices) {
+        error(1, 0, "an allocation has failed");
+    }
+    unpack_fn unpack = choose_unpack();
+    memcpy(r->values, x->values, x->height * x->width * sizeof(float));
+    memset(r->indices, 0, x->height * x->width * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = decode_row(unpack, x, row, indices);
+        memcpy(r->indices + row * x->width, indices, length * sizeof(u_int64_t));
+    }
+    free(indices);
+    return r;
+}
+
+u_int64_t compressed_index_bytes(const struct CompressedEllpack *x) {
+    return x->height * (sizeof(u_int32_t) + sizeof(u_int8_t) + 2 * sizeof(u_int64_t)) + x->offsets[x->height];
+}
+
+struct CompressedContext {
+    const struct CompressedEllpack *a;
+    const struct CompressedEllpack *b;
+    unpack_fn unpack;
+    struct RowAccumulator **accumulators; // one of the width of b per thread
+    u_int64_t **a_indices;
+    u_int64_t **b_indices;
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+};
+
+static void compressed_task(void *context, const struct RowTask *task, int thread) {
+    struct CompressedContext *c = context;
+    const struct CompressedEllpack *a = c->a;
+    const struct CompressedEllpack *b = c->b;
+    struct RowAccumulator *accumulator = c->accumulators[thread];
+    u_int64_t *a_indices = c->a_indices[thread];
+    u_int64_t *b_indices = c->b_indices[thread];
+    for (u_int64_t a_row_i = task->begin; a_row_i < task->end; a_row_i++) {
+        u_int64_t a_length = decode_row(c->unpack, a, a_row_i, a_indices);
+        start_row(accumulator);
+        for (u_int64_t a_col_i = 0; a_col_i < a_length; a_col_i++) {
+            u_int64_t b_row_i = a_indices[a_col_i];
+            if (b_row_i < b->height) {
+                u_int64_t b_length = decode_row(c->unpack, b, b_row_i, b_indices);
+                add_row(accumulator, a->values[a_row_i * a->width + a_col_i], b->values + b_row_i * b->width, b_indices, b_length);
+            }
+        }
+        u_int64_t length = finish_row(accumulator);
+        c->r_values[a_row_i] = malloc(sizeof(float) * length);
+        c->r_indices[a_row_i] = malloc(sizeof(u_int64_t) * length);
+        if ((!c->r_values[a_row_i] || !c->r_indices[a_row_i]) && length > 0) {
+            error(1, 0, "Error: Not enough memory for result row %lu", a_row_i);
+        }
+        emit_row(accumulator, c->r_values[a_row_i], c->r_indices[a_row_i]);
+        c->r_row_lengths[a_row_i] = length;
+    }
+}
+
+void matr_mult_ellpack_compressed(const void* a, const void* b, void* result) {
+    const struct CompressedEllpack *ax = a;
+    const struct CompressedEllpack *bx = b;
+    struct EllpackMatrix *r = result;
+    if (!ax || !bx || !ax->packed || !bx->packed) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    u_int64_t height = ax->height;
+    u_int64_t columns = bx->real_width;
+    int threads = scheduler_threads();
+    struct CompressedContext c = {ax, bx, choose_unpack(), NULL, NULL, NULL, NULL, NULL, NULL};
+    c.accumulators = calloc(threads, sizeof(struct RowAccumulator *));
+    c.a_indices = calloc(threads, sizeof(u_int64_t *));
+    c.b_indices = calloc(threads, sizeof(u_int64_t *));
+    c.r_values = calloc(height, sizeof(float *));
+    c.r_indices = calloc(height, sizeof(u_int64_t *));
+    c.r_row_lengths = calloc(height, sizeof(u_int64_t));
+    u_int64_t *costs = calloc(height, sizeof(u_int64_t));
+    if (!c.accumulators || !c.a_indices || !c.b_indices
+        || ((!c.r_values || !c.r_indices || !c.r_row_lengths || !costs) && height > 0)) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (int i = 0; i < threads; i++) {
+        c.accumulators[i] = make_row_accumulator(columns);
+        c.a_indices[i] = malloc((ax->width + COMPRESSED_SLACK) * sizeof(u_int64_t));
+        c.b_indices[i] = malloc((bx->width + COMPRESSED_SLACK) * sizeof(u_int64_t));
+        if (!c.a_indices[i] || !c.b_indices[i]) {
+            error(1, 0, "Error: Not enough memory for the multiplication");
+        }
+    }
+    // the products of a row are the lengths of the rows of b it selects, decoding a is needed for that anyway
+    for (u_int64_t row = 0; row < height; row++) {
+        u_int64_t length = decode_row(c.unpack, ax, row, c.a_indices[0]);
+        costs[row] = length + 1;
+        for (u_int64_t i = 0; i < length; i++) {
+            costs[row] += c.a_indices[0][i] < bx->height ? bx->lengths[c.a_indices[0][i]] : 0;
+        }
+    }
+    schedule_rows(height, costs, 1, compressed_task, &c, "compressed multiplication");
+
+    u_int64_t max_width = 0;
+    for (u_int64_t row = 0; row < height; row++) {
+        if (c.r_row_lengths[row] > max_width) {
+            max_width = c.r_row_lengths[row];
+        }
+    }
+    r->height = height;
+    r->width = max_width;
+    flatten_ellpack(r, c.r_values, c.r_indices, c.r_row_lengths);
+    r->real_width = columns;
+    for (int i = 0; i < threads; i++) {
+        free_row_accumulator(c.accumulators[i]);
+        free(c.a_indices[i]);
+        free(c.b_indices[i]);
+    }
+    free(c.accumulators);
+    free(c.a_indices);
+    free(c.b_indices);
+    free(costs);
+}
+
+void matr_vec_ellpack(const struct EllpackMatrix *x, const float *vector, float *result) {
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = rowlength_ellpack(x, row);
+        float sum = 0.0F;
+        for (u_int64_t i = 0; i < length; i++) {
+            sum += x->values[row * x->width + i] * vector[x->indices[row * x->width + i]];
+        }
+        result[row] = sum;
+    }
+}
+
+void matr_vec_ellpack_compressed(const struct CompressedEllpack *x, const float *vector, float *result) {
+    u_int64_t *indices = malloc((x->width + COMPRESSED_SLACK) * sizeof(u_int64_t));
+    if (!indices) {
+        error(1, 0, "an allocation has failed");
+    }
+    unpack_fn unpack = choose_unpack();
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = decode_row(unpack, x, row, indices);
+        float sum = 0.0F;
+        for (u_int64_t i = 0; i < length; i++) {
+            sum += x->values[row * x->width + i] * vector[indices[i]];
+        }
+        result[row] = sum;
+    }
+    free(indices);
+}
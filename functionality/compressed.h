@@ -0,0 +1,56 @@
+#ifndef PROJEKTAUFGABE_COMPRESSED_H
+#define PROJEKTAUFGABE_COMPRESSED_H
+
+#include "ellpack_utility.h"
+
+/**
+ * an EllpackMatrix whose sorted row indices are stored as the first index of the row followed by the
+ * differences to the previous index, packed with the bit width of the largest difference of the row,
+ * the differences come in blocks of 8 taking bits[row] bytes, the values are stored like in EllpackMatrix
+ */
+struct CompressedEllpack {
+    u_int64_t real_width;
+    u_int64_t height;
+    u_int64_t width;
+    float *values;
+    u_int32_t *lengths; // used entries of every row
+    u_int8_t *bits; // bit width of the differences of every row
+    u_int64_t *bases; // first index of every row
+    u_int64_t *offsets; // the packed differences of row i are bytes [offsets[i], offsets[i + 1]) of packed
+    unsigned char *packed; // followed by COMPRESSED_SLACK zero bytes so blocks can be read in 8 byte words
+};
+
+/** extra entries a buffer for the indices of a decoded row needs beyond the width, decoding writes whole blocks */
+#define COMPRESSED_SLACK 8
+
+/** bytes of the packed differences of a row with the given length and bit width */
+u_int64_t compressed_row_bytes(u_int64_t length, u_int64_t bits);
+
+/** creates a matrix with zeroed values, lengths, bit widths and first indices, offsets and packed are not allocated */
+struct CompressedEllpack *make_compressed(u_int64_t real_width, u_int64_t height, u_int64_t width, char *file);
+/** computes the offsets from the lengths and bit widths and allocates the zeroed packed bytes */
+void allocate_packed(struct CompressedEllpack *x);
+void free_compressed(struct CompressedEllpack *x);
+
+/** encodes the indices of x, the rows of x have to be sorted */
+struct CompressedEllpack *compress_ellpack(const struct EllpackMatrix *x);
+struct EllpackMatrix *decompress_ellpack(const struct CompressedEllpack *x);
+
+/** writes the indices of a row to indices, which needs room for width + COMPRESSED_SLACK entries, returns the length */
+u_int64_t decode_row_compressed(const struct CompressedEllpack *x, u_int64_t row, u_int64_t *indices);
+
+/** bytes of the index arrays, lengths, bit widths, first indices, offsets and packed differences */
+u_int64_t compressed_index_bytes(const struct CompressedEllpack *x);
+
+/**
+ * a and b are CompressedEllpack, result an EllpackMatrix equal to the one of matr_mult_ellpack,
+ * every row of a is summed row by row of b into a dense row, so b is read in its compressed form and never
+ * transposed, the rows are decoded on the fly and distributed by the work stealing scheduler
+ */
+void matr_mult_ellpack_compressed(const void* a, const void* b, void* result);
+
+/** result = x * vector, vector has real_width and result height entries */
+void matr_vec_ellpack(const struct EllpackMatrix *x, const float *vector, float *result);
+void matr_vec_ellpack_compressed(const struct CompressedEllpack *x, const float *vector, float *result);
+
+#endif //PROJEKTAUFGABE_COMPRESSED_H
@@ -0,0 +1,168 @@
+#include "dense.h"
+
+#include "memory.h"
+#include "scheduler.h"
+
+static const char *DENSE_MODE_NAMES[] = {"auto", "always"};
+
+int dense_mode_from_name(const char *name) {
+    for (int i = 0; i < (int) (sizeof(DENSE_MODE_NAMES) / sizeof(DENSE_MODE_NAMES[0])); i++) {
+        if (strcmp(name, DENSE_MODE_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+struct DenseMatrix *make_dense(u_int64_t height, u_int64_t width, char *file) {
+    struct DenseMatrix *x = malloc(sizeof(*x));
+    if (!x) {
+        error(1, 0, "Error: Not enough memory for the dense matrix %s", file);
+    }
+    x->height = height;
+    x->width = width;
+    x->values = alloc_array(height * width * sizeof(float), 1);
+    if (!x->values) {
+        error(1, 0, "Error: Not enough memory for the dense matrix %s", file);
+    }
+    return x;
+}
+
+void free_dense(struct DenseMatrix *x) {
+    free(x->values);
+    free(x);
+}
+
+struct EllpackMatrix *ellpack_from_dense(const struct DenseMatrix *x) {
+    u_int64_t width = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = 0;
+        for (u_int64_t column = 0; column < x->width; column++) {
+            length += x->values[row * x->width + column] != 0.0F;
+        }
+        width = length > width ? length : width;
+    }
+    struct EllpackMatrix *r = make_ellpack(x->width, x->height, width, "");
+    memset(r->values, 0, x->height * width * sizeof(float));
+    memset(r->indices, 0, x->height * width * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = 0;
+        for (u_int64_t column = 0; column < x->width; column++) {
+            float value = x->values[row * x->width + column];
+            if (value != 0.0F) {
+                r->values[row * width + length] = value;
+                r->indices[row * width + length] = column;
+                length++;
+            }
+        }
+    }
+    return r;
+}
+
+// y += factor * x
+static void axpy_scalar(float factor, const float *x, float *y, u_int64_t n) {
+    for (u_int64_t i = 0; i < n; i++) {
+        y[i] += factor * x[i];
+    }
+}
+
+// multiplies and adds without fusing them, an FMA would keep the rounding error of the first product where the
+// products of an entry cancel and leave an entry matr_mult_ellpack does not have
+__attribute__((target("avx")))
+static void axpy_avx(float factor, const float *x, float *y, u_int64_t n) {
+    __m256 f = _mm256_set1_ps(factor);
+    u_int64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(f, _mm256_loadu_ps(x + i))));
+    }
+    for (; i < n; i++) {
+        y[i] += factor * x[i];
+    }
+}
+
+struct DenseContext {
+    const struct EllpackMatrix *a;
+    const struct EllpackMatrix *b;
+    const u_int64_t *b_lengths;
+    const float *b_dense; // NULL if the rows of b are scattered
+    int simd;
+    struct DenseMatrix *r;
+};
+
+static void dense_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct DenseContext *c = context;
+    const struct EllpackMatrix *a = c->a;
+    const struct EllpackMatrix *b = c->b;
+    u_int64_t columns = c->r->width;
+    for (u_int64_t row = task->begin; row < task->end; row++) {
+        float *r_row = c->r->values + row * columns;
+        u_int64_t length = rowlength_ellpack(a, row);
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = a->indices[row * a->width + i];
+            float factor = a->values[row * a->width + i];
+            if (k >= b->height) {
+                continue;
+            }
+            if (c->b_dense && c->simd) {
+                axpy_avx(factor, c->b_dense + k * columns, r_row, columns);
+            } else if (c->b_dense) {
+                axpy_scalar(factor, c->b_dense + k * columns, r_row, columns);
+            } else {
+                const u_int64_t *b_row_indices = b->indices + k * b->width;
+                const float *b_row_values = b->values + k * b->width;
+                for (u_int64_t j = 0; j < c->b_lengths[k]; j++) {
+                    r_row[b_row_indices[j]] += factor * b_row_values[j];
+                }
+            }
+        }
+    }
+}
+
+void matr_mult_ellpack_dense(const struct EllpackMatrix *a, const struct EllpackMatrix *b, struct DenseMatrix *result) {
+    __builtin_cpu_init();
+    int simd = __builtin_cpu_supports("avx");
+    // a dense row of b is no larger than its ELLPACK row once the row is a third full
+    matr_mult_ellpack_dense_with(a, b, 3 * b->width >= b->real_width, simd, result);
+}
+
+void matr_mult_ellpack_dense_with(const struct EllpackMatrix *a, const struct EllpackMatrix *b, int dense_b, int simd,
+                                  struct DenseMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    u_int64_t columns = b->real_width;
+    result->height = a->height;
+    result->width = columns;
+    result->values = alloc_array(a->height * columns * sizeof(float), 1);
+    u_int64_t *b_lengths = calloc(b->height + 1, sizeof(u_int64_t));
+    u_int64_t *costs = calloc(a->height + 1, sizeof(u_int64_t));
+    float *b_dense = dense_b ? calloc(b->height * columns > 0 ? b->height * columns : 1, sizeof(float)) : NULL;
+    if (!result->values || !b_lengths || !costs || (dense_b && !b_dense)) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(b, b_row_i);
+        for (u_int64_t j = 0; b_dense && j < b_lengths[b_row_i]; j++) {
+            u_int64_t column = b->indices[b_row_i * b->width + j];
+            if (column < columns) {
+                b_dense[b_row_i * columns + column] = b->values[b_row_i * b->width + j];
+            }
+        }
+    }
+    // a dense row of b costs all columns, a scattered one its entries
+    for (u_int64_t a_row_i = 0; a_row_i < a->height; a_row_i++) {
+        u_int64_t length = rowlength_ellpack(a, a_row_i);
+        costs[a_row_i] = 1;
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = a->indices[a_row_i * a->width + i];
+            costs[a_row_i] += k >= b->height ? 0 : dense_b ? columns : b_lengths[k];
+        }
+    }
+    struct DenseContext c = {a, b, b_lengths, b_dense, simd, result};
+    schedule_rows(a->height, costs, 1, dense_task, &c, "dense multiply");
+    free(b_lengths);
+    free(costs);
+    free(b_dense);
+}
@@ -0,0 +1,47 @@
+#ifndef PROJEKTAUFGABE_DENSE_H
+#define PROJEKTAUFGABE_DENSE_H
+
+#include "ellpack_utility.h"
+
+/** products whose output is estimated to fill at least this share are stored densely, 4 bytes per column against
+ * 12 bytes per ELLPACK entry */
+#define DENSE_OUTPUT_FILL (1.0 / 3)
+
+/** a row major matrix with every entry stored */
+struct DenseMatrix {
+    u_int64_t height;
+    u_int64_t width;
+    float *values;
+};
+
+/** when --dense computes the product into a dense buffer */
+enum DenseMode {
+    DENSE_AUTO, // if the estimated output density is at least DENSE_OUTPUT_FILL
+    DENSE_ALWAYS
+};
+
+/** the mode with the given name (auto, always), -1 if there is none */
+int dense_mode_from_name(const char *name);
+
+/** a height x width matrix of zeros, errors name the given file */
+struct DenseMatrix *make_dense(u_int64_t height, u_int64_t width, char *file);
+void free_dense(struct DenseMatrix *x);
+
+/** the ELLPACK matrix of the non zero entries of x, as wide as the fullest row */
+struct EllpackMatrix *ellpack_from_dense(const struct DenseMatrix *x);
+
+/**
+ * a * b accumulated row by row into a dense result: every entry of a row of a adds its multiple of a row of b,
+ * rows of b at least a third full are expanded to a dense copy of b and added 8 columns at a time with AVX,
+ * sparser ones are scattered from the ELLPACK rows, the result has the bits of matr_mult_ellpack
+ */
+void matr_mult_ellpack_dense(const struct EllpackMatrix *a, const struct EllpackMatrix *b, struct DenseMatrix *result);
+
+/**
+ * the same with the path chosen: dense_b expands b, simd = 0 adds the dense rows of b one column at a time,
+ * every path adds the products of an entry in the order of k like the merge of matr_mult_ellpack
+ */
+void matr_mult_ellpack_dense_with(const struct EllpackMatrix *a, const struct EllpackMatrix *b, int dense_b, int simd,
+                                  struct DenseMatrix *result);
+
+#endif //PROJEKTAUFGABE_DENSE_H
@@ -0,0 +1,414 @@
+#include "differential.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#include "multiplication.h"
+#include "half_precision.h"
+#include "precision.h"
+#include "batch.h"
+#include "compressed.h"
+#include "blocked.h"
+#include "reproducible.h"
+#include "fixed_width.h"
+#include "rowwise.h"
+#include "dense.h"
+
+// cases listed as the slowest and as the most divergent
+#define RANKED_CASES 5
+
+static const char *KERNEL_NAMES[KERNEL_COUNT] = {
+        "linear", "vectorized", "naive", "parallel", "fp16", "bf16", "generic f32", "generic f64", "f32 accumulating f64",
+        "batched", "compressed", "blocked", "fixed width", "rowwise", "reproducible pairwise", "reproducible compensated",
+        "dense output"
+};
+
+/** one kernel on one case */
+struct CaseResult {
+    int kernel;
+    u_int64_t case_i;
+    double seconds;
+    double divergence;
+};
+
+/** the generated inputs of a case and the dense references of the float and the rounded half inputs */
+struct DifferentialCase {
+    u_int64_t rows, inner, columns;
+    int patterns;
+    struct EllpackMatrix *a;
+    struct EllpackMatrix *b;
+    double *exact[3]; // float, fp16 and bf16 inputs
+    double *scale[3]; // the sums of the absolute values of the products
+};
+
+const char *differential_kernel_name(int kernel) {
+    return KERNEL_NAMES[kernel];
+}
+
+// splitmix64
+static u_int64_t next_random(u_int64_t *state) {
+    u_int64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double next_unit(u_int64_t *state) {
+    return (double) (next_random(state) >> 11) / (double) (1ULL << 53);
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return end.tv_sec - start->tv_sec + 1e-9 * (end.tv_nsec - start->tv_nsec);
+}
+
+// a height x columns matrix, skipped rows and columns stay empty, the dense row has every column that is not skipped,
+// values keep away from 0 so that the half formats never round them to 0
+static struct EllpackMatrix *random_ellpack(u_int64_t height, u_int64_t columns, double density, const bool *empty_rows,
+                                            const bool *empty_columns, u_int64_t dense_row, u_int64_t *state) {
+    float *values = calloc(height * columns, sizeof(float));
+    u_int64_t *lengths = calloc(height, sizeof(u_int64_t));
+    if (!values || !lengths) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t width = 1;
+    for (u_int64_t row = 0; row < height; row++) {
+        for (u_int64_t column = 0; column < columns && !empty_rows[row]; column++) {
+            if (empty_columns[column] || (row != dense_row && next_unit(state) >= density)) {
+                continue;
+            }
+            float value = (float) (0.05 + 0.95 * next_unit(state));
+            values[row * columns + column] = next_random(state) & 1 ? value : -value;
+            lengths[row]++;
+        }
+        width = lengths[row] > width ? lengths[row] : width;
+    }
+    struct EllpackMatrix *x = make_ellpack(columns, height, width, "");
+    memset(x->values, 0, height * width * sizeof(float));
+    memset(x->indices, 0, height * width * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < height; row++) {
+        u_int64_t used = 0;
+        for (u_int64_t column = 0; column < columns; column++) {
+            if (values[row * columns + column] != 0.0F) {
+                x->values[row * width + used] = values[row * columns + column];
+                x->indices[row * width + used] = column;
+                used++;
+            }
+        }
+    }
+    free(values);
+    free(lengths);
+    return x;
+}
+
+// the exact product in double and the sums of the absolute values of the products of every entry
+static void dense_reference(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t columns,
+                            double **exact, double **scale) {
+    *exact = calloc(a->height * columns, sizeof(double));
+    *scale = calloc(a->height * columns, sizeof(double));
+    if (!*exact || !*scale) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t row = 0; row < a->height; row++) {
+        u_int64_t a_length = rowlength_ellpack(a, row);
+        for (u_int64_t i = 0; i < a_length; i++) {
+            double a_value = a->values[row * a->width + i];
+            u_int64_t k = a->indices[row * a->width + i];
+            u_int64_t b_length = rowlength_ellpack(b, k);
+            for (u_int64_t j = 0; j < b_length; j++) {
+                double product = a_value * b->values[k * b->width + j];
+                (*exact)[row * columns + b->indices[k * b->width + j]] += product;
+                (*scale)[row * columns + b->indices[k * b->width + j]] += fabs(product);
+            }
+        }
+    }
+}
+
+static void generate_case(const struct DifferentialConfig *config, u_int64_t case_i, struct DifferentialCase *c) {
+    u_int64_t state = config->seed + case_i;
+    c->rows = 1 + next_random(&state) % config->max_size;
+    c->inner = 1 + next_random(&state) % config->max_size;
+    c->columns = 1 + next_random(&state) % config->max_size;
+    c->patterns = (int) (case_i % (PATTERN_ALL + 1));
+    bool *empty = calloc(c->inner, sizeof(bool)); // no column of A is left out
+    bool *empty_rows[2] = {calloc(c->rows, sizeof(bool)), calloc(c->inner, sizeof(bool))};
+    bool *empty_columns = calloc(c->columns, sizeof(bool));
+    if (!empty || !empty_rows[0] || !empty_rows[1] || !empty_columns) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t heights[2] = {c->rows, c->inner};
+    for (int i = 0; i < 2 && (c->patterns & PATTERN_EMPTY_ROWS); i++) {
+        for (u_int64_t row = 0; row < heights[i]; row++) {
+            empty_rows[i][row] = next_random(&state) % 4 == 0;
+        }
+    }
+    for (u_int64_t column = 0; column < c->columns && (c->patterns & PATTERN_EMPTY_B_COLUMNS); column++) {
+        empty_columns[column] = next_random(&state) % 4 == 0;
+    }
+    // the dense rows are never empty
+    u_int64_t dense_rows[2] = {UINT64_MAX, UINT64_MAX};
+    for (int i = 0; i < 2 && (c->patterns & PATTERN_DENSE_ROW); i++) {
+        dense_rows[i] = next_random(&state) % heights[i];
+        empty_rows[i][dense_rows[i]] = false;
+    }
+    c->a = random_ellpack(c->rows, c->inner, config->density, empty_rows[0], empty, dense_rows[0], &state);
+    c->b = random_ellpack(c->inner, c->columns, config->density, empty_rows[1], empty_columns, dense_rows[1], &state);
+    dense_reference(c->a, c->b, c->columns, &c->exact[0], &c->scale[0]);
+    for (int format = FP16; format <= BF16; format++) {
+        struct EllpackMatrixHalf *half[2] = {half_from_ellpack(c->a, format), half_from_ellpack(c->b, format)};
+        struct EllpackMatrix *rounded[2] = {ellpack_from_half(half[0]), ellpack_from_half(half[1])};
+        dense_reference(rounded[0], rounded[1], c->columns, &c->exact[1 + format - FP16], &c->scale[1 + format - FP16]);
+        free_ellpack_half(half[0]);
+        free_ellpack_half(half[1]);
+        free_all(rounded, 2);
+    }
+    free(empty);
+    free(empty_rows[0]);
+    free(empty_rows[1]);
+    free(empty_columns);
+}
+
+static void free_case(struct DifferentialCase *c) {
+    free_ellpack(c->a);
+    free_ellpack(c->b);
+    for (int i = 0; i < 3; i++) {
+        free(c->exact[i]);
+        free(c->scale[i]);
+    }
+}
+
+// multiplies with the kernel and returns the float result, the inputs are converted outside of the timed part
+static struct EllpackMatrix *multiply_kernel(int kernel, const struct DifferentialCase *c, u_int64_t case_i, double *seconds) {
+    struct EllpackMatrix *result = calloc(1, sizeof(*result));
+    const void *inputs[2] = {c->a, c->b};
+    void (*free_input)(void *) = NULL;
+    void *output = result;
+    u_int64_t shape[3] = {1 + case_i % MAX_BLOCK, 1 + case_i / MAX_BLOCK % MAX_BLOCK, 1 + case_i / (MAX_BLOCK * MAX_BLOCK) % MAX_BLOCK};
+    switch (kernel) {
+        case HALF_FP16:
+        case HALF_BF16:
+            inputs[0] = half_from_ellpack(c->a, kernel == HALF_FP16 ? FP16 : BF16);
+            inputs[1] = half_from_ellpack(c->b, kernel == HALF_FP16 ? FP16 : BF16);
+            free_input = (void (*)(void *)) free_ellpack_half;
+            break;
+        case GENERIC_F64:
+            inputs[0] = f64_from_ellpack(c->a);
+            inputs[1] = f64_from_ellpack(c->b);
+            free_input = (void (*)(void *)) free_ellpack_f64;
+            output = calloc(1, sizeof(struct EllpackMatrixF64));
+            break;
+        case MIXED_F32_F64:
+            output = calloc(1, sizeof(struct EllpackMatrixF64));
+            break;
+        case KERNEL_DENSE:
+            output = calloc(1, sizeof(struct DenseMatrix));
+            break;
+        case COMPRESSED:
+            inputs[0] = compress_ellpack(c->a);
+            inputs[1] = compress_ellpack(c->b);
+            free_input = (void (*)(void *)) free_compressed;
+            break;
+        case BLOCKED:
+            // the shapes go round with the cases, so every kernel of the table gets to run
+            inputs[0] = blocked_from_ellpack(c->a, shape[0], shape[1]);
+            inputs[1] = blocked_from_ellpack(c->b, shape[1], shape[2]);
+            free_input = (void (*)(void *)) free_blocked;
+            break;
+        default:
+            break;
+    }
+    if (!output) {
+        error(1, 0, "an allocation has failed");
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    switch (kernel) {
+        case LINEAR:
+            matr_mult_ellpack(inputs[0], inputs[1], output);
+            break;
+        case VECTORIZED:
+            matr_mult_ellpack_vectorised(inputs[0], inputs[1], output);
+            break;
+        case NAIVE:
+            matr_mult_ellpack_naive(inputs[0], inputs[1], output);
+            break;
+        case PARALLEL:
+            matr_mult_ellpack_parallel(inputs[0], inputs[1], output);
+            break;
+        case HALF_FP16:
+        case HALF_BF16:
+            matr_mult_ellpack_half(inputs[0], inputs[1], output);
+            break;
+        case GENERIC_F32:
+            matr_mult_ellpack_f32(inputs[0], inputs[1], output);
+            break;
+        case GENERIC_F64:
+            matr_mult_ellpack_f64(inputs[0], inputs[1], output);
+            break;
+        case MIXED_F32_F64:
+            matr_mult_ellpack_f32_acc64(inputs[0], inputs[1], output);
+            break;
+        case BATCHED:
+            matr_mult_ellpack_batched(inputs[0], inputs[1], output);
+            break;
+        case COMPRESSED:
+            matr_mult_ellpack_compressed(inputs[0], inputs[1], output);
+            break;
+        case BLOCKED:
+            matr_mult_ellpack_blocked(inputs[0], inputs[1], output);
+            break;
+        case FIXED_WIDTH:
+            matr_mult_ellpack_fixed(inputs[0], inputs[1], output);
+            break;
+        case ROWWISE:
+            matr_mult_ellpack_rowwise(inputs[0], inputs[1], output);
+            break;
+        case KERNEL_REPRODUCIBLE_PAIRWISE:
+        case KERNEL_REPRODUCIBLE_COMPENSATED:
+            matr_mult_ellpack_reproducible(inputs[0], inputs[1],
+                                           kernel == KERNEL_REPRODUCIBLE_PAIRWISE ? SUM_PAIRWISE : SUM_COMPENSATED, 1, output);
+            break;
+        case KERNEL_DENSE:
+            matr_mult_ellpack_dense(inputs[0], inputs[1], output);
+            break;
+    }
+    *seconds = seconds_since(&start);
+    if (free_input) {
+        free_input((void *) inputs[0]);
+        free_input((void *) inputs[1]);
+    }
+    if (kernel == KERNEL_DENSE) {
+        free(result);
+        result = ellpack_from_dense(output);
+        free_dense(output);
+    } else if (output != result) {
+        free(result);
+        result = ellpack_from_f64(output);
+        free_ellpack_f64(output);
+    }
+    return result;
+}
+
+// the largest error of an entry of found relative to the sum of the absolute values of its products,
+// a wrong shape, unsorted or out of range indices and entries where the reference has no products are infinite
+static double divergence(const struct EllpackMatrix *found, const double *exact, const double *scale, u_int64_t height,
+                         u_int64_t columns, u_int64_t *worst) {
+    *worst = 0;
+    if (found->height != height || found->real_width != columns) {
+        return INFINITY;
+    }
+    double *row_values = calloc(columns, sizeof(double));
+    if (!row_values) {
+        error(1, 0, "an allocation has failed");
+    }
+    double largest = 0.0;
+    for (u_int64_t row = 0; row < height && largest != INFINITY; row++) {
+        u_int64_t length = rowlength_ellpack(found, row);
+        memset(row_values, 0, columns * sizeof(double));
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t column = found->indices[row * found->width + i];
+            if (column >= columns || (i > 0 && column <= found->indices[row * found->width + i - 1])) {
+                *worst = row * columns;
+                largest = INFINITY;
+                break;
+            }
+            row_values[column] = found->values[row * found->width + i];
+        }
+        for (u_int64_t column = 0; column < columns && largest != INFINITY; column++) {
+            u_int64_t entry = row * columns + column;
+            double error = fabs(row_values[column] - exact[entry]);
+            double relative = scale[entry] > 0 ? error / scale[entry] : (error > 0 ? INFINITY : 0.0);
+            if (relative > largest || isnan(relative)) {
+                largest = isnan(relative) ? INFINITY : relative;
+                *worst = entry;
+            }
+        }
+    }
+    free(row_values);
+    return largest;
+}
+
+static int slower(const void *x, const void *y) {
+    double p = ((const struct CaseResult *) x)->seconds;
+    double q = ((const struct CaseResult *) y)->seconds;
+    return (p < q) - (p > q);
+}
+
+static int more_divergent(const void *x, const void *y) {
+    double p = ((const struct CaseResult *) x)->divergence;
+    double q = ((const struct CaseResult *) y)->divergence;
+    return (p < q) - (p > q);
+}
+
+static void describe_case(FILE *report, const struct DifferentialConfig *config, u_int64_t case_i) {
+    struct DifferentialCase c;
+    generate_case(config, case_i, &c);
+    fprintf(report, "case %lu (seed %lu): A %lu x %lu, B %lu x %lu%s%s%s", case_i, config->seed + case_i, c.rows, c.inner,
+            c.inner, c.columns, c.patterns & PATTERN_EMPTY_ROWS ? ", empty rows" : "",
+            c.patterns & PATTERN_EMPTY_B_COLUMNS ? ", empty B columns" : "", c.patterns & PATTERN_DENSE_ROW ? ", dense rows" : "");
+    free_case(&c);
+}
+
+bool run_differential(const struct DifferentialConfig *config, int kernel, FILE *report) {
+    int first = kernel < 0 ? 0 : kernel;
+    int last = kernel < 0 ? KERNEL_COUNT - 1 : kernel;
+    u_int64_t runs = config->cases * (last - first + 1);
+    struct CaseResult *results = calloc(runs > 0 ? runs : 1, sizeof(*results));
+    if (!results) {
+        error(1, 0, "an allocation has failed");
+    }
+    bool passed = true;
+    u_int64_t run = 0;
+    for (u_int64_t case_i = 0; case_i < config->cases; case_i++) {
+        struct DifferentialCase c;
+        generate_case(config, case_i, &c);
+        for (int k = first; k <= last; k++) {
+            struct CaseResult *r = &results[run++];
+            r->kernel = k;
+            r->case_i = case_i;
+            struct EllpackMatrix *found = multiply_kernel(k, &c, case_i, &r->seconds);
+            int reference = k == HALF_FP16 ? 1 : (k == HALF_BF16 ? 2 : 0);
+            u_int64_t worst;
+            r->divergence = divergence(found, c.exact[reference], c.scale[reference], c.rows, c.columns, &worst);
+            if (r->divergence > config->tolerance) {
+                passed = false;
+                fprintf(report, "[FUZZ] MISMATCH %s on ", KERNEL_NAMES[k]);
+                describe_case(report, config, case_i);
+                fprintf(report, "\n[FUZZ] entry (%lu, %lu): expected %e, relative error %e\n", worst / c.columns,
+                        worst % c.columns, c.exact[reference][worst], r->divergence);
+            }
+            free_ellpack(found);
+        }
+        free_case(&c);
+    }
+    if (config->summary) {
+        for (int k = first; k <= last; k++) {
+            double seconds = 0.0;
+            double largest = 0.0;
+            for (u_int64_t i = 0; i < run; i++) {
+                if (results[i].kernel == k) {
+                    seconds += results[i].seconds;
+                    largest = results[i].divergence > largest ? results[i].divergence : largest;
+                }
+            }
+            printf("[FUZZ] %-24s %lu cases in %f secs, largest relative error %e\n", KERNEL_NAMES[k], config->cases, seconds, largest);
+        }
+        u_int64_t ranked = run < RANKED_CASES ? run : RANKED_CASES;
+        int (*orders[2])(const void *, const void *) = {slower, more_divergent};
+        const char *titles[2] = {"slowest", "most divergent"};
+        for (int order = 0; order < 2; order++) {
+            qsort(results, run, sizeof(*results), orders[order]);
+            printf("[FUZZ] The %s cases:\n", titles[order]);
+            for (u_int64_t i = 0; i < ranked; i++) {
+                printf("[FUZZ]   %s, %f secs, relative error %e on ", KERNEL_NAMES[results[i].kernel], results[i].seconds,
+                       results[i].divergence);
+                describe_case(stdout, config, results[i].case_i);
+                printf("\n");
+            }
+        }
+        printf("[FUZZ] %s\n", passed ? "all results within the tolerance" : "some results are not within the tolerance");
+    }
+    free(results);
+    return passed;
+}
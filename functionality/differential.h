@@ -0,0 +1,42 @@
+#ifndef PROJEKTAUFGABE_DIFFERENTIAL_H
+#define PROJEKTAUFGABE_DIFFERENTIAL_H
+
+#include "ellpack_utility.h"
+#include "multiplication.h"
+
+#include <stdbool.h>
+
+/** sparsity patterns of the generated matrices, every case combines some of them */
+enum DifferentialPattern {
+    PATTERN_EMPTY_ROWS = 1, // about a quarter of the rows of A and B have no entries
+    PATTERN_EMPTY_B_COLUMNS = 2, // about a quarter of the columns of B have no entries
+    PATTERN_DENSE_ROW = 4, // one row of A and one of B have every entry
+    PATTERN_ALL = 7
+};
+
+/** shape and sparsity of the generated cases */
+struct DifferentialConfig {
+    u_int64_t cases;
+    u_int64_t max_size; // the dimensions of A and B are drawn from 1 to max_size
+    double density; // chance of an entry outside the patterns
+    double tolerance; // of the error of an entry relative to the sum of the absolute values of its products
+    u_int64_t seed; // of the first case, case i uses seed + i
+    bool summary; // report the slowest and most divergent cases
+};
+
+/** the differential tester runs the kernel of every MultVersion and these after them */
+enum DifferentialKernel {
+    KERNEL_REPRODUCIBLE_PAIRWISE = ROWWISE + 1, KERNEL_REPRODUCIBLE_COMPENSATED, KERNEL_DENSE, KERNEL_COUNT
+};
+
+/** the name of a kernel of the differential tester */
+const char *differential_kernel_name(int kernel);
+
+/**
+ * multiplies random matrices with the given kernel, or with every kernel if it is negative, and compares the results
+ * against a dense double reference, the half precision kernels against the product of the rounded inputs,
+ * mismatches are written to report, returns whether every result was within the tolerance
+ */
+bool run_differential(const struct DifferentialConfig *config, int kernel, FILE *report);
+
+#endif //PROJEKTAUFGABE_DIFFERENTIAL_H
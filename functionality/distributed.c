@@ -0,0 +1,307 @@
+#include "distributed.h"
+
+#include "benchmarking.h"
+#include "memory.h"
+#include "multiplication.h"
+#include "parser.h"
+#include "scheduler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// rows received at a time before they are spread over the wider rows of the result
+#define STAGING_BYTES (1024 * 1024)
+// the most one send or recv moves
+#define MESSAGE_BYTES ((u_int64_t) 1 << 30)
+
+// sends all bytes unless the other end is gone, without a SIGPIPE
+static int send_all(int fd, const void *buffer, u_int64_t length) {
+    const char *p = buffer;
+    while (length > 0) {
+        ssize_t sent = send(fd, p, length < MESSAGE_BYTES ? length : MESSAGE_BYTES, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return 0;
+        }
+        p += sent;
+        length -= sent;
+    }
+    return 1;
+}
+
+// receives all bytes unless the other end is gone
+static int receive_all(int fd, void *buffer, u_int64_t length) {
+    char *p = buffer;
+    while (length > 0) {
+        ssize_t received = recv(fd, p, length < MESSAGE_BYTES ? length : MESSAGE_BYTES, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return 0;
+        }
+        p += received;
+        length -= received;
+    }
+    return 1;
+}
+
+// a block of rows is its real width, height and width followed by its values and indices
+static int send_block(int fd, u_int64_t real_width, u_int64_t height, u_int64_t width, const float *values,
+                      const u_int64_t *indices) {
+    u_int64_t header[3] = {real_width, height, width};
+    return send_all(fd, header, sizeof(header)) && send_all(fd, values, height * width * sizeof(float))
+           && send_all(fd, indices, height * width * sizeof(u_int64_t));
+}
+
+// the rows of a block of the given width into rows of the width of the result, the rest of every row is padding
+static int receive_rows(int fd, char *rows, u_int64_t result_width, u_int64_t width, u_int64_t height, size_t size,
+                        char *staging) {
+    u_int64_t row_bytes = width * size;
+    u_int64_t step = row_bytes > 0 && row_bytes < STAGING_BYTES ? STAGING_BYTES / row_bytes : 1;
+    for (u_int64_t row = 0; row < height; row += step) {
+        u_int64_t count = height - row < step ? height - row : step;
+        if (!receive_all(fd, staging, count * row_bytes)) {
+            return 0;
+        }
+        for (u_int64_t i = 0; i < count; i++) {
+            char *out = rows + (row + i) * result_width * size;
+            memcpy(out, staging + i * row_bytes, row_bytes);
+            memset(out + row_bytes, 0, (result_width - width) * size);
+        }
+    }
+    return 1;
+}
+
+// b in the binary format in a file of shared memory, removed from the file system at once, the indices of the workers
+// have to be aligned to 8 bytes, so an odd count of entries gets one more padding column
+static int share_matrix(const struct EllpackMatrix *b) {
+    char shm_path[] = "/dev/shm/ellmul-b-XXXXXX";
+    char tmp_path[] = "/tmp/ellmul-b-XXXXXX";
+    char *path = shm_path;
+    int fd = mkstemp(shm_path);
+    if (fd < 0) {
+        path = tmp_path;
+        fd = mkstemp(tmp_path);
+    }
+    if (fd < 0) {
+        error(1, errno, "Error: Matrix B cannot be shared with the workers");
+    }
+    unlink(path);
+    FILE *out_file = fdopen(dup(fd), "w");
+    if (!out_file) {
+        error(1, errno, "Error: Matrix B cannot be shared with the workers");
+    }
+    u_int64_t width = b->width + b->height * b->width % 2;
+    write_binary_header(out_file, BINARY_F32, b->real_width, b->height, width, path);
+    const float zero_value = 0.0F;
+    const u_int64_t zero_index = 0;
+    for (u_int64_t row = 0; row < b->height; row++) {
+        fwrite(b->values + row * b->width, sizeof(float), b->width, out_file);
+        fwrite(&zero_value, sizeof(float), width - b->width, out_file);
+    }
+    for (u_int64_t row = 0; row < b->height; row++) {
+        fwrite(b->indices + row * b->width, sizeof(u_int64_t), b->width, out_file);
+        fwrite(&zero_index, sizeof(u_int64_t), width - b->width, out_file);
+    }
+    int failed = ferror(out_file);
+    if (fclose(out_file) != 0 || failed) {
+        error(1, 0, "Error while writing matrix file %s", path);
+    }
+    return fd;
+}
+
+// consecutive rows of a for every worker, the bounds are where the products of the rows before them reach the next
+// share, a row costs the entries of the rows of b it adds
+static void split_rows(const struct EllpackMatrix *a, const struct EllpackMatrix *b, int workers, u_int64_t *bounds) {
+    u_int64_t *costs = calloc(a->height + 1, sizeof(u_int64_t));
+    u_int64_t *b_lengths = calloc(b->height + 1, sizeof(u_int64_t));
+    if (!costs || !b_lengths) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (u_int64_t k = 0; k < b->height; k++) {
+        b_lengths[k] = rowlength_ellpack(b, k);
+    }
+    u_int64_t total = 0;
+    for (u_int64_t row = 0; row < a->height; row++) {
+        u_int64_t length = rowlength_ellpack(a, row);
+        costs[row] = 1;
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = a->indices[row * a->width + i];
+            costs[row] += k < b->height ? b_lengths[k] : 0;
+        }
+        total += costs[row];
+    }
+    u_int64_t row = 0;
+    u_int64_t done = 0;
+    bounds[0] = 0;
+    for (int worker = 1; worker < workers; worker++) {
+        u_int64_t share = (u_int64_t) ((double) total * worker / workers);
+        while (row < a->height && done < share) {
+            done += costs[row++];
+        }
+        bounds[worker] = row;
+    }
+    bounds[workers] = a->height;
+    free(costs);
+    free(b_lengths);
+}
+
+// runs this program again as a worker on the other end of the socket pair, which is kept open in it
+static pid_t start_worker(int socket, int b_file, int version, int threads) {
+    char worker[64];
+    char implementation[16];
+    char thread_count[16];
+    char pages[32];
+    snprintf(worker, sizeof(worker), "--worker=%d,%d", socket, b_file);
+    snprintf(implementation, sizeof(implementation), "%d", version);
+    snprintf(thread_count, sizeof(thread_count), "%d", threads);
+    snprintf(pages, sizeof(pages), "--pages=%s", page_policy_name(get_page_policy()));
+    fflush(stdout);
+    fflush(stderr);
+    pid_t child = fork();
+    if (child == 0) {
+        execl("/proc/self/exe", "ellmul-worker", worker, "-V", implementation, "-t", thread_count, pages, (char *) NULL);
+        // the coordinator sees the socket closed
+        _exit(127);
+    }
+    return child;
+}
+
+void matr_mult_ellpack_distributed(const struct EllpackMatrix *a, const struct EllpackMatrix *b, int workers, int version,
+                                   struct EllpackMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    if (!float_ellpack_version(version)) {
+        error(1, 0, "Error: Workers multiply with the float implementations working on ELLPACK, not with %d", version);
+    }
+    if (workers < 1 || workers > MAX_WORKERS) {
+        error(1, 0, "Error: Between 1 and %d workers multiply, not %d", MAX_WORKERS, workers);
+    }
+    // no worker without rows
+    workers = (u_int64_t) workers < a->height ? workers : (int) (a->height > 0 ? a->height : 1);
+    int threads = scheduler_threads() / workers > 0 ? scheduler_threads() / workers : 1;
+    u_int64_t bounds[MAX_WORKERS + 1];
+    int sockets[MAX_WORKERS];
+    pid_t children[MAX_WORKERS];
+    split_rows(a, b, workers, bounds);
+    int b_file = share_matrix(b);
+
+    for (int worker = 0; worker < workers; worker++) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+            error(1, errno, "Error: No socket for worker %d", worker);
+        }
+        // the later workers must not hold the end of the coordinator open
+        fcntl(pair[0], F_SETFD, FD_CLOEXEC);
+        children[worker] = start_worker(pair[1], b_file, version, threads);
+        if (children[worker] < 0) {
+            error(1, errno, "Error: Worker %d cannot be started", worker);
+        }
+        close(pair[1]);
+        sockets[worker] = pair[0];
+    }
+    close(b_file);
+    // every worker receives its block before the first result is read, the blocks are views into the rows of a
+    for (int worker = 0; worker < workers; worker++) {
+        u_int64_t first = bounds[worker];
+        if (!send_block(sockets[worker], a->real_width, bounds[worker + 1] - first, a->width, a->values + first * a->width,
+                        a->indices + first * a->width)) {
+            error(1, 0, "Error: Worker %d has stopped before receiving its rows", worker);
+        }
+    }
+
+    u_int64_t widths[MAX_WORKERS];
+    result->height = a->height;
+    result->real_width = b->real_width;
+    result->width = 0;
+    for (int worker = 0; worker < workers; worker++) {
+        u_int64_t header[3];
+        if (!receive_all(sockets[worker], header, sizeof(header)) || header[0] != b->real_width
+            || header[1] != bounds[worker + 1] - bounds[worker]) {
+            error(1, 0, "Error: Worker %d has stopped before sending its result", worker);
+        }
+        widths[worker] = header[2];
+        result->width = widths[worker] > result->width ? widths[worker] : result->width;
+    }
+    result->values = alloc_array(result->height * result->width * sizeof(float), 0);
+    result->indices = alloc_array(result->height * result->width * sizeof(u_int64_t), 0);
+    char *staging = malloc(STAGING_BYTES > result->width * sizeof(u_int64_t) ? STAGING_BYTES : result->width * sizeof(u_int64_t));
+    if (!result->values || !result->indices || !staging) {
+        error(1, 0, "Error: Not enough memory for the result");
+    }
+    for (int worker = 0; worker < workers; worker++) {
+        u_int64_t first = bounds[worker];
+        u_int64_t height = bounds[worker + 1] - first;
+        if (!receive_rows(sockets[worker], (char *) (result->values + first * result->width), result->width,
+                          widths[worker], height, sizeof(float), staging)
+            || !receive_rows(sockets[worker], (char *) (result->indices + first * result->width), result->width,
+                             widths[worker], height, sizeof(u_int64_t), staging)) {
+            error(1, 0, "Error: Worker %d has stopped before sending its result", worker);
+        }
+        close(sockets[worker]);
+        int status;
+        if (waitpid(children[worker], &status, 0) != children[worker] || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            error(1, 0, "Error: Worker %d has failed", worker);
+        }
+    }
+    free(staging);
+}
+
+int run_worker(int socket, int b_file, int version) {
+    struct stat b_stat;
+    if (fstat(b_file, &b_stat) != 0 || (u_int64_t) b_stat.st_size < sizeof(struct BinaryHeader)) {
+        error(1, errno, "Error: The shared Matrix B cannot be read");
+    }
+    char *shared = mmap(NULL, b_stat.st_size, PROT_READ, MAP_SHARED, b_file, 0);
+    if (shared == MAP_FAILED) {
+        error(1, errno, "Error: The shared Matrix B cannot be mapped");
+    }
+    close(b_file);
+    // the offset of the file is shared with the coordinator and the other workers, the header is read from the mapping
+    struct BinaryHeader header;
+    FILE *b_header_file = fmemopen(shared, sizeof(header), "r");
+    if (!b_header_file) {
+        error(1, errno, "Error: The shared Matrix B cannot be read");
+    }
+    read_binary_header(b_header_file, &header, "shared by the coordinator");
+    fclose(b_header_file);
+    u_int64_t entries = header.height * header.width;
+    if (header.value_type != BINARY_F32 || entries % 2
+        || (u_int64_t) b_stat.st_size != sizeof(header) + entries * (sizeof(float) + sizeof(u_int64_t))) {
+        error(1, 0, "Error: The shared Matrix B is not the matrix of the coordinator");
+    }
+    struct EllpackMatrix b = {header.real_width, header.height, header.width, (float *) (shared + sizeof(header)),
+                              (u_int64_t *) (shared + sizeof(header) + entries * sizeof(float))};
+
+    u_int64_t block[3];
+    if (!receive_all(socket, block, sizeof(block))) {
+        error(1, 0, "Error: The coordinator has stopped before sending the rows of Matrix A");
+    }
+    struct EllpackMatrix *a = make_ellpack(block[0], block[1], block[2], "A");
+    if (!receive_all(socket, a->values, a->height * a->width * sizeof(float))
+        || !receive_all(socket, a->indices, a->height * a->width * sizeof(u_int64_t))) {
+        error(1, 0, "Error: The coordinator has stopped before sending the rows of Matrix A");
+    }
+    struct EllpackMatrix *result = malloc(sizeof(*result));
+    if (!result) {
+        error(1, 0, "Error: Not enough memory for the result");
+    }
+    benchmark_once(version, a, &b, result);
+    if (!send_block(socket, result->real_width, result->height, result->width, result->values, result->indices)) {
+        error(1, 0, "Error: The coordinator has stopped before receiving the result");
+    }
+    free_all((struct EllpackMatrix *[]){a, result}, 2);
+    munmap(shared, b_stat.st_size);
+    close(socket);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef PROJEKTAUFGABE_DISTRIBUTED_H
+#define PROJEKTAUFGABE_DISTRIBUTED_H
+
+#include "ellpack_utility.h"
+
+/** the largest number of worker processes of --workers */
+#define MAX_WORKERS 256
+
+/**
+ * a * b in worker processes on this machine: b is written once in the binary format to a memory file every worker maps
+ * read only, a is cut into one block of consecutive rows of about the same products per worker, which each worker
+ * receives over a socket pair, multiplies with the implementation and sends back, the blocks are assembled in order,
+ * the workers run this program again with the hidden option --worker and share the threads of the scheduler
+ */
+void matr_mult_ellpack_distributed(const struct EllpackMatrix *a, const struct EllpackMatrix *b, int workers, int version,
+                                   struct EllpackMatrix *result);
+
+/** the worker of matr_mult_ellpack_distributed on the given socket and memory file of b, returns the exit status */
+int run_worker(int socket, int b_file, int version);
+
+#endif //PROJEKTAUFGABE_DISTRIBUTED_H
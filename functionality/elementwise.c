@@ -0,0 +1,383 @@
+#include "elementwise.h"
+
+#include "scheduler.h"
+
+static const char *OP_NAMES[] = {"none", "add", "hadamard", "scale"};
+
+int elementwise_op_from_name(const char *name) {
+    for (int i = 1; i < (int) (sizeof(OP_NAMES) / sizeof(OP_NAMES[0])); i++) {
+        if (strcmp(name, OP_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/** the state of merging a row of a with a row of b into a row of the result */
+struct Merge {
+    const float *a_values;
+    const u_int64_t *a_indices;
+    u_int64_t a_length;
+    const float *b_values;
+    const u_int64_t *b_indices;
+    u_int64_t b_length;
+    float alpha;
+    float beta;
+    int intersect; // only equal indices remain as alpha * a * b, otherwise alpha * a + beta * b of the union
+    float *r_values;
+    u_int64_t *r_indices;
+    u_int64_t a_i;
+    u_int64_t b_i;
+    u_int64_t r_length;
+};
+
+// zeros are not stored, they would end the row
+static inline void emit(struct Merge *m, float value, u_int64_t index) {
+    if (value != 0.0F) {
+        m->r_values[m->r_length] = value;
+        m->r_indices[m->r_length++] = index;
+    }
+}
+
+// advances the merge by one index, the lower index of both rows or the common one
+static inline void merge_step(struct Merge *m) {
+    u_int64_t a_index = m->a_indices[m->a_i];
+    u_int64_t b_index = m->b_indices[m->b_i];
+    if (a_index == b_index) {
+        float a_value = m->a_values[m->a_i++];
+        float b_value = m->b_values[m->b_i++];
+        emit(m, m->intersect ? m->alpha * a_value * b_value : m->alpha * a_value + m->beta * b_value, a_index);
+    } else if (a_index < b_index) {
+        if (!m->intersect) {
+            emit(m, m->alpha * m->a_values[m->a_i], a_index);
+        }
+        m->a_i++;
+    } else {
+        if (!m->intersect) {
+            emit(m, m->beta * m->b_values[m->b_i], b_index);
+        }
+        m->b_i++;
+    }
+}
+
+static inline void merge_tail(struct Merge *m) {
+    while (m->a_i < m->a_length && m->b_i < m->b_length) {
+        merge_step(m);
+    }
+    for (; !m->intersect && m->a_i < m->a_length; m->a_i++) {
+        emit(m, m->alpha * m->a_values[m->a_i], m->a_indices[m->a_i]);
+    }
+    for (; !m->intersect && m->b_i < m->b_length; m->b_i++) {
+        emit(m, m->beta * m->b_values[m->b_i], m->b_indices[m->b_i]);
+    }
+}
+
+static void merge_rows_scalar(struct Merge *m) {
+    merge_tail(m);
+}
+
+// blocks of 8 equal indices in both rows are combined at once, other blocks are merged entry by entry
+__attribute__((target("avx2")))
+static void merge_rows_avx2(struct Merge *m) {
+    __m256 alpha = _mm256_set1_ps(m->alpha);
+    __m256 beta = _mm256_set1_ps(m->beta);
+    __m256 zero = _mm256_setzero_ps();
+    while (m->a_i + 8 <= m->a_length && m->b_i + 8 <= m->b_length) {
+        const u_int64_t *a_indices = m->a_indices + m->a_i;
+        const u_int64_t *b_indices = m->b_indices + m->b_i;
+        __m256i equal_low = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) a_indices),
+                                               _mm256_loadu_si256((const __m256i *) b_indices));
+        __m256i equal_high = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (a_indices + 4)),
+                                                _mm256_loadu_si256((const __m256i *) (b_indices + 4)));
+        if (_mm256_movemask_epi8(_mm256_and_si256(equal_low, equal_high)) == -1) {
+            __m256 a_values = _mm256_loadu_ps(m->a_values + m->a_i);
+            __m256 b_values = _mm256_loadu_ps(m->b_values + m->b_i);
+            __m256 r_values = m->intersect ? _mm256_mul_ps(_mm256_mul_ps(alpha, a_values), b_values)
+                                           : _mm256_add_ps(_mm256_mul_ps(alpha, a_values), _mm256_mul_ps(beta, b_values));
+            // a block containing a zero is left to the scalar merge which drops it
+            if (_mm256_movemask_ps(_mm256_cmp_ps(r_values, zero, _CMP_EQ_OQ)) == 0) {
+                _mm256_storeu_ps(m->r_values + m->r_length, r_values);
+                memcpy(m->r_indices + m->r_length, a_indices, 8 * sizeof(u_int64_t));
+                m->a_i += 8;
+                m->b_i += 8;
+                m->r_length += 8;
+                continue;
+            }
+        }
+        for (int i = 0; i < 8 && m->a_i < m->a_length && m->b_i < m->b_length; i++) {
+            merge_step(m);
+        }
+    }
+    merge_tail(m);
+}
+
+static u_int64_t scale_row_scalar(float alpha, const float *values, const u_int64_t *indices, u_int64_t length,
+                                  float *r_values, u_int64_t *r_indices) {
+    u_int64_t r_length = 0;
+    for (u_int64_t i = 0; i < length; i++) {
+        float value = alpha * values[i];
+        if (value != 0.0F) {
+            r_values[r_length] = value;
+            r_indices[r_length++] = indices[i];
+        }
+    }
+    return r_length;
+}
+
+// scales 8 values at once as long as none of them underflows to zero
+__attribute__((target("avx2")))
+static u_int64_t scale_row_avx2(float alpha, const float *values, const u_int64_t *indices, u_int64_t length,
+                                float *r_values, u_int64_t *r_indices) {
+    __m256 alpha_vec = _mm256_set1_ps(alpha);
+    __m256 zero = _mm256_setzero_ps();
+    u_int64_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256 scaled = _mm256_mul_ps(alpha_vec, _mm256_loadu_ps(values + i));
+        if (_mm256_movemask_ps(_mm256_cmp_ps(scaled, zero, _CMP_EQ_OQ)) != 0) {
+            break;
+        }
+        _mm256_storeu_ps(r_values + i, scaled);
+    }
+    memcpy(r_indices, indices, i * sizeof(u_int64_t));
+    return i + scale_row_scalar(alpha, values + i, indices + i, length - i, r_values + i, r_indices + i);
+}
+
+enum RowKernel {
+    ROW_MERGE, ROW_SCALE, ROW_MULT_ADD
+};
+
+struct ElementwiseContext {
+    enum RowKernel kernel;
+    const struct EllpackMatrix *a;
+    const struct EllpackMatrix *b;
+    const struct EllpackMatrix *bx; // transpose of b for the multiplication
+    const struct EllpackMatrix *c;
+    const u_int64_t *bx_lengths;
+    float alpha;
+    float beta;
+    int intersect;
+    int simd;
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+    float **scratch_values; // one upper limit size row per thread
+    u_int64_t **scratch_indices;
+};
+
+// the product row is merged with the row of c in the order of its columns, c entries between products are passed on
+static u_int64_t mult_add_row(const struct ElementwiseContext *c, u_int64_t row, float *r_values, u_int64_t *r_indices) {
+    const struct EllpackMatrix *ax = c->a;
+    const struct EllpackMatrix *bx = c->bx;
+    u_int64_t a_length = rowlength_ellpack(ax, row);
+    const u_int64_t *a_row_indices = ax->indices + row * ax->width;
+    const float *a_row_values = ax->values + row * ax->width;
+    u_int64_t c_length = c->c ? rowlength_ellpack(c->c, row) : 0;
+    const u_int64_t *c_row_indices = c->c ? c->c->indices + row * c->c->width : NULL;
+    const float *c_row_values = c->c ? c->c->values + row * c->c->width : NULL;
+    struct Merge m = {0};
+    m.r_values = r_values;
+    m.r_indices = r_indices;
+    u_int64_t c_i = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height && a_length > 0; b_row_i++) {
+        const u_int64_t *b_row_indices = bx->indices + b_row_i * bx->width;
+        const float *b_row_values = bx->values + b_row_i * bx->width;
+        u_int64_t a_column_i = 0;
+        u_int64_t b_column_i = 0;
+        float res_sum = 0.0F;
+        while (a_column_i < a_length && b_column_i < c->bx_lengths[b_row_i]) {
+            if (a_row_indices[a_column_i] == b_row_indices[b_column_i]) {
+                res_sum += a_row_values[a_column_i] * b_row_values[b_column_i];
+                a_column_i++;
+                b_column_i++;
+            } else if (a_row_indices[a_column_i] > b_row_indices[b_column_i]) {
+                b_column_i++;
+            } else {
+                a_column_i++;
+            }
+        }
+        for (; c_i < c_length && c_row_indices[c_i] < b_row_i; c_i++) {
+            emit(&m, c->beta * c_row_values[c_i], c_row_indices[c_i]);
+        }
+        if (c_i < c_length && c_row_indices[c_i] == b_row_i) {
+            emit(&m, c->alpha * res_sum + c->beta * c_row_values[c_i++], b_row_i);
+        } else {
+            emit(&m, c->alpha * res_sum, b_row_i);
+        }
+    }
+    for (; c_i < c_length; c_i++) {
+        emit(&m, c->beta * c_row_values[c_i], c_row_indices[c_i]);
+    }
+    return m.r_length;
+}
+
+static void elementwise_task(void *context, const struct RowTask *task, int thread) {
+    struct ElementwiseContext *c = context;
+    float *r_row_values = c->scratch_values[thread];
+    u_int64_t *r_row_indices = c->scratch_indices[thread];
+    for (u_int64_t row = task->begin; row < task->end; row++) {
+        const struct EllpackMatrix *a = c->a;
+        u_int64_t length;
+        if (c->kernel == ROW_MULT_ADD) {
+            length = mult_add_row(c, row, r_row_values, r_row_indices);
+        } else if (c->kernel == ROW_SCALE) {
+            length = (c->simd ? scale_row_avx2 : scale_row_scalar)(c->alpha, a->values + row * a->width, a->indices + row * a->width,
+                                                                    rowlength_ellpack(a, row), r_row_values, r_row_indices);
+        } else {
+            struct Merge m = {a->values + row * a->width, a->indices + row * a->width, rowlength_ellpack(a, row),
+                              c->b->values + row * c->b->width, c->b->indices + row * c->b->width, rowlength_ellpack(c->b, row),
+                              c->alpha, c->beta, c->intersect, r_row_values, r_row_indices, 0, 0, 0};
+            if (c->simd) {
+                merge_rows_avx2(&m);
+            } else {
+                merge_rows_scalar(&m);
+            }
+            length = m.r_length;
+        }
+        c->r_values[row] = malloc(sizeof(float) * length);
+        c->r_indices[row] = malloc(sizeof(u_int64_t) * length);
+        if ((!c->r_values[row] || !c->r_indices[row]) && length > 0) {
+            error(1, 0, "Error: Not enough memory for result row %lu", row);
+        }
+        memcpy(c->r_values[row], r_row_values, sizeof(float) * length);
+        memcpy(c->r_indices[row], r_row_indices, sizeof(u_int64_t) * length);
+        c->r_row_lengths[row] = length;
+    }
+}
+
+// computes every row of the result with the kernel of the context, scratch_size bounds the length of a result row
+static void run_rows(struct ElementwiseContext *c, u_int64_t scratch_size, const char *name,
+                     struct EllpackMatrix *result, u_int64_t real_width) {
+    u_int64_t height = c->a->height;
+    int threads = scheduler_threads();
+    __builtin_cpu_init();
+    c->simd = __builtin_cpu_supports("avx2");
+    u_int64_t *costs = calloc(height, sizeof(u_int64_t));
+    c->r_values = calloc(height, sizeof(float *));
+    c->r_indices = calloc(height, sizeof(u_int64_t *));
+    c->r_row_lengths = calloc(height, sizeof(u_int64_t));
+    c->scratch_values = calloc(threads, sizeof(float *));
+    c->scratch_indices = calloc(threads, sizeof(u_int64_t *));
+    if (!costs || !c->r_values || !c->r_indices || !c->r_row_lengths || !c->scratch_values || !c->scratch_indices) {
+        error(1, 0, "Error: Not enough memory for the %s", name);
+    }
+    for (int i = 0; i < threads; i++) {
+        c->scratch_values[i] = calloc(scratch_size + 1, sizeof(float));
+        c->scratch_indices[i] = calloc(scratch_size + 1, sizeof(u_int64_t));
+        if (!c->scratch_values[i] || !c->scratch_indices[i]) {
+            error(1, 0, "Error: Not enough memory for the %s", name);
+        }
+    }
+    u_int64_t b_nnz = 0;
+    for (u_int64_t b_row_i = 0; c->bx && b_row_i < c->bx->height; b_row_i++) {
+        b_nnz += c->bx_lengths[b_row_i];
+    }
+    for (u_int64_t row = 0; row < height; row++) {
+        u_int64_t a_length = rowlength_ellpack(c->a, row);
+        costs[row] = a_length + 1;
+        if (c->kernel == ROW_MERGE) {
+            costs[row] += rowlength_ellpack(c->b, row);
+        } else if (c->kernel == ROW_MULT_ADD) {
+            costs[row] = (a_length + 1) * c->bx->height + (a_length ? b_nnz : 0) + (c->c ? rowlength_ellpack(c->c, row) : 0);
+        }
+    }
+    schedule_rows(height, costs, 1, elementwise_task, c, name);
+
+    u_int64_t max_width = 0;
+    for (u_int64_t row = 0; row < height; row++) {
+        if (c->r_row_lengths[row] > max_width) {
+            max_width = c->r_row_lengths[row];
+        }
+    }
+    result->height = height;
+    result->width = max_width;
+    flatten_ellpack(result, c->r_values, c->r_indices, c->r_row_lengths);
+    result->real_width = real_width;
+    for (int i = 0; i < threads; i++) {
+        free(c->scratch_values[i]);
+        free(c->scratch_indices[i]);
+    }
+    free(c->scratch_values);
+    free(c->scratch_indices);
+    free(costs);
+}
+
+static void merge_matrices(float alpha, const struct EllpackMatrix *a, float beta, const struct EllpackMatrix *b,
+                           int intersect, struct EllpackMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    if (a->height != b->height) {
+        error(1, 0, "Error: Dimensions mismatch: Matrix A and Matrix B need the same height. %lu != %lu", a->height, b->height);
+    }
+    struct ElementwiseContext c = {0};
+    c.kernel = ROW_MERGE;
+    c.a = a;
+    c.b = b;
+    c.alpha = alpha;
+    c.beta = beta;
+    c.intersect = intersect;
+    run_rows(&c, intersect ? (a->width < b->width ? a->width : b->width) : a->width + b->width,
+             intersect ? "hadamard" : "add", result, a->real_width > b->real_width ? a->real_width : b->real_width);
+}
+
+void matr_add_ellpack(const void* a, const void* b, void* result) {
+    merge_matrices(1.0F, a, 1.0F, b, 0, result);
+}
+
+void matr_add_scaled_ellpack(float alpha, const struct EllpackMatrix *a, float beta, const struct EllpackMatrix *b,
+                             struct EllpackMatrix *result) {
+    merge_matrices(alpha, a, beta, b, 0, result);
+}
+
+void matr_hadamard_ellpack(const void* a, const void* b, void* result) {
+    merge_matrices(1.0F, a, 1.0F, b, 1, result);
+}
+
+void matr_scale_ellpack(float alpha, const struct EllpackMatrix *a, struct EllpackMatrix *result) {
+    if (!valid_ellpack(a)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return;
+    }
+    struct ElementwiseContext c = {0};
+    c.kernel = ROW_SCALE;
+    c.a = a;
+    c.alpha = alpha;
+    run_rows(&c, a->width, "scale", result, a->real_width);
+}
+
+void matr_mult_add_ellpack(float alpha, const struct EllpackMatrix *a, const struct EllpackMatrix *b,
+                           float beta, const struct EllpackMatrix *c, struct EllpackMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b) || (c && !valid_ellpack(c))) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    if (c && c->height != a->height) {
+        error(1, 0, "Error: Dimensions mismatch: Matrix C must have the height of Matrix A. %lu != %lu", c->height, a->height);
+    }
+    struct EllpackMatrix *bx = transpose_ellpack_parallel(b);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+        return;
+    }
+    u_int64_t *bx_lengths = calloc(bx->height, sizeof(u_int64_t));
+    if (!bx_lengths && bx->height > 0) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height; b_row_i++) {
+        bx_lengths[b_row_i] = rowlength_ellpack(bx, b_row_i);
+    }
+    struct ElementwiseContext context = {0};
+    context.kernel = ROW_MULT_ADD;
+    context.a = a;
+    context.b = b;
+    context.bx = bx;
+    context.c = c;
+    context.bx_lengths = bx_lengths;
+    context.alpha = alpha;
+    context.beta = beta;
+    u_int64_t real_width = c && c->real_width > b->real_width ? c->real_width : b->real_width;
+    run_rows(&context, bx->height + (c ? c->width : 0), "multiply add", result, real_width);
+    free(bx_lengths);
+    free_ellpack(bx);
+}
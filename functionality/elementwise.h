@@ -0,0 +1,35 @@
+#ifndef PROJEKTAUFGABE_ELEMENTWISE_H
+#define PROJEKTAUFGABE_ELEMENTWISE_H
+
+#include "ellpack_utility.h"
+
+/** element wise operations selectable on the command line */
+enum ElementwiseOp {
+    ELEMENT_NONE, ELEMENT_ADD, ELEMENT_HADAMARD, ELEMENT_SCALE
+};
+
+/** the operation with the given name (add, hadamard, scale), -1 if there is none */
+int elementwise_op_from_name(const char *name);
+
+/**
+ * element wise kernels, the rows are merged along their sorted indices like in the multiplication
+ * and distributed by the work stealing scheduler, runs of equal indices are combined with AVX2,
+ * entries that become zero are dropped, a and b need the same height
+ */
+void matr_add_ellpack(const void* a, const void* b, void* result);
+/** result = alpha * a + beta * b */
+void matr_add_scaled_ellpack(float alpha, const struct EllpackMatrix *a, float beta, const struct EllpackMatrix *b,
+                             struct EllpackMatrix *result);
+/** result = a * b entry by entry, only indices present in both rows remain */
+void matr_hadamard_ellpack(const void* a, const void* b, void* result);
+/** result = alpha * a */
+void matr_scale_ellpack(float alpha, const struct EllpackMatrix *a, struct EllpackMatrix *result);
+
+/**
+ * result = alpha * a * b + beta * c, every result row merges the entries of the product row with the row of c
+ * while they are computed so the product is never stored, c may be NULL
+ */
+void matr_mult_add_ellpack(float alpha, const struct EllpackMatrix *a, const struct EllpackMatrix *b,
+                           float beta, const struct EllpackMatrix *c, struct EllpackMatrix *result);
+
+#endif //PROJEKTAUFGABE_ELEMENTWISE_H
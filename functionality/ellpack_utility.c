@@ -1,4 +1,6 @@
 #include "ellpack_utility.h"
+#include "memory.h"
+#include "scheduler.h"
 
 
 // Partly inspired from https://stackoverflow.com/a/41129764
@@ -7,8 +9,8 @@ struct EllpackMatrix* make_ellpack(u_int64_t real_width, u_int64_t height, u_int
     ellpack->real_width = real_width;
     ellpack->width = width;
     ellpack->height = height;
-    ellpack->values = malloc(sizeof(float) * width * height);
-    ellpack->indices = malloc(sizeof(u_int64_t) * width * height);
+    ellpack->values = alloc_array(sizeof(float) * width * height, 0);
+    ellpack->indices = alloc_array(sizeof(u_int64_t) * width * height, 0);
     if(!ellpack->values || !ellpack->indices) {
         error(1, 0, "Error: Not enough memory to load matrix %s", file);
     }
@@ -62,16 +64,25 @@ u_int64_t realwidth_ellpack(const struct EllpackMatrix * const x) {
         while (j < x -> width && x->values[i * x -> width + j] != 0.0) {
             j++;
         }
-        if (x -> indices[i * x->width + --j] > max_width) {
+        // empty rows have no last index
+        if (j > 0 && x -> indices[i * x->width + --j] > max_width) {
             max_width = x->indices[i * x -> width + j];
         }
     }
     return max_width + 1; // to include column n the width needs to be at least n+1
 }
 
+u_int64_t rowlength_ellpack(const struct EllpackMatrix *x, u_int64_t row) {
+    u_int64_t length = 0;
+    while (length < x->width && x->values[row * x->width + length] != 0.0) {
+        length++;
+    }
+    return length;
+}
+
 void flatten_ellpack(struct EllpackMatrix *x, float **values, u_int64_t **indices, u_int64_t *lengths) {
-    x->values = calloc(x->height * x->width, sizeof(float));
-    x->indices = calloc(x->height * x->width, sizeof(u_int64_t));
+    x->values = alloc_array(x->height * x->width * sizeof(float), 1);
+    x->indices = alloc_array(x->height * x->width * sizeof(u_int64_t), 1);
     if (x->values && x->indices) {
         for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {
             memcpy(x->values + x_row_i * x->width, values[x_row_i], lengths[x_row_i] * sizeof(float));
@@ -151,6 +162,200 @@ struct EllpackMatrix *transpose_ellpack(const struct EllpackMatrix * x) {
     return r;
 }
 
+struct TransposeContext {
+    const struct EllpackMatrix *x;
+    u_int64_t blocks; // of consecutive rows of x
+    u_int64_t *x_lengths;
+    u_int64_t *offsets; // per block and column of x: its entries, then the position of its first one in the row of r
+    struct EllpackMatrix *r;
+};
+
+// counts the entries of the blocks [begin, end) per column
+static void transpose_count_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct TransposeContext *c = context;
+    const struct EllpackMatrix *x = c->x;
+    for (u_int64_t block = task->begin; block < task->end; block++) {
+        u_int64_t *counts = c->offsets + block * c->r->height;
+        for (u_int64_t x_row_i = block * x->height / c->blocks; x_row_i < (block + 1) * x->height / c->blocks; x_row_i++) {
+            c->x_lengths[x_row_i] = rowlength_ellpack(x, x_row_i);
+            for (u_int64_t x_col_i = 0; x_col_i < c->x_lengths[x_row_i]; x_col_i++) {
+                u_int64_t column = x->indices[x_row_i * x->width + x_col_i];
+                if (column < c->r->height) {
+                    counts[column]++;
+                }
+            }
+        }
+    }
+}
+
+// moves the entries of the blocks [begin, end) to their rows of r, behind the entries of the blocks before them
+static void transpose_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct TransposeContext *c = context;
+    const struct EllpackMatrix *x = c->x;
+    struct EllpackMatrix *r = c->r;
+    for (u_int64_t block = task->begin; block < task->end; block++) {
+        u_int64_t *fill = c->offsets + block * r->height;
+        for (u_int64_t x_row_i = block * x->height / c->blocks; x_row_i < (block + 1) * x->height / c->blocks; x_row_i++) {
+            for (u_int64_t x_col_i = 0; x_col_i < c->x_lengths[x_row_i]; x_col_i++) {
+                u_int64_t r_row_i = x->indices[x_row_i * x->width + x_col_i];
+                if (r_row_i < r->height) {
+                    u_int64_t position = r_row_i * r->width + fill[r_row_i]++;
+                    r->values[position] = x->values[x_row_i * x->width + x_col_i];
+                    r->indices[position] = x_row_i;
+                }
+            }
+        }
+    }
+}
+
+struct EllpackMatrix *transpose_ellpack_parallel(const struct EllpackMatrix * x) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    struct EllpackMatrix *r = malloc(sizeof(*r));
+    if (r == NULL) {
+        error(1, 0, "allocation failed for result matrix");
+        return NULL;
+    }
+    r->height = realwidth_ellpack(x);
+    r->real_width = x->height;
+    // the counts of every block take at most the space of the entries of x
+    u_int64_t columns = r->height > 0 ? r->height : 1;
+    u_int64_t blocks = x->height * x->width / columns;
+    blocks = blocks < (u_int64_t) scheduler_threads() ? blocks : (u_int64_t) scheduler_threads();
+    blocks = blocks < x->height ? blocks : x->height;
+    blocks = blocks > 0 ? blocks : 1;
+    struct TransposeContext c = {x, blocks, calloc(x->height + 1, sizeof(u_int64_t)),
+                                 calloc(blocks * r->height + 1, sizeof(u_int64_t)), r};
+    u_int64_t *costs = calloc(blocks, sizeof(u_int64_t));
+    if (!c.x_lengths || !c.offsets || !costs) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t block = 0; block < blocks; block++) {
+        costs[block] = ((block + 1) * x->height / blocks - block * x->height / blocks) * x->width + 1;
+    }
+    schedule_rows(blocks, costs, 1, transpose_count_task, &c, "transpose count");
+
+    // the entries of a column are placed block after block, so every row of r is ordered like the rows of x
+    r->width = 0;
+    for (u_int64_t r_row_i = 0; r_row_i < r->height; r_row_i++) {
+        u_int64_t position = 0;
+        for (u_int64_t block = 0; block < blocks; block++) {
+            u_int64_t count = c.offsets[block * r->height + r_row_i];
+            c.offsets[block * r->height + r_row_i] = position;
+            position += count;
+        }
+        r->width = position > r->width ? position : r->width;
+    }
+    r->values = alloc_array(r->height * r->width * sizeof(float), 1);
+    r->indices = alloc_array(r->height * r->width * sizeof(u_int64_t), 1);
+    if (!r->values || !r->indices) {
+        free_ellpack(r);
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t block = 0; block < blocks; block++) {
+        costs[block] = 1;
+        for (u_int64_t x_row_i = block * x->height / blocks; x_row_i < (block + 1) * x->height / blocks; x_row_i++) {
+            costs[block] += c.x_lengths[x_row_i];
+        }
+    }
+    schedule_rows(blocks, costs, 1, transpose_task, &c, "transpose");
+    free(c.x_lengths);
+    free(c.offsets);
+    free(costs);
+    return r;
+}
+
+int compare_columns(const void *x, const void *y) {
+    u_int64_t p = *(const u_int64_t *) x;
+    u_int64_t q = *(const u_int64_t *) y;
+    return (p > q) - (p < q);
+}
+
+// touched columns spread over at most this many columns each are gathered by scanning their range instead of sorting
+#define SCAN_SPREAD 8
+
+struct RowAccumulator *make_row_accumulator(u_int64_t columns) {
+    struct RowAccumulator *x = calloc(1, sizeof(*x));
+    if (!x) {
+        error(1, 0, "Error: Not enough memory for the row accumulator");
+        return NULL;
+    }
+    x->columns = columns;
+    x->sums = calloc(columns > 0 ? columns : 1, sizeof(float));
+    x->marks = calloc(columns > 0 ? columns : 1, sizeof(u_int64_t));
+    x->touched = calloc(columns > 0 ? columns : 1, sizeof(u_int64_t));
+    if (!x->sums || !x->marks || !x->touched) {
+        error(1, 0, "Error: Not enough memory for the row accumulator");
+    }
+    return x;
+}
+
+void free_row_accumulator(struct RowAccumulator *x) {
+    if (x) {
+        free(x->sums);
+        free(x->marks);
+        free(x->touched);
+    }
+    free(x);
+}
+
+void start_row(struct RowAccumulator *x) {
+    x->stamp++;
+    x->count = 0;
+    x->first = x->columns;
+    x->last = 0;
+}
+
+void add_row(struct RowAccumulator *x, float factor, const float *values, const u_int64_t *indices, u_int64_t length) {
+    for (u_int64_t i = 0; i < length; i++) {
+        u_int64_t column = indices[i];
+        if (column >= x->columns) {
+            error(1, 0, "Error: Column %lu of Matrix B is outside of its width %lu", column, x->columns);
+        }
+        if (x->marks[column] != x->stamp) {
+            // the merge starts every sum at 0 as well
+            x->marks[column] = x->stamp;
+            x->sums[column] = 0.0F;
+            x->touched[x->count++] = column;
+            x->first = column < x->first ? column : x->first;
+            x->last = column > x->last ? column : x->last;
+        }
+        x->sums[column] += factor * values[i];
+    }
+}
+
+u_int64_t finish_row(struct RowAccumulator *x) {
+    // the columns in ascending order, only the non zero sums like the merge
+    u_int64_t length = 0;
+    if (x->count > 0 && x->last - x->first < x->count * SCAN_SPREAD) {
+        for (u_int64_t column = x->first; column <= x->last; column++) {
+            if (x->marks[column] == x->stamp && x->sums[column] != 0.0F) {
+                x->touched[length++] = column;
+            }
+        }
+    } else {
+        qsort(x->touched, x->count, sizeof(u_int64_t), compare_columns);
+        for (u_int64_t i = 0; i < x->count; i++) {
+            if (x->sums[x->touched[i]] != 0.0F) {
+                x->touched[length++] = x->touched[i];
+            }
+        }
+    }
+    x->count = length;
+    return length;
+}
+
+void emit_row(const struct RowAccumulator *x, float *values, u_int64_t *indices) {
+    for (u_int64_t i = 0; i < x->count; i++) {
+        values[i] = x->sums[x->touched[i]];
+        indices[i] = x->touched[i];
+    }
+}
+
 // From: https://stackoverflow.com/a/35270026
 // "Fastest way to do horizontal SSE vector sum (or other reduction)"
 float hsum_ps_sse1(__m128 v) {                                  // v = [ D C | B A ]
@@ -41,9 +41,55 @@ u_int64_t realwidth_ellpack(const struct EllpackMatrix *x);
 /** creates the representation matrices in the ellpack matrix from the arrays of rows */
 void flatten_ellpack(struct EllpackMatrix *x, float **values, u_int64_t **indices, u_int64_t *lengths);
 
+/** counts the used entries of a row, padding starts at the first zero value */
+u_int64_t rowlength_ellpack(const struct EllpackMatrix *x, u_int64_t row);
+
 /** creates and returns a the transpose of the matrix in ellpack format */
 struct EllpackMatrix *transpose_ellpack(const struct EllpackMatrix * x);
 
+/**
+ * same as transpose_ellpack, the rows of x are cut into one block per thread at most, the entries of every block are
+ * counted per column and placed behind the ones of the blocks before it by the work stealing scheduler
+ */
+struct EllpackMatrix *transpose_ellpack_parallel(const struct EllpackMatrix * x);
+
+/** orders u_int64_t column numbers ascending for qsort, also structs starting with their column number */
+int compare_columns(const void *x, const void *y);
+
+/**
+ * a dense row of sums of the width of b for the row by row product of a and b: every entry (k, a_ik) of a row of a
+ * adds a_ik times row k of b, the touched columns are collected so only they have to be visited when the row is
+ * written, the products are added in the order of k like the merge of matr_mult_ellpack
+ */
+struct RowAccumulator {
+    u_int64_t columns;
+    float *sums;
+    u_int64_t *marks; // the stamp of the row that last touched a column, so nothing has to be cleared between rows
+    u_int64_t *touched; // the columns touched by the current row, after finish_row the non zero ones in ascending order
+    u_int64_t count;
+    u_int64_t first;
+    u_int64_t last;
+    u_int64_t stamp;
+};
+
+/** creates an empty RowAccumulator for result rows with the given number of columns */
+struct RowAccumulator *make_row_accumulator(u_int64_t columns);
+
+/** deallocates a RowAccumulator */
+void free_row_accumulator(struct RowAccumulator *x);
+
+/** starts a new result row, the sums of the previous one are forgotten */
+void start_row(struct RowAccumulator *x);
+
+/** adds factor times the row of b given by its values, column indices and length to the current result row */
+void add_row(struct RowAccumulator *x, float factor, const float *values, const u_int64_t *indices, u_int64_t length);
+
+/** puts the columns with non zero sums of the current row in ascending order and returns their number */
+u_int64_t finish_row(struct RowAccumulator *x);
+
+/** writes the entries of the finished row into values and indices, which need room for the length finish_row returned */
+void emit_row(const struct RowAccumulator *x, float *values, u_int64_t *indices);
+
 /** adds the fours floats in a 128 bit register */
 float hsum_ps_sse1(__m128 v);
 
@@ -0,0 +1,210 @@
+#include "fixed_width.h"
+
+#include "multiplication.h"
+#include "scheduler.h"
+
+/** the row of a in MAX_FIXED_WIDTH slots, live has a bit for every used slot */
+struct FixedRow {
+    u_int64_t indices[MAX_FIXED_WIDTH];
+    float values[MAX_FIXED_WIDTH + 1]; // the slot after the last one stays 0 and is picked if no index matches
+    u_int32_t live;
+};
+
+typedef u_int64_t (*fixed_row_kernel)(const struct FixedRow *a, const struct EllpackMatrix *bx, const u_int64_t *b_lengths,
+                                      float *r_values, u_int64_t *r_indices);
+
+// the slots of a holding key, the trip count is a constant in every generated kernel, so the loop is unrolled
+static inline u_int32_t match_scalar(const u_int64_t *indices, int width, u_int64_t key) {
+    u_int32_t mask = 0;
+#pragma GCC unroll 16
+    for (int i = 0; i < width; i++) {
+        mask |= (u_int32_t) (indices[i] == key) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static inline u_int32_t match_avx2(const u_int64_t *indices, int width, u_int64_t key) {
+    __m256i keys = _mm256_set1_epi64x((long long) key);
+    u_int32_t mask = 0;
+    for (int i = 0; i < (width + 3) / 4; i++) {
+        __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (indices + 4 * i)), keys);
+        mask |= (u_int32_t) _mm256_movemask_pd(_mm256_castsi256_pd(equal)) << (4 * i);
+    }
+    return mask;
+}
+
+// one result row: every row of bx is merged with the row of a without a data dependent branch, the lowest live
+// matching slot or the zero slot after the last one gives the factor, so the products are added in the order of k
+// like in the merge of matr_mult_ellpack
+#define FIXED_ROW_KERNEL(NAME, W, MATCH, TARGET) \
+TARGET static u_int64_t NAME(const struct FixedRow *a, const struct EllpackMatrix *bx, const u_int64_t *b_lengths, \
+                             float *r_values, u_int64_t *r_indices) { \
+    u_int64_t count = 0; \
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height; b_row_i++) { \
+        const u_int64_t *b_row_indices = bx->indices + b_row_i * bx->width; \
+        const float *b_row_values = bx->values + b_row_i * bx->width; \
+        float res_sum = 0.0F; \
+        for (u_int64_t b_column_i = 0; b_column_i < b_lengths[b_row_i]; b_column_i++) { \
+            u_int32_t mask = (MATCH(a->indices, W, b_row_indices[b_column_i]) & a->live) | (1U << W); \
+            res_sum += a->values[__builtin_ctz(mask)] * b_row_values[b_column_i]; \
+        } \
+        if (res_sum != 0.0F) { \
+            r_values[count] = res_sum; \
+            r_indices[count] = b_row_i; \
+            count++; \
+        } \
+    } \
+    return count; \
+}
+
+#define FIXED_WIDTH_KERNELS(W) \
+FIXED_ROW_KERNEL(fixed_row_scalar_##W, W, match_scalar, ) \
+FIXED_ROW_KERNEL(fixed_row_avx2_##W, W, match_avx2, __attribute__((target("avx2"))))
+FIXED_WIDTH_KERNELS(1)
+FIXED_WIDTH_KERNELS(2)
+FIXED_WIDTH_KERNELS(3)
+FIXED_WIDTH_KERNELS(4)
+FIXED_WIDTH_KERNELS(5)
+FIXED_WIDTH_KERNELS(6)
+FIXED_WIDTH_KERNELS(7)
+FIXED_WIDTH_KERNELS(8)
+FIXED_WIDTH_KERNELS(9)
+FIXED_WIDTH_KERNELS(10)
+FIXED_WIDTH_KERNELS(11)
+FIXED_WIDTH_KERNELS(12)
+FIXED_WIDTH_KERNELS(13)
+FIXED_WIDTH_KERNELS(14)
+FIXED_WIDTH_KERNELS(15)
+FIXED_WIDTH_KERNELS(16)
+
+#define FIXED_KERNEL_ROW(ISA) { \
+        fixed_row_##ISA##_1, fixed_row_##ISA##_2, fixed_row_##ISA##_3, fixed_row_##ISA##_4, \
+        fixed_row_##ISA##_5, fixed_row_##ISA##_6, fixed_row_##ISA##_7, fixed_row_##ISA##_8, \
+        fixed_row_##ISA##_9, fixed_row_##ISA##_10, fixed_row_##ISA##_11, fixed_row_##ISA##_12, \
+        fixed_row_##ISA##_13, fixed_row_##ISA##_14, fixed_row_##ISA##_15, fixed_row_##ISA##_16}
+
+// indexed by [simd][width - 1]
+static const fixed_row_kernel FIXED_KERNELS[2][MAX_FIXED_WIDTH] = {FIXED_KERNEL_ROW(scalar), FIXED_KERNEL_ROW(avx2)};
+
+struct FixedContext {
+    const struct EllpackMatrix *ax;
+    const struct EllpackMatrix *bx;
+    const u_int64_t *b_lengths;
+    fixed_row_kernel kernel;
+    float **scratch_values; // one upper limit size row per thread
+    u_int64_t **scratch_indices;
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+};
+
+static void fixed_task(void *context, const struct RowTask *task, int thread) {
+    struct FixedContext *c = context;
+    const struct EllpackMatrix *ax = c->ax;
+    float *r_row_values = c->scratch_values[thread];
+    u_int64_t *r_row_indices = c->scratch_indices[thread];
+    struct FixedRow row = {{0}, {0}, 0};
+    for (u_int64_t r_row_i = task->begin; r_row_i < task->end; r_row_i++) {
+        u_int64_t length = rowlength_ellpack(ax, r_row_i);
+        memcpy(row.indices, ax->indices + r_row_i * ax->width, length * sizeof(u_int64_t));
+        memcpy(row.values, ax->values + r_row_i * ax->width, length * sizeof(float));
+        memset(row.values + length, 0, (MAX_FIXED_WIDTH + 1 - length) * sizeof(float));
+        row.live = (u_int32_t) ((1ULL << length) - 1);
+        u_int64_t r_column_counter = c->kernel(&row, c->bx, c->b_lengths, r_row_values, r_row_indices);
+        c->r_values[r_row_i] = malloc(sizeof(float) * r_column_counter);
+        c->r_indices[r_row_i] = malloc(sizeof(u_int64_t) * r_column_counter);
+        if ((!c->r_values[r_row_i] || !c->r_indices[r_row_i]) && r_column_counter > 0) {
+            error(1, 0, "Error: Not enough memory for result row %lu", r_row_i);
+        }
+        memcpy(c->r_values[r_row_i], r_row_values, sizeof(float) * r_column_counter);
+        memcpy(c->r_indices[r_row_i], r_row_indices, sizeof(u_int64_t) * r_column_counter);
+        c->r_row_lengths[r_row_i] = r_column_counter;
+    }
+}
+
+u_int64_t fixed_width_kernel(const struct EllpackMatrix *a) {
+    return a->width >= 1 && a->width <= MAX_FIXED_WIDTH ? a->width : 0;
+}
+
+void matr_mult_ellpack_fixed(const void* a, const void* b, void* result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    u_int64_t width = fixed_width_kernel(a);
+    if (width == 0) {
+        matr_mult_ellpack_parallel(a, b, result);
+        return;
+    }
+    __builtin_cpu_init();
+    matr_mult_ellpack_fixed_width(a, b, width, __builtin_cpu_supports("avx2"), result);
+}
+
+void matr_mult_ellpack_fixed_width(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t width, int simd,
+                                   struct EllpackMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    if (width < 1 || width > MAX_FIXED_WIDTH || a->width > width) {
+        error(1, 0, "Error: There is no kernel of width %lu for a matrix of width %lu", width, a->width);
+    }
+    struct EllpackMatrix *bx = transpose_ellpack_parallel(b);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+        return;
+    }
+    u_int64_t height = a->height;
+    int threads = scheduler_threads();
+    struct FixedContext c = {a, bx, NULL, FIXED_KERNELS[simd ? 1 : 0][width - 1], NULL, NULL, NULL, NULL, NULL};
+    u_int64_t *b_lengths = calloc(bx->height + 1, sizeof(u_int64_t));
+    u_int64_t *costs = calloc(height, sizeof(u_int64_t));
+    c.scratch_values = calloc(threads, sizeof(float *));
+    c.scratch_indices = calloc(threads, sizeof(u_int64_t *));
+    c.r_values = calloc(height, sizeof(float *));
+    c.r_indices = calloc(height, sizeof(u_int64_t *));
+    c.r_row_lengths = calloc(height, sizeof(u_int64_t));
+    if (!b_lengths || !c.scratch_values || !c.scratch_indices
+        || ((!costs || !c.r_values || !c.r_indices || !c.r_row_lengths) && height > 0)) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (int i = 0; i < threads; i++) {
+        c.scratch_values[i] = calloc(bx->height + 1, sizeof(float));
+        c.scratch_indices[i] = calloc(bx->height + 1, sizeof(u_int64_t));
+        if (!c.scratch_values[i] || !c.scratch_indices[i]) {
+            error(1, 0, "Error: Not enough memory for the multiplication");
+        }
+    }
+    u_int64_t b_nnz = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(bx, b_row_i);
+        b_nnz += b_lengths[b_row_i];
+    }
+    // every row costs the same, one compare per entry of b
+    for (u_int64_t a_row_i = 0; a_row_i < height; a_row_i++) {
+        costs[a_row_i] = bx->height + b_nnz;
+    }
+    c.b_lengths = b_lengths;
+    schedule_rows(height, costs, 1, fixed_task, &c, "fixed width multiply");
+
+    u_int64_t max_width = 0;
+    for (u_int64_t r_row_i = 0; r_row_i < height; r_row_i++) {
+        if (c.r_row_lengths[r_row_i] > max_width) {
+            max_width = c.r_row_lengths[r_row_i];
+        }
+    }
+    result->height = height;
+    result->width = max_width;
+    flatten_ellpack(result, c.r_values, c.r_indices, c.r_row_lengths);
+    result->real_width = b->real_width;
+    for (int i = 0; i < threads; i++) {
+        free(c.scratch_values[i]);
+        free(c.scratch_indices[i]);
+    }
+    free(c.scratch_values);
+    free(c.scratch_indices);
+    free(b_lengths);
+    free(costs);
+    free_ellpack(bx);
+}
@@ -0,0 +1,23 @@
+#ifndef PROJEKTAUFGABE_FIXED_WIDTH_H
+#define PROJEKTAUFGABE_FIXED_WIDTH_H
+
+#include "ellpack_utility.h"
+
+/** widths of A with a kernel of their own */
+#define MAX_FIXED_WIDTH 16
+
+/** the width whose kernel matr_mult_ellpack_fixed runs for a, 0 if it falls back to matr_mult_ellpack_parallel */
+u_int64_t fixed_width_kernel(const struct EllpackMatrix *a);
+
+/**
+ * a * b with merges generated for every width of a from 1 to MAX_FIXED_WIDTH: the index of each entry of a row of bx
+ * is compared with all slots of the row of a at once (AVX2 or unrolled scalar compares) and the matching value of a
+ * is picked without a branch, other widths run matr_mult_ellpack_parallel, the result is the same as matr_mult_ellpack
+ */
+void matr_mult_ellpack_fixed(const void* a, const void* b, void* result);
+
+/** the same with the kernel of the given width, which has to be at least the width of a, simd = 0 runs the scalar one */
+void matr_mult_ellpack_fixed_width(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t width, int simd,
+                                   struct EllpackMatrix *result);
+
+#endif //PROJEKTAUFGABE_FIXED_WIDTH_H
@@ -0,0 +1,397 @@
+#include "half_precision.h"
+#include "memory.h"
+#include "parser.h"
+
+#include <immintrin.h>
+
+static u_int32_t float_bits(float value) {
+    u_int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(u_int32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// rounds away the lowest shift bits of m to nearest even
+static u_int32_t round_shift(u_int32_t m, u_int32_t shift) {
+    if (shift >= 32) {
+        return 0;
+    }
+    u_int32_t result = m >> shift;
+    u_int32_t rest = m & ((1U << shift) - 1);
+    u_int32_t half = 1U << (shift - 1);
+    if (rest > half || (rest == half && (result & 1))) {
+        result++;
+    }
+    return result;
+}
+
+u_int16_t float_to_half(float value, enum HalfFormat format) {
+    u_int32_t x = float_bits(value);
+    u_int32_t abs = x & 0x7fffffffU;
+    if (format == BF16) {
+        u_int16_t sign = (u_int16_t) ((x >> 16) & 0x8000);
+        if (abs > 0x7f800000U) {
+            return (u_int16_t) ((x >> 16) | 0x40); // keep nan quiet
+        }
+        if (abs == 0x7f800000U) {
+            return (u_int16_t) (x >> 16);
+        }
+        u_int32_t rounded = (abs + 0x7fffU + ((abs >> 16) & 1)) >> 16;
+        if (rounded >= 0x7f80) {
+            return sign | 0x7f7f; // saturate to the largest finite value
+        }
+        if (rounded == 0 && abs != 0) {
+            return sign | 1; // 0 would turn the entry into padding
+        }
+        return sign | (u_int16_t) rounded;
+    }
+    u_int16_t sign = (u_int16_t) ((x >> 16) & 0x8000);
+    if (abs > 0x7f800000U) {
+        return sign | 0x7e00;
+    }
+    if (abs == 0x7f800000U) {
+        return sign | 0x7c00;
+    }
+    if (abs >= 0x477ff000U) { // 65520 and above would round to infinity
+        return sign | 0x7bff;
+    }
+    if (abs == 0) {
+        return sign;
+    }
+    if (abs < 0x38800000U) { // below 2^-14 the result is subnormal, in units of 2^-24
+        u_int32_t mantissa = (abs & 0x7fffffU) | 0x800000U;
+        int exponent = (int) (abs >> 23) - 127;
+        u_int32_t result = round_shift(mantissa, (u_int32_t) (-(exponent + 1)));
+        return sign | (u_int16_t) (result ? result : 1);
+    }
+    u_int32_t result = round_shift(abs, 13) - ((127 - 15) << 10);
+    return sign | (u_int16_t) result;
+}
+
+float half_to_float(u_int16_t value, enum HalfFormat format) {
+    if (format == BF16) {
+        return bits_float((u_int32_t) value << 16);
+    }
+    u_int32_t sign = (u_int32_t) (value & 0x8000) << 16;
+    u_int32_t exponent = (value >> 10) & 0x1f;
+    u_int32_t mantissa = value & 0x3ff;
+    if (exponent == 0) {
+        float subnormal = (float) mantissa * 5.9604644775390625e-8F; // 2^-24
+        return sign ? -subnormal : subnormal;
+    }
+    if (exponent == 31) {
+        return bits_float(sign | 0x7f800000U | (mantissa << 13));
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+struct EllpackMatrixHalf *make_ellpack_half(u_int64_t real_width, u_int64_t height, u_int64_t width, enum HalfFormat format, char* file) {
+    struct EllpackMatrixHalf* ellpack = malloc(sizeof(struct EllpackMatrixHalf));
+    if (!ellpack) {
+        error(1, 0, "Error: Not enough memory to load matrix %s", file);
+    }
+    ellpack->real_width = real_width;
+    ellpack->width = width;
+    ellpack->height = height;
+    ellpack->format = format;
+    ellpack->values = alloc_array(width * height * sizeof(u_int16_t), 1);
+    ellpack->indices = alloc_array(width * height * sizeof(u_int64_t), 1);
+    if((!ellpack->values || !ellpack->indices) && width * height > 0) {
+        error(1, 0, "Error: Not enough memory to load matrix %s", file);
+    }
+    return ellpack;
+}
+
+void free_ellpack_half(struct EllpackMatrixHalf *x) {
+    free(x->values);
+    free(x->indices);
+    free(x);
+}
+
+int valid_ellpack_half(const struct EllpackMatrixHalf *x) {
+    return x && (x->width * x->height == 0 || (x->values && x->indices));
+}
+
+// padding is stored as +0 or -0
+static u_int64_t rowlength_half(const struct EllpackMatrixHalf *x, u_int64_t row) {
+    u_int64_t length = 0;
+    while (length < x->width && (x->values[row * x->width + length] & 0x7fff) != 0) {
+        length++;
+    }
+    return length;
+}
+
+struct EllpackMatrixHalf *half_from_ellpack(const struct EllpackMatrix *x, enum HalfFormat format) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    struct EllpackMatrixHalf *r = make_ellpack_half(x->real_width, x->height, x->width, format, "");
+    for (u_int64_t i = 0; i < x->height * x->width; i++) {
+        r->values[i] = float_to_half(x->values[i], format);
+    }
+    memcpy(r->indices, x->indices, x->height * x->width * sizeof(u_int64_t));
+    return r;
+}
+
+struct EllpackMatrix *ellpack_from_half(const struct EllpackMatrixHalf *x) {
+    if (!valid_ellpack_half(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    struct EllpackMatrix *r = make_ellpack(x->real_width, x->height, x->width, "");
+    for (u_int64_t i = 0; i < x->height * x->width; i++) {
+        r->values[i] = half_to_float(x->values[i], x->format);
+    }
+    memcpy(r->indices, x->indices, x->height * x->width * sizeof(u_int64_t));
+    return r;
+}
+
+struct EllpackMatrixHalf *transpose_ellpack_half(const struct EllpackMatrixHalf *x) {
+    if (!valid_ellpack_half(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    // count the entries of each column first, then fill the rows of r in the order of the rows of x
+    u_int64_t *x_lengths = calloc(x->height, sizeof(u_int64_t));
+    u_int64_t *counts = calloc(x->real_width, sizeof(u_int64_t));
+    if (!x_lengths || !counts) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t height = 0;
+    u_int64_t max_width = 0;
+    for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {
+        x_lengths[x_row_i] = rowlength_half(x, x_row_i);
+        for (u_int64_t x_col_i = 0; x_col_i < x_lengths[x_row_i]; x_col_i++) {
+            u_int64_t column = x->indices[x_row_i * x->width + x_col_i];
+            if (column >= x->real_width) {
+                continue;
+            }
+            if (++counts[column] > max_width) {
+                max_width = counts[column];
+            }
+            if (column + 1 > height) {
+                height = column + 1;
+            }
+        }
+    }
+    struct EllpackMatrixHalf *r = make_ellpack_half(x->height, height, max_width, x->format, "");
+    memset(counts, 0, x->real_width * sizeof(u_int64_t));
+    for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {
+        for (u_int64_t x_col_i = 0; x_col_i < x_lengths[x_row_i]; x_col_i++) {
+            u_int64_t column = x->indices[x_row_i * x->width + x_col_i];
+            if (column >= x->real_width) {
+                continue;
+            }
+            u_int64_t position = column * r->width + counts[column]++;
+            r->values[position] = x->values[x_row_i * x->width + x_col_i];
+            r->indices[position] = x_row_i;
+        }
+    }
+    free(x_lengths);
+    free(counts);
+    return r;
+}
+
+struct EllpackMatrixHalf *parse_matrix_half(char *matrix_path, enum HalfFormat format) {
+    u_int32_t value_type = BINARY_F32;
+    if (is_binary_matrix(matrix_path)) {
+        FILE *matrix_file = fopen(matrix_path, "r");
+        struct BinaryHeader header;
+        read_binary_header(matrix_file, &header, matrix_path);
+        value_type = header.value_type & ~BINARY_COMPRESSED_INDICES;
+        if (value_type == (format == FP16 ? BINARY_F16 : BINARY_BF16)) {
+            // stored in the requested format, read without conversion
+            printf("[INIT] Reading binary matrix %s [%lu (formerly %lu) x %lu]\n", matrix_path, header.width, header.real_width, header.height);
+            struct EllpackMatrixHalf *matrix = make_ellpack_half(header.real_width, header.height, header.width, format, matrix_path);
+            u_int64_t entries = header.height * header.width;
+            if (fread(matrix->values, sizeof(u_int16_t), entries, matrix_file) != entries
+                || !read_binary_indices(matrix_file, &header, matrix->values, sizeof(u_int16_t), matrix->indices, matrix_path)) {
+                free_ellpack_half(matrix);
+                error(1, 0, "Error while parsing binary matrix %s: File is truncated", matrix_path);
+            }
+            fclose(matrix_file);
+            return matrix;
+        }
+        fclose(matrix_file);
+    }
+    struct EllpackMatrix *full = parse_matrix(matrix_path);
+    printf("[INIT] Converting matrix %s to %s\n", matrix_path, format == FP16 ? "fp16" : "bf16");
+    struct EllpackMatrixHalf *matrix = half_from_ellpack(full, format);
+    free_ellpack(full);
+    return matrix;
+}
+
+void write_matrix_half_binary(struct EllpackMatrixHalf *matrix, char *out_path) {
+    FILE *out_file = fopen(out_path, "w");
+    if(!out_file) {
+        free_ellpack_half(matrix);
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    u_int64_t entries = matrix->height * matrix->width;
+    write_binary_header(out_file, matrix->format == FP16 ? BINARY_F16 : BINARY_BF16, matrix->real_width, matrix->height, matrix->width, out_path);
+    fwrite(matrix->values, sizeof(u_int16_t), entries, out_file);
+    fwrite(matrix->indices, sizeof(u_int64_t), entries, out_file);
+    if (ferror(out_file)) {
+        fclose(out_file);
+        free_ellpack_half(matrix);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+    fclose(out_file);
+}
+
+typedef float (*half_dot_fn)(const u_int16_t *a_values, const u_int64_t *a_indices, u_int64_t a_length,
+                             const u_int16_t *b_values, const u_int64_t *b_indices, u_int64_t b_length, enum HalfFormat format);
+
+// merges two sorted rows, the 16 bit values of equal indices are collected and every full batch of LANES is handed to FLUSH
+#define HALF_MERGE(LANES, FLUSH) \
+    u_int16_t a_temp[LANES]; \
+    u_int16_t b_temp[LANES]; \
+    int cnt_vals = 0; \
+    u_int64_t a_column_i = 0; \
+    u_int64_t b_column_i = 0; \
+    while (a_column_i < a_length && b_column_i < b_length) { \
+        if (a_indices[a_column_i] == b_indices[b_column_i]) { \
+            a_temp[cnt_vals] = a_values[a_column_i++]; \
+            b_temp[cnt_vals] = b_values[b_column_i++]; \
+            if (++cnt_vals == (LANES)) { \
+                FLUSH; \
+                cnt_vals = 0; \
+            } \
+        } else if (a_indices[a_column_i] > b_indices[b_column_i]) { \
+            b_column_i++; \
+        } else { \
+            a_column_i++; \
+        } \
+    }
+
+static float half_dot_scalar(const u_int16_t *a_values, const u_int64_t *a_indices, u_int64_t a_length,
+                             const u_int16_t *b_values, const u_int64_t *b_indices, u_int64_t b_length, enum HalfFormat format) {
+    float res_sum = 0.0F;
+    HALF_MERGE(1, res_sum += half_to_float(a_temp[0], format) * half_to_float(b_temp[0], format))
+    return res_sum;
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 widen_half8(const u_int16_t *values, enum HalfFormat format) {
+    __m128i raw = _mm_loadu_si128((const __m128i *) values);
+    if (format == FP16) {
+        return _mm256_cvtph_ps(raw);
+    }
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float half_dot_avx2(const u_int16_t *a_values, const u_int64_t *a_indices, u_int64_t a_length,
+                           const u_int16_t *b_values, const u_int64_t *b_indices, u_int64_t b_length, enum HalfFormat format) {
+    __m256 res_vec = _mm256_setzero_ps();
+    HALF_MERGE(8, res_vec = _mm256_fmadd_ps(widen_half8(a_temp, format), widen_half8(b_temp, format), res_vec))
+    __m128 halves = _mm_add_ps(_mm256_castps256_ps128(res_vec), _mm256_extractf128_ps(res_vec, 1));
+    float res_sum = hsum_ps_sse1(halves);
+    for (int i = 0; i < cnt_vals; i++) {
+        res_sum += half_to_float(a_temp[i], format) * half_to_float(b_temp[i], format);
+    }
+    return res_sum;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 widen_half16(const u_int16_t *values, enum HalfFormat format) {
+    __m256i raw = _mm256_loadu_si256((const __m256i *) values);
+    if (format == FP16) {
+        return _mm512_cvtph_ps(raw);
+    }
+    return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(raw), 16));
+}
+
+__attribute__((target("avx512f")))
+static float half_dot_avx512(const u_int16_t *a_values, const u_int64_t *a_indices, u_int64_t a_length,
+                             const u_int16_t *b_values, const u_int64_t *b_indices, u_int64_t b_length, enum HalfFormat format) {
+    __m512 res_vec = _mm512_setzero_ps();
+    HALF_MERGE(16, res_vec = _mm512_fmadd_ps(widen_half16(a_temp, format), widen_half16(b_temp, format), res_vec))
+    float res_sum = _mm512_reduce_add_ps(res_vec);
+    for (int i = 0; i < cnt_vals; i++) {
+        res_sum += half_to_float(a_temp[i], format) * half_to_float(b_temp[i], format);
+    }
+    return res_sum;
+}
+
+static half_dot_fn select_half_dot(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return half_dot_avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+        return half_dot_avx2;
+    }
+    return half_dot_scalar;
+}
+
+void matr_mult_ellpack_half(const void* a, const void* b, void* result) {
+    struct EllpackMatrix *r = (struct EllpackMatrix *) result;
+    if (!valid_ellpack_half(a) || !valid_ellpack_half(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    struct EllpackMatrixHalf *ax = (struct EllpackMatrixHalf *) a;
+    if (ax->format != ((struct EllpackMatrixHalf *) b)->format) {
+        error(1, 0, "the argument matrices have different value formats");
+        return;
+    }
+    struct EllpackMatrixHalf *bx = transpose_ellpack_half((struct EllpackMatrixHalf *) b);
+    half_dot_fn dot = select_half_dot();
+    r->height = ax->height;
+    // arrays of result rows
+    float **r_values = calloc(r->height, sizeof(float *));
+    u_int64_t **r_indices = calloc(r->height, sizeof(u_int64_t *));
+    u_int64_t *r_row_lengths = calloc(ax->height, sizeof(u_int64_t));
+    u_int64_t *b_lengths = calloc(bx->height, sizeof(u_int64_t));
+    u_int64_t max_width = 0;
+    // array of upper limit size for each result row
+    float *r_row_values = calloc(bx->height, sizeof(float));
+    u_int64_t *r_row_indices = calloc(bx->height, sizeof(u_int64_t));
+    if (!r_values || !r_indices || !r_row_lengths || !b_lengths || !r_row_indices || !r_row_values) {
+        r->height = 0; // skip all loops and go to cleanup
+    }
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height && r->height > 0; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_half(bx, b_row_i);
+    }
+    for (u_int64_t r_row_i = 0; r_row_i < r->height; r_row_i++) {
+        u_int64_t a_length = rowlength_half(ax, r_row_i);
+        u_int64_t r_column_counter = 0;
+        for (u_int64_t b_row_i = 0; b_row_i < bx->height && a_length > 0; b_row_i++) {
+            float res_sum = dot(ax->values + r_row_i * ax->width, ax->indices + r_row_i * ax->width, a_length,
+                                bx->values + b_row_i * bx->width, bx->indices + b_row_i * bx->width, b_lengths[b_row_i], ax->format);
+            // only add the result entry if it s not zero
+            if (res_sum != 0.0) {
+                r_row_values[r_column_counter] = res_sum;
+                r_row_indices[r_column_counter] = b_row_i;
+                r_column_counter++;
+            }
+        }
+        if (r_column_counter > max_width) {
+            max_width = r_column_counter;
+        }
+        // store the resulting row with its length
+        r_values[r_row_i] = calloc(r_column_counter, sizeof(float));
+        r_indices[r_row_i] = calloc(r_column_counter, sizeof(u_int64_t));
+        if (!r_values[r_row_i] || !r_indices[r_row_i]) {
+            r->height = r_row_i + 1; // only clean up to this row in the flatten method
+            break;
+        }
+        memcpy(r_values[r_row_i], r_row_values, sizeof(float) * r_column_counter);
+        memcpy(r_indices[r_row_i], r_row_indices, sizeof(u_int64_t) * r_column_counter);
+        r_row_lengths[r_row_i] = r_column_counter;
+    }
+    r->width = max_width;
+    flatten_ellpack(r, r_values, r_indices, r_row_lengths);
+    free(r_row_values);
+    free(r_row_indices);
+    free(b_lengths);
+    free_ellpack_half(bx);
+    r->real_width = ((struct EllpackMatrixHalf *) b)->real_width;
+}
@@ -0,0 +1,47 @@
+#ifndef PROJEKTAUFGABE_HALF_PRECISION_H
+#define PROJEKTAUFGABE_HALF_PRECISION_H
+
+#include "ellpack_utility.h"
+
+/** 16 bit value formats, IEEE half precision and bfloat16 (the upper half of a float) */
+enum HalfFormat {
+    FP16, BF16
+};
+
+/** an EllpackMatrix storing its values in 16 bits, the indices are unchanged */
+struct EllpackMatrixHalf {
+    u_int64_t real_width;
+    u_int64_t height;
+    u_int64_t width;
+    enum HalfFormat format;
+    u_int16_t *values;
+    u_int64_t *indices;
+};
+
+/** rounds to nearest even, values out of range saturate and non zero values never become 0 (the padding) */
+u_int16_t float_to_half(float value, enum HalfFormat format);
+float half_to_float(u_int16_t value, enum HalfFormat format);
+
+struct EllpackMatrixHalf *make_ellpack_half(u_int64_t real_width, u_int64_t height, u_int64_t width, enum HalfFormat format, char* file);
+void free_ellpack_half(struct EllpackMatrixHalf *x);
+int valid_ellpack_half(const struct EllpackMatrixHalf *x);
+
+/** converts the values of x to the given 16 bit format */
+struct EllpackMatrixHalf *half_from_ellpack(const struct EllpackMatrix *x, enum HalfFormat format);
+/** widens the values of x back to float */
+struct EllpackMatrix *ellpack_from_half(const struct EllpackMatrixHalf *x);
+
+/** creates and returns the transpose of the matrix, values are copied without conversion */
+struct EllpackMatrixHalf *transpose_ellpack_half(const struct EllpackMatrixHalf *x);
+
+/** parses a text or binary matrix into the given format */
+struct EllpackMatrixHalf *parse_matrix_half(char *matrix_path, enum HalfFormat format);
+void write_matrix_half_binary(struct EllpackMatrixHalf *matrix, char *out_path);
+
+/**
+ * a and b are EllpackMatrixHalf of the same format, result is a float EllpackMatrix,
+ * values are widened with F16C / AVX-512 and accumulated in float
+ */
+void matr_mult_ellpack_half(const void* a, const void* b, void* result);
+
+#endif //PROJEKTAUFGABE_HALF_PRECISION_H
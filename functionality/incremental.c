@@ -0,0 +1,151 @@
+#include "incremental.h"
+
+// moves the rows of x to a larger width, the new slots are padding
+static void grow_width(struct EllpackMatrix *x, u_int64_t width) {
+    float *values = calloc(x->height * width, sizeof(float));
+    u_int64_t *indices = calloc(x->height * width, sizeof(u_int64_t));
+    if ((!values || !indices) && x->height * width > 0) {
+        error(1, 0, "Error: Not enough memory to grow the matrix to width %lu", width);
+    }
+    for (u_int64_t row = 0; row < x->height; row++) {
+        memcpy(values + row * width, x->values + row * x->width, x->width * sizeof(float));
+        memcpy(indices + row * width, x->indices + row * x->width, x->width * sizeof(u_int64_t));
+    }
+    free(x->values);
+    free(x->indices);
+    x->values = values;
+    x->indices = indices;
+    x->width = width;
+}
+
+// writes a row that fits into the width of x and pads the rest of it
+static void set_row(struct EllpackMatrix *x, u_int64_t row, const float *values, const u_int64_t *indices, u_int64_t length) {
+    memcpy(x->values + row * x->width, values, length * sizeof(float));
+    memcpy(x->indices + row * x->width, indices, length * sizeof(u_int64_t));
+    memset(x->values + row * x->width + length, 0, (x->width - length) * sizeof(float));
+    memset(x->indices + row * x->width + length, 0, (x->width - length) * sizeof(u_int64_t));
+}
+
+void apply_row_delta(struct EllpackMatrix *x, const struct RowDelta *delta) {
+    if (!valid_ellpack(x) || !valid_ellpack(delta->changes) || delta->changes->height < delta->count) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    const struct EllpackMatrix *changes = delta->changes;
+    u_int64_t max_length = 0;
+    for (u_int64_t i = 0; i < delta->count; i++) {
+        if (delta->rows[i] >= x->height) {
+            error(1, 0, "Error: Changed row %lu is outside of the matrix with height %lu", delta->rows[i], x->height);
+        }
+        u_int64_t length = rowlength_ellpack(changes, i);
+        if (length > max_length) {
+            max_length = length;
+        }
+    }
+    if (max_length > x->width) {
+        grow_width(x, max_length);
+    }
+    for (u_int64_t i = 0; i < delta->count; i++) {
+        u_int64_t length = rowlength_ellpack(changes, i);
+        set_row(x, delta->rows[i], changes->values + i * changes->width, changes->indices + i * changes->width, length);
+        if (length > 0 && changes->indices[i * changes->width + length - 1] + 1 > x->real_width) {
+            x->real_width = changes->indices[i * changes->width + length - 1] + 1;
+        }
+    }
+}
+
+u_int64_t matr_mult_ellpack_update(struct EllpackMatrix *a, struct EllpackMatrix *b,
+                                   const struct RowDelta *a_delta, const struct RowDelta *b_delta, struct EllpackMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b) || !valid_ellpack(result) || result->height != a->height) {
+        error(1, 0, "an argument matrix has wrong format");
+        return 0;
+    }
+    if (a_delta) {
+        apply_row_delta(a, a_delta);
+    }
+    if (b_delta) {
+        apply_row_delta(b, b_delta);
+    }
+    // result rows of changed a rows and of a rows referencing a changed b row
+    char *affected = calloc(a->height, 1);
+    char *changed_b = calloc(b->height, 1);
+    if (!affected || !changed_b) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t i = 0; a_delta && i < a_delta->count; i++) {
+        affected[a_delta->rows[i]] = 1;
+    }
+    for (u_int64_t i = 0; b_delta && i < b_delta->count; i++) {
+        changed_b[b_delta->rows[i]] = 1;
+    }
+    u_int64_t *rows = malloc(a->height * sizeof(u_int64_t));
+    if (!rows) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t count = 0;
+    for (u_int64_t a_row_i = 0; a_row_i < a->height; a_row_i++) {
+        u_int64_t a_length = rowlength_ellpack(a, a_row_i);
+        for (u_int64_t i = 0; b_delta && i < a_length && !affected[a_row_i]; i++) {
+            u_int64_t index = a->indices[a_row_i * a->width + i];
+            affected[a_row_i] = index < b->height && changed_b[index];
+        }
+        if (affected[a_row_i]) {
+            rows[count++] = a_row_i;
+        }
+    }
+
+    // the affected rows are summed row by row of b into a dense row, no transpose of b is needed,
+    // every entry adds its products in the order of k like the merge of matr_mult_ellpack
+    struct RowAccumulator *accumulator = make_row_accumulator(b->real_width);
+    u_int64_t *offsets = malloc((count + 1) * sizeof(u_int64_t));
+    float *new_values = NULL;
+    u_int64_t *new_indices = NULL;
+    u_int64_t capacity = 0;
+    if (!offsets) {
+        error(1, 0, "an allocation has failed");
+    }
+    offsets[0] = 0;
+    u_int64_t max_length = 0;
+    for (u_int64_t i = 0; i < count; i++) {
+        u_int64_t a_row_i = rows[i];
+        u_int64_t a_length = rowlength_ellpack(a, a_row_i);
+        start_row(accumulator);
+        for (u_int64_t a_col_i = 0; a_col_i < a_length; a_col_i++) {
+            u_int64_t b_row_i = a->indices[a_row_i * a->width + a_col_i];
+            if (b_row_i < b->height) {
+                add_row(accumulator, a->values[a_row_i * a->width + a_col_i], b->values + b_row_i * b->width,
+                        b->indices + b_row_i * b->width, rowlength_ellpack(b, b_row_i));
+            }
+        }
+        u_int64_t length = finish_row(accumulator);
+        if (offsets[i] + length > capacity) {
+            capacity = capacity * 2 > offsets[i] + length ? capacity * 2 : offsets[i] + length;
+            new_values = realloc(new_values, capacity * sizeof(float));
+            new_indices = realloc(new_indices, capacity * sizeof(u_int64_t));
+            if (!new_values || !new_indices) {
+                error(1, 0, "an allocation has failed");
+            }
+        }
+        emit_row(accumulator, new_values + offsets[i], new_indices + offsets[i]);
+        offsets[i + 1] = offsets[i] + length;
+        if (length > max_length) {
+            max_length = length;
+        }
+    }
+
+    if (max_length > result->width) {
+        grow_width(result, max_length);
+    }
+    for (u_int64_t i = 0; i < count; i++) {
+        set_row(result, rows[i], new_values + offsets[i], new_indices + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    result->real_width = b->real_width;
+    free(affected);
+    free(changed_b);
+    free(rows);
+    free_row_accumulator(accumulator);
+    free(offsets);
+    free(new_values);
+    free(new_indices);
+    return count;
+}
@@ -0,0 +1,25 @@
+#ifndef PROJEKTAUFGABE_INCREMENTAL_H
+#define PROJEKTAUFGABE_INCREMENTAL_H
+
+#include "ellpack_utility.h"
+
+/** new contents of some rows of a matrix, row rows[i] is replaced by row i of changes */
+struct RowDelta {
+    u_int64_t count;
+    const u_int64_t *rows;
+    const struct EllpackMatrix *changes;
+};
+
+/** replaces the rows of x, rows longer than the width of x let it grow, the real width covers the new columns */
+void apply_row_delta(struct EllpackMatrix *x, const struct RowDelta *delta);
+
+/**
+ * applies the deltas to a and b (each may be NULL) and recomputes only the rows of the previous result a * b
+ * that change: the changed rows of a and every row of a referencing a changed row of b,
+ * the rows are patched in place and result grows if a new row does not fit into its width,
+ * returns the number of recomputed rows
+ */
+u_int64_t matr_mult_ellpack_update(struct EllpackMatrix *a, struct EllpackMatrix *b,
+                                   const struct RowDelta *a_delta, const struct RowDelta *b_delta, struct EllpackMatrix *result);
+
+#endif //PROJEKTAUFGABE_INCREMENTAL_H
@@ -0,0 +1,253 @@
+#include "memory.h"
+
+#include <error.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+// explicit huge page mappings alive at once, arrays beyond them get transparent huge pages
+#define MAX_MAPPINGS 1024
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void __real_free(void *pointer);
+int __real_posix_memalign(void **pointer, size_t alignment, size_t size);
+
+// signed, a block allocated inside the c library and freed by the program is subtracted without being added
+static _Atomic int64_t current_bytes = 0;
+static _Atomic int64_t peak_bytes = 0;
+static _Atomic int64_t phase_peak_bytes = 0;
+static u_int64_t limit_bytes = 0;
+static const char *phase_name = NULL;
+
+static enum PagePolicy page_policy = PAGES_TRANSPARENT;
+static const char *PAGE_POLICY_NAMES[] = {"small", "transparent", "explicit"};
+static atomic_flag explicit_failed = ATOMIC_FLAG_INIT;
+
+// the MAP_HUGETLB arrays, free and realloc look them up before handing a block to the c library
+struct Mapping {
+    void *address;
+    size_t bytes;
+};
+static struct Mapping mappings[MAX_MAPPINGS];
+static _Atomic int mapping_count = 0;
+static pthread_mutex_t mapping_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void raise_to(_Atomic int64_t *peak, int64_t bytes) {
+    int64_t seen = atomic_load(peak);
+    while (bytes > seen && !atomic_compare_exchange_weak(peak, &seen, bytes));
+}
+
+static void account(int64_t bytes) {
+    int64_t now = atomic_fetch_add(&current_bytes, bytes) + bytes;
+    if (bytes > 0) {
+        raise_to(&peak_bytes, now);
+        raise_to(&phase_peak_bytes, now);
+    }
+}
+
+// fails before the allocation instead of letting the kernel kill the process later
+static void check_limit(size_t bytes) {
+    int64_t now = atomic_load(&current_bytes);
+    if (limit_bytes && (bytes > limit_bytes || now + (int64_t) bytes > (int64_t) limit_bytes)) {
+        error(1, 0, "Error: Allocating %zu bytes exceeds the memory limit of %lu bytes, %ld bytes are in use",
+              bytes, limit_bytes, now);
+    }
+}
+
+// the bytes of the mapping at pointer, which is removed if unmap is set, 0 if it is no mapping
+static size_t find_mapping(void *pointer, int unmap) {
+    if (!pointer || atomic_load(&mapping_count) == 0) {
+        return 0;
+    }
+    size_t bytes = 0;
+    pthread_mutex_lock(&mapping_lock);
+    int count = atomic_load(&mapping_count);
+    for (int i = 0; i < count; i++) {
+        if (mappings[i].address == pointer) {
+            bytes = mappings[i].bytes;
+            if (unmap) {
+                mappings[i] = mappings[count - 1];
+                atomic_store(&mapping_count, count - 1);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mapping_lock);
+    if (bytes && unmap) {
+        munmap(pointer, bytes);
+        account(-(int64_t) bytes);
+    }
+    return bytes;
+}
+
+// NULL if no huge pages are reserved or the table is full
+static void *map_huge(size_t bytes) {
+    if (atomic_load(&mapping_count) >= MAX_MAPPINGS) {
+        return NULL;
+    }
+    check_limit(bytes);
+    void *pointer = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pointer == MAP_FAILED) {
+        return NULL;
+    }
+    pthread_mutex_lock(&mapping_lock);
+    int count = atomic_load(&mapping_count);
+    if (count < MAX_MAPPINGS) {
+        mappings[count] = (struct Mapping) {pointer, bytes};
+        atomic_store(&mapping_count, count + 1);
+    }
+    pthread_mutex_unlock(&mapping_lock);
+    if (count >= MAX_MAPPINGS) {
+        munmap(pointer, bytes);
+        return NULL;
+    }
+    account((int64_t) bytes);
+    return pointer;
+}
+
+void *__wrap_malloc(size_t size) {
+    check_limit(size);
+    void *pointer = __real_malloc(size);
+    account((int64_t) malloc_usable_size(pointer));
+    return pointer;
+}
+
+void *__wrap_calloc(size_t number, size_t size) {
+    check_limit(size && number > SIZE_MAX / size ? SIZE_MAX : number * size);
+    void *pointer = __real_calloc(number, size);
+    account((int64_t) malloc_usable_size(pointer));
+    return pointer;
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    size_t mapped = find_mapping(pointer, 0);
+    if (mapped) {
+        void *moved = size ? __wrap_malloc(size) : NULL;
+        if (!moved && size) {
+            return NULL;
+        }
+        memcpy(moved, pointer, size < mapped ? size : mapped);
+        find_mapping(pointer, 1);
+        return moved;
+    }
+    size_t before = malloc_usable_size(pointer);
+    check_limit(size > before ? size - before : 0);
+    void *moved = __real_realloc(pointer, size);
+    // a failed realloc keeps the old block
+    if (moved || size == 0) {
+        account((int64_t) malloc_usable_size(moved) - (int64_t) before);
+    }
+    return moved;
+}
+
+int __wrap_posix_memalign(void **pointer, size_t alignment, size_t size) {
+    check_limit(size);
+    int failed = __real_posix_memalign(pointer, alignment, size);
+    if (!failed) {
+        account((int64_t) malloc_usable_size(*pointer));
+    }
+    return failed;
+}
+
+void __wrap_free(void *pointer) {
+    if (find_mapping(pointer, 1)) {
+        return;
+    }
+    account(-(int64_t) malloc_usable_size(pointer));
+    __real_free(pointer);
+}
+
+void set_memory_limit(u_int64_t limit) {
+    limit_bytes = limit;
+}
+
+u_int64_t memory_limit(void) {
+    return limit_bytes;
+}
+
+u_int64_t memory_current(void) {
+    int64_t bytes = atomic_load(&current_bytes);
+    return bytes > 0 ? (u_int64_t) bytes : 0;
+}
+
+u_int64_t memory_peak(void) {
+    return (u_int64_t) atomic_load(&peak_bytes);
+}
+
+u_int64_t peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (u_int64_t) usage.ru_maxrss << 10;
+}
+
+void begin_memory_phase(const char *name) {
+    phase_name = name;
+    atomic_store(&phase_peak_bytes, atomic_load(&current_bytes));
+}
+
+void end_memory_phase(void) {
+    printf("[MEM] %s: %lu bytes in use, peak %lu bytes", phase_name ? phase_name : "run", memory_current(),
+           (u_int64_t) atomic_load(&phase_peak_bytes));
+    if (limit_bytes) {
+        printf(" of the limit of %lu", limit_bytes);
+    }
+    printf(", peak resident %lu bytes\n", peak_rss());
+}
+
+int page_policy_from_name(const char *name) {
+    for (int i = 0; i < (int) (sizeof(PAGE_POLICY_NAMES) / sizeof(PAGE_POLICY_NAMES[0])); i++) {
+        if (strcmp(name, PAGE_POLICY_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *page_policy_name(enum PagePolicy policy) {
+    return PAGE_POLICY_NAMES[policy];
+}
+
+void set_page_policy(enum PagePolicy policy) {
+    page_policy = policy;
+}
+
+enum PagePolicy get_page_policy(void) {
+    return page_policy;
+}
+
+void *alloc_array(size_t bytes, int zero) {
+    int huge = bytes >= HUGE_PAGE_BYTES;
+    size_t rounded = huge ? (bytes + HUGE_PAGE_BYTES - 1) & ~(size_t) (HUGE_PAGE_BYTES - 1) : bytes;
+    if (huge && page_policy == PAGES_EXPLICIT) {
+        // mapped pages are zero already
+        void *pointer = map_huge(rounded);
+        if (pointer) {
+            return pointer;
+        }
+        if (!atomic_flag_test_and_set(&explicit_failed)) {
+            printf("[MEM] No explicit huge pages are available, arrays get transparent huge pages\n");
+        }
+    }
+    void *pointer = NULL;
+    // the huge page boundaries of a large array are the ones madvise can change
+    if (posix_memalign(&pointer, huge ? HUGE_PAGE_BYTES : ARRAY_ALIGNMENT, rounded > 0 ? rounded : ARRAY_ALIGNMENT) != 0) {
+        return NULL;
+    }
+    if (huge) {
+        madvise(pointer, rounded, page_policy == PAGES_SMALL ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    }
+    if (zero) {
+        memset(pointer, 0, bytes);
+    }
+    return pointer;
+}
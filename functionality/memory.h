@@ -0,0 +1,52 @@
+#ifndef PROJEKTAUFGABE_MEMORY_H
+#define PROJEKTAUFGABE_MEMORY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** alignment of every array from alloc_array, a cache line and the widest vector */
+#define ARRAY_ALIGNMENT 64
+/** arrays of at least this size start at a huge page and take whole huge pages */
+#define HUGE_PAGE_BYTES ((size_t) 2 << 20)
+
+/** the pages of large arrays */
+enum PagePolicy {
+    PAGES_SMALL, // 4 KiB pages, transparent huge pages are switched off for the array
+    PAGES_TRANSPARENT, // madvise(MADV_HUGEPAGE)
+    PAGES_EXPLICIT // MAP_HUGETLB from the reserved huge pages, transparent ones if there are too few
+};
+
+/*
+ * every malloc, calloc, realloc, posix_memalign and free of the program goes through the counting wrappers in memory.c,
+ * the linker redirects them with --wrap (see Makefile), memory allocated inside the c library is not counted
+ */
+
+/** allocations that would take the counted bytes above limit fail with an error, 0 switches the limit off */
+void set_memory_limit(u_int64_t limit);
+u_int64_t memory_limit(void);
+
+/** bytes currently allocated */
+u_int64_t memory_current(void);
+/** the most bytes allocated at once since the start */
+u_int64_t memory_peak(void);
+/** the most resident bytes of the process since the start */
+u_int64_t peak_rss(void);
+
+/** starts a named phase, its peak starts at the bytes currently allocated */
+void begin_memory_phase(const char *name);
+/** prints the bytes in use at the end of the phase begun last and its peak */
+void end_memory_phase(void);
+
+/** the policy with the given name (small, transparent, explicit), -1 if there is none */
+int page_policy_from_name(const char *name);
+const char *page_policy_name(enum PagePolicy policy);
+void set_page_policy(enum PagePolicy policy);
+enum PagePolicy get_page_policy(void);
+
+/**
+ * an array of bytes aligned to ARRAY_ALIGNMENT with the pages of the policy, zeroed if zero is set, NULL if it fails,
+ * it is freed and reallocated like any other block, the wrappers unmap explicit huge pages
+ */
+void *alloc_array(size_t bytes, int zero);
+
+#endif //PROJEKTAUFGABE_MEMORY_H
@@ -1,6 +1,14 @@
 #include "multiplication.h"
+#include <stdatomic.h>
 #include <string.h>
 #include "ellpack_utility.h"
+#include "scheduler.h"
+#include "pruning.h"
+
+int float_ellpack_version(int version) {
+    return version == LINEAR || version == VECTORIZED || version == NAIVE || version == PARALLEL || version == GENERIC_F32
+           || version == BATCHED || version == FIXED_WIDTH || version == ROWWISE;
+}
 
 void matr_mult_ellpack(const void* a, const void* b, void* result) {
     struct EllpackMatrix *r = (struct EllpackMatrix *) result;
@@ -29,6 +37,12 @@ void matr_mult_ellpack(const void* a, const void* b, void* result) {
     if (!r_values || !r_indices || !r_row_lengths || !r_row_indices || !r_row_values) {
         r->height = 0; // skip all loops and go to cleanup
     }
+    // the entries of a row go through the pruner if a drop rule is set
+    int pruning = prune_active();
+    struct RowPruner pruner;
+    if (pruning) {
+        init_pruner(&pruner, bx->height);
+    }
     for (u_int64_t r_row_i = 0; r_row_i < r->height; r_row_i++) { // Zeileniteration
         u_int64_t r_column_counter = 0; // only not null results are written to result row, to mantain ellpack form
         for (u_int64_t b_row_i = 0; b_row_i < bx->height; b_row_i++) {
@@ -50,12 +64,17 @@ void matr_mult_ellpack(const void* a, const void* b, void* result) {
                 }
             }
             // only add the result entry if it s not zero
-            if (res_sum != 0.0) {
+            if (res_sum != 0.0 && pruning) {
+                prune_offer(&pruner, res_sum, b_row_i);
+            } else if (res_sum != 0.0) {
                 r_row_values[r_column_counter] = res_sum;
                 r_row_indices[r_column_counter] = b_row_i;
                 r_column_counter++;
             }
         }
+        if (pruning) {
+            r_column_counter = prune_finish(&pruner, r_row_values, r_row_indices);
+        }
         if (r_column_counter > max_width) {
             max_width = r_column_counter;
         }
@@ -74,6 +93,9 @@ void matr_mult_ellpack(const void* a, const void* b, void* result) {
     flatten_ellpack(r, r_values, r_indices, r_row_lengths);
     free(r_row_values);
     free(r_row_indices);
+    if (pruning) {
+        free_pruner(&pruner);
+    }
     free_ellpack(bx);
     r->real_width = ((struct EllpackMatrix *) b)->real_width;
 }
@@ -131,8 +153,8 @@ void matr_mult_ellpack_vectorised(const void* a, const void* b, void* result) {
                     a_column_i++;
                 }
                 if (cnt_vals==4) {
-                    a_vec_val = _mm_load_ss(a_temp);
-                    b_vec_val = _mm_load_ss(b_temp);
+                    a_vec_val = _mm_loadu_ps(a_temp);
+                    b_vec_val = _mm_loadu_ps(b_temp);
                     a_vec_val = _mm_mul_ps(a_vec_val,b_vec_val);
                     res_vec = _mm_add_ps(a_vec_val, res_vec);
                     cnt_vals = 0;
@@ -186,9 +208,9 @@ void matr_mult_ellpack_naive(const void* a, const void* b, void* result) {
     u_int64_t **r_indices = calloc(r->height, sizeof(u_int64_t *));
     u_int64_t *r_row_lengths = calloc(ax->height, sizeof(u_int64_t));
     u_int64_t max_width = 0;
-    // array of upper limit size for each result row
-    float *r_row_values = calloc(bx->height, sizeof(float));
-    u_int64_t *r_row_indices = calloc(bx->height, sizeof(u_int64_t));
+    // array of upper limit size for each result row, b is not transposed so a row can have every column of b
+    float *r_row_values = calloc(bx->real_width, sizeof(float));
+    u_int64_t *r_row_indices = calloc(bx->real_width, sizeof(u_int64_t));
     if (!r_values || !r_indices || !r_row_lengths || !r_row_indices || !r_row_values) {
         r->height = 0; // skip all loops and go to cleanup
     }
@@ -236,3 +258,219 @@ void matr_mult_ellpack_naive(const void* a, const void* b, void* result) {
     free(r_row_indices);
     r->real_width = ((struct EllpackMatrix *) b)->real_width;
 }
+
+/** a part of a heavy result row, computed for the transposed b rows [sub_begin, sub_begin + ...) */
+struct RowPiece {
+    u_int64_t sub_begin;
+    u_int64_t length;
+    float *values;
+    u_int64_t *indices;
+    struct RowPiece *next;
+};
+
+struct ParallelMultContext {
+    const struct EllpackMatrix *ax;
+    const struct EllpackMatrix *bx;
+    const u_int64_t *a_lengths;
+    const u_int64_t *b_lengths;
+    u_int64_t sub_extent;
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+    struct RowPiece *_Atomic *pieces; // pieces of split rows, pushed without locking
+    float **scratch_values; // one upper limit size row per thread
+    u_int64_t **scratch_indices;
+    struct RowPruner *pruners; // one per thread if a drop rule is set
+    int whole_rows; // the drop rule needs whole rows, the scheduler gets a sub extent of 1
+};
+
+static void mult_task(void *context, const struct RowTask *task, int thread) {
+    struct ParallelMultContext *c = context;
+    const struct EllpackMatrix *ax = c->ax;
+    const struct EllpackMatrix *bx = c->bx;
+    float *r_row_values = c->scratch_values[thread];
+    u_int64_t *r_row_indices = c->scratch_indices[thread];
+    struct RowPruner *pruner = c->pruners ? &c->pruners[thread] : NULL;
+    u_int64_t sub_end = c->whole_rows ? bx->height : task->sub_end;
+    for (u_int64_t r_row_i = task->begin; r_row_i < task->end; r_row_i++) {
+        u_int64_t r_column_counter = 0;
+        const u_int64_t *a_row_indices = ax->indices + r_row_i * ax->width;
+        const float *a_row_values = ax->values + r_row_i * ax->width;
+        for (u_int64_t b_row_i = task->sub_begin; b_row_i < sub_end && b_row_i < bx->height; b_row_i++) {
+            const u_int64_t *b_row_indices = bx->indices + b_row_i * bx->width;
+            const float *b_row_values = bx->values + b_row_i * bx->width;
+            u_int64_t a_column_i = 0;
+            u_int64_t b_column_i = 0;
+            float res_sum = 0.0F;
+            // merge only the used entries, the padding would add zeros
+            while (a_column_i < c->a_lengths[r_row_i] && b_column_i < c->b_lengths[b_row_i]) {
+                if (a_row_indices[a_column_i] == b_row_indices[b_column_i]) {
+                    res_sum += a_row_values[a_column_i] * b_row_values[b_column_i];
+                    a_column_i++;
+                    b_column_i++;
+                } else if (a_row_indices[a_column_i] > b_row_indices[b_column_i]) {
+                    b_column_i++;
+                } else {
+                    a_column_i++;
+                }
+            }
+            if (res_sum != 0.0 && pruner) {
+                prune_offer(pruner, res_sum, b_row_i);
+            } else if (res_sum != 0.0) {
+                r_row_values[r_column_counter] = res_sum;
+                r_row_indices[r_column_counter] = b_row_i;
+                r_column_counter++;
+            }
+        }
+        if (pruner) {
+            r_column_counter = prune_finish(pruner, r_row_values, r_row_indices);
+        }
+        float *values = malloc(sizeof(float) * r_column_counter);
+        u_int64_t *indices = malloc(sizeof(u_int64_t) * r_column_counter);
+        if ((!values || !indices) && r_column_counter > 0) {
+            error(1, 0, "Error: Not enough memory for result row %lu", r_row_i);
+        }
+        memcpy(values, r_row_values, sizeof(float) * r_column_counter);
+        memcpy(indices, r_row_indices, sizeof(u_int64_t) * r_column_counter);
+        if (task->sub_begin == 0 && task->sub_end == c->sub_extent) {
+            c->r_values[r_row_i] = values;
+            c->r_indices[r_row_i] = indices;
+            c->r_row_lengths[r_row_i] = r_column_counter;
+        } else {
+            struct RowPiece *piece = malloc(sizeof(*piece));
+            if (!piece) {
+                error(1, 0, "Error: Not enough memory for result row %lu", r_row_i);
+            }
+            *piece = (struct RowPiece) {task->sub_begin, r_column_counter, values, indices, NULL};
+            piece->next = atomic_load(&c->pieces[r_row_i]);
+            while (!atomic_compare_exchange_weak(&c->pieces[r_row_i], &piece->next, piece));
+        }
+    }
+}
+
+static int compare_pieces(const void *x, const void *y) {
+    const struct RowPiece *p = *(struct RowPiece * const *) x;
+    const struct RowPiece *q = *(struct RowPiece * const *) y;
+    return (p->sub_begin > q->sub_begin) - (p->sub_begin < q->sub_begin);
+}
+
+// concatenates the pieces of a split row in the order of their sub ranges
+static void stitch_pieces(struct ParallelMultContext *c, u_int64_t r_row_i) {
+    u_int64_t count = 0;
+    u_int64_t length = 0;
+    for (struct RowPiece *piece = c->pieces[r_row_i]; piece; piece = piece->next) {
+        count++;
+        length += piece->length;
+    }
+    struct RowPiece **sorted = malloc(count * sizeof(struct RowPiece *));
+    c->r_values[r_row_i] = malloc(sizeof(float) * length);
+    c->r_indices[r_row_i] = malloc(sizeof(u_int64_t) * length);
+    if (!sorted || ((!c->r_values[r_row_i] || !c->r_indices[r_row_i]) && length > 0)) {
+        error(1, 0, "Error: Not enough memory for result row %lu", r_row_i);
+    }
+    count = 0;
+    for (struct RowPiece *piece = c->pieces[r_row_i]; piece; piece = piece->next) {
+        sorted[count++] = piece;
+    }
+    qsort(sorted, count, sizeof(struct RowPiece *), compare_pieces);
+    u_int64_t offset = 0;
+    for (u_int64_t i = 0; i < count; i++) {
+        memcpy(c->r_values[r_row_i] + offset, sorted[i]->values, sizeof(float) * sorted[i]->length);
+        memcpy(c->r_indices[r_row_i] + offset, sorted[i]->indices, sizeof(u_int64_t) * sorted[i]->length);
+        offset += sorted[i]->length;
+        free(sorted[i]->values);
+        free(sorted[i]->indices);
+        free(sorted[i]);
+    }
+    c->r_row_lengths[r_row_i] = length;
+    free(sorted);
+}
+
+void matr_mult_ellpack_parallel(const void* a, const void* b, void* result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    struct EllpackMatrix *bx = transpose_ellpack_parallel((struct EllpackMatrix *) b);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+        return;
+    }
+    matr_mult_ellpack_transposed(a, bx, ((struct EllpackMatrix *) b)->real_width, result);
+    free_ellpack(bx);
+}
+
+void matr_mult_ellpack_transposed(const struct EllpackMatrix *ax, const struct EllpackMatrix *bx, u_int64_t real_width,
+                                  struct EllpackMatrix *r) {
+    r->height = ax->height;
+    int threads = scheduler_threads();
+    struct ParallelMultContext c;
+    c.ax = ax;
+    c.bx = bx;
+    c.whole_rows = prune_needs_rows();
+    c.sub_extent = bx->height > 0 && !c.whole_rows ? bx->height : 1;
+    c.pruners = prune_active() ? calloc(threads, sizeof(struct RowPruner)) : NULL;
+    u_int64_t *a_lengths = calloc(ax->height, sizeof(u_int64_t));
+    u_int64_t *b_lengths = calloc(bx->height, sizeof(u_int64_t));
+    u_int64_t *costs = calloc(ax->height, sizeof(u_int64_t));
+    c.r_values = calloc(r->height, sizeof(float *));
+    c.r_indices = calloc(r->height, sizeof(u_int64_t *));
+    c.r_row_lengths = calloc(r->height, sizeof(u_int64_t));
+    c.pieces = calloc(r->height, sizeof(struct RowPiece *));
+    c.scratch_values = calloc(threads, sizeof(float *));
+    c.scratch_indices = calloc(threads, sizeof(u_int64_t *));
+    if (!a_lengths || !b_lengths || !costs || !c.r_values || !c.r_indices || !c.r_row_lengths || !c.pieces
+        || !c.scratch_values || !c.scratch_indices || (prune_active() && !c.pruners)) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (int i = 0; i < threads; i++) {
+        c.scratch_values[i] = calloc(bx->height > 0 ? bx->height : 1, sizeof(float));
+        c.scratch_indices[i] = calloc(bx->height > 0 ? bx->height : 1, sizeof(u_int64_t));
+        if (c.pruners) {
+            init_pruner(&c.pruners[i], bx->height);
+        }
+        if (!c.scratch_values[i] || !c.scratch_indices[i]) {
+            error(1, 0, "Error: Not enough memory for the multiplication");
+        }
+    }
+    u_int64_t b_nnz = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(bx, b_row_i);
+        b_nnz += b_lengths[b_row_i];
+    }
+    // each result row merges its row of a with every row of bx
+    for (u_int64_t a_row_i = 0; a_row_i < ax->height; a_row_i++) {
+        a_lengths[a_row_i] = rowlength_ellpack(ax, a_row_i);
+        costs[a_row_i] = (a_lengths[a_row_i] + 1) * bx->height + (a_lengths[a_row_i] ? b_nnz : 0);
+    }
+    c.a_lengths = a_lengths;
+    c.b_lengths = b_lengths;
+    schedule_rows(r->height, costs, c.sub_extent, mult_task, &c, "multiply");
+
+    u_int64_t max_width = 0;
+    for (u_int64_t r_row_i = 0; r_row_i < r->height; r_row_i++) {
+        if (c.pieces[r_row_i]) {
+            stitch_pieces(&c, r_row_i);
+        }
+        if (c.r_row_lengths[r_row_i] > max_width) {
+            max_width = c.r_row_lengths[r_row_i];
+        }
+    }
+    r->width = max_width;
+    flatten_ellpack(r, c.r_values, c.r_indices, c.r_row_lengths);
+    for (int i = 0; i < threads; i++) {
+        free(c.scratch_values[i]);
+        free(c.scratch_indices[i]);
+        if (c.pruners) {
+            free_pruner(&c.pruners[i]);
+        }
+    }
+    free(c.scratch_values);
+    free(c.scratch_indices);
+    free(c.pruners);
+    free(c.pieces);
+    free(a_lengths);
+    free(b_lengths);
+    free(costs);
+    r->real_width = real_width;
+}
@@ -4,7 +4,7 @@
 #include "ellpack_utility.h"
 
 enum MultVersion {
-    LINEAR, VECTORIZED, NAIVE
+    LINEAR, VECTORIZED, NAIVE, PARALLEL, HALF_FP16, HALF_BF16, GENERIC_F32, GENERIC_F64, MIXED_F32_F64, BATCHED, COMPRESSED, BLOCKED, FIXED_WIDTH, ROWWISE
 };
 
 /**
@@ -13,6 +13,13 @@ enum MultVersion {
  * result wird ein Pointer zur Darstellung der Produktmatrix M x P entlang P kompriemiert
  */
 void matr_mult_ellpack(const void* a, const void* b, void* result);
+/** whether the implementation multiplies and returns float EllpackMatrix, the others store 16 bit or double values or use other formats */
+int float_ellpack_version(int version);
 void matr_mult_ellpack_naive(const void* a, const void* b, void* result);
 void matr_mult_ellpack_vectorised(const void* a, const void* b, void* result);
+/** same merge as matr_mult_ellpack, rows of the result are distributed by the work stealing scheduler */
+void matr_mult_ellpack_parallel(const void* a, const void* b, void* result);
+/** the parallel merge with b already transposed to bx, real_width is the width of b and of the result */
+void matr_mult_ellpack_transposed(const struct EllpackMatrix *a, const struct EllpackMatrix *bx, u_int64_t real_width,
+                                  struct EllpackMatrix *result);
 #endif
\ No newline at end of file
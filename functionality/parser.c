@@ -4,6 +4,11 @@
 
 #include "parser.h"
 #include "ellpack_utility.h"
+#include "half_precision.h"
+#include "precision.h"
+#include "compressed.h"
+#include "dense.h"
+#include "text_writer.h"
 
 #include <error.h>
 #include <argp.h>
@@ -12,9 +17,29 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define CSV_LINE_LENGTH 61
 
+static int quiet = 0;
+
+void set_parser_quiet(int parser_quiet) {
+    quiet = parser_quiet;
+}
+
+// prints the progress of loading a matrix unless quiet
+static void progress(const char *format, ...) {
+    if (quiet) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
 static void token_error(char* path, unsigned long long line_count) {
     error(1, 0, "Error while parsing matrix %s: Invalid line %llu: Token error", path, line_count);
 }
@@ -33,13 +58,18 @@ static int skip_lines(FILE *file, unsigned long long num) {
     return 0;
 }
 
-struct EllpackMatrix* parse_matrix(char *matrix_path) {
-    FILE *matrix_file = fopen(matrix_path, "r");
-    if(!matrix_file) {
-        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", matrix_path);
+// the text format is parsed into a float or a double matrix, only the value arrays differ
+static void free_parsed(struct EllpackMatrix *matrix, struct EllpackMatrixF64 *matrix64) {
+    if (matrix) {
+        free_ellpack(matrix);
     }
+    if (matrix64) {
+        free_ellpack_f64(matrix64);
+    }
+}
 
-    // Read the first 2 lines containing WIDTH\nHEIGHT in u_int64_t format
+// reads the first 2 lines containing WIDTH\nHEIGHT in u_int64_t format and the empty line after them
+static void parse_text_size(FILE *matrix_file, char *matrix_path, long *height_out, long *width_out) {
     char line[20] = {0};
     unsigned long long line_count = 0;
     char* end_ptr;
@@ -70,11 +100,25 @@ struct EllpackMatrix* parse_matrix(char *matrix_path) {
     if(width > UINT_MAX || height > UINT_MAX) {
         error(1, 0, "Matrix size dimensions are too large! At %s", matrix_path);
     }
+    *height_out = height;
+    *width_out = width;
+}
 
+static void parse_text_matrix(char *matrix_path, struct EllpackMatrix **matrix_out, struct EllpackMatrixF64 **matrix64_out) {
+    FILE *matrix_file = fopen(matrix_path, "r");
+    if(!matrix_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", matrix_path);
+    }
+
+    long width = 0;
+    long height = 0;
+    parse_text_size(matrix_file, matrix_path, &height, &width);
+    unsigned long long line_count;
+    char* end_ptr;
 
     // Scan matrix for shrinking possibilities
     // CSV separator is ; -> FLOAT;INT;INT so line length = (float) 18 + (int) 20 + (int) 20 + (;) 2 + (\n) 1 = 61
-    printf("[SCAN] Scanning matrix %s ...\n", matrix_path);
+    progress("[SCAN] Scanning matrix %s ...\n", matrix_path);
 
     char matrix_line[CSV_LINE_LENGTH] = {0};
     char* token;
@@ -138,26 +182,43 @@ struct EllpackMatrix* parse_matrix(char *matrix_path) {
         max_width = (u_int64_t) width;
     }
 
-    printf("[SCAN] Completed, Shrinking matrix width from %lu -> %lu\n", width, max_width);
-    printf("[INIT] Allocating %lu bytes of memory for matrix %s\n", (4 * max_width * height) + (8 * max_width * height), matrix_path);
-
-    struct EllpackMatrix* matrix = make_ellpack((u_int64_t) width, (u_int64_t) height, max_width, matrix_path);
+    progress("[SCAN] Completed, Shrinking matrix width from %lu -> %lu\n", width, max_width);
+    progress("[INIT] Allocating %lu bytes of memory for matrix %s\n", (4 * max_width * height) + (8 * max_width * height), matrix_path);
+
+    struct EllpackMatrix* matrix = NULL;
+    struct EllpackMatrixF64* matrix64 = NULL;
+    float *values = NULL;
+    double *values64 = NULL;
+    u_int64_t *indices;
+    if (matrix64_out) {
+        matrix64 = make_ellpack_f64((u_int64_t) width, (u_int64_t) height, max_width, matrix_path);
+        values64 = matrix64->values;
+        indices = matrix64->indices;
+    } else {
+        matrix = make_ellpack((u_int64_t) width, (u_int64_t) height, max_width, matrix_path);
+        values = matrix->values;
+        indices = matrix->indices;
+    }
 
-    for(u_int64_t run_row = 0; run_row < matrix->height; ++run_row) {
-        for(u_int64_t run_col = 0; run_col < matrix->width; ++run_col) {
-            matrix->indices[run_row * matrix->width + run_col] = 0;
-            matrix->values[run_row * matrix->width + run_col] = 0;
+    for(u_int64_t run_row = 0; run_row < (u_int64_t) height; ++run_row) {
+        for(u_int64_t run_col = 0; run_col < max_width; ++run_col) {
+            indices[run_row * max_width + run_col] = 0;
+            if (values64) {
+                values64[run_row * max_width + run_col] = 0;
+            } else {
+                values[run_row * max_width + run_col] = 0;
+            }
         }
     }
 
-    printf("[INIT] Reading data of matrix %s into memory\n", matrix_path);
+    progress("[INIT] Reading data of matrix %s into memory\n", matrix_path);
 
     // Go to start of file (after height and width declarations)
     rewind(matrix_file);
 
     int skr = skip_lines(matrix_file, 3);
     if(skr != 0) {
-        free_ellpack(matrix);
+        free_parsed(matrix, matrix64);
         error(1, 0, "I/O Error while skipping lines in %s", matrix_path);
     }
 
@@ -169,7 +230,7 @@ struct EllpackMatrix* parse_matrix(char *matrix_path) {
     while (fgets(matrix_line, CSV_LINE_LENGTH, matrix_file)) {
         token = strtok(matrix_line, ";");
         if (!token) {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             token_error(matrix_path, line_count);
         }
         errno = 0;
@@ -178,55 +239,55 @@ struct EllpackMatrix* parse_matrix(char *matrix_path) {
             parse_error(matrix_path, line_count, token);
         }
         if(row_raw > UINT_MAX || row_raw < 0) {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             error(1, 0, "Error while parsing matrix %s, Invalid line %llu: Row number is out of bounds", matrix_path, line_count);
         }
         u_int64_t row = (u_int64_t) row_raw;
 
-        if(row >= matrix->height) {
-            free_ellpack(matrix);
+        if(row >= (u_int64_t) height) {
+            free_parsed(matrix, matrix64);
             error(1, 0, "Error while parsing matrix %s, Invalid line %llu: Row number is out of bounds", matrix_path, line_count);
         }
 
         token = strtok(NULL, ";");
         if (!token) {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             token_error(matrix_path, line_count);
         }
         errno = 0;
         long column_raw = strtol(token, &end_ptr, 10);
         if (errno != 0 || *token == '\0' || *end_ptr != '\0') {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             parse_error(matrix_path, line_count, token);
         }
         if(column_raw > UINT_MAX || column_raw < 0) {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             error(1, 0, "Error while parsing matrix %s, Invalid line %llu: Column number is out of bounds", matrix_path, line_count);
         }
         u_int64_t column = (u_int64_t) column_raw;
 
-        if(column >= matrix->real_width) {
-            free_ellpack(matrix);
+        if(column >= (u_int64_t) width) {
+            free_parsed(matrix, matrix64);
             error(1, 0, "Error while parsing matrix %s, Invalid line %llu: Column number is out of bounds", matrix_path, line_count);
         }
 
         token = strtok(NULL, ";");
         if (!token) {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             token_error(matrix_path, line_count);
         }
         errno = 0;
-        float value = strtof(token, &end_ptr);
+        double value = values64 ? strtod(token, &end_ptr) : strtof(token, &end_ptr);
         if (errno != 0 || *token == '\0' || *end_ptr != '\n') {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             parse_error(matrix_path, line_count, token);
         }
 
         u_int64_t new_col = 0;
         bool col_found = false;
 
-        for (u_int64_t r_col = 0; r_col < matrix->width; ++r_col) {
-            if (matrix->values[row * matrix->width + r_col] == 0) {
+        for (u_int64_t r_col = 0; r_col < max_width; ++r_col) {
+            if ((values64 ? values64[row * max_width + r_col] : values[row * max_width + r_col]) == 0) {
                 new_col = r_col;
                 col_found = true;
                 break;
@@ -234,47 +295,316 @@ struct EllpackMatrix* parse_matrix(char *matrix_path) {
         }
 
         if(!col_found) {
-            free_ellpack(matrix);
+            free_parsed(matrix, matrix64);
             error(1, 0, "Error while parsing matrix %s, size overflowed at line %llu", matrix_path, line_count);
         }
 
-        matrix->values[row * matrix->width + new_col] = value;
-        matrix->indices[row * matrix->width + new_col] = column;
+        if (values64) {
+            values64[row * max_width + new_col] = value;
+        } else {
+            values[row * max_width + new_col] = (float) value;
+        }
+        indices[row * max_width + new_col] = column;
 
         ++line_count;
     }
 
     fclose(matrix_file);
+    if (matrix64_out) {
+        *matrix64_out = matrix64;
+    } else {
+        *matrix_out = matrix;
+    }
+}
+
+struct EllpackMatrix* parse_matrix(char *matrix_path) {
+    if (is_binary_matrix(matrix_path)) {
+        return parse_matrix_binary(matrix_path);
+    }
+    if (is_dense_matrix(matrix_path)) {
+        struct DenseMatrix *dense = parse_matrix_dense_binary(matrix_path);
+        struct EllpackMatrix *matrix = ellpack_from_dense(dense);
+        free_dense(dense);
+        return matrix;
+    }
+    struct EllpackMatrix *matrix = NULL;
+    parse_text_matrix(matrix_path, &matrix, NULL);
     return matrix;
 }
 
-void write_matrix(struct EllpackMatrix* matrix, char *out_path) {
+struct EllpackMatrixF64* parse_matrix_f64(char *matrix_path) {
+    if (is_binary_matrix(matrix_path)) {
+        return parse_matrix_f64_binary(matrix_path);
+    }
+    struct EllpackMatrixF64 *matrix = NULL;
+    parse_text_matrix(matrix_path, NULL, &matrix);
+    return matrix;
+}
+
+void write_matrix_header(FILE *out_file, u_int64_t height, u_int64_t real_width) {
+    fprintf(out_file, "%lu\n", height);
+    fprintf(out_file, "%lu\n", real_width);
+    fprintf(out_file, "\n");
+}
+
+// only the last entry of the last row can miss its line break, and whether it does depends on the width of the whole
+// matrix, which is the width of the panels so far once the last panel is written
+void write_matrix_rows(FILE *out_file, const struct EllpackMatrix *rows, u_int64_t first_row, u_int64_t height, u_int64_t width) {
+    for (u_int64_t run_row = 0; run_row < rows->height; run_row++) {
+        u_int64_t row = first_row + run_row;
+        for (u_int64_t run_col = 0; run_col < rows->width; run_col++) {
+            float value_entry = rows->values[run_row * rows->width + run_col];
+            if (value_entry == 0) {
+                continue;
+            }
+            char line[ENTRY_TEXT_LENGTH];
+            fwrite(line, 1, format_entry(row, rows->indices[run_row * rows->width + run_col], value_entry,
+                                         row < height - 1 || run_col < width - 1, line), out_file);
+        }
+    }
+}
+
+// writes a float or a double matrix in the text format, doubles keep all 17 significant digits
+static void write_text_matrix(struct EllpackMatrix* matrix, struct EllpackMatrixF64* matrix64, char *out_path) {
     FILE *out_file = fopen(out_path, "w");
     if(!out_file) {
-        free_ellpack(matrix);
+        free_parsed(matrix, matrix64);
         error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
     }
+    u_int64_t height = matrix64 ? matrix64->height : matrix->height;
+    u_int64_t width = matrix64 ? matrix64->width : matrix->width;
+    const u_int64_t *indices = matrix64 ? matrix64->indices : matrix->indices;
 
     // Write the first 2 lines containing WIDTH\nHEIGHT in u_int64_t format
-    fprintf(out_file, "%lu\n", matrix->height);
-    fprintf(out_file, "%lu\n", matrix->real_width);
+    fprintf(out_file, "%lu\n", height);
+    fprintf(out_file, "%lu\n", matrix64 ? matrix64->real_width : matrix->real_width);
     fprintf(out_file, "\n");
 
     // Print the matrix in reduced coordinate schema
-    for(u_int64_t run_row = 0; run_row < matrix->height; ++run_row) {
-        for(u_int64_t run_col = 0; run_col < matrix->width; ++run_col) {
-            u_int64_t index_entry = matrix->indices[run_row * matrix->width + run_col];
-            float value_entry = matrix->values[run_row * matrix->width + run_col];
-            if(value_entry != 0) {
-                u_int64_t real_column = index_entry;
-                fprintf(out_file, "%lu;%lu;%.9e", run_row, real_column, value_entry);
-                if(run_row < (matrix->height - 1) || run_col < (matrix->width - 1)) {
-                    fprintf(out_file, "\n");
+    for(u_int64_t run_row = 0; run_row < height; ++run_row) {
+        for(u_int64_t run_col = 0; run_col < width; ++run_col) {
+            u_int64_t index_entry = indices[run_row * width + run_col];
+            if (matrix64) {
+                double value_entry = matrix64->values[run_row * width + run_col];
+                if (value_entry == 0) {
+                    continue;
                 }
+                fprintf(out_file, "%lu;%lu;%.17e", run_row, index_entry, value_entry);
+            } else {
+                float value_entry = matrix->values[run_row * width + run_col];
+                if (value_entry == 0) {
+                    continue;
+                }
+                fprintf(out_file, "%lu;%lu;%.9e", run_row, index_entry, value_entry);
+            }
+            if(run_row < (height - 1) || run_col < (width - 1)) {
+                fprintf(out_file, "\n");
             }
         }
     }
 
+    if (ferror(out_file)) {
+        fclose(out_file);
+        free_parsed(matrix, matrix64);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+    fclose(out_file);
+}
+
+// float matrices are formatted in parallel by the text writer, with the bytes of the fprintf of write_text_matrix
+void write_matrix(struct EllpackMatrix* matrix, char *out_path) {
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        free_parsed(matrix, NULL);
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    if (!write_matrix_text_fd(matrix, fd) || close(fd) != 0) {
+        free_parsed(matrix, NULL);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+}
+
+void write_matrix_f64(struct EllpackMatrixF64* matrix, char *out_path) {
+    write_text_matrix(NULL, matrix, out_path);
+}
+
+static const char BINARY_MAGIC[4] = {'E', 'L', 'L', 'B'};
+
+int is_binary_matrix(char *matrix_path) {
+    FILE *matrix_file = fopen(matrix_path, "r");
+    if (!matrix_file) {
+        return 0;
+    }
+    char magic[4] = {0};
+    size_t read = fread(magic, 1, sizeof(magic), matrix_file);
+    fclose(matrix_file);
+    return read == sizeof(magic) && memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+size_t binary_value_size(u_int32_t value_type) {
+    switch (value_type & ~BINARY_COMPRESSED_INDICES) {
+        case BINARY_F32:
+            return sizeof(float);
+        case BINARY_F64:
+            return sizeof(double);
+        case BINARY_F16:
+        case BINARY_BF16:
+            return sizeof(u_int16_t);
+        default:
+            return 0;
+    }
+}
+
+void read_binary_header(FILE *matrix_file, struct BinaryHeader *header, char *matrix_path) {
+    if (fread(header, sizeof(*header), 1, matrix_file) != 1 || memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        error(1, 0, "Error while parsing binary matrix %s: Invalid header", matrix_path);
+    }
+    if (binary_value_size(header->value_type) == 0) {
+        error(1, 0, "Error while parsing binary matrix %s: Unknown value type %u", matrix_path, header->value_type);
+    }
+    if (header->height == 0 || header->real_width == 0 || header->height > UINT_MAX || header->real_width > UINT_MAX
+        || header->width > header->real_width) {
+        error(1, 0, "Error while parsing binary matrix %s: Invalid dimensions", matrix_path);
+    }
+}
+
+void write_binary_header(FILE *out_file, u_int32_t value_type, u_int64_t real_width, u_int64_t height, u_int64_t width, char *out_path) {
+    struct BinaryHeader header = {{0}, value_type, real_width, height, width};
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    if (fwrite(&header, sizeof(header), 1, out_file) != 1) {
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+}
+
+// reads the compressed indices of x, whose lengths, bit widths and first indices are allocated
+static int read_compressed_indices(FILE *matrix_file, struct CompressedEllpack *x) {
+    u_int64_t packed_bytes;
+    if (fread(x->lengths, sizeof(u_int32_t), x->height, matrix_file) != x->height
+        || fread(x->bits, sizeof(u_int8_t), x->height, matrix_file) != x->height
+        || fread(x->bases, sizeof(u_int64_t), x->height, matrix_file) != x->height
+        || fread(&packed_bytes, sizeof(packed_bytes), 1, matrix_file) != 1) {
+        return 0;
+    }
+    allocate_packed(x);
+    return packed_bytes == x->offsets[x->height] && fread(x->packed, 1, packed_bytes, matrix_file) == packed_bytes;
+}
+
+// the entries of a row up to its first zero value have to increase below real_width, the padding after them has to
+// stay below real_width as well, values are float, double or 16 bit by their size
+static int valid_index_row(const void *values, size_t value_size, const u_int64_t *indices, u_int64_t width,
+                           u_int64_t real_width) {
+    int padding = 0;
+    for (u_int64_t i = 0; i < width; i++) {
+        if (value_size == sizeof(float)) {
+            padding = padding || ((const float *) values)[i] == 0;
+        } else if (value_size == sizeof(double)) {
+            padding = padding || ((const double *) values)[i] == 0;
+        } else {
+            padding = padding || (((const u_int16_t *) values)[i] & 0x7fff) == 0;
+        }
+        if (indices[i] >= real_width || (!padding && i > 0 && indices[i] <= indices[i - 1])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// rejects the file like the text parser rejects a column out of bounds or out of order
+static void check_binary_indices(const void *values, size_t value_size, const u_int64_t *indices, u_int64_t rows,
+                                 u_int64_t width, u_int64_t real_width, u_int64_t first_row, char *matrix_path) {
+    for (u_int64_t row = 0; row < rows; row++) {
+        if (!valid_index_row((const char *) values + row * width * value_size, value_size, indices + row * width, width,
+                             real_width)) {
+            error(1, 0, "Error while parsing binary matrix %s, Invalid row %lu: Column number is out of bounds or out of order",
+                  matrix_path, first_row + row);
+        }
+    }
+}
+
+int read_binary_indices(FILE *matrix_file, const struct BinaryHeader *header, const void *values, size_t value_size,
+                        u_int64_t *indices, char *matrix_path) {
+    u_int64_t entries = header->height * header->width;
+    if (!(header->value_type & BINARY_COMPRESSED_INDICES)) {
+        if (fread(indices, sizeof(u_int64_t), entries, matrix_file) != entries) {
+            return 0;
+        }
+        check_binary_indices(values, value_size, indices, header->height, header->width, header->real_width, 0, matrix_path);
+        return 1;
+    }
+    // only the indices are needed, the values have been read into the caller s matrix
+    struct CompressedEllpack *compressed = make_compressed(header->real_width, header->height, 0, "");
+    compressed->width = header->width;
+    int complete = read_compressed_indices(matrix_file, compressed);
+    u_int64_t *row = malloc((header->width + COMPRESSED_SLACK) * sizeof(u_int64_t));
+    if (!row) {
+        error(1, 0, "an allocation has failed");
+    }
+    memset(indices, 0, entries * sizeof(u_int64_t));
+    for (u_int64_t row_i = 0; complete && row_i < header->height; row_i++) {
+        u_int64_t length = decode_row_compressed(compressed, row_i, row);
+        memcpy(indices + row_i * header->width, row, length * sizeof(u_int64_t));
+    }
+    free(row);
+    free_compressed(compressed);
+    if (complete) {
+        check_binary_indices(values, value_size, indices, header->height, header->width, header->real_width, 0, matrix_path);
+    }
+    return complete;
+}
+
+struct EllpackMatrix* parse_matrix_binary(char *matrix_path) {
+    FILE *matrix_file = fopen(matrix_path, "r");
+    if(!matrix_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", matrix_path);
+    }
+    struct BinaryHeader header;
+    read_binary_header(matrix_file, &header, matrix_path);
+    progress("[INIT] Reading binary matrix %s [%lu (formerly %lu) x %lu]\n", matrix_path, header.width, header.real_width, header.height);
+
+    u_int64_t entries = header.height * header.width;
+    u_int32_t value_type = header.value_type & ~BINARY_COMPRESSED_INDICES;
+    struct EllpackMatrix* matrix = make_ellpack(header.real_width, header.height, header.width, matrix_path);
+    size_t read = 0;
+    if (value_type == BINARY_F32) {
+        read = fread(matrix->values, sizeof(float), entries, matrix_file);
+    } else if (value_type == BINARY_F64) {
+        // double values are narrowed while reading
+        double value;
+        while (read < entries && fread(&value, sizeof(double), 1, matrix_file) == 1) {
+            matrix->values[read++] = (float) value;
+        }
+    } else {
+        // 16 bit values are widened while reading
+        u_int16_t *half_values = malloc(sizeof(u_int16_t) * entries);
+        if (!half_values) {
+            free_ellpack(matrix);
+            error(1, 0, "Error: Not enough memory to load matrix %s", matrix_path);
+        }
+        read = fread(half_values, sizeof(u_int16_t), entries, matrix_file);
+        enum HalfFormat format = value_type == BINARY_F16 ? FP16 : BF16;
+        for (u_int64_t i = 0; i < read; i++) {
+            matrix->values[i] = half_to_float(half_values[i], format);
+        }
+        free(half_values);
+    }
+    if (read != entries || !read_binary_indices(matrix_file, &header, matrix->values, sizeof(float), matrix->indices, matrix_path)) {
+        free_ellpack(matrix);
+        error(1, 0, "Error while parsing binary matrix %s: File is truncated", matrix_path);
+    }
+    fclose(matrix_file);
+    return matrix;
+}
+
+void write_matrix_binary(struct EllpackMatrix* matrix, char *out_path) {
+    FILE *out_file = fopen(out_path, "w");
+    if(!out_file) {
+        free_ellpack(matrix);
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    u_int64_t entries = matrix->height * matrix->width;
+    write_binary_header(out_file, BINARY_F32, matrix->real_width, matrix->height, matrix->width, out_path);
+    fwrite(matrix->values, sizeof(float), entries, out_file);
+    fwrite(matrix->indices, sizeof(u_int64_t), entries, out_file);
     if (ferror(out_file)) {
         fclose(out_file);
         free_ellpack(matrix);
@@ -282,3 +612,387 @@ void write_matrix(struct EllpackMatrix* matrix, char *out_path) {
     }
     fclose(out_file);
 }
+
+static const char DENSE_MAGIC[4] = {'E', 'L', 'L', 'D'};
+
+int is_dense_matrix(char *matrix_path) {
+    FILE *matrix_file = fopen(matrix_path, "r");
+    if (!matrix_file) {
+        return 0;
+    }
+    char magic[4] = {0};
+    size_t read = fread(magic, 1, sizeof(magic), matrix_file);
+    fclose(matrix_file);
+    return read == sizeof(magic) && memcmp(magic, DENSE_MAGIC, sizeof(magic)) == 0;
+}
+
+struct DenseMatrix* parse_matrix_dense_binary(char *matrix_path) {
+    FILE *matrix_file = fopen(matrix_path, "r");
+    if(!matrix_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", matrix_path);
+    }
+    struct BinaryHeader header;
+    if (fread(&header, sizeof(header), 1, matrix_file) != 1 || memcmp(header.magic, DENSE_MAGIC, sizeof(DENSE_MAGIC)) != 0
+        || header.value_type != BINARY_F32) {
+        error(1, 0, "Error while parsing dense matrix %s: Invalid header", matrix_path);
+    }
+    if (header.height == 0 || header.real_width == 0 || header.height > UINT_MAX || header.real_width > UINT_MAX
+        || header.width != header.real_width) {
+        error(1, 0, "Error while parsing dense matrix %s: Invalid dimensions", matrix_path);
+    }
+    progress("[INIT] Reading dense matrix %s [%lu x %lu]\n", matrix_path, header.width, header.height);
+    struct DenseMatrix *matrix = make_dense(header.height, header.width, matrix_path);
+    if (fread(matrix->values, sizeof(float), header.height * header.width, matrix_file) != header.height * header.width) {
+        free_dense(matrix);
+        error(1, 0, "Error while parsing dense matrix %s: File is truncated", matrix_path);
+    }
+    fclose(matrix_file);
+    return matrix;
+}
+
+void write_matrix_dense_binary(struct DenseMatrix* matrix, char *out_path) {
+    FILE *out_file = fopen(out_path, "w");
+    if(!out_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    struct BinaryHeader header = {{0}, BINARY_F32, matrix->width, matrix->height, matrix->width};
+    memcpy(header.magic, DENSE_MAGIC, sizeof(DENSE_MAGIC));
+    fwrite(&header, sizeof(header), 1, out_file);
+    fwrite(matrix->values, sizeof(float), matrix->height * matrix->width, out_file);
+    if (ferror(out_file)) {
+        fclose(out_file);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+    fclose(out_file);
+}
+
+// the entries of a row in the text format are numbered by their position in the ELLPACK row, only the last one of
+// the last row misses its line break if the fullest row is that long
+void write_matrix_dense(struct DenseMatrix* matrix, char *out_path) {
+    FILE *out_file = fopen(out_path, "w");
+    if(!out_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    u_int64_t width = 0;
+    for (u_int64_t run_row = 0; run_row < matrix->height; ++run_row) {
+        u_int64_t length = 0;
+        for (u_int64_t column = 0; column < matrix->width; ++column) {
+            length += matrix->values[run_row * matrix->width + column] != 0;
+        }
+        width = length > width ? length : width;
+    }
+    write_matrix_header(out_file, matrix->height, matrix->width);
+    for (u_int64_t run_row = 0; run_row < matrix->height; ++run_row) {
+        u_int64_t run_col = 0;
+        for (u_int64_t column = 0; column < matrix->width; ++column) {
+            float value_entry = matrix->values[run_row * matrix->width + column];
+            if (value_entry == 0) {
+                continue;
+            }
+            char line[ENTRY_TEXT_LENGTH];
+            fwrite(line, 1, format_entry(run_row, column, value_entry,
+                                         run_row < (matrix->height - 1) || run_col < (width - 1), line), out_file);
+            run_col++;
+        }
+    }
+    if (ferror(out_file)) {
+        fclose(out_file);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+    fclose(out_file);
+}
+
+struct EllpackMatrixF64* parse_matrix_f64_binary(char *matrix_path) {
+    FILE *matrix_file = fopen(matrix_path, "r");
+    if(!matrix_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", matrix_path);
+    }
+    struct BinaryHeader header;
+    read_binary_header(matrix_file, &header, matrix_path);
+    progress("[INIT] Reading binary matrix %s [%lu (formerly %lu) x %lu]\n", matrix_path, header.width, header.real_width, header.height);
+
+    u_int64_t entries = header.height * header.width;
+    u_int32_t value_type = header.value_type & ~BINARY_COMPRESSED_INDICES;
+    struct EllpackMatrixF64* matrix = make_ellpack_f64(header.real_width, header.height, header.width, matrix_path);
+    size_t read = 0;
+    if (value_type == BINARY_F64) {
+        read = fread(matrix->values, sizeof(double), entries, matrix_file);
+    } else {
+        // narrower values are widened while reading
+        size_t value_size = binary_value_size(value_type);
+        unsigned char value[sizeof(float)];
+        while (read < entries && fread(value, value_size, 1, matrix_file) == 1) {
+            if (value_type == BINARY_F32) {
+                float narrow;
+                memcpy(&narrow, value, sizeof(float));
+                matrix->values[read++] = narrow;
+            } else {
+                u_int16_t half;
+                memcpy(&half, value, sizeof(u_int16_t));
+                matrix->values[read++] = half_to_float(half, value_type == BINARY_F16 ? FP16 : BF16);
+            }
+        }
+    }
+    if (read != entries || !read_binary_indices(matrix_file, &header, matrix->values, sizeof(double), matrix->indices, matrix_path)) {
+        free_ellpack_f64(matrix);
+        error(1, 0, "Error while parsing binary matrix %s: File is truncated", matrix_path);
+    }
+    fclose(matrix_file);
+    return matrix;
+}
+
+void write_matrix_f64_binary(struct EllpackMatrixF64* matrix, char *out_path) {
+    FILE *out_file = fopen(out_path, "w");
+    if(!out_file) {
+        free_ellpack_f64(matrix);
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    u_int64_t entries = matrix->height * matrix->width;
+    write_binary_header(out_file, BINARY_F64, matrix->real_width, matrix->height, matrix->width, out_path);
+    fwrite(matrix->values, sizeof(double), entries, out_file);
+    fwrite(matrix->indices, sizeof(u_int64_t), entries, out_file);
+    if (ferror(out_file)) {
+        fclose(out_file);
+        free_ellpack_f64(matrix);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+    fclose(out_file);
+}
+
+struct CompressedEllpack* parse_matrix_compressed(char *matrix_path) {
+    if (is_binary_matrix(matrix_path)) {
+        FILE *matrix_file = fopen(matrix_path, "r");
+        struct BinaryHeader header;
+        read_binary_header(matrix_file, &header, matrix_path);
+        if (header.value_type == (BINARY_F32 | BINARY_COMPRESSED_INDICES)) {
+            progress("[INIT] Reading binary matrix %s [%lu (formerly %lu) x %lu]\n", matrix_path, header.width, header.real_width, header.height);
+            struct CompressedEllpack *matrix = make_compressed(header.real_width, header.height, header.width, matrix_path);
+            u_int64_t entries = header.height * header.width;
+            if (fread(matrix->values, sizeof(float), entries, matrix_file) != entries || !read_compressed_indices(matrix_file, matrix)) {
+                free_compressed(matrix);
+                error(1, 0, "Error while parsing binary matrix %s: File is truncated", matrix_path);
+            }
+            u_int64_t *row = malloc((header.width + COMPRESSED_SLACK) * sizeof(u_int64_t));
+            if (!row) {
+                error(1, 0, "an allocation has failed");
+            }
+            for (u_int64_t row_i = 0; row_i < header.height; row_i++) {
+                check_binary_indices(matrix->values + row_i * header.width, sizeof(float), row, 1,
+                                     decode_row_compressed(matrix, row_i, row), header.real_width, row_i, matrix_path);
+            }
+            free(row);
+            fclose(matrix_file);
+            return matrix;
+        }
+        fclose(matrix_file);
+    }
+    struct EllpackMatrix *full = parse_matrix(matrix_path);
+    progress("[INIT] Compressing the indices of matrix %s\n", matrix_path);
+    struct CompressedEllpack *matrix = compress_ellpack(full);
+    free_ellpack(full);
+    return matrix;
+}
+
+void write_matrix_compressed_binary(struct CompressedEllpack* matrix, char *out_path) {
+    FILE *out_file = fopen(out_path, "w");
+    if(!out_file) {
+        free_compressed(matrix);
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", out_path);
+    }
+    u_int64_t packed_bytes = matrix->offsets[matrix->height];
+    write_binary_header(out_file, BINARY_F32 | BINARY_COMPRESSED_INDICES, matrix->real_width, matrix->height, matrix->width, out_path);
+    fwrite(matrix->values, sizeof(float), matrix->height * matrix->width, out_file);
+    fwrite(matrix->lengths, sizeof(u_int32_t), matrix->height, out_file);
+    fwrite(matrix->bits, sizeof(u_int8_t), matrix->height, out_file);
+    fwrite(matrix->bases, sizeof(u_int64_t), matrix->height, out_file);
+    fwrite(&packed_bytes, sizeof(packed_bytes), 1, out_file);
+    fwrite(matrix->packed, 1, packed_bytes, out_file);
+    if (ferror(out_file)) {
+        fclose(out_file);
+        free_compressed(matrix);
+        error(1, 0, "Error while writing matrix file %s", out_path);
+    }
+    fclose(out_file);
+}
+
+struct MatrixStream {
+    char *path;
+    FILE *file;
+    u_int64_t height;
+    u_int64_t real_width;
+    u_int64_t next_row; // first row of the next panel
+    struct BinaryHeader header;
+    int binary;
+    struct EllpackMatrix *loaded; // binary matrices whose rows cannot be read on their own are loaded at once
+    // the entries of the text matrix read so far for the current panel, the first one may belong to a later panel
+    unsigned long long line_count;
+    u_int64_t count;
+    u_int64_t capacity;
+    u_int64_t *rows;
+    u_int64_t *columns;
+    float *values;
+};
+
+struct MatrixStream *open_matrix_stream(char *matrix_path, u_int64_t *height, u_int64_t *real_width) {
+    struct MatrixStream *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        error(1, 0, "an allocation has failed");
+    }
+    stream->path = matrix_path;
+    stream->binary = is_binary_matrix(matrix_path);
+    stream->file = fopen(matrix_path, "r");
+    if (!stream->file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", matrix_path);
+    }
+    if (stream->binary) {
+        read_binary_header(stream->file, &stream->header, matrix_path);
+        stream->height = stream->header.height;
+        stream->real_width = stream->header.real_width;
+        if (stream->header.value_type != BINARY_F32) {
+            fclose(stream->file);
+            stream->file = NULL;
+            stream->loaded = parse_matrix_binary(matrix_path);
+        }
+    } else {
+        long text_height;
+        long text_width;
+        parse_text_size(stream->file, matrix_path, &text_height, &text_width);
+        stream->height = text_height;
+        stream->real_width = text_width;
+        stream->line_count = 4;
+    }
+    *height = stream->height;
+    *real_width = stream->real_width;
+    return stream;
+}
+
+// reads the entries of the text matrix up to the first one of a row at or after end
+static void read_text_entries(struct MatrixStream *stream, u_int64_t end) {
+    char matrix_line[CSV_LINE_LENGTH] = {0};
+    char *end_ptr;
+    while ((stream->count == 0 || stream->rows[stream->count - 1] < end) && fgets(matrix_line, CSV_LINE_LENGTH, stream->file)) {
+        u_int64_t numbers[2];
+        char *token = strtok(matrix_line, ";");
+        for (int i = 0; i < 2; i++) {
+            if (!token) {
+                token_error(stream->path, stream->line_count);
+            }
+            errno = 0;
+            long number = strtol(token, &end_ptr, 10);
+            if (errno != 0 || *token == '\0' || *end_ptr != '\0') {
+                parse_error(stream->path, stream->line_count, token);
+            }
+            if (number < 0 || (u_int64_t) number >= (i == 0 ? stream->height : stream->real_width)) {
+                error(1, 0, "Error while parsing matrix %s, Invalid line %llu: %s number is out of bounds", stream->path,
+                      stream->line_count, i == 0 ? "Row" : "Column");
+            }
+            numbers[i] = (u_int64_t) number;
+            token = strtok(NULL, ";");
+        }
+        if (!token) {
+            token_error(stream->path, stream->line_count);
+        }
+        errno = 0;
+        float value = strtof(token, &end_ptr);
+        if (errno != 0 || *token == '\0' || *end_ptr != '\n') {
+            parse_error(stream->path, stream->line_count, token);
+        }
+        if (numbers[0] < stream->next_row || (stream->count > 0 && numbers[0] < stream->rows[stream->count - 1])) {
+            error(1, 0, "Error while parsing matrix %s, Invalid line %llu: Rows have to be in ascending order to be streamed",
+                  stream->path, stream->line_count);
+        }
+        if (stream->count == stream->capacity) {
+            stream->capacity = stream->capacity > 0 ? 2 * stream->capacity : 1024;
+            stream->rows = realloc(stream->rows, stream->capacity * sizeof(u_int64_t));
+            stream->columns = realloc(stream->columns, stream->capacity * sizeof(u_int64_t));
+            stream->values = realloc(stream->values, stream->capacity * sizeof(float));
+            if (!stream->rows || !stream->columns || !stream->values) {
+                error(1, 0, "Error: Not enough memory to stream matrix %s", stream->path);
+            }
+        }
+        stream->rows[stream->count] = numbers[0];
+        stream->columns[stream->count] = numbers[1];
+        stream->values[stream->count++] = value;
+        stream->line_count++;
+    }
+}
+
+// the rows [begin, end) of the text matrix, entries keep their order in the file like in parse_matrix
+static struct EllpackMatrix *text_panel(struct MatrixStream *stream, u_int64_t begin, u_int64_t end) {
+    read_text_entries(stream, end);
+    u_int64_t used = stream->count;
+    if (used > 0 && stream->rows[used - 1] >= end) {
+        used--; // the first entry of the next panel
+    }
+    u_int64_t *lengths = calloc(end - begin, sizeof(u_int64_t));
+    if (!lengths) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t width = 0;
+    for (u_int64_t i = 0; i < used; i++) {
+        lengths[stream->rows[i] - begin]++;
+        width = lengths[stream->rows[i] - begin] > width ? lengths[stream->rows[i] - begin] : width;
+    }
+    struct EllpackMatrix *panel = make_ellpack(stream->real_width, end - begin, width, stream->path);
+    memset(panel->values, 0, (end - begin) * width * sizeof(float));
+    memset(panel->indices, 0, (end - begin) * width * sizeof(u_int64_t));
+    memset(lengths, 0, (end - begin) * sizeof(u_int64_t));
+    for (u_int64_t i = 0; i < used; i++) {
+        u_int64_t row = stream->rows[i] - begin;
+        panel->values[row * width + lengths[row]] = stream->values[i];
+        panel->indices[row * width + lengths[row]++] = stream->columns[i];
+    }
+    if (used < stream->count) {
+        stream->rows[0] = stream->rows[used];
+        stream->columns[0] = stream->columns[used];
+        stream->values[0] = stream->values[used];
+    }
+    stream->count -= used;
+    free(lengths);
+    return panel;
+}
+
+struct EllpackMatrix *read_matrix_panel(struct MatrixStream *stream, u_int64_t rows, u_int64_t *first_row) {
+    if (stream->next_row >= stream->height) {
+        return NULL;
+    }
+    u_int64_t begin = stream->next_row;
+    u_int64_t end = begin + rows < stream->height ? begin + rows : stream->height;
+    struct EllpackMatrix *panel;
+    if (stream->loaded) {
+        panel = make_ellpack(stream->real_width, end - begin, stream->loaded->width, stream->path);
+        memcpy(panel->values, stream->loaded->values + begin * panel->width, (end - begin) * panel->width * sizeof(float));
+        memcpy(panel->indices, stream->loaded->indices + begin * panel->width, (end - begin) * panel->width * sizeof(u_int64_t));
+    } else if (stream->binary) {
+        // the values and the indices of the rows are two contiguous ranges of the file
+        u_int64_t width = stream->header.width;
+        panel = make_ellpack(stream->real_width, end - begin, width, stream->path);
+        u_int64_t entries = (end - begin) * width;
+        long values_at = (long) (sizeof(struct BinaryHeader) + begin * width * sizeof(float));
+        long indices_at = (long) (sizeof(struct BinaryHeader) + stream->height * width * sizeof(float) + begin * width * sizeof(u_int64_t));
+        if (fseek(stream->file, values_at, SEEK_SET) != 0 || fread(panel->values, sizeof(float), entries, stream->file) != entries
+            || fseek(stream->file, indices_at, SEEK_SET) != 0 || fread(panel->indices, sizeof(u_int64_t), entries, stream->file) != entries) {
+            error(1, 0, "Error while parsing binary matrix %s: File is truncated", stream->path);
+        }
+        check_binary_indices(panel->values, sizeof(float), panel->indices, end - begin, width, stream->real_width, begin,
+                             stream->path);
+    } else {
+        panel = text_panel(stream, begin, end);
+    }
+    *first_row = begin;
+    stream->next_row = end;
+    return panel;
+}
+
+void close_matrix_stream(struct MatrixStream *stream) {
+    if (stream->file) {
+        fclose(stream->file);
+    }
+    if (stream->loaded) {
+        free_ellpack(stream->loaded);
+    }
+    free(stream->rows);
+    free(stream->columns);
+    free(stream->values);
+    free(stream);
+}
@@ -5,8 +5,95 @@
 #ifndef PROJEKTAUFGABE_PARSER_H
 #define PROJEKTAUFGABE_PARSER_H
 
+#include <stdio.h>
+#include <sys/types.h>
+
+/** value types of the binary matrix format */
+enum BinaryValueType {
+    BINARY_F32, BINARY_F16, BINARY_BF16, BINARY_F64
+};
+
+/**
+ * flag of the value type, the height * width indices are replaced by the compressed indices of a CompressedEllpack:
+ * height u_int32_t lengths, height u_int8_t bit widths, height u_int64_t first indices,
+ * the u_int64_t count of packed bytes and the packed bytes
+ */
+#define BINARY_COMPRESSED_INDICES 0x100
+
+struct CompressedEllpack;
+struct DenseMatrix;
+
+/** header of the binary format, followed by height * width values and height * width indices */
+struct BinaryHeader {
+    char magic[4]; // ELLB
+    u_int32_t value_type;
+    u_int64_t real_width;
+    u_int64_t height;
+    u_int64_t width;
+};
+
 
 struct EllpackMatrix* parse_matrix(char *matrix_path);
 void write_matrix(struct EllpackMatrix* matrix, char *out_path);
 
+/** the first lines of the text format, the rows follow panel by panel with write_matrix_rows */
+void write_matrix_header(FILE *out_file, u_int64_t height, u_int64_t real_width);
+/**
+ * appends the rows of a panel starting at first_row of a text matrix of the given height,
+ * width is the largest width of the panels written so far including this one
+ */
+void write_matrix_rows(FILE *out_file, const struct EllpackMatrix *rows, u_int64_t first_row, u_int64_t height, u_int64_t width);
+
+/** the same text format with double values, written with 17 significant digits */
+struct EllpackMatrixF64* parse_matrix_f64(char *matrix_path);
+void write_matrix_f64(struct EllpackMatrixF64* matrix, char *out_path);
+
+/** suppresses the progress output of the parse functions */
+void set_parser_quiet(int quiet);
+
+/** checks whether the file starts with the magic of the binary format */
+int is_binary_matrix(char *matrix_path);
+/** size in bytes of one stored value of the given type */
+size_t binary_value_size(u_int32_t value_type);
+/** reads and validates the header, the file is left at the start of the values */
+void read_binary_header(FILE *matrix_file, struct BinaryHeader *header, char *matrix_path);
+/**
+ * reads the indices following the values, compressed indices are decoded, returns 0 if the file is truncated,
+ * the file is rejected if an index is not below real_width or the indices of a row do not increase up to its first
+ * zero value, values are the ones read before as float, double or 16 bit by value_size
+ */
+int read_binary_indices(FILE *matrix_file, const struct BinaryHeader *header, const void *values, size_t value_size,
+                        u_int64_t *indices, char *matrix_path);
+void write_binary_header(FILE *out_file, u_int32_t value_type, u_int64_t real_width, u_int64_t height, u_int64_t width, char *out_path);
+
+/** reads a binary matrix, 16 bit values are widened to float and doubles are narrowed */
+struct EllpackMatrix* parse_matrix_binary(char *matrix_path);
+void write_matrix_binary(struct EllpackMatrix* matrix, char *out_path);
+struct EllpackMatrixF64* parse_matrix_f64_binary(char *matrix_path);
+void write_matrix_f64_binary(struct EllpackMatrixF64* matrix, char *out_path);
+
+/** reads a matrix with compressed indices, matrices in the other formats are compressed after loading */
+struct CompressedEllpack* parse_matrix_compressed(char *matrix_path);
+void write_matrix_compressed_binary(struct CompressedEllpack* matrix, char *out_path);
+
+/** checks whether the file starts with the magic of the dense binary format, ELLD, read by parse_matrix as well */
+int is_dense_matrix(char *matrix_path);
+/** the dense format has the header of the binary format with width = real_width followed by the height * width values */
+struct DenseMatrix* parse_matrix_dense_binary(char *matrix_path);
+void write_matrix_dense_binary(struct DenseMatrix* matrix, char *out_path);
+/** writes the non zero entries in the text format, the same text as write_matrix of the matrix in ELLPACK */
+void write_matrix_dense(struct DenseMatrix* matrix, char *out_path);
+
+/** a matrix read panel by panel of consecutive rows */
+struct MatrixStream;
+
+/**
+ * opens a text or binary matrix for reading in panels and returns its dimensions,
+ * the rows of a text matrix have to be in ascending order
+ */
+struct MatrixStream *open_matrix_stream(char *matrix_path, u_int64_t *height, u_int64_t *real_width);
+/** the next panel of up to rows rows starting at first_row with a width of its own, NULL after the last row */
+struct EllpackMatrix *read_matrix_panel(struct MatrixStream *stream, u_int64_t rows, u_int64_t *first_row);
+void close_matrix_stream(struct MatrixStream *stream);
+
 #endif //PROJEKTAUFGABE_PARSER_H
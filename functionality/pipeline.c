@@ -0,0 +1,354 @@
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include "multiplication.h"
+#include "memory.h"
+#include "parser.h"
+#include "pruning.h"
+#include "scheduler.h"
+
+// panels a queue holds before the stage filling it has to wait
+#define QUEUE_PANELS 4
+
+/** consecutive rows of a matrix starting at first_row */
+struct Panel {
+    u_int64_t first_row;
+    struct EllpackMatrix *rows;
+};
+
+/** a bounded first in first out queue of panels, push waits while it is full and pop while it is empty */
+struct PanelQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct Panel items[QUEUE_PANELS];
+    int head;
+    int count;
+    int closed; // no more panels will be pushed
+};
+
+/** seconds a stage spent working and waiting on its queues */
+struct StageStats {
+    double busy;
+    double waited;
+    u_int64_t panels;
+};
+
+struct Pipeline {
+    struct MatrixStream *stream;
+    u_int64_t panel_rows;
+    u_int64_t height;
+    u_int64_t real_width; // of the result
+    char *out_path;
+    struct PanelQueue loaded;
+    struct PanelQueue finished;
+    struct StageStats load;
+    struct StageStats multiply;
+    struct StageStats write;
+};
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return end.tv_sec - start->tv_sec + 1e-9 * (end.tv_nsec - start->tv_nsec);
+}
+
+static void queue_init(struct PanelQueue *q) {
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->head = 0;
+    q->count = 0;
+    q->closed = 0;
+}
+
+static void queue_destroy(struct PanelQueue *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->changed);
+}
+
+static void queue_push(struct PanelQueue *q, struct Panel panel, double *waited) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&q->lock);
+    while (q->count == QUEUE_PANELS) {
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    q->items[(q->head + q->count) % QUEUE_PANELS] = panel;
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    *waited += seconds_since(&start);
+}
+
+// returns 0 once the queue is closed and empty
+static int queue_pop(struct PanelQueue *q, struct Panel *panel, double *waited) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) {
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    int popped = q->count > 0;
+    if (popped) {
+        *panel = q->items[q->head];
+        q->head = (q->head + 1) % QUEUE_PANELS;
+        q->count--;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    *waited += seconds_since(&start);
+    return popped;
+}
+
+static void queue_close(struct PanelQueue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void *load_stage(void *arg) {
+    struct Pipeline *p = arg;
+    while (1) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        struct Panel panel = {0};
+        panel.rows = read_matrix_panel(p->stream, p->panel_rows, &panel.first_row);
+        p->load.busy += seconds_since(&start);
+        if (!panel.rows) {
+            break;
+        }
+        queue_push(&p->loaded, panel, &p->load.waited);
+        p->load.panels++;
+    }
+    queue_close(&p->loaded);
+    return NULL;
+}
+
+// writes the rows in the format of write_matrix
+static void *write_stage(void *arg) {
+    struct Pipeline *p = arg;
+    FILE *out_file = fopen(p->out_path, "w");
+    if (!out_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", p->out_path);
+    }
+    write_matrix_header(out_file, p->height, p->real_width);
+    u_int64_t width = 0;
+    struct Panel panel = {0};
+    while (queue_pop(&p->finished, &panel, &p->write.waited)) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        width = panel.rows->width > width ? panel.rows->width : width;
+        write_matrix_rows(out_file, panel.rows, panel.first_row, p->height, width);
+        free_ellpack(panel.rows);
+        p->write.busy += seconds_since(&start);
+        p->write.panels++;
+    }
+    if (ferror(out_file)) {
+        error(1, 0, "Error while writing matrix file %s", p->out_path);
+    }
+    fclose(out_file);
+    return NULL;
+}
+
+int run_pipeline(char *a_path, char *b_path, char *out_path, u_int64_t panel_rows) {
+    struct timespec total;
+    clock_gettime(CLOCK_MONOTONIC, &total);
+    begin_memory_phase("pipeline");
+    struct Pipeline p = {0};
+    p.panel_rows = panel_rows;
+    p.out_path = out_path;
+    u_int64_t a_width;
+    p.stream = open_matrix_stream(a_path, &p.height, &a_width);
+    queue_init(&p.loaded);
+    queue_init(&p.finished);
+    printf("[LOAD] Streaming Matrix A [%lu x %lu] in panels of %lu rows\n", a_width, p.height, panel_rows);
+    pthread_t loader;
+    if (pthread_create(&loader, NULL, load_stage, &p) != 0) {
+        error(1, 0, "Error: The loader thread could not be started");
+    }
+
+    // b is needed as a whole, it is loaded while the first panels of a arrive
+    printf("[LOAD] Loading Matrix B ...\n");
+    struct EllpackMatrix *bmatrix = parse_matrix(b_path);
+    if (p.height != bmatrix->real_width) {
+        error(1, 0, "Error: Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu", p.height, bmatrix->real_width);
+    }
+    printf("[DONE] Matrix B loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", bmatrix->width, bmatrix->real_width, bmatrix->height);
+    struct EllpackMatrix *bx = transpose_ellpack_parallel(bmatrix);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+    }
+    p.real_width = bmatrix->real_width;
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, write_stage, &p) != 0) {
+        error(1, 0, "Error: The writer thread could not be started");
+    }
+
+    printf("[MUL] Multiplying the panels of Matrix A while they are loaded and written to %s ...\n", out_path);
+    struct Panel panel = {0};
+    while (queue_pop(&p.loaded, &panel, &p.multiply.waited)) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        struct EllpackMatrix *result = calloc(1, sizeof(*result));
+        if (!result) {
+            error(1, 0, "an allocation has failed");
+        }
+        matr_mult_ellpack_transposed(panel.rows, bx, bmatrix->real_width, result);
+        free_ellpack(panel.rows);
+        p.multiply.busy += seconds_since(&start);
+        queue_push(&p.finished, (struct Panel) {panel.first_row, result}, &p.multiply.waited);
+        p.multiply.panels++;
+    }
+    queue_close(&p.finished);
+    pthread_join(loader, NULL);
+    pthread_join(writer, NULL);
+
+    double elapsed = seconds_since(&total);
+    double stages = p.load.busy + p.multiply.busy + p.write.busy;
+    printf("\n[PIPELINE] %lu panels in %f secs, the stages were busy for %f secs together (%.2fx overlap)\n",
+           p.multiply.panels, elapsed, stages, elapsed > 0 ? stages / elapsed : 0.0);
+    const char *names[3] = {"load", "multiply", "write"};
+    const struct StageStats *stats[3] = {&p.load, &p.multiply, &p.write};
+    for (int i = 0; i < 3; i++) {
+        printf("[PIPELINE] %-8s busy %f secs, waiting on the queues %f secs\n", names[i], stats[i]->busy, stats[i]->waited);
+    }
+    if (prune_active()) {
+        printf("[PRUNE] %lu entries dropped while accumulating\n", take_pruned_entries());
+    }
+    end_memory_phase();
+    printf("[FREE] Freeing used memory ...\n");
+    close_matrix_stream(p.stream);
+    queue_destroy(&p.loaded);
+    queue_destroy(&p.finished);
+    free_ellpack(bmatrix);
+    free_ellpack(bx);
+    return 0;
+}
+
+// an upper bound of the entries of every result row: the entries of the rows of b its row of a meets, at most the
+// number of columns of the result
+static u_int64_t *result_row_bounds(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t columns) {
+    u_int64_t *bounds = calloc(a->height + 1, sizeof(u_int64_t));
+    u_int64_t *b_lengths = calloc(b->height + 1, sizeof(u_int64_t));
+    if (!bounds || !b_lengths) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(b, b_row_i);
+    }
+    for (u_int64_t a_row_i = 0; a_row_i < a->height; a_row_i++) {
+        u_int64_t length = rowlength_ellpack(a, a_row_i);
+        for (u_int64_t a_col_i = 0; a_col_i < length && bounds[a_row_i] < columns; a_col_i++) {
+            u_int64_t k = a->indices[a_row_i * a->width + a_col_i];
+            bounds[a_row_i] += k < b->height ? b_lengths[k] : 0;
+        }
+        bounds[a_row_i] = bounds[a_row_i] < columns ? bounds[a_row_i] : columns;
+    }
+    free(b_lengths);
+    return bounds;
+}
+
+// the most bytes malloc_usable_size adds to a request
+static const u_int64_t BLOCK_BYTES = 24;
+// per row the lengths, costs, row pointers and pieces and the two blocks of the row before flatten_ellpack
+static const u_int64_t ROW_BYTES = 6 * sizeof(u_int64_t) + 2 * 24;
+// the entries of a row before and after flatten_ellpack
+static const u_int64_t ENTRY_BYTES = sizeof(float) + sizeof(u_int64_t);
+
+// the bytes matr_mult_ellpack_transposed allocates whatever the number of rows: the rows of every thread, the row
+// lengths of bx, a pruner per thread and the blocks of its arrays
+static u_int64_t transposed_fixed_bytes(u_int64_t columns) {
+    u_int64_t threads = (u_int64_t) scheduler_threads();
+    u_int64_t pruners = prune_active() ? threads * (columns + 1) * sizeof(struct PrunedEntry) : 0;
+    return threads * (columns + 1) * ENTRY_BYTES + columns * sizeof(u_int64_t) + pruners + (4 * threads + 16) * BLOCK_BYTES;
+}
+
+// the transpose of b, a row per column of b as wide as the fullest column, the counters of transposing it and the
+// allocations of the multiplication with it that do not grow with the rows of a
+static u_int64_t transpose_bytes(const struct EllpackMatrix *b) {
+    u_int64_t columns = realwidth_ellpack(b);
+    u_int64_t *counts = calloc(columns + 1, sizeof(u_int64_t));
+    if (!counts) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t fullest = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < b->height; b_row_i++) {
+        u_int64_t length = rowlength_ellpack(b, b_row_i);
+        for (u_int64_t b_col_i = 0; b_col_i < length; b_col_i++) {
+            u_int64_t column = b->indices[b_row_i * b->width + b_col_i];
+            if (column < columns && ++counts[column] > fullest) {
+                fullest = counts[column];
+            }
+        }
+    }
+    free(counts);
+    return columns * fullest * ENTRY_BYTES + (b->height + 2 * columns) * sizeof(u_int64_t) + transposed_fixed_bytes(columns);
+}
+
+u_int64_t multiply_bytes(const struct EllpackMatrix *a, const struct EllpackMatrix *b) {
+    u_int64_t columns = realwidth_ellpack(b);
+    u_int64_t *bounds = result_row_bounds(a, b, columns);
+    u_int64_t entries = 0;
+    u_int64_t widest = 0;
+    for (u_int64_t a_row_i = 0; a_row_i < a->height; a_row_i++) {
+        entries += bounds[a_row_i];
+        widest = bounds[a_row_i] > widest ? bounds[a_row_i] : widest;
+    }
+    free(bounds);
+    return transpose_bytes(b) + a->height * (ROW_BYTES + widest * ENTRY_BYTES) + entries * ENTRY_BYTES;
+}
+
+int multiply_in_panels(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t budget, FILE *out_file,
+                       u_int64_t *panels) {
+    *panels = 0;
+    u_int64_t columns = realwidth_ellpack(b);
+    u_int64_t fixed = transpose_bytes(b) + (a->height + 1) * sizeof(u_int64_t); // and the bounds of the rows
+    u_int64_t available = budget > fixed ? budget - fixed : 0;
+    u_int64_t *bounds = result_row_bounds(a, b, columns);
+    for (u_int64_t a_row_i = 0; a_row_i < a->height; a_row_i++) {
+        if (ROW_BYTES + 2 * bounds[a_row_i] * ENTRY_BYTES > available) {
+            free(bounds);
+            return 0;
+        }
+    }
+    struct EllpackMatrix *bx = transpose_ellpack_parallel(b);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+    }
+    write_matrix_header(out_file, a->height, b->real_width);
+    u_int64_t width = 0;
+    u_int64_t begin = 0;
+    while (begin < a->height) {
+        // grow the panel while its rows, padded to the widest of them, fit
+        u_int64_t end = begin;
+        u_int64_t entries = 0;
+        u_int64_t widest = 0;
+        while (end < a->height) {
+            u_int64_t panel_widest = bounds[end] > widest ? bounds[end] : widest;
+            u_int64_t rows = end + 1 - begin;
+            if (rows * (ROW_BYTES + panel_widest * ENTRY_BYTES) + (entries + bounds[end]) * ENTRY_BYTES > available) {
+                break;
+            }
+            entries += bounds[end];
+            widest = panel_widest;
+            end++;
+        }
+        struct EllpackMatrix rows = {a->real_width, end - begin, a->width, a->values + begin * a->width,
+                                     a->indices + begin * a->width};
+        struct EllpackMatrix *result = calloc(1, sizeof(*result));
+        if (!result) {
+            error(1, 0, "an allocation has failed");
+        }
+        matr_mult_ellpack_transposed(&rows, bx, b->real_width, result);
+        width = result->width > width ? result->width : width;
+        write_matrix_rows(out_file, result, begin, a->height, width);
+        free_ellpack(result);
+        (*panels)++;
+        begin = end;
+    }
+    free(bounds);
+    free_ellpack(bx);
+    return 1;
+}
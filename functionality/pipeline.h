@@ -0,0 +1,28 @@
+#ifndef PROJEKTAUFGABE_PIPELINE_H
+#define PROJEKTAUFGABE_PIPELINE_H
+
+#include "ellpack_utility.h"
+
+/** rows of A per panel of the pipeline unless given */
+#define DEFAULT_PANEL_ROWS 1024
+
+/**
+ * multiplies A * B in three overlapping stages: a loader thread streams panels of panel_rows rows of A from the file,
+ * the calling thread multiplies every panel with the transpose of B as soon as it is there and a writer thread appends
+ * the finished rows to the text output, bounded queues between the stages stop a stage that runs ahead,
+ * the output is the same as the one of write_matrix
+ */
+int run_pipeline(char *a_path, char *b_path, char *out_path, u_int64_t panel_rows);
+
+/** an upper bound of the bytes matr_mult_ellpack_parallel allocates for a * b, counted from the row lengths */
+u_int64_t multiply_bytes(const struct EllpackMatrix *a, const struct EllpackMatrix *b);
+
+/**
+ * the lower memory strategy of --mem-limit: multiplies a * b in panels of rows of a cut so that the transpose of b
+ * and the allocations of one panel stay below budget bytes, every panel is written to out_file in the text format
+ * before the next one is multiplied, the full result never exists, returns 0 without writing if one row does not fit
+ */
+int multiply_in_panels(const struct EllpackMatrix *a, const struct EllpackMatrix *b, u_int64_t budget, FILE *out_file,
+                       u_int64_t *panels);
+
+#endif //PROJEKTAUFGABE_PIPELINE_H
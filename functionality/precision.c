@@ -0,0 +1,167 @@
+#include "precision.h"
+#include "memory.h"
+
+struct EllpackMatrixF64 *make_ellpack_f64(u_int64_t real_width, u_int64_t height, u_int64_t width, char* file) {
+    struct EllpackMatrixF64* ellpack = malloc(sizeof(struct EllpackMatrixF64));
+    if (!ellpack) {
+        error(1, 0, "Error: Not enough memory to load matrix %s", file);
+    }
+    ellpack->real_width = real_width;
+    ellpack->width = width;
+    ellpack->height = height;
+    ellpack->values = alloc_array(width * height * sizeof(double), 1);
+    ellpack->indices = alloc_array(width * height * sizeof(u_int64_t), 1);
+    if((!ellpack->values || !ellpack->indices) && width * height > 0) {
+        error(1, 0, "Error: Not enough memory to load matrix %s", file);
+    }
+    return ellpack;
+}
+
+void free_ellpack_f64(struct EllpackMatrixF64 *x) {
+    free(x->values);
+    free(x->indices);
+    free(x);
+}
+
+int valid_ellpack_f64(const struct EllpackMatrixF64 *x) {
+    return x && x->values && x->indices;
+}
+
+struct EllpackMatrixF64 *f64_from_ellpack(const struct EllpackMatrix *x) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    struct EllpackMatrixF64 *r = make_ellpack_f64(x->real_width, x->height, x->width, "");
+    for (u_int64_t i = 0; i < x->height * x->width; i++) {
+        r->values[i] = x->values[i];
+    }
+    memcpy(r->indices, x->indices, x->height * x->width * sizeof(u_int64_t));
+    return r;
+}
+
+struct EllpackMatrix *ellpack_from_f64(const struct EllpackMatrixF64 *x) {
+    if (!valid_ellpack_f64(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    struct EllpackMatrix *r = make_ellpack(x->real_width, x->height, x->width, "");
+    for (u_int64_t i = 0; i < x->height * x->width; i++) {
+        r->values[i] = (float) x->values[i];
+    }
+    memcpy(r->indices, x->indices, x->height * x->width * sizeof(u_int64_t));
+    return r;
+}
+
+// row helpers of one value type, the transpose counts the entries per column and fills the rows in one pass
+#define DEFINE_ELLPACK_HELPERS(SUFFIX, MATRIX, T, MAKE)                                               \
+static u_int64_t rowlength_##SUFFIX(const MATRIX *x, u_int64_t row) {                                 \
+    u_int64_t length = 0;                                                                             \
+    while (length < x->width && x->values[row * x->width + length] != 0) {                            \
+        length++;                                                                                     \
+    }                                                                                                 \
+    return length;                                                                                    \
+}                                                                                                     \
+                                                                                                      \
+static MATRIX *transpose_##SUFFIX(const MATRIX *x) {                                                  \
+    u_int64_t *x_lengths = calloc(x->height, sizeof(u_int64_t));                                      \
+    u_int64_t *counts = calloc(x->real_width, sizeof(u_int64_t));                                     \
+    if (!x_lengths || !counts) {                                                                      \
+        error(1, 0, "an allocation has failed");                                                      \
+    }                                                                                                 \
+    u_int64_t height = 0;                                                                             \
+    u_int64_t max_width = 0;                                                                          \
+    for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {                                     \
+        x_lengths[x_row_i] = rowlength_##SUFFIX(x, x_row_i);                                          \
+        for (u_int64_t x_col_i = 0; x_col_i < x_lengths[x_row_i]; x_col_i++) {                        \
+            u_int64_t column = x->indices[x_row_i * x->width + x_col_i];                              \
+            if (column >= x->real_width) {                                                            \
+                continue;                                                                             \
+            }                                                                                         \
+            if (++counts[column] > max_width) {                                                       \
+                max_width = counts[column];                                                           \
+            }                                                                                         \
+            if (column + 1 > height) {                                                                \
+                height = column + 1;                                                                  \
+            }                                                                                         \
+        }                                                                                             \
+    }                                                                                                 \
+    MATRIX *r = MAKE(x->height, height, max_width, "");                                               \
+    memset(r->values, 0, height * max_width * sizeof(T));                                             \
+    memset(r->indices, 0, height * max_width * sizeof(u_int64_t));                                    \
+    memset(counts, 0, x->real_width * sizeof(u_int64_t));                                             \
+    for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {                                     \
+        for (u_int64_t x_col_i = 0; x_col_i < x_lengths[x_row_i]; x_col_i++) {                        \
+            u_int64_t column = x->indices[x_row_i * x->width + x_col_i];                              \
+            if (column >= x->real_width) {                                                            \
+                continue;                                                                             \
+            }                                                                                         \
+            u_int64_t position = column * r->width + counts[column]++;                                \
+            r->values[position] = x->values[x_row_i * x->width + x_col_i];                            \
+            r->indices[position] = x_row_i;                                                           \
+        }                                                                                             \
+    }                                                                                                 \
+    free(x_lengths);                                                                                  \
+    free(counts);                                                                                     \
+    return r;                                                                                         \
+}
+
+DEFINE_ELLPACK_HELPERS(f32, struct EllpackMatrix, float, make_ellpack)
+DEFINE_ELLPACK_HELPERS(f64, struct EllpackMatrixF64, double, make_ellpack_f64)
+
+static void flatten_f64(struct EllpackMatrixF64 *x, double **values, u_int64_t **indices, u_int64_t *lengths) {
+    x->values = alloc_array(x->height * x->width * sizeof(double), 1);
+    x->indices = alloc_array(x->height * x->width * sizeof(u_int64_t), 1);
+    if (x->values && x->indices) {
+        for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {
+            memcpy(x->values + x_row_i * x->width, values[x_row_i], lengths[x_row_i] * sizeof(double));
+            memcpy(x->indices + x_row_i * x->width, indices[x_row_i], lengths[x_row_i] * sizeof(u_int64_t));
+        }
+    }
+    for (u_int64_t x_row_i = 0; x_row_i < x->height; x_row_i++) {
+        free(values[x_row_i]);
+        free(indices[x_row_i]);
+    }
+    free(values);
+    free(indices);
+    free(lengths);
+}
+
+// float storage and accumulation
+#define KERNEL matr_mult_ellpack_f32
+#define IN_T float
+#define IN_MATRIX struct EllpackMatrix
+#define IN_ROWLENGTH rowlength_f32
+#define IN_TRANSPOSE transpose_f32
+#define IN_FREE free_ellpack
+#define ACC_T float
+#define OUT_T float
+#define OUT_MATRIX struct EllpackMatrix
+#define OUT_FLATTEN flatten_ellpack
+#include "precision_template.h"
+
+// double storage and accumulation
+#define KERNEL matr_mult_ellpack_f64
+#define IN_T double
+#define IN_MATRIX struct EllpackMatrixF64
+#define IN_ROWLENGTH rowlength_f64
+#define IN_TRANSPOSE transpose_f64
+#define IN_FREE free_ellpack_f64
+#define ACC_T double
+#define OUT_T double
+#define OUT_MATRIX struct EllpackMatrixF64
+#define OUT_FLATTEN flatten_f64
+#include "precision_template.h"
+
+// float storage, the products are widened and accumulated in double
+#define KERNEL matr_mult_ellpack_f32_acc64
+#define IN_T float
+#define IN_MATRIX struct EllpackMatrix
+#define IN_ROWLENGTH rowlength_f32
+#define IN_TRANSPOSE transpose_f32
+#define IN_FREE free_ellpack
+#define ACC_T double
+#define OUT_T double
+#define OUT_MATRIX struct EllpackMatrixF64
+#define OUT_FLATTEN flatten_f64
+#include "precision_template.h"
@@ -0,0 +1,34 @@
+#ifndef PROJEKTAUFGABE_PRECISION_H
+#define PROJEKTAUFGABE_PRECISION_H
+
+#include "ellpack_utility.h"
+
+/** an EllpackMatrix storing double values */
+struct EllpackMatrixF64 {
+    u_int64_t real_width;
+    u_int64_t height;
+    u_int64_t width;
+    double *values;
+    u_int64_t *indices;
+};
+
+struct EllpackMatrixF64 *make_ellpack_f64(u_int64_t real_width, u_int64_t height, u_int64_t width, char* file);
+void free_ellpack_f64(struct EllpackMatrixF64 *x);
+int valid_ellpack_f64(const struct EllpackMatrixF64 *x);
+
+/** widens the values of x to double */
+struct EllpackMatrixF64 *f64_from_ellpack(const struct EllpackMatrix *x);
+/** rounds the values of x to float */
+struct EllpackMatrix *ellpack_from_f64(const struct EllpackMatrixF64 *x);
+
+/**
+ * kernels generated from one type generic scalar merge (see precision_template.h), f32 gives the bits of
+ * matr_mult_ellpack:
+ * f32 takes and returns EllpackMatrix, f64 takes and returns EllpackMatrixF64,
+ * f32_acc64 takes EllpackMatrix, accumulates in double and returns EllpackMatrixF64
+ */
+void matr_mult_ellpack_f32(const void* a, const void* b, void* result);
+void matr_mult_ellpack_f64(const void* a, const void* b, void* result);
+void matr_mult_ellpack_f32_acc64(const void* a, const void* b, void* result);
+
+#endif //PROJEKTAUFGABE_PRECISION_H
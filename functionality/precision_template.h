@@ -0,0 +1,112 @@
+// Type generic merge multiplication, included by precision.c once per kernel variant.
+// No include guard on purpose, the parameters below have to be defined before every inclusion
+// and are undefined again at the end:
+//
+// KERNEL              name of the generated multiplication
+// IN_T, IN_MATRIX     value type and struct of both input matrices
+// IN_ROWLENGTH        used entries of a row of an input matrix
+// IN_TRANSPOSE        transpose of an input matrix, IN_FREE releases it
+// ACC_T               type of the accumulator of each result entry
+// OUT_T, OUT_MATRIX   value type and struct of the result, OUT_FLATTEN builds it from its rows
+//
+// the merge is scalar and adds the products one after another in the order of k like matr_mult_ellpack, so the float
+// kernel gives its bits and products that cancel leave no entry, a vector path would have to sum in lanes
+
+#define TEMPLATE_CONCAT_(x, y) x##y
+#define TEMPLATE_CONCAT(x, y) TEMPLATE_CONCAT_(x, y)
+#define DOT TEMPLATE_CONCAT(KERNEL, _dot)
+
+static ACC_T DOT(const IN_T *a_values, const u_int64_t *a_indices, u_int64_t a_length,
+                 const IN_T *b_values, const u_int64_t *b_indices, u_int64_t b_length) {
+    ACC_T res_sum = 0;
+    u_int64_t a_column_i = 0;
+    u_int64_t b_column_i = 0;
+    while (a_column_i < a_length && b_column_i < b_length) {
+        if (a_indices[a_column_i] == b_indices[b_column_i]) {
+            res_sum += (ACC_T) a_values[a_column_i++] * (ACC_T) b_values[b_column_i++];
+        } else if (a_indices[a_column_i] > b_indices[b_column_i]) {
+            b_column_i++;
+        } else {
+            a_column_i++;
+        }
+    }
+    return res_sum;
+}
+
+void KERNEL(const void* a, const void* b, void* result) {
+    const IN_MATRIX *ax = a;
+    OUT_MATRIX *r = result;
+    if (!ax || !ax->values || !ax->indices || !b || !((const IN_MATRIX *) b)->values || !((const IN_MATRIX *) b)->indices) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    IN_MATRIX *bx = IN_TRANSPOSE(b);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+        return;
+    }
+    r->height = ax->height;
+    // arrays of result rows
+    OUT_T **r_values = calloc(r->height, sizeof(OUT_T *));
+    u_int64_t **r_indices = calloc(r->height, sizeof(u_int64_t *));
+    u_int64_t *r_row_lengths = calloc(ax->height, sizeof(u_int64_t));
+    u_int64_t *b_lengths = calloc(bx->height, sizeof(u_int64_t));
+    u_int64_t max_width = 0;
+    // array of upper limit size for each result row
+    OUT_T *r_row_values = calloc(bx->height, sizeof(OUT_T));
+    u_int64_t *r_row_indices = calloc(bx->height, sizeof(u_int64_t));
+    if (!r_values || !r_indices || !r_row_lengths || !b_lengths || !r_row_indices || !r_row_values) {
+        r->height = 0; // skip all loops and go to cleanup
+    }
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height && r->height > 0; b_row_i++) {
+        b_lengths[b_row_i] = IN_ROWLENGTH(bx, b_row_i);
+    }
+    for (u_int64_t r_row_i = 0; r_row_i < r->height; r_row_i++) {
+        u_int64_t a_length = IN_ROWLENGTH(ax, r_row_i);
+        u_int64_t r_column_counter = 0;
+        for (u_int64_t b_row_i = 0; b_row_i < bx->height && a_length > 0; b_row_i++) {
+            ACC_T res_sum = DOT(ax->values + r_row_i * ax->width, ax->indices + r_row_i * ax->width, a_length,
+                                bx->values + b_row_i * bx->width, bx->indices + b_row_i * bx->width, b_lengths[b_row_i]);
+            // only add the result entry if it s not zero
+            if (res_sum != 0.0) {
+                r_row_values[r_column_counter] = (OUT_T) res_sum;
+                r_row_indices[r_column_counter] = b_row_i;
+                r_column_counter++;
+            }
+        }
+        if (r_column_counter > max_width) {
+            max_width = r_column_counter;
+        }
+        // store the resulting row with its length
+        r_values[r_row_i] = calloc(r_column_counter, sizeof(OUT_T));
+        r_indices[r_row_i] = calloc(r_column_counter, sizeof(u_int64_t));
+        if (!r_values[r_row_i] || !r_indices[r_row_i]) {
+            r->height = r_row_i + 1; // only clean up to this row in the flatten method
+            break;
+        }
+        memcpy(r_values[r_row_i], r_row_values, sizeof(OUT_T) * r_column_counter);
+        memcpy(r_indices[r_row_i], r_row_indices, sizeof(u_int64_t) * r_column_counter);
+        r_row_lengths[r_row_i] = r_column_counter;
+    }
+    r->width = max_width;
+    OUT_FLATTEN(r, r_values, r_indices, r_row_lengths);
+    free(r_row_values);
+    free(r_row_indices);
+    free(b_lengths);
+    IN_FREE(bx);
+    r->real_width = ((const IN_MATRIX *) b)->real_width;
+}
+
+#undef DOT
+#undef TEMPLATE_CONCAT
+#undef TEMPLATE_CONCAT_
+#undef KERNEL
+#undef IN_T
+#undef IN_MATRIX
+#undef IN_ROWLENGTH
+#undef IN_TRANSPOSE
+#undef IN_FREE
+#undef ACC_T
+#undef OUT_T
+#undef OUT_MATRIX
+#undef OUT_FLATTEN
@@ -0,0 +1,113 @@
+#include "pruning.h"
+
+#include <stdatomic.h>
+
+static struct PruneRule configured_rule = {0.0F, 0.0F, 0};
+static _Atomic u_int64_t pruned_entries = 0;
+
+void set_prune_rule(struct PruneRule rule) {
+    configured_rule = rule;
+}
+
+struct PruneRule prune_rule(void) {
+    return configured_rule;
+}
+
+int prune_active(void) {
+    return configured_rule.absolute > 0.0F || prune_needs_rows();
+}
+
+int prune_needs_rows(void) {
+    return configured_rule.relative > 0.0F || configured_rule.top_k > 0;
+}
+
+u_int64_t take_pruned_entries(void) {
+    return atomic_exchange(&pruned_entries, 0);
+}
+
+void init_pruner(struct RowPruner *p, u_int64_t capacity) {
+    p->rule = configured_rule;
+    p->count = 0;
+    p->offered = 0;
+    p->squares = 0.0;
+    if (p->rule.top_k > 0 && p->rule.top_k < capacity) {
+        capacity = p->rule.top_k;
+    }
+    p->entries = malloc((capacity > 0 ? capacity : 1) * sizeof(struct PrunedEntry));
+    if (!p->entries) {
+        error(1, 0, "an allocation has failed");
+    }
+}
+
+void free_pruner(struct RowPruner *p) {
+    free(p->entries);
+}
+
+// the entry top k would give up first
+static int weaker(struct PrunedEntry x, struct PrunedEntry y) {
+    float p = fabsf(x.value);
+    float q = fabsf(y.value);
+    return p < q || (p == q && x.index > y.index);
+}
+
+static void sift_down(struct PrunedEntry *heap, u_int64_t count, u_int64_t i) {
+    while (2 * i + 1 < count) {
+        u_int64_t child = 2 * i + 1;
+        if (child + 1 < count && weaker(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!weaker(heap[child], heap[i])) {
+            break;
+        }
+        struct PrunedEntry swap = heap[i];
+        heap[i] = heap[child];
+        heap[child] = swap;
+        i = child;
+    }
+}
+
+void prune_offer(struct RowPruner *p, float value, u_int64_t index) {
+    p->offered++;
+    p->squares += (double) value * value;
+    if (fabsf(value) < p->rule.absolute) {
+        return;
+    }
+    struct PrunedEntry entry = {index, value};
+    if (p->rule.top_k == 0 || p->count < p->rule.top_k) {
+        u_int64_t i = p->count++;
+        p->entries[i] = entry;
+        // sift up, without top k the entries just stay in the order they came
+        while (p->rule.top_k > 0 && i > 0 && weaker(p->entries[i], p->entries[(i - 1) / 2])) {
+            struct PrunedEntry swap = p->entries[i];
+            p->entries[i] = p->entries[(i - 1) / 2];
+            p->entries[(i - 1) / 2] = swap;
+            i = (i - 1) / 2;
+        }
+    } else if (weaker(p->entries[0], entry)) {
+        p->entries[0] = entry;
+        sift_down(p->entries, p->count, 0);
+    }
+}
+
+u_int64_t prune_finish(struct RowPruner *p, float *values, u_int64_t *indices) {
+    if (p->rule.top_k > 0) {
+        qsort(p->entries, p->count, sizeof(struct PrunedEntry), compare_columns);
+    }
+    // |value| < relative * norm compared in squares, so no square root is needed
+    double threshold = (double) p->rule.relative * p->rule.relative * p->squares;
+    u_int64_t kept = 0;
+    for (u_int64_t i = 0; i < p->count; i++) {
+        double value = p->entries[i].value;
+        if (p->rule.relative > 0.0F && value * value < threshold) {
+            continue;
+        }
+        values[kept] = p->entries[i].value;
+        indices[kept] = p->entries[i].index;
+        kept++;
+    }
+    atomic_fetch_add(&pruned_entries, p->offered - kept);
+    p->count = 0;
+    p->offered = 0;
+    p->squares = 0.0;
+    return kept;
+}
@@ -0,0 +1,48 @@
+#ifndef PROJEKTAUFGABE_PRUNING_H
+#define PROJEKTAUFGABE_PRUNING_H
+
+#include "ellpack_utility.h"
+
+/** entries the kernels drop while they accumulate a result row, a rule of 0 is off */
+struct PruneRule {
+    float absolute; // drop entries with |value| < absolute
+    float relative; // drop entries with |value| < relative * the euclidean norm of the row before pruning
+    u_int64_t top_k; // keep only the k entries of largest magnitude, the lower column wins a tie
+};
+
+/** sets the rule of matr_mult_ellpack and matr_mult_ellpack_parallel, all zero switches pruning off */
+void set_prune_rule(struct PruneRule rule);
+struct PruneRule prune_rule(void);
+int prune_active(void);
+/** whether the rule needs the whole row of an entry to decide, so rows must not be split */
+int prune_needs_rows(void);
+
+/** entries dropped since the last call */
+u_int64_t take_pruned_entries(void);
+
+/** an entry of a result row kept by a RowPruner, the column comes first so the entries sort with compare_columns */
+struct PrunedEntry {
+    u_int64_t index;
+    float value;
+};
+
+/**
+ * collects the entries of one result row as they are computed in ascending columns, absolute drops at once,
+ * top k keeps a heap of the k largest entries and relative drops at the end when the norm is known
+ */
+struct RowPruner {
+    struct PruneRule rule;
+    u_int64_t count;
+    u_int64_t offered;
+    double squares; // of all offered entries
+    struct PrunedEntry *entries; // a heap with the weakest entry first under top k, otherwise in ascending columns
+};
+
+/** capacity is the most entries a row can have */
+void init_pruner(struct RowPruner *p, u_int64_t capacity);
+void free_pruner(struct RowPruner *p);
+void prune_offer(struct RowPruner *p, float value, u_int64_t index);
+/** writes the kept entries in ascending columns, returns their number and resets the pruner for the next row */
+u_int64_t prune_finish(struct RowPruner *p, float *values, u_int64_t *indices);
+
+#endif //PROJEKTAUFGABE_PRUNING_H
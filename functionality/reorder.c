@@ -0,0 +1,297 @@
+#include "reorder.h"
+
+#include <stdint.h>
+
+// columns used by more rows are skipped while clustering, they are shared by almost every row anyway
+#define CLUSTER_MAX_COLUMN_ROWS 1024
+
+static const char *ORDER_NAMES[] = {"none", "rcm", "degree", "cluster"};
+
+int row_order_from_name(const char *name) {
+    for (int i = 0; i < (int) (sizeof(ORDER_NAMES) / sizeof(ORDER_NAMES[0])); i++) {
+        if (strcmp(name, ORDER_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *row_order_name(enum RowOrder order) {
+    return ORDER_NAMES[order];
+}
+
+/** the rows of x grouped by column, column c holds rows [offsets[c], offsets[c + 1]) in ascending order */
+struct ColumnRows {
+    u_int64_t columns;
+    u_int64_t *offsets;
+    u_int64_t *rows;
+    u_int64_t *lengths; // entries of each row of x
+};
+
+static struct ColumnRows column_rows(const struct EllpackMatrix *x) {
+    struct ColumnRows c = {0, NULL, NULL, calloc(x->height, sizeof(u_int64_t))};
+    if (!c.lengths && x->height > 0) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t nnz = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        c.lengths[row] = rowlength_ellpack(x, row);
+        nnz += c.lengths[row];
+        for (u_int64_t i = 0; i < c.lengths[row]; i++) {
+            if (x->indices[row * x->width + i] + 1 > c.columns) {
+                c.columns = x->indices[row * x->width + i] + 1;
+            }
+        }
+    }
+    c.offsets = calloc(c.columns + 1, sizeof(u_int64_t));
+    c.rows = malloc(nnz * sizeof(u_int64_t));
+    if (!c.offsets || (!c.rows && nnz > 0)) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t row = 0; row < x->height; row++) {
+        for (u_int64_t i = 0; i < c.lengths[row]; i++) {
+            c.offsets[x->indices[row * x->width + i] + 1]++;
+        }
+    }
+    for (u_int64_t column = 0; column < c.columns; column++) {
+        c.offsets[column + 1] += c.offsets[column];
+    }
+    u_int64_t *fill = malloc((c.columns + 1) * sizeof(u_int64_t));
+    if (!fill) {
+        error(1, 0, "an allocation has failed");
+    }
+    memcpy(fill, c.offsets, (c.columns + 1) * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < x->height; row++) {
+        for (u_int64_t i = 0; i < c.lengths[row]; i++) {
+            c.rows[fill[x->indices[row * x->width + i]]++] = row;
+        }
+    }
+    free(fill);
+    return c;
+}
+
+static void free_column_rows(struct ColumnRows *c) {
+    free(c->offsets);
+    free(c->rows);
+    free(c->lengths);
+}
+
+struct RowKey {
+    u_int64_t key;
+    u_int64_t row;
+};
+
+static int compare_keys(const void *x, const void *y) {
+    const struct RowKey *p = x;
+    const struct RowKey *q = y;
+    if (p->key != q->key) {
+        return (p->key > q->key) - (p->key < q->key);
+    }
+    return (p->row > q->row) - (p->row < q->row);
+}
+
+// sorts rows by the key, ties keep the original row order
+static void sort_rows(u_int64_t *rows, u_int64_t count, const u_int64_t *keys, int descending, struct RowKey *buffer) {
+    for (u_int64_t i = 0; i < count; i++) {
+        buffer[i].key = descending ? UINT64_MAX - keys[rows[i]] : keys[rows[i]];
+        buffer[i].row = rows[i];
+    }
+    qsort(buffer, count, sizeof(struct RowKey), compare_keys);
+    for (u_int64_t i = 0; i < count; i++) {
+        rows[i] = buffer[i].row;
+    }
+}
+
+// breadth first search over rows and columns, every column is expanded once so the search stays linear in nnz
+static void order_rcm(const struct EllpackMatrix *x, const struct ColumnRows *c, u_int64_t *order, struct RowKey *buffer) {
+    char *visited = calloc(x->height, 1);
+    char *expanded = calloc(c->columns, 1);
+    u_int64_t *starts = malloc(x->height * sizeof(u_int64_t));
+    if (!visited || (!expanded && c->columns > 0) || !starts) {
+        error(1, 0, "an allocation has failed");
+    }
+    // every component starts at its row of the lowest degree
+    for (u_int64_t row = 0; row < x->height; row++) {
+        starts[row] = row;
+    }
+    sort_rows(starts, x->height, c->lengths, 0, buffer);
+    u_int64_t head = 0;
+    u_int64_t tail = 0;
+    for (u_int64_t start_i = 0; start_i < x->height; start_i++) {
+        if (visited[starts[start_i]]) {
+            continue;
+        }
+        visited[starts[start_i]] = 1;
+        order[tail++] = starts[start_i];
+        while (head < tail) {
+            u_int64_t row = order[head++];
+            u_int64_t first = tail;
+            for (u_int64_t i = 0; i < c->lengths[row]; i++) {
+                u_int64_t column = x->indices[row * x->width + i];
+                if (expanded[column]) {
+                    continue;
+                }
+                expanded[column] = 1;
+                for (u_int64_t j = c->offsets[column]; j < c->offsets[column + 1]; j++) {
+                    if (!visited[c->rows[j]]) {
+                        visited[c->rows[j]] = 1;
+                        order[tail++] = c->rows[j];
+                    }
+                }
+            }
+            sort_rows(order + first, tail - first, c->lengths, 0, buffer);
+        }
+    }
+    for (u_int64_t i = 0; i < x->height / 2; i++) {
+        u_int64_t swap = order[i];
+        order[i] = order[x->height - 1 - i];
+        order[x->height - 1 - i] = swap;
+    }
+    free(visited);
+    free(expanded);
+    free(starts);
+}
+
+// greedy chain, the next row is the unvisited row sharing the most columns with the current one
+static void order_cluster(const struct EllpackMatrix *x, const struct ColumnRows *c, u_int64_t *order) {
+    char *visited = calloc(x->height, 1);
+    u_int64_t *shared = calloc(x->height, sizeof(u_int64_t));
+    u_int64_t *touched = malloc(x->height * sizeof(u_int64_t));
+    if (!visited || !shared || !touched) {
+        error(1, 0, "an allocation has failed");
+    }
+    u_int64_t next_unvisited = 0;
+    u_int64_t row = 0;
+    for (u_int64_t count = 0; count < x->height; count++) {
+        order[count] = row;
+        visited[row] = 1;
+        u_int64_t touched_count = 0;
+        for (u_int64_t i = 0; i < c->lengths[row]; i++) {
+            u_int64_t column = x->indices[row * x->width + i];
+            if (c->offsets[column + 1] - c->offsets[column] > CLUSTER_MAX_COLUMN_ROWS) {
+                continue;
+            }
+            for (u_int64_t j = c->offsets[column]; j < c->offsets[column + 1]; j++) {
+                u_int64_t other = c->rows[j];
+                if (!visited[other] && shared[other]++ == 0) {
+                    touched[touched_count++] = other;
+                }
+            }
+        }
+        u_int64_t best = UINT64_MAX;
+        for (u_int64_t i = 0; i < touched_count; i++) {
+            if (best == UINT64_MAX || shared[touched[i]] > shared[best]
+                || (shared[touched[i]] == shared[best] && touched[i] < best)) {
+                best = touched[i];
+            }
+            shared[touched[i]] = 0;
+        }
+        if (best == UINT64_MAX) {
+            // nothing shared, continue with the first unvisited row of the file
+            while (next_unvisited < x->height && visited[next_unvisited]) {
+                next_unvisited++;
+            }
+            best = next_unvisited;
+        }
+        row = best;
+    }
+    free(visited);
+    free(shared);
+    free(touched);
+}
+
+u_int64_t *row_order(const struct EllpackMatrix *x, enum RowOrder order_type) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    u_int64_t *order = malloc(x->height * sizeof(u_int64_t));
+    struct RowKey *buffer = malloc(x->height * sizeof(struct RowKey));
+    if ((!order || !buffer) && x->height > 0) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t row = 0; row < x->height; row++) {
+        order[row] = row;
+    }
+    if (order_type != ORDER_NONE && x->height > 0) {
+        struct ColumnRows c = column_rows(x);
+        switch (order_type) {
+            case ORDER_RCM:
+                order_rcm(x, &c, order, buffer);
+                break;
+            case ORDER_DEGREE:
+                sort_rows(order, x->height, c.lengths, 1, buffer);
+                break;
+            case ORDER_CLUSTER:
+                order_cluster(x, &c, order);
+                break;
+            default:
+                break;
+        }
+        free_column_rows(&c);
+    }
+    free(buffer);
+    return order;
+}
+
+struct EllpackMatrix *permute_rows(const struct EllpackMatrix *x, const u_int64_t *order, int inverse) {
+    if (!valid_ellpack(x)) {
+        error(1, 0, "the argument matrix has wrong format");
+        return NULL;
+    }
+    struct EllpackMatrix *r = make_ellpack(x->real_width, x->height, x->width, "");
+    for (u_int64_t i = 0; i < x->height; i++) {
+        u_int64_t from = inverse ? i : order[i];
+        u_int64_t to = inverse ? order[i] : i;
+        memcpy(r->values + to * r->width, x->values + from * x->width, x->width * sizeof(float));
+        memcpy(r->indices + to * r->width, x->indices + from * x->width, x->width * sizeof(u_int64_t));
+    }
+    return r;
+}
+
+u_int64_t bandwidth_ellpack(const struct EllpackMatrix *x) {
+    u_int64_t bandwidth = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = rowlength_ellpack(x, row);
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t column = x->indices[row * x->width + i];
+            u_int64_t distance = column > row ? column - row : row - column;
+            if (distance > bandwidth) {
+                bandwidth = distance;
+            }
+        }
+    }
+    return bandwidth;
+}
+
+double column_reuse_ellpack(const struct EllpackMatrix *x, u_int64_t window) {
+    u_int64_t columns = 0;
+    for (u_int64_t i = 0; i < x->height * x->width; i++) {
+        if (x->values[i] != 0 && x->indices[i] + 1 > columns) {
+            columns = x->indices[i] + 1;
+        }
+    }
+    // the last row that used each column
+    u_int64_t *last_row = malloc(columns * sizeof(u_int64_t));
+    if (!last_row && columns > 0) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t column = 0; column < columns; column++) {
+        last_row[column] = UINT64_MAX;
+    }
+    u_int64_t hits = 0;
+    u_int64_t entries = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        u_int64_t length = rowlength_ellpack(x, row);
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t column = x->indices[row * x->width + i];
+            if (last_row[column] != UINT64_MAX && row - last_row[column] <= window) {
+                hits++;
+            }
+            last_row[column] = row;
+            entries++;
+        }
+    }
+    free(last_row);
+    return entries > 0 ? (double) hits / entries : 0.0;
+}
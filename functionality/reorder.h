@@ -0,0 +1,32 @@
+#ifndef PROJEKTAUFGABE_REORDER_H
+#define PROJEKTAUFGABE_REORDER_H
+
+#include "ellpack_utility.h"
+
+/** orders of the rows of a matrix before the multiplication */
+enum RowOrder {
+    ORDER_NONE, ORDER_RCM, ORDER_DEGREE, ORDER_CLUSTER
+};
+
+/** the order with the given name (none, rcm, degree, cluster), -1 if there is none */
+int row_order_from_name(const char *name);
+const char *row_order_name(enum RowOrder order);
+
+/**
+ * computes a permutation of the rows of x, row i of the reordered matrix is row order[i] of x:
+ * rcm is reverse Cuthill-McKee on the graph of rows sharing a column,
+ * degree sorts the rows by their number of entries, largest first,
+ * cluster chains every row to the unvisited row sharing the most columns with it
+ */
+u_int64_t *row_order(const struct EllpackMatrix *x, enum RowOrder order);
+
+/** creates the matrix with the rows x[order[i]], with inverse set row order[i] of the result is row i of x */
+struct EllpackMatrix *permute_rows(const struct EllpackMatrix *x, const u_int64_t *order, int inverse);
+
+/** the largest distance between the row and the column of an entry */
+u_int64_t bandwidth_ellpack(const struct EllpackMatrix *x);
+
+/** the share of entries whose column was already used by one of the window rows before */
+double column_reuse_ellpack(const struct EllpackMatrix *x, u_int64_t window);
+
+#endif //PROJEKTAUFGABE_REORDER_H
@@ -0,0 +1,227 @@
+#include "reproducible.h"
+
+#include "scheduler.h"
+
+// products summed by one fixed tree before the block sums are combined
+#define SUM_BLOCK 8
+
+static const char *SUMMATION_NAMES[] = {"pairwise", "compensated"};
+
+int summation_from_name(const char *name) {
+    for (int i = 0; i < (int) (sizeof(SUMMATION_NAMES) / sizeof(SUMMATION_NAMES[0])); i++) {
+        if (strcmp(name, SUMMATION_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *summation_name(enum Summation mode) {
+    return SUMMATION_NAMES[mode];
+}
+
+// ((p0 + p4) + (p2 + p6)) + ((p1 + p5) + (p3 + p7)), the order of the halving reduction of a vector of 8
+static float block_sum_scalar(const float *p) {
+    float q0 = p[0] + p[4];
+    float q1 = p[1] + p[5];
+    float q2 = p[2] + p[6];
+    float q3 = p[3] + p[7];
+    return (q0 + q2) + (q1 + q3);
+}
+
+__attribute__((target("avx")))
+static float block_sum_avx(const float *p) {
+    __m256 v = _mm256_loadu_ps(p);
+    __m128 q = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 h = _mm_add_ps(q, _mm_movehl_ps(q, q));
+    return _mm_cvtss_f32(_mm_add_ss(h, _mm_shuffle_ps(h, h, 1)));
+}
+
+// the block sums are combined by halving, the first half takes the middle one
+static float combine_pairwise(const float *sums, u_int64_t count) {
+    if (count == 1) {
+        return sums[0];
+    }
+    u_int64_t half = (count + 1) / 2;
+    return combine_pairwise(sums, half) + combine_pairwise(sums + half, count - half);
+}
+
+float sum_products(const float *products, u_int64_t count, enum Summation mode, int simd) {
+    if (mode == SUM_COMPENSATED) {
+        float sum = 0.0F;
+        float compensation = 0.0F;
+        for (u_int64_t i = 0; i < count; i++) {
+            float t = sum + products[i];
+            if (fabsf(sum) >= fabsf(products[i])) {
+                compensation += (sum - t) + products[i];
+            } else {
+                compensation += (products[i] - t) + sum;
+            }
+            sum = t;
+        }
+        return sum + compensation;
+    }
+    if (count == 0) {
+        return 0.0F;
+    }
+    // the last block is padded with zeros, the sums of the blocks are kept on the stack for the usual short rows
+    u_int64_t blocks = (count + SUM_BLOCK - 1) / SUM_BLOCK;
+    float stack_sums[64];
+    float *sums = blocks <= 64 ? stack_sums : malloc(blocks * sizeof(float));
+    if (!sums) {
+        error(1, 0, "an allocation has failed");
+    }
+    for (u_int64_t block = 0; block < blocks; block++) {
+        float padded[SUM_BLOCK] = {0};
+        const float *p = products + block * SUM_BLOCK;
+        if ((block + 1) * SUM_BLOCK > count) {
+            memcpy(padded, p, (count - block * SUM_BLOCK) * sizeof(float));
+            p = padded;
+        }
+        sums[block] = simd ? block_sum_avx(p) : block_sum_scalar(p);
+    }
+    float sum = combine_pairwise(sums, blocks);
+    if (sums != stack_sums) {
+        free(sums);
+    }
+    return sum;
+}
+
+struct ReproducibleContext {
+    const struct EllpackMatrix *ax;
+    const struct EllpackMatrix *bx;
+    const u_int64_t *a_lengths;
+    const u_int64_t *b_lengths;
+    enum Summation mode;
+    int simd;
+    float **products; // the matched products of one entry per thread
+    float **scratch_values; // one upper limit size row per thread
+    u_int64_t **scratch_indices;
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+};
+
+static void reproducible_task(void *context, const struct RowTask *task, int thread) {
+    struct ReproducibleContext *c = context;
+    const struct EllpackMatrix *ax = c->ax;
+    const struct EllpackMatrix *bx = c->bx;
+    float *products = c->products[thread];
+    float *r_row_values = c->scratch_values[thread];
+    u_int64_t *r_row_indices = c->scratch_indices[thread];
+    for (u_int64_t r_row_i = task->begin; r_row_i < task->end; r_row_i++) {
+        u_int64_t r_column_counter = 0;
+        const u_int64_t *a_row_indices = ax->indices + r_row_i * ax->width;
+        const float *a_row_values = ax->values + r_row_i * ax->width;
+        for (u_int64_t b_row_i = 0; b_row_i < bx->height && c->a_lengths[r_row_i] > 0; b_row_i++) {
+            const u_int64_t *b_row_indices = bx->indices + b_row_i * bx->width;
+            const float *b_row_values = bx->values + b_row_i * bx->width;
+            u_int64_t a_column_i = 0;
+            u_int64_t b_column_i = 0;
+            u_int64_t count = 0;
+            while (a_column_i < c->a_lengths[r_row_i] && b_column_i < c->b_lengths[b_row_i]) {
+                if (a_row_indices[a_column_i] == b_row_indices[b_column_i]) {
+                    products[count++] = a_row_values[a_column_i] * b_row_values[b_column_i];
+                    a_column_i++;
+                    b_column_i++;
+                } else if (a_row_indices[a_column_i] > b_row_indices[b_column_i]) {
+                    b_column_i++;
+                } else {
+                    a_column_i++;
+                }
+            }
+            float res_sum = sum_products(products, count, c->mode, c->simd);
+            // only add the result entry if it s not zero
+            if (res_sum != 0.0F) {
+                r_row_values[r_column_counter] = res_sum;
+                r_row_indices[r_column_counter] = b_row_i;
+                r_column_counter++;
+            }
+        }
+        c->r_values[r_row_i] = malloc(sizeof(float) * r_column_counter);
+        c->r_indices[r_row_i] = malloc(sizeof(u_int64_t) * r_column_counter);
+        if ((!c->r_values[r_row_i] || !c->r_indices[r_row_i]) && r_column_counter > 0) {
+            error(1, 0, "Error: Not enough memory for result row %lu", r_row_i);
+        }
+        memcpy(c->r_values[r_row_i], r_row_values, sizeof(float) * r_column_counter);
+        memcpy(c->r_indices[r_row_i], r_row_indices, sizeof(u_int64_t) * r_column_counter);
+        c->r_row_lengths[r_row_i] = r_column_counter;
+    }
+}
+
+void matr_mult_ellpack_reproducible(const struct EllpackMatrix *a, const struct EllpackMatrix *b, enum Summation mode, int simd,
+                                    struct EllpackMatrix *result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    struct EllpackMatrix *bx = transpose_ellpack_parallel(b);
+    if (!bx) {
+        error(1, 0, "transpose failed");
+        return;
+    }
+    __builtin_cpu_init();
+    u_int64_t height = a->height;
+    int threads = scheduler_threads();
+    struct ReproducibleContext c = {0};
+    c.ax = a;
+    c.bx = bx;
+    c.mode = mode;
+    c.simd = simd && __builtin_cpu_supports("avx");
+    u_int64_t *a_lengths = calloc(height, sizeof(u_int64_t));
+    u_int64_t *b_lengths = calloc(bx->height, sizeof(u_int64_t));
+    u_int64_t *costs = calloc(height, sizeof(u_int64_t));
+    c.products = calloc(threads, sizeof(float *));
+    c.scratch_values = calloc(threads, sizeof(float *));
+    c.scratch_indices = calloc(threads, sizeof(u_int64_t *));
+    c.r_values = calloc(height, sizeof(float *));
+    c.r_indices = calloc(height, sizeof(u_int64_t *));
+    c.r_row_lengths = calloc(height, sizeof(u_int64_t));
+    if (!a_lengths || !b_lengths || !costs || !c.products || !c.scratch_values || !c.scratch_indices
+        || !c.r_values || !c.r_indices || !c.r_row_lengths) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (int i = 0; i < threads; i++) {
+        c.products[i] = calloc(a->width + 1, sizeof(float));
+        c.scratch_values[i] = calloc(bx->height + 1, sizeof(float));
+        c.scratch_indices[i] = calloc(bx->height + 1, sizeof(u_int64_t));
+        if (!c.products[i] || !c.scratch_values[i] || !c.scratch_indices[i]) {
+            error(1, 0, "Error: Not enough memory for the multiplication");
+        }
+    }
+    u_int64_t b_nnz = 0;
+    for (u_int64_t b_row_i = 0; b_row_i < bx->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(bx, b_row_i);
+        b_nnz += b_lengths[b_row_i];
+    }
+    for (u_int64_t a_row_i = 0; a_row_i < height; a_row_i++) {
+        a_lengths[a_row_i] = rowlength_ellpack(a, a_row_i);
+        costs[a_row_i] = (a_lengths[a_row_i] + 1) * bx->height + (a_lengths[a_row_i] ? b_nnz : 0);
+    }
+    c.a_lengths = a_lengths;
+    c.b_lengths = b_lengths;
+    schedule_rows(height, costs, 1, reproducible_task, &c, "reproducible multiply");
+
+    u_int64_t max_width = 0;
+    for (u_int64_t r_row_i = 0; r_row_i < height; r_row_i++) {
+        if (c.r_row_lengths[r_row_i] > max_width) {
+            max_width = c.r_row_lengths[r_row_i];
+        }
+    }
+    result->height = height;
+    result->width = max_width;
+    flatten_ellpack(result, c.r_values, c.r_indices, c.r_row_lengths);
+    result->real_width = b->real_width;
+    for (int i = 0; i < threads; i++) {
+        free(c.products[i]);
+        free(c.scratch_values[i]);
+        free(c.scratch_indices[i]);
+    }
+    free(c.products);
+    free(c.scratch_values);
+    free(c.scratch_indices);
+    free(a_lengths);
+    free(b_lengths);
+    free(costs);
+    free_ellpack(bx);
+}
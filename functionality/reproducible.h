@@ -0,0 +1,29 @@
+#ifndef PROJEKTAUFGABE_REPRODUCIBLE_H
+#define PROJEKTAUFGABE_REPRODUCIBLE_H
+
+#include "ellpack_utility.h"
+
+/** orders in which the products of one result entry are summed */
+enum Summation {
+    SUM_PAIRWISE, SUM_COMPENSATED
+};
+
+/** the summation with the given name (pairwise, compensated), -1 if there is none */
+int summation_from_name(const char *name);
+const char *summation_name(enum Summation mode);
+
+/**
+ * sums the products in an order fixed by their count: pairwise adds blocks of 8 in a fixed tree
+ * and combines the block sums by halving, compensated adds them one after another with a Neumaier correction,
+ * simd = 0 uses the scalar block sums, which give the same bits as the AVX ones
+ */
+float sum_products(const float *products, u_int64_t count, enum Summation mode, int simd);
+
+/**
+ * the merge of matr_mult_ellpack_parallel, the matched products of every result entry are collected in the order of k
+ * and summed by sum_products, so the result has the same bits for every thread count, task split and vector width
+ */
+void matr_mult_ellpack_reproducible(const struct EllpackMatrix *a, const struct EllpackMatrix *b, enum Summation mode, int simd,
+                                    struct EllpackMatrix *result);
+
+#endif //PROJEKTAUFGABE_REPRODUCIBLE_H
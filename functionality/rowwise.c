@@ -0,0 +1,88 @@
+#include "rowwise.h"
+
+#include "scheduler.h"
+
+struct RowwiseContext {
+    const struct EllpackMatrix *a;
+    const struct EllpackMatrix *b;
+    const u_int64_t *b_lengths;
+    struct RowAccumulator **accumulators; // one of the width of b per thread
+    float **r_values;
+    u_int64_t **r_indices;
+    u_int64_t *r_row_lengths;
+};
+
+static void rowwise_task(void *context, const struct RowTask *task, int thread) {
+    struct RowwiseContext *c = context;
+    const struct EllpackMatrix *a = c->a;
+    const struct EllpackMatrix *b = c->b;
+    struct RowAccumulator *accumulator = c->accumulators[thread];
+    for (u_int64_t row = task->begin; row < task->end; row++) {
+        start_row(accumulator);
+        u_int64_t length = rowlength_ellpack(a, row);
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = a->indices[row * a->width + i];
+            if (k < b->height) {
+                add_row(accumulator, a->values[row * a->width + i], b->values + k * b->width, b->indices + k * b->width,
+                        c->b_lengths[k]);
+            }
+        }
+        u_int64_t r_length = finish_row(accumulator);
+        c->r_values[row] = malloc(sizeof(float) * r_length);
+        c->r_indices[row] = malloc(sizeof(u_int64_t) * r_length);
+        if ((!c->r_values[row] || !c->r_indices[row]) && r_length > 0) {
+            error(1, 0, "Error: Not enough memory for result row %lu", row);
+        }
+        emit_row(accumulator, c->r_values[row], c->r_indices[row]);
+        c->r_row_lengths[row] = r_length;
+    }
+}
+
+void matr_mult_ellpack_rowwise(const void* a, const void* b, void* result) {
+    if (!valid_ellpack(a) || !valid_ellpack(b)) {
+        error(1, 0, "an argument matrix has wrong format");
+        return;
+    }
+    const struct EllpackMatrix *ax = a;
+    const struct EllpackMatrix *bm = b;
+    struct EllpackMatrix *r = result;
+    int threads = scheduler_threads();
+    struct RowwiseContext c = {ax, bm, calloc(bm->height + 1, sizeof(u_int64_t)),
+                               calloc(threads, sizeof(struct RowAccumulator *)), calloc(ax->height + 1, sizeof(float *)),
+                               calloc(ax->height + 1, sizeof(u_int64_t *)), calloc(ax->height + 1, sizeof(u_int64_t))};
+    u_int64_t *b_lengths = (u_int64_t *) c.b_lengths;
+    u_int64_t *costs = calloc(ax->height + 1, sizeof(u_int64_t));
+    if (!b_lengths || !c.accumulators || !c.r_values || !c.r_indices || !c.r_row_lengths || !costs) {
+        error(1, 0, "Error: Not enough memory for the multiplication");
+    }
+    for (int i = 0; i < threads; i++) {
+        c.accumulators[i] = make_row_accumulator(bm->real_width);
+    }
+    for (u_int64_t b_row_i = 0; b_row_i < bm->height; b_row_i++) {
+        b_lengths[b_row_i] = rowlength_ellpack(bm, b_row_i);
+    }
+    // a result row costs the entries of the rows of b it adds
+    for (u_int64_t a_row_i = 0; a_row_i < ax->height; a_row_i++) {
+        u_int64_t length = rowlength_ellpack(ax, a_row_i);
+        costs[a_row_i] = 1;
+        for (u_int64_t i = 0; i < length; i++) {
+            u_int64_t k = ax->indices[a_row_i * ax->width + i];
+            costs[a_row_i] += k < bm->height ? b_lengths[k] : 0;
+        }
+    }
+    schedule_rows(ax->height, costs, 1, rowwise_task, &c, "rowwise multiply");
+
+    r->height = ax->height;
+    r->width = 0;
+    for (u_int64_t r_row_i = 0; r_row_i < r->height; r_row_i++) {
+        r->width = c.r_row_lengths[r_row_i] > r->width ? c.r_row_lengths[r_row_i] : r->width;
+    }
+    flatten_ellpack(r, c.r_values, c.r_indices, c.r_row_lengths);
+    for (int i = 0; i < threads; i++) {
+        free_row_accumulator(c.accumulators[i]);
+    }
+    free(c.accumulators);
+    free(b_lengths);
+    free(costs);
+    r->real_width = bm->real_width;
+}
@@ -0,0 +1,13 @@
+#ifndef PROJEKTAUFGABE_ROWWISE_H
+#define PROJEKTAUFGABE_ROWWISE_H
+
+#include "ellpack_utility.h"
+
+/**
+ * a * b without transposing b: every entry (k, a_ik) of a row of a adds a_ik times row k of b to an accumulator of
+ * the width of b, the touched columns are collected and written in ascending order, the products of an entry are added
+ * in the order of k like the merge, so the result is the same as matr_mult_ellpack
+ */
+void matr_mult_ellpack_rowwise(const void* a, const void* b, void* result);
+
+#endif //PROJEKTAUFGABE_ROWWISE_H
@@ -0,0 +1,296 @@
+#include "scheduler.h"
+
+#include <error.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_GRAIN (1UL << 16)
+
+static int configured_threads = 0;
+static u_int64_t configured_grain = DEFAULT_GRAIN;
+static int verbose_stats = 0;
+
+// set while a thread executes the tasks of a run, a run started from a task executes inline
+static _Thread_local int in_task = 0;
+
+/** a double ended queue of tasks, the owner works at the tail, thieves take from the head */
+struct TaskDeque {
+    pthread_mutex_t lock;
+    struct RowTask *tasks;
+    u_int64_t capacity;
+    u_int64_t head;
+    u_int64_t tail;
+};
+
+struct SchedulerRun {
+    const u_int64_t *costs;
+    u_int64_t *prefix; // prefix[i] = sum of the costs of rows [0, i)
+    u_int64_t sub_extent;
+    u_int64_t grain;
+    u_int64_t heavy; // single rows above this cost are split along the sub range
+    row_task_fn fn;
+    void *context;
+    int threads;
+    struct TaskDeque *deques;
+    struct SchedulerStats *stats;
+    atomic_uint_fast64_t pending; // tasks queued or in execution
+};
+
+struct WorkerArgs {
+    struct SchedulerRun *run;
+    int thread;
+};
+
+void set_scheduler_threads(int threads) {
+    configured_threads = threads;
+}
+
+int scheduler_threads(void) {
+    if (configured_threads > 0) {
+        return configured_threads;
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (int) online : 1;
+}
+
+void set_scheduler_grain(u_int64_t grain) {
+    configured_grain = grain > 0 ? grain : 1;
+}
+
+u_int64_t scheduler_grain(void) {
+    return configured_grain;
+}
+
+void set_scheduler_verbose(int verbose) {
+    verbose_stats = verbose;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static void push_task(struct TaskDeque *deque, struct RowTask task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        if (deque->head > 0) { // reuse the space freed by thieves first
+            memmove(deque->tasks, deque->tasks + deque->head, (deque->tail - deque->head) * sizeof(struct RowTask));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        } else {
+            u_int64_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+            struct RowTask *tasks = realloc(deque->tasks, capacity * sizeof(struct RowTask));
+            if (!tasks) {
+                error(1, 0, "Error: Not enough memory for the task queue");
+            }
+            deque->tasks = tasks;
+            deque->capacity = capacity;
+        }
+    }
+    deque->tasks[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static int pop_task(struct TaskDeque *deque, struct RowTask *task, int steal) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        *task = steal ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+        found = 1;
+        if (deque->head == deque->tail) {
+            deque->head = deque->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static u_int64_t task_cost(const struct SchedulerRun *run, const struct RowTask *task) {
+    u_int64_t cost = run->prefix[task->end] - run->prefix[task->begin];
+    if (task->end - task->begin == 1 && task->sub_end - task->sub_begin < run->sub_extent) {
+        cost = (u_int64_t) ((double) cost * (double) (task->sub_end - task->sub_begin) / (double) run->sub_extent);
+    }
+    return cost;
+}
+
+// first row m in (begin, end) such that the rows [begin, m) carry at least half the cost of the range
+static u_int64_t cost_midpoint(const struct SchedulerRun *run, u_int64_t begin, u_int64_t end) {
+    u_int64_t half = run->prefix[begin] + (run->prefix[end] - run->prefix[begin]) / 2;
+    u_int64_t low = begin + 1;
+    u_int64_t high = end - 1;
+    while (low < high) {
+        u_int64_t mid = low + (high - low) / 2;
+        if (run->prefix[mid] < half) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// splits the task until it is small enough, the split off halves are offered to thieves
+static void split_task(struct SchedulerRun *run, int thread, struct RowTask *task) {
+    for (;;) {
+        u_int64_t cost = task_cost(run, task);
+        struct RowTask right = *task;
+        if (task->end - task->begin > 1 && cost > run->grain) {
+            u_int64_t mid = cost_midpoint(run, task->begin, task->end);
+            right.begin = mid;
+            task->end = mid;
+        } else if (task->end - task->begin == 1 && task->sub_end - task->sub_begin > 1 && cost > run->heavy) {
+            u_int64_t mid = task->sub_begin + (task->sub_end - task->sub_begin) / 2;
+            right.sub_begin = mid;
+            task->sub_end = mid;
+        } else {
+            return;
+        }
+        atomic_fetch_add(&run->pending, 1);
+        push_task(&run->deques[thread], right);
+        run->stats[thread].splits++;
+    }
+}
+
+static void *worker(void *argument) {
+    struct WorkerArgs *args = argument;
+    struct SchedulerRun *run = args->run;
+    int thread = args->thread;
+    unsigned int seed = (unsigned int) thread * 2654435761U + 1;
+    struct RowTask task;
+    in_task = 1;
+    while (atomic_load(&run->pending) > 0) {
+        int found = pop_task(&run->deques[thread], &task, 0);
+        // own queue is empty, try to steal from the others starting at a random victim
+        for (int tries = 1; !found && tries < run->threads; tries++) {
+            seed = seed * 1103515245U + 12345U;
+            int victim = (int) ((thread + 1 + (seed >> 16) % (run->threads - 1)) % run->threads);
+            if (victim != thread && pop_task(&run->deques[victim], &task, 1)) {
+                run->stats[thread].steals++;
+                found = 1;
+            }
+        }
+        if (!found) {
+            sched_yield();
+            continue;
+        }
+        split_task(run, thread, &task);
+        double start = now();
+        run->fn(run->context, &task, thread);
+        run->stats[thread].busy += now() - start;
+        run->stats[thread].tasks++;
+        atomic_fetch_sub(&run->pending, 1);
+    }
+    in_task = 0;
+    return NULL;
+}
+
+static void print_stats(const struct SchedulerRun *run, const char *name, double wall) {
+    double max_busy = 0;
+    double sum_busy = 0;
+    for (int i = 0; i < run->threads; i++) {
+        const struct SchedulerStats *s = &run->stats[i];
+        printf("[SCHED] %s: thread %i: busy %f secs (%.1f%%), tasks %lu, steals %lu, splits %lu\n",
+               name, i, s->busy, wall > 0 ? 100.0 * s->busy / wall : 0.0, s->tasks, s->steals, s->splits);
+        sum_busy += s->busy;
+        if (s->busy > max_busy) {
+            max_busy = s->busy;
+        }
+    }
+    double avg_busy = sum_busy / run->threads;
+    printf("[SCHED] %s: %i threads, wall %f secs, imbalance (max / avg busy) %.3f\n",
+           name, run->threads, wall, avg_busy > 0 ? max_busy / avg_busy : 1.0);
+}
+
+void schedule_rows(u_int64_t rows, const u_int64_t *costs, u_int64_t sub_extent, row_task_fn fn, void *context, const char *name) {
+    if (rows == 0) {
+        return;
+    }
+    // the threads of the outer run are busy already, a nested run on more of them would only oversubscribe the cpus
+    if (in_task) {
+        fn(context, &(struct RowTask) {0, rows, 0, sub_extent > 0 ? sub_extent : 1}, 0);
+        return;
+    }
+    struct SchedulerRun run;
+    run.costs = costs;
+    run.sub_extent = sub_extent > 0 ? sub_extent : 1;
+    run.grain = configured_grain;
+    run.fn = fn;
+    run.context = context;
+    run.threads = scheduler_threads();
+    if ((u_int64_t) run.threads > rows * run.sub_extent) {
+        run.threads = (int) (rows * run.sub_extent);
+    }
+    run.prefix = malloc((rows + 1) * sizeof(u_int64_t));
+    run.deques = calloc(run.threads, sizeof(struct TaskDeque));
+    struct SchedulerStats *stats = calloc(run.threads, sizeof(struct SchedulerStats));
+    pthread_t *handles = calloc(run.threads, sizeof(pthread_t));
+    struct WorkerArgs *args = calloc(run.threads, sizeof(struct WorkerArgs));
+    if (!run.prefix || !run.deques || !stats || !handles || !args) {
+        error(1, 0, "Error: Not enough memory to schedule %s", name);
+    }
+    run.stats = stats;
+    run.prefix[0] = 0;
+    for (u_int64_t i = 0; i < rows; i++) {
+        run.prefix[i + 1] = run.prefix[i] + costs[i];
+    }
+    u_int64_t total = run.prefix[rows];
+    run.heavy = total / (4 * (u_int64_t) run.threads);
+    if (run.heavy < run.grain) {
+        run.heavy = run.grain;
+    }
+
+    // seed every thread with a contiguous range of about the same cost
+    atomic_init(&run.pending, 0);
+    u_int64_t begin = 0;
+    for (int i = 0; i < run.threads; i++) {
+        pthread_mutex_init(&run.deques[i].lock, NULL);
+        u_int64_t end = rows;
+        if (i < run.threads - 1) {
+            u_int64_t target = total / run.threads * (i + 1);
+            end = begin;
+            while (end < rows && run.prefix[end] < target) {
+                end++;
+            }
+        }
+        if (end > begin) {
+            push_task(&run.deques[i], (struct RowTask) {begin, end, 0, run.sub_extent});
+            atomic_fetch_add(&run.pending, 1);
+            begin = end;
+        }
+    }
+
+    double start = now();
+    for (int i = 0; i < run.threads; i++) {
+        args[i] = (struct WorkerArgs) {&run, i};
+    }
+    for (int i = 1; i < run.threads; i++) {
+        if (pthread_create(&handles[i], NULL, worker, &args[i]) != 0) {
+            error(1, 0, "Error: Could not start worker thread %i", i);
+        }
+    }
+    worker(&args[0]);
+    for (int i = 1; i < run.threads; i++) {
+        pthread_join(handles[i], NULL);
+    }
+    double wall = now() - start;
+
+    if (verbose_stats) {
+        print_stats(&run, name, wall);
+    }
+    for (int i = 0; i < run.threads; i++) {
+        pthread_mutex_destroy(&run.deques[i].lock);
+        free(run.deques[i].tasks);
+    }
+    free(stats);
+    free(run.deques);
+    free(run.prefix);
+    free(handles);
+    free(args);
+}
@@ -0,0 +1,44 @@
+#ifndef PROJEKTAUFGABE_SCHEDULER_H
+#define PROJEKTAUFGABE_SCHEDULER_H
+
+#include <sys/types.h>
+
+/** a task covering the rows [begin, end), a single heavy row is further split along [sub_begin, sub_end) */
+struct RowTask {
+    u_int64_t begin;
+    u_int64_t end;
+    u_int64_t sub_begin;
+    u_int64_t sub_end;
+};
+
+/** counters of one worker thread during a scheduled run */
+struct SchedulerStats {
+    double busy; // seconds spent executing tasks
+    u_int64_t tasks;
+    u_int64_t steals;
+    u_int64_t splits;
+};
+
+/** executes one task, thread is the number of the executing worker */
+typedef void (*row_task_fn)(void *context, const struct RowTask *task, int thread);
+
+/** sets the number of worker threads, values < 1 select the number of online cpus */
+void set_scheduler_threads(int threads);
+int scheduler_threads(void);
+
+/** sets the cost below which a task is not split any further */
+void set_scheduler_grain(u_int64_t grain);
+u_int64_t scheduler_grain(void);
+
+/** prints per thread statistics after every run if set */
+void set_scheduler_verbose(int verbose);
+
+/**
+ * runs fn on all rows [0, rows) with work stealing between the threads,
+ * costs holds the estimated work of each row, ranges are split at their cost midpoint
+ * and a single row costing more than a fair share of a thread is split along [0, sub_extent),
+ * called from a task of another run it executes all rows as one task on thread 0 of the calling thread
+ */
+void schedule_rows(u_int64_t rows, const u_int64_t *costs, u_int64_t sub_extent, row_task_fn fn, void *context, const char *name);
+
+#endif //PROJEKTAUFGABE_SCHEDULER_H
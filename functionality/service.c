@@ -0,0 +1,380 @@
+#include "service.h"
+#include "ellpack_utility.h"
+#include "multiplication.h"
+#include "precision.h"
+#include "parser.h"
+
+#include <errno.h>
+#include <error.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REQUEST_LENGTH 4096
+#define NAME_LENGTH 256
+
+struct CacheEntry {
+    char name[NAME_LENGTH];
+    struct EllpackMatrix *matrix;
+    u_int64_t bytes;
+    u_int64_t last_used;
+};
+
+struct MatrixCache {
+    struct CacheEntry *entries;
+    u_int64_t count;
+    u_int64_t capacity;
+    u_int64_t bytes;
+    u_int64_t limit;
+    u_int64_t clock; // increases with every access, orders the entries by their last use
+};
+
+static u_int64_t matrix_bytes(const struct EllpackMatrix *matrix) {
+    return sizeof(*matrix) + matrix->height * matrix->width * (sizeof(float) + sizeof(u_int64_t));
+}
+
+static struct CacheEntry *cache_find(struct MatrixCache *cache, const char *name) {
+    for (u_int64_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i].name, name) == 0) {
+            cache->entries[i].last_used = ++cache->clock;
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void cache_remove(struct MatrixCache *cache, u_int64_t i) {
+    free_ellpack(cache->entries[i].matrix);
+    cache->bytes -= cache->entries[i].bytes;
+    cache->entries[i] = cache->entries[--cache->count];
+}
+
+// evicts the least recently used matrices until bytes more fit below the limit
+static int cache_make_room(struct MatrixCache *cache, u_int64_t bytes) {
+    if (bytes > cache->limit) {
+        return 0;
+    }
+    while (cache->bytes + bytes > cache->limit && cache->count > 0) {
+        u_int64_t oldest = 0;
+        for (u_int64_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used < cache->entries[oldest].last_used) {
+                oldest = i;
+            }
+        }
+        printf("[CACHE] Evicting %s (%lu bytes)\n", cache->entries[oldest].name, cache->entries[oldest].bytes);
+        cache_remove(cache, oldest);
+    }
+    return 1;
+}
+
+static void cache_insert(struct MatrixCache *cache, const char *name, struct EllpackMatrix *matrix) {
+    if (cache->count == cache->capacity) {
+        u_int64_t capacity = cache->capacity ? cache->capacity * 2 : 16;
+        struct CacheEntry *entries = realloc(cache->entries, capacity * sizeof(struct CacheEntry));
+        if (!entries) {
+            error(1, 0, "Error: Not enough memory for the matrix cache");
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    struct CacheEntry *entry = &cache->entries[cache->count++];
+    snprintf(entry->name, NAME_LENGTH, "%s", name);
+    entry->matrix = matrix;
+    entry->bytes = matrix_bytes(matrix);
+    entry->last_used = ++cache->clock;
+    cache->bytes += entry->bytes;
+}
+
+static void reply(int client, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void reply(int client, const char *format, ...) {
+    char message[REQUEST_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (length > 0) {
+        ssize_t written = write(client, message, (size_t) length < sizeof(message) ? (size_t) length : sizeof(message) - 1);
+        (void) written;
+    }
+}
+
+// reads one request line, returns its length or -1
+static ssize_t read_request(int client, char *request) {
+    ssize_t length = 0;
+    while (length < REQUEST_LENGTH - 1) {
+        ssize_t got = read(client, request + length, 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0 || request[length] == '\n') {
+            break;
+        }
+        length++;
+    }
+    request[length] = '\0';
+    return length;
+}
+
+// parsing exits on malformed input, so it runs in a child which hands the matrix over as a binary file,
+// the error messages of the child go straight to the client
+static struct EllpackMatrix *load_isolated(int client, char *path) {
+    char binary_path[] = "/tmp/ellmul-cache-XXXXXX";
+    int fd = mkstemp(binary_path);
+    if (fd < 0) {
+        return NULL;
+    }
+    close(fd);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        dup2(client, STDERR_FILENO);
+        struct EllpackMatrix *matrix = parse_matrix(path);
+        write_matrix_binary(matrix, binary_path);
+        free_ellpack(matrix);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status = 0;
+    struct EllpackMatrix *matrix = NULL;
+    if (child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        matrix = parse_matrix_binary(binary_path);
+    }
+    unlink(binary_path);
+    return matrix;
+}
+
+static void handle_load(struct MatrixCache *cache, int client, char *name, char *path) {
+    if (!name || !path || strlen(name) >= NAME_LENGTH) {
+        reply(client, "ERR usage: LOAD <name> <path>\n");
+        return;
+    }
+    if (access(path, R_OK) != 0) {
+        reply(client, "ERR matrix file does not exist or missing read permission: %s\n", path);
+        return;
+    }
+    printf("[CACHE] Loading %s from %s\n", name, path);
+    struct EllpackMatrix *matrix = load_isolated(client, path);
+    if (!matrix) {
+        reply(client, "ERR could not load %s\n", path);
+        return;
+    }
+    if (matrix_bytes(matrix) > cache->limit) {
+        reply(client, "ERR %s needs %lu bytes, more than the cache limit of %lu\n", name, matrix_bytes(matrix), cache->limit);
+        free_ellpack(matrix);
+        return;
+    }
+    // reloading replaces the old matrix only once the new one is loaded
+    for (u_int64_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i].name, name) == 0) {
+            cache_remove(cache, i);
+            break;
+        }
+    }
+    cache_make_room(cache, matrix_bytes(matrix));
+    cache_insert(cache, name, matrix);
+    reply(client, "OK loaded %s [%lu (formerly %lu) x %lu], %lu bytes, cache %lu / %lu bytes\n", name,
+          matrix->width, matrix->real_width, matrix->height, matrix_bytes(matrix), cache->bytes, cache->limit);
+}
+
+// the multiplication runs in a child working on the copy on write view of the cache,
+// the service keeps accepting requests and the child answers the client itself
+static void handle_mul(struct MatrixCache *cache, int client, char *a_name, char *b_name, char *out_path, char *impl, char *binary) {
+    if (!a_name || !b_name || !out_path) {
+        reply(client, "ERR usage: MUL <a> <b> <output> [impl] [bin]\n");
+        return;
+    }
+    struct CacheEntry *a = cache_find(cache, a_name);
+    struct CacheEntry *b = cache_find(cache, b_name);
+    if (!a || !b) {
+        reply(client, "ERR matrix %s is not loaded\n", a ? b_name : a_name);
+        return;
+    }
+    if (a->matrix->height != b->matrix->real_width) {
+        reply(client, "ERR Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu\n",
+              a->matrix->height, b->matrix->real_width);
+        return;
+    }
+    // the implementation may be left out before bin
+    if (impl && !binary && strcmp(impl, "bin") == 0) {
+        binary = impl;
+        impl = NULL;
+    }
+    if (binary && strcmp(binary, "bin") != 0) {
+        reply(client, "ERR usage: MUL <a> <b> <output> [impl] [bin]\n");
+        return;
+    }
+    char *end_ptr = NULL;
+    errno = 0;
+    long version = impl ? strtol(impl, &end_ptr, 10) : 0;
+    if (impl && (errno != 0 || *impl == '\0' || *end_ptr != '\0')) {
+        reply(client, "ERR not an implementation: %s\n", impl);
+        return;
+    }
+    if (version != LINEAR && version != VECTORIZED && version != NAIVE && version != PARALLEL && version != GENERIC_F32) {
+        reply(client, "ERR the service runs the implementations 0, 1, 2, 3 and 6, not %s\n", impl);
+        return;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        reply(client, "ERR could not start the multiplication\n");
+        return;
+    }
+    if (child > 0) {
+        return;
+    }
+    dup2(client, STDERR_FILENO);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct EllpackMatrix *result = calloc(1, sizeof(*result));
+    switch (version) {
+        case 0:
+            matr_mult_ellpack(a->matrix, b->matrix, result);
+            break;
+        case 1:
+            matr_mult_ellpack_vectorised(a->matrix, b->matrix, result);
+            break;
+        case 2:
+            matr_mult_ellpack_naive(a->matrix, b->matrix, result);
+            break;
+        case 3:
+            matr_mult_ellpack_parallel(a->matrix, b->matrix, result);
+            break;
+        case 6:
+            matr_mult_ellpack_f32(a->matrix, b->matrix, result);
+            break;
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (binary) {
+        write_matrix_binary(result, out_path);
+    } else {
+        write_matrix(result, out_path);
+    }
+    reply(client, "OK wrote %s [%lu (formerly %lu) x %lu] in %f secs\n", out_path, result->width, result->real_width,
+          result->height, end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec));
+    free_ellpack(result);
+    _exit(0);
+}
+
+static int compare_recent(const void *x, const void *y) {
+    const struct CacheEntry *p = x;
+    const struct CacheEntry *q = y;
+    return (p->last_used < q->last_used) - (p->last_used > q->last_used);
+}
+
+static void handle_stats(struct MatrixCache *cache, int client) {
+    qsort(cache->entries, cache->count, sizeof(struct CacheEntry), compare_recent);
+    reply(client, "OK %lu matrices, %lu / %lu bytes\n", cache->count, cache->bytes, cache->limit);
+    for (u_int64_t i = 0; i < cache->count; i++) {
+        struct EllpackMatrix *m = cache->entries[i].matrix;
+        reply(client, "%s [%lu (formerly %lu) x %lu] %lu bytes\n", cache->entries[i].name, m->width, m->real_width,
+              m->height, cache->entries[i].bytes);
+    }
+}
+
+struct MatrixCache *make_cache(u_int64_t memory_limit) {
+    struct MatrixCache *cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        error(1, 0, "Error: Not enough memory for the matrix cache");
+    }
+    cache->limit = memory_limit;
+    return cache;
+}
+
+void free_cache(struct MatrixCache *cache) {
+    while (cache->count > 0) {
+        cache_remove(cache, cache->count - 1);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+int serve_request(struct MatrixCache *cache, int client, char *request) {
+    char *save;
+    char *command = strtok_r(request, " \t\r\n", &save);
+    char *args[5];
+    for (int i = 0; i < 5; i++) {
+        args[i] = strtok_r(NULL, " \t\r\n", &save);
+    }
+    if (!command) {
+        reply(client, "ERR empty request\n");
+    } else if (strcmp(command, "LOAD") == 0) {
+        handle_load(cache, client, args[0], args[1]);
+    } else if (strcmp(command, "MUL") == 0) {
+        handle_mul(cache, client, args[0], args[1], args[2], args[3], args[4]);
+    } else if (strcmp(command, "DROP") == 0) {
+        int dropped = 0;
+        for (u_int64_t i = 0; args[0] && i < cache->count; i++) {
+            if (strcmp(cache->entries[i].name, args[0]) == 0) {
+                cache_remove(cache, i);
+                dropped = 1;
+                break;
+            }
+        }
+        if (dropped) {
+            reply(client, "OK dropped %s\n", args[0]);
+        } else {
+            reply(client, "ERR matrix %s is not loaded\n", args[0] ? args[0] : "");
+        }
+    } else if (strcmp(command, "STATS") == 0) {
+        handle_stats(cache, client);
+    } else if (strcmp(command, "SHUTDOWN") == 0) {
+        reply(client, "OK shutting down\n");
+        return 0;
+    } else {
+        reply(client, "ERR unknown request %s\n", command);
+    }
+    return 1;
+}
+
+int run_service(char *socket_path, u_int64_t memory_limit) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        error(1, 0, "Error: Socket path is too long: %s", socket_path);
+    }
+    strcpy(address.sun_path, socket_path);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (server < 0 || bind(server, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(server, 16) != 0) {
+        error(1, errno, "Error: Could not listen on %s", socket_path);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    printf("[SERVE] Listening on %s, cache limit %lu bytes\n", socket_path, memory_limit);
+    fflush(stdout);
+
+    struct MatrixCache *cache = make_cache(memory_limit);
+    int running = 1;
+    char request[REQUEST_LENGTH];
+    while (running) {
+        int client = accept(server, NULL, NULL);
+        while (waitpid(-1, NULL, WNOHANG) > 0); // collect finished multiplications
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error(1, errno, "Error: Could not accept connections on %s", socket_path);
+        }
+        if (read_request(client, request) > 0) {
+            running = serve_request(cache, client, request);
+        }
+        close(client);
+        fflush(stdout);
+    }
+    while (wait(NULL) > 0); // let running multiplications finish
+    free_cache(cache);
+    close(server);
+    unlink(socket_path);
+    printf("[SERVE] Stopped\n");
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef PROJEKTAUFGABE_SERVICE_H
+#define PROJEKTAUFGABE_SERVICE_H
+
+#include <sys/types.h>
+
+/** the matrices loaded by name, the least recently used ones are evicted above memory_limit bytes */
+struct MatrixCache;
+
+struct MatrixCache *make_cache(u_int64_t memory_limit);
+void free_cache(struct MatrixCache *cache);
+
+/**
+ * answers one request line of the protocol below on client, a multiplication runs in a child answering the client
+ * itself, returns 0 after SHUTDOWN
+ */
+int serve_request(struct MatrixCache *cache, int client, char *request);
+
+/**
+ * runs the multiplication service on a unix socket until it receives SHUTDOWN,
+ * matrices are kept loaded by name and the least recently used ones are evicted
+ * once their size would exceed memory_limit bytes
+ *
+ * requests are single lines, the answer starts with OK or ERR:
+ *   LOAD <name> <path>                 parse a text or binary matrix into the cache, a matrix of the same name
+ *                                      is replaced once the new one is loaded and kept if it fails
+ *   MUL <a> <b> <output> [impl] [bin]  multiply two cached matrices and write the result, impl is one of the
+ *                                      implementations 0, 1, 2, 3 and 6 (default: 0), bin writes binary, also
+ *                                      without impl
+ *   DROP <name>                        remove a matrix from the cache
+ *   STATS                              list the cached matrices, most recently used first
+ *   SHUTDOWN                           stop the service
+ */
+int run_service(char *socket_path, u_int64_t memory_limit);
+
+#endif //PROJEKTAUFGABE_SERVICE_H
@@ -3,9 +3,36 @@
 //
 
 #include "testing.h"
+#include "scheduler.h"
+#include "half_precision.h"
+#include "precision.h"
+#include "batch.h"
+#include "reorder.h"
+#include "incremental.h"
+#include "elementwise.h"
+#include "compressed.h"
+#include "blocked.h"
+#include "reproducible.h"
+#include "differential.h"
+#include "pruning.h"
+#include "fixed_width.h"
+#include "rowwise.h"
+#include "autotune.h"
+#include "memory.h"
+#include "dense.h"
+#include "pipeline.h"
+#include "parser.h"
+#include "text_writer.h"
+#include "distributed.h"
+#include "service.h"
+#include "analyze.h"
 
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 struct EllpackMatrix *create_ellpack(u_int64_t rw, u_int64_t w, u_int64_t h, const float values[], const u_int64_t indices[]) {
     struct EllpackMatrix * r = make_ellpack(rw, h, w, "");
@@ -73,10 +100,1115 @@ bool compare_ellpack(struct EllpackMatrix *a, struct EllpackMatrix *b) {
     return equal;
 }
 
+// the largest absolute and relative difference of two results, entries missing in one of them count as 0
+static void max_error_ellpack(const struct EllpackMatrix *found, const struct EllpackMatrix *expected, float *abs_error, float *rel_error) {
+    *abs_error = 0;
+    *rel_error = 0;
+    for (u_int64_t row = 0; row < found->height && row < expected->height; row++) {
+        u_int64_t f_length = rowlength_ellpack(found, row);
+        u_int64_t e_length = rowlength_ellpack(expected, row);
+        u_int64_t f_i = 0;
+        u_int64_t e_i = 0;
+        while (f_i < f_length || e_i < e_length) {
+            u_int64_t f_index = f_i < f_length ? found->indices[row * found->width + f_i] : UINT64_MAX;
+            u_int64_t e_index = e_i < e_length ? expected->indices[row * expected->width + e_i] : UINT64_MAX;
+            float f_value = f_index <= e_index ? found->values[row * found->width + f_i++] : 0.0F;
+            float e_value = e_index <= f_index ? expected->values[row * expected->width + e_i++] : 0.0F;
+            float difference = fabsf(f_value - e_value);
+            if (difference > *abs_error) {
+                *abs_error = difference;
+            }
+            if (e_value != 0.0F && difference / fabsf(e_value) > *rel_error) {
+                *rel_error = difference / fabsf(e_value);
+            }
+        }
+    }
+}
+
+// a row of a becomes dense so the result has to grow and the last row of b changes sign and doubles,
+// the patched result has to match the product of the changed matrices
+static bool check_incremental(struct TestStruct test, FILE *report) {
+    struct EllpackMatrix *a = create_ellpack(test.a->real_width, test.a->width, test.a->height, test.a->values, test.a->indices);
+    struct EllpackMatrix *b = create_ellpack(test.b->real_width, test.b->width, test.b->height, test.b->values, test.b->indices);
+    struct EllpackMatrix *res = malloc(sizeof(*res));
+    matr_mult_ellpack(a, b, res);
+    struct EllpackMatrix *a_row = make_ellpack(a->real_width, 1, a->real_width, "");
+    for (u_int64_t i = 0; i < a->real_width; i++) {
+        a_row->values[i] = 1.0F + (float) i;
+        a_row->indices[i] = i;
+    }
+    u_int64_t b_row_i = b->height - 1;
+    struct EllpackMatrix *b_row = create_ellpack(b->real_width, b->width, 1, b->values + b_row_i * b->width, b->indices + b_row_i * b->width);
+    for (u_int64_t i = 0; i < b_row->width; i++) {
+        b_row->values[i] *= -2.0F;
+    }
+    u_int64_t a_row_i = 0;
+    struct RowDelta a_delta = {1, &a_row_i, a_row};
+    struct RowDelta b_delta = {1, &b_row_i, b_row};
+    matr_mult_ellpack_update(a, b, &a_delta, &b_delta, res);
+    struct EllpackMatrix *expected = malloc(sizeof(*expected));
+    matr_mult_ellpack(a, b, expected);
+    float abs_error;
+    float rel_error;
+    max_error_ellpack(res, expected, &abs_error, &rel_error);
+    bool equal = res->height == expected->height && res->real_width == expected->real_width && abs_error < TESTING_PRECISION;
+    if (!equal) {
+        fprintf(report, "error on incremental update of the product of the changed matrices:\n");
+        print_ellpack(report, a, "A");
+        print_ellpack(report, b, "B");
+        print_ellpack(report, expected, "expected");
+        print_ellpack(report, res, "but found");
+    }
+    free_all((struct EllpackMatrix *[]){a, b, res, a_row, b_row, expected}, 6);
+    return equal;
+}
+
+// the entries of x in a dense row major array with the given number of columns
+static double *dense_ellpack(const struct EllpackMatrix *x, u_int64_t columns) {
+    double *dense = calloc(x->height * columns, sizeof(double));
+    for (u_int64_t row = 0; row < x->height; row++) {
+        for (u_int64_t i = 0; i < rowlength_ellpack(x, row); i++) {
+            dense[row * columns + x->indices[row * x->width + i]] = x->values[row * x->width + i];
+        }
+    }
+    return dense;
+}
+
+// found has to hold exactly the non zero entries of expected in ascending columns
+static bool matches_dense(const struct EllpackMatrix *found, const double *expected, u_int64_t height, u_int64_t columns) {
+    if (found->height != height) {
+        return false;
+    }
+    for (u_int64_t row = 0; row < height; row++) {
+        u_int64_t length = rowlength_ellpack(found, row);
+        u_int64_t i = 0;
+        for (u_int64_t column = 0; column < columns; column++) {
+            double value = 0;
+            if (i < length && found->indices[row * found->width + i] == column) {
+                value = found->values[row * found->width + i++];
+            }
+            double magnitude = fabs(expected[row * columns + column]) > 1.0 ? fabs(expected[row * columns + column]) : 1.0;
+            if (fabs(value - expected[row * columns + column]) >= TESTING_PRECISION * magnitude) {
+                return false;
+            }
+        }
+        if (i != length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the element wise kernels of a and the expected product r against dense references,
+// 2 * a * b - 0.5 * r is computed by the fused kernel, a - a has to be empty
+static bool check_elementwise(struct TestStruct test, FILE *report) {
+    u_int64_t columns = test.a->real_width > test.r->real_width ? test.a->real_width : test.r->real_width;
+    double *a = dense_ellpack(test.a, columns);
+    double *r = dense_ellpack(test.r, columns);
+    double *expected = calloc(test.a->height * columns, sizeof(double));
+    struct EllpackMatrix *results[5];
+    for (int i = 0; i < 5; i++) {
+        results[i] = malloc(sizeof(struct EllpackMatrix));
+    }
+    matr_add_scaled_ellpack(1.5F, test.a, -3.0F, test.r, results[0]);
+    matr_hadamard_ellpack(test.a, test.r, results[1]);
+    matr_scale_ellpack(-0.25F, test.a, results[2]);
+    matr_mult_add_ellpack(2.0F, test.a, test.b, -0.5F, test.r, results[3]);
+    matr_add_scaled_ellpack(1.0F, test.a, -1.0F, test.a, results[4]);
+    bool equal = true;
+    for (int i = 0; i < 5 && equal; i++) {
+        for (u_int64_t j = 0; j < test.a->height * columns; j++) {
+            double values[5] = {1.5 * a[j] - 3.0 * r[j], a[j] * r[j], -0.25 * a[j], 2.0 * r[j] - 0.5 * r[j], 0};
+            expected[j] = values[i];
+        }
+        equal = matches_dense(results[i], expected, test.a->height, columns) && (i != 4 || results[i]->width == 0);
+        if (!equal) {
+            fprintf(report, "error on element wise kernel %d of matrices:\n", i);
+            print_ellpack(report, test.a, "A");
+            print_ellpack(report, test.r, "R");
+            print_ellpack(report, results[i], "but found");
+        }
+    }
+    free_all(results, 5);
+    free(a);
+    free(r);
+    free(expected);
+    return equal;
+}
+
+// the indices of the test matrices and of a long row with gaps of growing bit widths have to survive compression,
+// x * vector has to be the same with compressed and plain indices
+static bool check_compressed(struct TestStruct test, FILE *report) {
+    struct EllpackMatrix *wide = make_ellpack(0, 2, 100, "");
+    u_int64_t index = 3;
+    for (u_int64_t i = 0; i < wide->width; i++) {
+        wide->values[i] = 1.0F + (float) i;
+        wide->indices[i] = index;
+        wide->values[wide->width + i] = i < 17 ? 2.0F : 0.0F;
+        wide->indices[wide->width + i] = i < 17 ? 5 * i : 0;
+        index += (u_int64_t) 1 << (i % 40);
+    }
+    wide->real_width = index;
+    struct EllpackMatrix *matrices[4] = {test.a, test.b, test.r, wide};
+    bool equal = true;
+    for (int i = 0; i < 4 && equal; i++) {
+        struct CompressedEllpack *compressed = compress_ellpack(matrices[i]);
+        struct EllpackMatrix *restored = decompress_ellpack(compressed);
+        equal = compare_ellpack(restored, matrices[i]);
+        if (equal && i < 3) {
+            float *vector = malloc(matrices[i]->real_width * sizeof(float));
+            float *expected = malloc(matrices[i]->height * sizeof(float));
+            float *found = malloc(matrices[i]->height * sizeof(float));
+            for (u_int64_t j = 0; j < matrices[i]->real_width; j++) {
+                vector[j] = 0.5F - (float) j;
+            }
+            matr_vec_ellpack(matrices[i], vector, expected);
+            matr_vec_ellpack_compressed(compressed, vector, found);
+            equal = memcmp(expected, found, matrices[i]->height * sizeof(float)) == 0;
+            free(vector);
+            free(expected);
+            free(found);
+        }
+        if (!equal) {
+            fprintf(report, "error on compressed indices of matrix:\n");
+            print_ellpack(report, matrices[i], "X");
+            print_ellpack(report, restored, "but found");
+        }
+        free_compressed(compressed);
+        free_ellpack(restored);
+    }
+    free_ellpack(wide);
+    return equal;
+}
+
+// every block shape has to keep the entries of the test matrices and every kernel has to compute the test result
+static bool check_blocked(struct TestStruct test, FILE *report) {
+    for (u_int64_t r = 1; r <= MAX_BLOCK; r++) {
+        for (u_int64_t k = 1; k <= MAX_BLOCK; k++) {
+            struct BlockedEllpack *a = blocked_from_ellpack(test.a, r, k);
+            struct EllpackMatrix *restored = ellpack_from_blocked(a);
+            bool equal = compare_ellpack(restored, test.a);
+            free_ellpack(restored);
+            for (u_int64_t c = 1; c <= MAX_BLOCK && equal; c++) {
+                struct BlockedEllpack *b = blocked_from_ellpack(test.b, k, c);
+                struct EllpackMatrix *res = malloc(sizeof(*res));
+                matr_mult_ellpack_blocked(a, b, res);
+                equal = compare_ellpack(res, test.r);
+                if (!equal) {
+                    fprintf(report, "error on blocks of %lu x %lu times %lu x %lu with matrices:\n", r, k, k, c);
+                    print_ellpack(report, test.a, "A");
+                    print_ellpack(report, test.b, "B");
+                    print_ellpack(report, res, "but found");
+                }
+                free_blocked(b);
+                free_ellpack(res);
+            }
+            free_blocked(a);
+            if (!equal) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// the same values and indices bit for bit
+static bool identical_ellpack(const struct EllpackMatrix *x, const struct EllpackMatrix *y) {
+    return x->height == y->height && x->width == y->width && x->real_width == y->real_width
+           && memcmp(x->values, y->values, x->height * x->width * sizeof(float)) == 0
+           && memcmp(x->indices, y->indices, x->height * x->width * sizeof(u_int64_t)) == 0;
+}
+
+// rows of up to width entries with values of very different magnitudes, so the order of a sum changes its bits
+static struct EllpackMatrix *scattered_ellpack(u_int64_t real_width, u_int64_t height, u_int64_t width, u_int64_t seed) {
+    struct EllpackMatrix *x = make_ellpack(real_width, height, width, "");
+    memset(x->values, 0, height * width * sizeof(float));
+    memset(x->indices, 0, height * width * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < height; row++) {
+        u_int64_t column = row % 3;
+        for (u_int64_t i = 0; i < width && column < real_width; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            float value = (float) ((seed >> 40) % 2001) / 1000.0F - 1.0F;
+            x->values[row * width + i] = value != 0.0F ? value * (float) ((u_int64_t) 1 << (seed >> 59)) : 0.5F;
+            x->indices[row * width + i] = column;
+            column += 1 + (seed >> 33) % 3;
+        }
+    }
+    return x;
+}
+
+// the parallel transpose has to produce exactly the rows of the sequential one for every thread count, also for a
+// matrix with enough entries to be cut into a block per thread
+static bool check_transpose_parallel(struct TestStruct test, FILE *report) {
+    struct EllpackMatrix *inputs[2] = {test.b, scattered_ellpack(400, 37, 150, 3)};
+    int threads = scheduler_threads();
+    const int thread_counts[3] = {1, 3, 8};
+    bool equal = true;
+    for (int config = 0; config < 6 && equal; config++) {
+        set_scheduler_threads(thread_counts[config % 3]);
+        struct EllpackMatrix *expected = transpose_ellpack(inputs[config / 3]);
+        struct EllpackMatrix *found = transpose_ellpack_parallel(inputs[config / 3]);
+        equal = compare_ellpack(expected, found);
+        if (!equal) {
+            fprintf(report, "error on parallel transpose with %d threads of matrix:\n", thread_counts[config % 3]);
+            print_ellpack(report, inputs[config / 3], "X");
+            print_ellpack(report, expected, "expected");
+            print_ellpack(report, found, "but found");
+        }
+        free_ellpack(expected);
+        free_ellpack(found);
+    }
+    set_scheduler_threads(threads);
+    free_ellpack(inputs[1]);
+    return equal;
+}
+
+// both summations have to give the same bits for every thread count, task size and vector width,
+// on the test matrices they have to compute the test result
+static bool check_reproducible(struct TestStruct test, FILE *report) {
+    struct EllpackMatrix *inputs[2][2] = {{test.a, test.b},
+                                          {scattered_ellpack(400, 37, 150, 1), scattered_ellpack(37, 29, 300, 2)}};
+    int threads = scheduler_threads();
+    u_int64_t grain = scheduler_grain();
+    const int thread_counts[4] = {1, 2, 3, 8};
+    bool equal = true;
+    for (int pair = 0; pair < 2 && equal; pair++) {
+        for (enum Summation mode = SUM_PAIRWISE; mode <= SUM_COMPENSATED && equal; mode++) {
+            struct EllpackMatrix *first = malloc(sizeof(*first));
+            set_scheduler_threads(1);
+            matr_mult_ellpack_reproducible(inputs[pair][0], inputs[pair][1], mode, 0, first);
+            equal = pair == 1 || compare_ellpack(first, test.r);
+            for (int config = 0; config < 16 && equal; config++) {
+                set_scheduler_threads(thread_counts[config % 4]);
+                set_scheduler_grain(config / 4 % 2 ? 1 : 64);
+                struct EllpackMatrix *res = malloc(sizeof(*res));
+                matr_mult_ellpack_reproducible(inputs[pair][0], inputs[pair][1], mode, config / 8, res);
+                equal = identical_ellpack(res, first);
+                if (!equal) {
+                    fprintf(report, "error on reproducible %s sums with %d threads, grain %d and simd %d of matrices:\n",
+                            summation_name(mode), thread_counts[config % 4], config / 4 % 2 ? 1 : 64, config / 8);
+                    print_ellpack(report, inputs[pair][0], "A");
+                    print_ellpack(report, inputs[pair][1], "B");
+                    print_ellpack(report, first, "expected");
+                    print_ellpack(report, res, "but found");
+                }
+                free_ellpack(res);
+            }
+            free_ellpack(first);
+        }
+    }
+    set_scheduler_threads(threads);
+    set_scheduler_grain(grain);
+    free_ellpack(inputs[1][0]);
+    free_ellpack(inputs[1][1]);
+    return equal;
+}
+
+// the entries of a row of x kept by the rule, applied after the multiplication as a reference
+static u_int64_t prune_row_reference(const struct EllpackMatrix *x, u_int64_t row, struct PruneRule rule, float *values,
+                                      u_int64_t *indices) {
+    u_int64_t length = rowlength_ellpack(x, row);
+    const float *row_values = x->values + row * x->width;
+    double squares = 0.0;
+    for (u_int64_t i = 0; i < length; i++) {
+        squares += (double) row_values[i] * row_values[i];
+    }
+    u_int64_t kept = 0;
+    for (u_int64_t i = 0; i < length; i++) {
+        float value = row_values[i];
+        if (fabsf(value) < rule.absolute) {
+            continue;
+        }
+        // the number of stronger entries decides top k
+        u_int64_t stronger = 0;
+        for (u_int64_t j = 0; j < length && rule.top_k > 0; j++) {
+            float other = row_values[j];
+            stronger += fabsf(other) >= rule.absolute
+                        && (fabsf(other) > fabsf(value) || (fabsf(other) == fabsf(value) && j < i));
+        }
+        if ((rule.top_k > 0 && stronger >= rule.top_k)
+            || (rule.relative > 0.0F && (double) value * value < (double) rule.relative * rule.relative * squares)) {
+            continue;
+        }
+        values[kept] = value;
+        indices[kept] = x->indices[row * x->width + i];
+        kept++;
+    }
+    return kept;
+}
+
+// every drop rule applied while accumulating, in the sequential and the parallel merge, has to keep exactly the entries
+// it keeps after the multiplication
+static bool check_pruning(FILE *report) {
+    struct EllpackMatrix *a = scattered_ellpack(200, 31, 60, 3);
+    struct EllpackMatrix *b = scattered_ellpack(31, 23, 200, 4);
+    const struct PruneRule rules[5] = {{1e6F, 0.0F, 0}, {0.0F, 0.2F, 0}, {0.0F, 0.0F, 3}, {1e5F, 0.05F, 5}, {0.0F, 0.0F, 1000}};
+    struct PruneRule previous = prune_rule();
+    struct EllpackMatrix *full = malloc(sizeof(*full));
+    set_prune_rule((struct PruneRule) {0.0F, 0.0F, 0});
+    matr_mult_ellpack(a, b, full);
+    float *values = malloc((full->width + 1) * sizeof(float));
+    u_int64_t *indices = malloc((full->width + 1) * sizeof(u_int64_t));
+    bool equal = true;
+    for (int config = 0; config < 10 && equal; config++) {
+        int rule = config % 5;
+        set_prune_rule(rules[rule]);
+        struct EllpackMatrix *res = malloc(sizeof(*res));
+        if (config >= 5) {
+            matr_mult_ellpack_parallel(a, b, res);
+        } else {
+            matr_mult_ellpack(a, b, res);
+        }
+        u_int64_t dropped = take_pruned_entries();
+        u_int64_t expected_dropped = 0;
+        for (u_int64_t row = 0; row < full->height && equal; row++) {
+            u_int64_t kept = prune_row_reference(full, row, rules[rule], values, indices);
+            expected_dropped += rowlength_ellpack(full, row) - kept;
+            equal = res->height == full->height && rowlength_ellpack(res, row) == kept
+                    && memcmp(res->values + row * res->width, values, kept * sizeof(float)) == 0
+                    && memcmp(res->indices + row * res->width, indices, kept * sizeof(u_int64_t)) == 0;
+        }
+        equal = equal && dropped == expected_dropped;
+        if (!equal) {
+            fprintf(report, "error on drop rule %d (absolute %e, relative %e, top %lu) of the %s merge:\n", rule,
+                    rules[rule].absolute, rules[rule].relative, rules[rule].top_k, config >= 5 ? "parallel" : "sequential");
+            print_ellpack(report, full, "unpruned");
+            print_ellpack(report, res, "but found");
+        }
+        free_ellpack(res);
+    }
+    set_prune_rule(previous);
+    free(values);
+    free(indices);
+    free_all((struct EllpackMatrix *[]){a, b, full}, 3);
+    return equal;
+}
+
+// the kernel of every width, scalar and vectorised, has to give the bits of matr_mult_ellpack, on matrices of its width
+// and on narrower ones whose unused slots it has to skip
+static bool check_fixed_width(FILE *report) {
+    bool equal = true;
+    for (u_int64_t width = 1; width <= MAX_FIXED_WIDTH && equal; width++) {
+        for (int narrower = 0; narrower < 2 && equal; narrower++) {
+            struct EllpackMatrix *a = scattered_ellpack(60, 19, width - narrower * (width / 2), 5 + width);
+            struct EllpackMatrix *b = scattered_ellpack(19, 27, 40, 6 + width);
+            struct EllpackMatrix *expected = malloc(sizeof(*expected));
+            matr_mult_ellpack(a, b, expected);
+            for (int simd = 0; simd < 2 && equal; simd++) {
+                struct EllpackMatrix *res = malloc(sizeof(*res));
+                matr_mult_ellpack_fixed_width(a, b, width, simd, res);
+                equal = identical_ellpack(res, expected);
+                if (!equal) {
+                    fprintf(report, "error on the fixed width %lu kernel with simd %d of matrices:\n", width, simd);
+                    print_ellpack(report, a, "A");
+                    print_ellpack(report, b, "B");
+                    print_ellpack(report, expected, "expected");
+                    print_ellpack(report, res, "but found");
+                }
+                free_ellpack(res);
+            }
+            free_all((struct EllpackMatrix *[]){a, b, expected}, 3);
+        }
+    }
+    return equal;
+}
+
+// the accumulated rows have to give the bits of matr_mult_ellpack, with the touched columns scanned for wide rows and
+// sorted for rows scattered over a wide b
+static bool check_rowwise(FILE *report) {
+    bool equal = true;
+    for (u_int64_t spread = 1; spread <= 1000 && equal; spread *= 10) {
+        struct EllpackMatrix *a = scattered_ellpack(40, 23, 12, 3 + spread);
+        struct EllpackMatrix *b = scattered_ellpack(40, 40, 30, 4 + spread);
+        b->real_width *= spread;
+        for (u_int64_t i = 0; i < b->height * b->width; i++) {
+            b->indices[i] *= spread;
+        }
+        struct EllpackMatrix *expected = malloc(sizeof(*expected));
+        struct EllpackMatrix *res = malloc(sizeof(*res));
+        matr_mult_ellpack(a, b, expected);
+        matr_mult_ellpack_rowwise(a, b, res);
+        equal = identical_ellpack(res, expected);
+        if (!equal) {
+            fprintf(report, "error on the rowwise multiplication with columns spread by %lu of matrices:\n", spread);
+            print_ellpack(report, a, "A");
+            print_ellpack(report, b, "B");
+            print_ellpack(report, expected, "expected");
+            print_ellpack(report, res, "but found");
+        }
+        free_all((struct EllpackMatrix *[]){a, b, expected, res}, 4);
+    }
+    return equal;
+}
+
+// decisions have to be found again only for the same fingerprint, thread count and cpu, the later one winning, and an
+// autotuned run has to pick the cached implementation the second time
+static bool check_autotune(FILE *report) {
+    char path[] = "/tmp/ellmul-autotune-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(report, "error on creating a cache file for the autotuner\n");
+        return false;
+    }
+    close(fd);
+    struct EllpackMatrix *a = scattered_ellpack(40, 700, 6, 11);
+    struct EllpackMatrix *b = scattered_ellpack(40, 40, 9, 12);
+    struct EllpackMatrix *c = scattered_ellpack(40, 40, 10, 12);
+    u_int64_t fingerprint = matrix_fingerprint(a, b);
+    bool equal = fingerprint == matrix_fingerprint(a, b) && fingerprint != matrix_fingerprint(a, c)
+                 && autotune_store(path, fingerprint, 4, "cpu x", 3) && autotune_store(path, fingerprint, 4, "cpu x", 13)
+                 && autotune_lookup(path, fingerprint, 4, "cpu x") == 13 && autotune_lookup(path, fingerprint, 2, "cpu x") == -1
+                 && autotune_lookup(path, fingerprint, 4, "cpu y") == -1 && autotune_lookup(path, fingerprint + 1, 4, "cpu x") == -1;
+    if (equal) {
+        int picked = autotune_implementation(a, c, path);
+        equal = picked >= 0 && autotune_implementation(a, c, path) == picked;
+    }
+    if (!equal) {
+        fprintf(report, "error on caching the decisions of the autotuner in %s\n", path);
+    }
+    unlink(path);
+    free_all((struct EllpackMatrix *[]){a, b, c}, 3);
+    return equal;
+}
+
+// the blocks of the workers have to be assembled to the bits of matr_mult_ellpack for every worker count, with more
+// workers than rows, an odd count of entries of b padded in the shared file and a first row so long that workers get none
+static bool check_distributed(FILE *report) {
+    struct EllpackMatrix *b = scattered_ellpack(50, 41, 9, 32);
+    struct EllpackMatrix *inputs[2] = {scattered_ellpack(41, 23, 7, 31), scattered_ellpack(41, 5, 7, 33)};
+    memset(inputs[1]->values + inputs[1]->width, 0, (inputs[1]->height - 1) * inputs[1]->width * sizeof(float));
+    const int worker_counts[5] = {1, 2, 3, 7, 30};
+    const enum MultVersion versions[2] = {LINEAR, ROWWISE};
+    bool equal = true;
+    for (int input = 0; input < 2 && equal; input++) {
+        struct EllpackMatrix *expected = malloc(sizeof(*expected));
+        matr_mult_ellpack(inputs[input], b, expected);
+        for (int config = 0; config < 10 && equal; config++) {
+            struct EllpackMatrix *res = malloc(sizeof(*res));
+            matr_mult_ellpack_distributed(inputs[input], b, worker_counts[config % 5], versions[config / 5], res);
+            equal = identical_ellpack(res, expected);
+            if (!equal) {
+                fprintf(report, "error on %d workers with implementation %d of matrices:\n", worker_counts[config % 5],
+                        versions[config / 5]);
+                print_ellpack(report, inputs[input], "A");
+                print_ellpack(report, b, "B");
+                print_ellpack(report, expected, "expected");
+                print_ellpack(report, res, "but found");
+            }
+            free_ellpack(res);
+        }
+        free_ellpack(expected);
+    }
+    free_all((struct EllpackMatrix *[]){inputs[0], inputs[1], b}, 3);
+    return equal;
+}
+
+// sends a request to the service and returns its answer line starting with OK or ERR, error messages of the children
+// loading a matrix come first and are skipped
+static void service_request(struct MatrixCache *cache, int sockets[2], const char *request, char *answer, size_t size) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s", request);
+    serve_request(cache, sockets[0], line);
+    for (;;) {
+        size_t length = 0;
+        char c = 0;
+        while (length < size - 1 && read(sockets[1], &c, 1) == 1 && c != '\n') {
+            answer[length++] = c;
+        }
+        answer[length] = '\0';
+        if (length == 0 || strncmp(answer, "OK", 2) == 0 || strncmp(answer, "ERR", 3) == 0) {
+            return;
+        }
+    }
+}
+
+// the requests of the service on a socket pair: a failed reload has to keep the loaded matrix, the product written by
+// the child of MUL has to be the product of matr_mult_ellpack, implementations it does not run are refused
+static bool check_service(FILE *report) {
+    char a_path[] = "/tmp/ellmul-service-a-XXXXXX";
+    char b_path[] = "/tmp/ellmul-service-b-XXXXXX";
+    char broken_path[] = "/tmp/ellmul-service-broken-XXXXXX";
+    char out_path[] = "/tmp/ellmul-service-out-XXXXXX";
+    char *paths[4] = {a_path, b_path, broken_path, out_path};
+    for (int i = 0; i < 4; i++) {
+        int fd = mkstemp(paths[i]);
+        if (fd < 0) {
+            fprintf(report, "error on creating the files of the service\n");
+            return false;
+        }
+        if (i == 2) {
+            ssize_t written = write(fd, "no matrix\n", 10);
+            (void) written;
+        }
+        close(fd);
+    }
+    struct EllpackMatrix *a = scattered_ellpack(41, 23, 7, 31);
+    struct EllpackMatrix *b = scattered_ellpack(23, 41, 9, 32);
+    write_matrix_binary(a, a_path);
+    write_matrix_binary(b, b_path);
+    set_parser_quiet(1);
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+        fprintf(report, "error on creating the socket of the service\n");
+        free_all((struct EllpackMatrix *[]){a, b}, 2);
+        return false;
+    }
+    struct MatrixCache *cache = make_cache((u_int64_t) 1 << 30);
+    char request[256];
+    char answer[256];
+    const char *step = "LOAD a";
+    snprintf(request, sizeof(request), "LOAD a %s", a_path);
+    service_request(cache, sockets, request, answer, sizeof(answer));
+    bool equal = strncmp(answer, "OK loaded a ", 12) == 0;
+    if (equal) {
+        step = "LOAD b";
+        snprintf(request, sizeof(request), "LOAD b %s", b_path);
+        service_request(cache, sockets, request, answer, sizeof(answer));
+        equal = strncmp(answer, "OK loaded b ", 12) == 0;
+    }
+    if (equal) {
+        step = "LOAD a from a broken file";
+        snprintf(request, sizeof(request), "LOAD a %s", broken_path);
+        service_request(cache, sockets, request, answer, sizeof(answer));
+        equal = strncmp(answer, "ERR could not load", 18) == 0;
+    }
+    if (equal) {
+        step = "STATS";
+        service_request(cache, sockets, "STATS", answer, sizeof(answer));
+        equal = strncmp(answer, "OK 2 matrices", 13) == 0;
+    }
+    // the implementation may be left out before bin
+    const char *binary_arguments[2] = {"0 bin", "bin"};
+    for (int i = 0; i < 2 && equal; i++) {
+        step = i ? "MUL without implementation" : "MUL";
+        snprintf(request, sizeof(request), "MUL a b %s %s", out_path, binary_arguments[i]);
+        equal = truncate(out_path, 0) == 0;
+        service_request(cache, sockets, request, answer, sizeof(answer));
+        waitpid(-1, NULL, 0);
+        equal = equal && strncmp(answer, "OK wrote", 8) == 0;
+        if (equal) {
+            struct EllpackMatrix *res = parse_matrix_binary(out_path);
+            struct EllpackMatrix *expected = malloc(sizeof(*expected));
+            matr_mult_ellpack(a, b, expected);
+            equal = identical_ellpack(res, expected);
+            free_all((struct EllpackMatrix *[]){res, expected}, 2);
+        }
+    }
+    const char *refused_arguments[3] = {"9", "3x", "0 text"};
+    for (int i = 0; i < 3 && equal; i++) {
+        snprintf(request, sizeof(request), "MUL a b %s %s", out_path, refused_arguments[i]);
+        step = request;
+        service_request(cache, sockets, request, answer, sizeof(answer));
+        equal = strncmp(answer, "ERR", 3) == 0;
+    }
+    if (!equal) {
+        fprintf(report, "error on the service request %s, answered %s\n", step, answer);
+    }
+    set_parser_quiet(0);
+    free_cache(cache);
+    free_all((struct EllpackMatrix *[]){a, b}, 2);
+    close(sockets[0]);
+    close(sockets[1]);
+    for (int i = 0; i < 4; i++) {
+        unlink(paths[i]);
+    }
+    return equal;
+}
+
+// arrays of every page policy have to be aligned, zeroed on request, counted and given back by free and realloc, the
+// explicit huge pages falling back to transparent ones where none are reserved
+static bool check_arrays(FILE *report) {
+    enum PagePolicy policy = get_page_policy();
+    bool equal = true;
+    for (int pages = PAGES_SMALL; pages <= PAGES_EXPLICIT && equal; pages++) {
+        set_page_policy(pages);
+        for (size_t bytes = 1; bytes <= 4 * HUGE_PAGE_BYTES && equal; bytes = bytes * 7 + 1) {
+            u_int64_t before = memory_current();
+            unsigned char *array = alloc_array(bytes, 1);
+            equal = array && (uintptr_t) array % ARRAY_ALIGNMENT == 0 && memory_current() >= before + bytes
+                    && (bytes < HUGE_PAGE_BYTES || (uintptr_t) array % HUGE_PAGE_BYTES == 0);
+            for (size_t i = 0; i < bytes && equal; i += 4093) {
+                equal = array[i] == 0;
+            }
+            if (equal) {
+                array[bytes - 1] = 7;
+                array = realloc(array, bytes + 1);
+                equal = array && array[bytes - 1] == 7;
+            }
+            free(array);
+            equal = equal && memory_current() == before;
+            if (!equal) {
+                fprintf(report, "error on an array of %zu bytes with %s pages\n", bytes, page_policy_name(pages));
+            }
+        }
+    }
+    set_page_policy(policy);
+    return equal;
+}
+
+// the counters have to follow an allocation, and the text written panel by panel under a budget has to be the text of
+// the whole parallel result, from panels of single rows up to one panel
+static bool check_memory(struct TestStruct test, FILE *report) {
+    u_int64_t before = memory_current();
+    // through a volatile pointer, otherwise the unused allocation and its free are removed as builtins
+    char *volatile block = malloc(1000);
+    bool equal = memory_current() >= before + 1000 && memory_peak() >= before + 1000;
+    free(block);
+    equal = equal && memory_current() == before;
+    if (!equal) {
+        fprintf(report, "error on counting an allocation of 1000 bytes\n");
+        return false;
+    }
+    struct EllpackMatrix *res = malloc(sizeof(*res));
+    matr_mult_ellpack_parallel(test.a, test.b, res);
+    FILE *expected = tmpfile();
+    write_matrix_header(expected, res->height, res->real_width);
+    write_matrix_rows(expected, res, 0, res->height, res->width);
+    free_ellpack(res);
+    u_int64_t budget = 1;
+    u_int64_t whole = 2 * multiply_bytes(test.a, test.b);
+    for (int run = 0; run < 2 && equal; run++) {
+        FILE *out = tmpfile();
+        u_int64_t panels = 0;
+        // the smallest budget doubling from 1 byte that fits, then room for the whole multiplication
+        while (!multiply_in_panels(test.a, test.b, run ? whole : budget, out, &panels) && !run) {
+            budget *= 2;
+        }
+        equal = ftell(out) == ftell(expected) && (run == 0 || panels <= 1);
+        rewind(out);
+        rewind(expected);
+        for (int c = 0; equal && c != EOF; ) {
+            c = fgetc(out);
+            equal = c == fgetc(expected);
+        }
+        if (!equal) {
+            fprintf(report, "error on multiplying in %lu panels with a budget of %lu bytes\n", panels, run ? whole : budget);
+            print_ellpack(report, test.a, "A");
+            print_ellpack(report, test.b, "B");
+        }
+        fclose(out);
+    }
+    fclose(expected);
+    return equal;
+}
+
+struct NestedWrite {
+    const struct EllpackMatrix *x;
+    FILE *outs[4];
+    bool written[4];
+};
+
+// writes the matrix from a task of the scheduler like the batch writes its results
+static void nested_write_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct NestedWrite *c = context;
+    for (u_int64_t i = task->begin; i < task->end; i++) {
+        c->written[i] = write_matrix_text_fd(c->x, fileno(c->outs[i]));
+    }
+}
+
+// both files from their start to their end
+static bool same_text(FILE *x, FILE *y) {
+    rewind(x);
+    rewind(y);
+    bool equal = true;
+    for (int c = 0; equal && c != EOF; ) {
+        c = fgetc(x);
+        equal = c == fgetc(y);
+    }
+    return equal;
+}
+
+// the formatter has to print what printf prints for every power of two and its neighbours, which hold the ties between
+// two 10 digit texts, and for random bit patterns, the parallel writer the text of fprintf for matrices of many chunks,
+// also to a pipe and when several matrices are written from the tasks of a scheduled run
+static bool check_text_writer(FILE *report) {
+    u_int64_t seed = 23;
+    for (u_int64_t i = 0; i < 200000; i++) {
+        u_int32_t bits;
+        if (i < 6 * 256) {
+            // 2^e for every exponent, the next float above and below it, positive and negative
+            bits = (u_int32_t) (i / 6 % 256) << 23;
+            bits = (bits + (u_int32_t) (i % 3) - (i % 3 == 2 && bits ? 2 : 0)) | (u_int32_t) (i / 3 % 2) << 31;
+        } else {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            bits = (u_int32_t) (seed >> 32);
+        }
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        char expected[32];
+        char found[32] = {0};
+        int length = snprintf(expected, sizeof(expected), "%.9e", value);
+        if (format_float(value, found) != length || memcmp(found, expected, length) != 0) {
+            fprintf(report, "error on formatting %08x: expected %s but found %s\n", bits, expected, found);
+            return false;
+        }
+    }
+    bool equal = true;
+    for (u_int64_t width = 0; width < 12 && equal; width += 3) {
+        struct EllpackMatrix *x = scattered_ellpack(50, 3000 + width, width, 7 + width);
+        for (u_int64_t i = 0; i < x->height * x->width; i += 5) {
+            x->values[i] = 0.0F;
+        }
+        FILE *expected = tmpfile();
+        FILE *out = tmpfile();
+        fprintf(expected, "%lu\n%lu\n\n", x->height, x->real_width);
+        for (u_int64_t row = 0; row < x->height; row++) {
+            for (u_int64_t col = 0; col < x->width; col++) {
+                if (x->values[row * x->width + col] != 0) {
+                    fprintf(expected, "%lu;%lu;%.9e", row, x->indices[row * x->width + col], x->values[row * x->width + col]);
+                    if (row < x->height - 1 || col < x->width - 1) {
+                        fprintf(expected, "\n");
+                    }
+                }
+            }
+        }
+        fflush(expected);
+        equal = write_matrix_text_fd(x, fileno(out)) && lseek(fileno(out), 0, SEEK_END) == ftell(expected)
+                && same_text(out, expected);
+        if (!equal) {
+            fprintf(report, "error on writing a matrix of width %lu in parallel\n", width);
+        }
+        // a pipe cannot be written at offsets, a child writes it while it is read here
+        int pipe_fds[2];
+        if (equal && pipe(pipe_fds) == 0) {
+            FILE *piped = tmpfile();
+            pid_t child = fork();
+            if (child == 0) {
+                close(pipe_fds[0]);
+                _exit(write_matrix_text_fd(x, pipe_fds[1]) ? 0 : 1);
+            }
+            close(pipe_fds[1]);
+            char buffer[4096];
+            ssize_t length;
+            while ((length = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+                fwrite(buffer, 1, length, piped);
+            }
+            close(pipe_fds[0]);
+            int status = 1;
+            waitpid(child, &status, 0);
+            fflush(piped);
+            equal = child > 0 && status == 0 && same_text(piped, expected);
+            if (!equal) {
+                fprintf(report, "error on writing a matrix of width %lu to a pipe\n", width);
+            }
+            fclose(piped);
+        }
+        struct NestedWrite nested = {x, {tmpfile(), tmpfile(), tmpfile(), tmpfile()}, {false}};
+        const u_int64_t costs[4] = {1, 1, 1, 1};
+        int threads = scheduler_threads();
+        set_scheduler_threads(4);
+        schedule_rows(4, costs, 1, nested_write_task, &nested, "nested write");
+        set_scheduler_threads(threads);
+        for (int i = 0; i < 4; i++) {
+            if (equal && !(nested.written[i] && same_text(nested.outs[i], expected))) {
+                fprintf(report, "error on writing a matrix of width %lu from a scheduled task\n", width);
+                equal = false;
+            }
+            fclose(nested.outs[i]);
+        }
+        fclose(out);
+        fclose(expected);
+        free_ellpack(x);
+    }
+    return equal;
+}
+
+// the text the pipeline writes has to be the one write_matrix writes for the product, for panels of single rows up to
+// one panel larger than the matrix, with empty first and last rows, a is streamed from the binary format
+static bool check_pipeline(FILE *report) {
+    char a_path[] = "/tmp/ellmul-pipeline-a-XXXXXX";
+    char b_path[] = "/tmp/ellmul-pipeline-b-XXXXXX";
+    char expected_path[] = "/tmp/ellmul-pipeline-expected-XXXXXX";
+    char out_path[] = "/tmp/ellmul-pipeline-out-XXXXXX";
+    char *paths[4] = {a_path, b_path, expected_path, out_path};
+    for (int i = 0; i < 4; i++) {
+        int fd = mkstemp(paths[i]);
+        if (fd < 0) {
+            fprintf(report, "error on creating the files of the pipeline\n");
+            return false;
+        }
+        close(fd);
+    }
+    struct EllpackMatrix *a = scattered_ellpack(41, 23, 7, 31);
+    struct EllpackMatrix *b = scattered_ellpack(23, 41, 9, 32);
+    memset(a->values, 0, a->width * sizeof(float));
+    memset(a->values + (a->height - 1) * a->width, 0, a->width * sizeof(float));
+    struct EllpackMatrix *expected = malloc(sizeof(*expected));
+    matr_mult_ellpack(a, b, expected);
+    set_parser_quiet(1);
+    write_matrix_binary(a, a_path);
+    write_matrix_binary(b, b_path);
+    write_matrix(expected, expected_path);
+    FILE *expected_file = fopen(expected_path, "r");
+    const u_int64_t panel_rows[3] = {1, 2, a->height + 1};
+    bool equal = expected_file != NULL;
+    for (int i = 0; i < 3 && equal; i++) {
+        run_pipeline(a_path, b_path, out_path, panel_rows[i]);
+        FILE *out = fopen(out_path, "r");
+        equal = out && same_text(out, expected_file);
+        if (!equal) {
+            fprintf(report, "error on the pipeline with panels of %lu rows of matrices:\n", panel_rows[i]);
+            print_ellpack(report, a, "A");
+            print_ellpack(report, b, "B");
+            print_ellpack(report, expected, "expected");
+        }
+        if (out) {
+            fclose(out);
+        }
+    }
+    if (expected_file) {
+        fclose(expected_file);
+    }
+    set_parser_quiet(0);
+    free_all((struct EllpackMatrix *[]){a, b, expected}, 3);
+    for (int i = 0; i < 4; i++) {
+        unlink(paths[i]);
+    }
+    return equal;
+}
+
+// both ways of adding the rows of b, scalar and vectorised, have to give the bits of matr_mult_ellpack
+static bool check_dense(struct TestStruct test, FILE *report) {
+    struct EllpackMatrix *expected = malloc(sizeof(*expected));
+    matr_mult_ellpack(test.a, test.b, expected);
+    bool equal = true;
+    for (int config = 0; config < 4 && equal; config++) {
+        struct DenseMatrix *dense = malloc(sizeof(*dense));
+        matr_mult_ellpack_dense_with(test.a, test.b, config % 2, config / 2, dense);
+        struct EllpackMatrix *res = ellpack_from_dense(dense);
+        equal = identical_ellpack(res, expected);
+        if (!equal) {
+            fprintf(report, "error on the dense output with dense b %d and simd %d of matrices:\n", config % 2, config / 2);
+            print_ellpack(report, test.a, "A");
+            print_ellpack(report, test.b, "B");
+            print_ellpack(report, expected, "expected");
+            print_ellpack(report, res, "but found");
+        }
+        free_ellpack(res);
+        free_dense(dense);
+    }
+    free_ellpack(expected);
+    return equal;
+}
+
+// multiplies the 16 bit versions of the test matrices and returns the float result of the rounded inputs,
+// the rounding error against the float test result is reported
+static struct EllpackMatrix *multiply_half(struct TestStruct test, enum TestCases test_case, enum HalfFormat format,
+                                           struct EllpackMatrix *res, FILE *report) {
+    struct EllpackMatrixHalf *a = half_from_ellpack(test.a, format);
+    struct EllpackMatrixHalf *b = half_from_ellpack(test.b, format);
+    matr_mult_ellpack_half(a, b, res);
+    struct EllpackMatrix *a_rounded = ellpack_from_half(a);
+    struct EllpackMatrix *b_rounded = ellpack_from_half(b);
+    struct EllpackMatrix *reference = malloc(sizeof(*reference));
+    matr_mult_ellpack(a_rounded, b_rounded, reference);
+    float abs_error;
+    float rel_error;
+    max_error_ellpack(res, test.r, &abs_error, &rel_error);
+    fprintf(report, "%s testcase %d: max abs error %e, max rel error %e against float32\n",
+            format == FP16 ? "fp16" : "bf16", test_case, abs_error, rel_error);
+    free_ellpack_half(a);
+    free_ellpack_half(b);
+    free_ellpack(a_rounded);
+    free_ellpack(b_rounded);
+    return reference;
+}
+
+// runs the double kernels and returns the exact double product rounded to float, every entry summed in the order of
+// k like the merge, so the kernels have to give its bits and products that cancel must not leave an entry
+static struct EllpackMatrix *multiply_f64(struct TestStruct test, enum MultVersion version, struct EllpackMatrix *res) {
+    struct EllpackMatrixF64 *result = malloc(sizeof(*result));
+    if (version == GENERIC_F64) {
+        struct EllpackMatrixF64 *a = f64_from_ellpack(test.a);
+        struct EllpackMatrixF64 *b = f64_from_ellpack(test.b);
+        matr_mult_ellpack_f64(a, b, result);
+        free_ellpack_f64(a);
+        free_ellpack_f64(b);
+    } else {
+        matr_mult_ellpack_f32_acc64(test.a, test.b, result);
+    }
+    struct EllpackMatrix *rounded = ellpack_from_f64(result);
+    *res = *rounded;
+    free(rounded);
+    free_ellpack_f64(result);
+
+    u_int64_t columns = test.b->real_width;
+    double *sums = calloc(test.a->height * columns + 1, sizeof(double));
+    bool *used = calloc(test.a->height * columns + 1, sizeof(bool));
+    u_int64_t width = 0;
+    for (u_int64_t row = 0; row < test.a->height; row++) {
+        for (u_int64_t i = 0; i < rowlength_ellpack(test.a, row); i++) {
+            u_int64_t k = test.a->indices[row * test.a->width + i];
+            double factor = test.a->values[row * test.a->width + i];
+            for (u_int64_t j = 0; k < test.b->height && j < rowlength_ellpack(test.b, k); j++) {
+                u_int64_t column = test.b->indices[k * test.b->width + j];
+                sums[row * columns + column] += factor * (double) test.b->values[k * test.b->width + j];
+                used[row * columns + column] = true;
+            }
+        }
+        u_int64_t length = 0;
+        for (u_int64_t column = 0; column < columns; column++) {
+            length += used[row * columns + column] && sums[row * columns + column] != 0.0;
+        }
+        width = length > width ? length : width;
+    }
+    struct EllpackMatrix *reference = make_ellpack(columns, test.a->height, width, "");
+    memset(reference->values, 0, test.a->height * width * sizeof(float));
+    memset(reference->indices, 0, test.a->height * width * sizeof(u_int64_t));
+    for (u_int64_t row = 0; row < test.a->height; row++) {
+        u_int64_t length = 0;
+        for (u_int64_t column = 0; column < columns; column++) {
+            if (used[row * columns + column] && sums[row * columns + column] != 0.0) {
+                reference->values[row * width + length] = (float) sums[row * columns + column];
+                reference->indices[row * width + length++] = column;
+            }
+        }
+    }
+    free(sums);
+    free(used);
+    return reference;
+}
+
+// every row order has to be a permutation and the product of the reordered rows has to return to the expected result
+static bool check_reorder(struct TestStruct test, FILE *report) {
+    for (enum RowOrder order_type = ORDER_RCM; order_type <= ORDER_CLUSTER; order_type++) {
+        u_int64_t *order = row_order(test.a, order_type);
+        bool *seen = calloc(test.a->height, sizeof(bool));
+        bool permutation = true;
+        for (u_int64_t i = 0; i < test.a->height; i++) {
+            permutation = permutation && order[i] < test.a->height && !seen[order[i]];
+            if (permutation) {
+                seen[order[i]] = true;
+            }
+        }
+        free(seen);
+        bool equal = false;
+        if (permutation) {
+            struct EllpackMatrix *reordered = permute_rows(test.a, order, 0);
+            struct EllpackMatrix *res = malloc(sizeof(*res));
+            matr_mult_ellpack(reordered, test.b, res);
+            struct EllpackMatrix *restored = permute_rows(res, order, 1);
+            equal = compare_ellpack(restored, test.r);
+            free_all((struct EllpackMatrix *[]){reordered, res, restored}, 3);
+        }
+        free(order);
+        if (!equal) {
+            fprintf(report, "error on %s row order of matrix:\n", row_order_name(order_type));
+            print_ellpack(report, test.a, "A");
+            return false;
+        }
+    }
+    return true;
+}
+
+// the statistics of the sparse test cases counted by hand, all their rows are sampled so the output entries are exact,
+// products that cancel like the first entry of BIGSPARSE1 are counted, then the advisor on made up statistics
+static bool check_analyze(FILE *report) {
+    const struct {
+        enum TestCases test_case;
+        u_int64_t nnz[2];
+        u_int64_t histogram[2][3]; // rows of length 0, 1 and 2 to 3
+        double padding[2];
+        u_int64_t products;
+        double output_nnz;
+    } expected[3] = {
+            {BIGSPARSE1, {3, 3}, {{0, 1, 1}, {0, 1, 1}}, {4.0 / 3, 4.0 / 3}, 5, 4},
+            {BIGSPARSE2, {7, 4}, {{0, 1, 3}, {0, 4, 0}}, {8.0 / 7, 1.0}, 7, 6},
+            {BIGSPARSE3, {7, 15}, {{0, 1, 3}, {0, 0, 5}}, {8.0 / 7, 1.0}, 21, 15},
+    };
+    bool equal = true;
+    for (int i = 0; i < 3 && equal; i++) {
+        struct TestStruct test = choose_testcase(expected[i].test_case);
+        const struct EllpackMatrix *inputs[2] = {test.a, test.b};
+        for (int input = 0; input < 2 && equal; input++) {
+            struct MatrixStats stats;
+            matrix_stats(inputs[input], &stats);
+            equal = stats.nnz == expected[i].nnz[input] && stats.histogram[0] == expected[i].histogram[input][0]
+                    && stats.histogram[1] == expected[i].histogram[input][1]
+                    && stats.histogram[2] == expected[i].histogram[input][2] && stats.histogram[3] == 0
+                    && fabs(stats.padding - expected[i].padding[input]) < TESTING_PRECISION;
+            if (!equal) {
+                fprintf(report, "error on the statistics of matrix %s of testcase %d: nnz %lu, rows of length 0 %lu, 1 %lu,"
+                                " 2 to 3 %lu, padding %f\n", input ? "B" : "A", expected[i].test_case, stats.nnz,
+                        stats.histogram[0], stats.histogram[1], stats.histogram[2], stats.padding);
+            }
+        }
+        struct ProductStats p_stats;
+        product_stats(test.a, test.b, &p_stats);
+        if (equal && (p_stats.products != expected[i].products || p_stats.sampled_rows != test.a->height
+                      || p_stats.output_nnz != expected[i].output_nnz)) {
+            fprintf(report, "error on the product statistics of testcase %d: %lu products, %f output entries from %lu rows\n",
+                    expected[i].test_case, p_stats.products, p_stats.output_nnz, p_stats.sampled_rows);
+            equal = false;
+        }
+        free_all((struct EllpackMatrix *[]){test.a, test.b, test.r}, 3);
+    }
+    // products, merge steps, sampled rows, output entries and density with the threads and the expected advice
+    const struct ProductStats advised[4] = {{10, 160, 1, 5, 0}, {10, 100, 1, 5, 0}, {80, 100, 1, 10, 0}, {10, 100, 1, 5, 0}};
+    const u_int64_t threads[4] = {4, 2, 1, 1};
+    const enum MultVersion versions[4] = {ROWWISE, PARALLEL, VECTORIZED, LINEAR};
+    for (int i = 0; i < 4 && equal; i++) {
+        equal = advise_implementation(&advised[i], threads[i]) == versions[i];
+        if (!equal) {
+            fprintf(report, "error on the advice for %lu products, %lu merge steps and %lu threads: implementation %d\n",
+                    advised[i].products, advised[i].merge_steps, threads[i], advise_implementation(&advised[i], threads[i]));
+        }
+    }
+    return equal;
+}
+
+// all test cases multiplied as one batch, every result has to match its single multiplication
+static bool check_batch(FILE *report) {
+    struct EllpackMatrix *a[TERMINAL];
+    struct EllpackMatrix *b[TERMINAL];
+    struct EllpackMatrix *r[TERMINAL];
+    for (enum TestCases test_case = 0; test_case != TERMINAL; test_case++) {
+        struct TestStruct test = choose_testcase(test_case);
+        a[test_case] = test.a;
+        b[test_case] = test.b;
+        r[test_case] = test.r;
+    }
+    struct MatrixBatch *batch = make_batch(a, b, TERMINAL);
+    matr_mult_ellpack_batch(batch);
+    bool equal = true;
+    for (enum TestCases test_case = 0; test_case != TERMINAL; test_case++) {
+        if (equal && !compare_ellpack(batch->results[test_case], r[test_case])) {
+            fprintf(report, "error on batched testcase: %d\n", test_case);
+            print_ellpack(report, r[test_case], "expected");
+            print_ellpack(report, batch->results[test_case], "but found");
+            equal = false;
+        }
+        free_all((struct EllpackMatrix *[]){a[test_case], b[test_case], r[test_case]}, 3);
+    }
+    free_batch(batch);
+    return equal;
+}
+
 void testing(enum MultVersion version, FILE *report) {
+    // split down to single rows and single merges so stealing and stitching get exercised
+    u_int64_t grain = scheduler_grain();
+    if (version == PARALLEL || version == BATCHED || version == COMPRESSED || version == BLOCKED || version == FIXED_WIDTH
+        || version == ROWWISE) {
+        set_scheduler_grain(1);
+    }
+    if ((version == BATCHED && !check_batch(report)) || (version == FIXED_WIDTH && !check_fixed_width(report))
+        || (version == ROWWISE && !check_rowwise(report))) {
+        set_scheduler_grain(grain);
+        return;
+    }
     for (enum TestCases test_case = 0; test_case != TERMINAL; test_case++) {
         struct TestStruct test = choose_testcase(test_case);
         struct EllpackMatrix *res = malloc(sizeof(*res));
+        struct EllpackMatrix *expected = test.r;
+        if ((version == COMPRESSED && !check_compressed(test, report)) || (version == BLOCKED && !check_blocked(test, report))) {
+            free_ellpack(test.a);
+            free_ellpack(test.b);
+            free_ellpack(test.r);
+            free(res);
+            set_scheduler_grain(grain);
+            return;
+        }
         switch (version) {
             case LINEAR:
                 matr_mult_ellpack(test.a, test.b, res);
@@ -87,25 +1219,139 @@ void testing(enum MultVersion version, FILE *report) {
             case NAIVE:
                 matr_mult_ellpack_naive(test.a, test.b, res);
                 break;
+            case PARALLEL:
+                matr_mult_ellpack_parallel(test.a, test.b, res);
+                break;
+            case GENERIC_F32:
+                matr_mult_ellpack_f32(test.a, test.b, res);
+                break;
+            case BATCHED:
+                matr_mult_ellpack_batched(test.a, test.b, res);
+                break;
+            case COMPRESSED:
+                ;
+                struct CompressedEllpack *a = compress_ellpack(test.a);
+                struct CompressedEllpack *b = compress_ellpack(test.b);
+                matr_mult_ellpack_compressed(a, b, res);
+                free_compressed(a);
+                free_compressed(b);
+                break;
+            case BLOCKED:
+                ;
+                u_int64_t shape[3];
+                block_shape_ellpack(test.a, test.b, shape);
+                struct BlockedEllpack *a_blocked = blocked_from_ellpack(test.a, shape[0], shape[1]);
+                struct BlockedEllpack *b_blocked = blocked_from_ellpack(test.b, shape[1], shape[2]);
+                matr_mult_ellpack_blocked(a_blocked, b_blocked, res);
+                free_blocked(a_blocked);
+                free_blocked(b_blocked);
+                break;
+            case FIXED_WIDTH:
+                matr_mult_ellpack_fixed(test.a, test.b, res);
+                break;
+            case ROWWISE:
+                matr_mult_ellpack_rowwise(test.a, test.b, res);
+                break;
+            case GENERIC_F64:
+            case MIXED_F32_F64:
+                expected = multiply_f64(test, version, res);
+                break;
+            case HALF_FP16:
+            case HALF_BF16:
+                // the kernel has to match the float multiplication of the rounded inputs
+                expected = multiply_half(test, test_case, version == HALF_FP16 ? FP16 : BF16, res, report);
+                break;
             default:
                 break;
         }
-        if (!compare_ellpack(res, test.r)) {
+        if (!compare_ellpack(res, expected)) {
             fprintf(report, "error on testcase: %d with matrices:\n", test_case);
             print_ellpack(report, test.a, "A");
             print_ellpack(report, test.b, "B");
-            print_ellpack(report, test.r, "expected");
+            print_ellpack(report, expected, "expected");
             print_ellpack(report, res, "but found");
+            if (expected != test.r) {
+                free_ellpack(expected);
+            }
             free_ellpack(test.a);
             free_ellpack(test.b);
             free_ellpack(test.r);
             free_ellpack(res);
+            set_scheduler_grain(grain);
             return;
         }
+        if (expected != test.r) {
+            free_ellpack(expected);
+        }
         free_ellpack(test.a);
         free_ellpack(test.b);
         free_ellpack(test.r);
         free_ellpack(res);
     }
+    // random shapes with empty rows, empty columns and dense rows against a dense reference,
+    // the parallel tests also cover the reproducible summations
+    struct DifferentialConfig random_cases = {64, 24, 0.2, TESTING_PRECISION, 1, false};
+    bool passed = run_differential(&random_cases, version, report);
+    for (int kernel = KERNEL_REPRODUCIBLE_PAIRWISE; version == PARALLEL && kernel < KERNEL_COUNT; kernel++) {
+        passed = passed && run_differential(&random_cases, kernel, report);
+    }
+    set_scheduler_grain(grain);
+    if (!passed) {
+        return;
+    }
     fprintf(report, "-- all tests passed --\n");
 }
+
+// the checks of the features around the kernels, on their own matrices or on every test case
+struct FeatureCheck {
+    const char *name;
+    bool (*check)(FILE *report);
+    bool (*check_case)(struct TestStruct test, FILE *report);
+};
+
+static const struct FeatureCheck FEATURE_CHECKS[] = {
+        {"service", check_service, NULL},
+        {"text writer", check_text_writer, NULL},
+        {"autotune", check_autotune, NULL},
+        {"arrays", check_arrays, NULL},
+        {"distributed", check_distributed, NULL},
+        {"pruning", check_pruning, NULL},
+        {"pipeline", check_pipeline, NULL},
+        {"analyze", check_analyze, NULL},
+        {"parallel transpose", NULL, check_transpose_parallel},
+        {"reproducible", NULL, check_reproducible},
+        {"memory", NULL, check_memory},
+        {"dense output", NULL, check_dense},
+        {"reorder", NULL, check_reorder},
+        {"incremental", NULL, check_incremental},
+        {"elementwise", NULL, check_elementwise},
+};
+
+void testing_features(FILE *report) {
+    // split down to single rows so stealing and stitching get exercised
+    u_int64_t grain = scheduler_grain();
+    set_scheduler_grain(1);
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(FEATURE_CHECKS) / sizeof(FEATURE_CHECKS[0]); i++) {
+        bool feature_passed = true;
+        if (FEATURE_CHECKS[i].check) {
+            feature_passed = FEATURE_CHECKS[i].check(report);
+        }
+        for (enum TestCases test_case = 0; FEATURE_CHECKS[i].check_case && feature_passed && test_case != TERMINAL; test_case++) {
+            struct TestStruct test = choose_testcase(test_case);
+            feature_passed = FEATURE_CHECKS[i].check_case(test, report);
+            if (!feature_passed) {
+                fprintf(report, "on testcase: %d\n", test_case);
+            }
+            free_all((struct EllpackMatrix *[]){test.a, test.b, test.r}, 3);
+        }
+        if (!feature_passed) {
+            fprintf(report, "-- %s check failed --\n", FEATURE_CHECKS[i].name);
+            passed = false;
+        }
+    }
+    set_scheduler_grain(grain);
+    if (passed) {
+        fprintf(report, "-- all tests passed --\n");
+    }
+}
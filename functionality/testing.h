@@ -43,4 +43,7 @@ bool compare_ellpack(struct EllpackMatrix *a, struct EllpackMatrix *b);
 
 void testing(enum MultVersion version, FILE *report);
 
+/** the features around the kernels, every failed one is reported by its name */
+void testing_features(FILE *report);
+
 #endif //PROJEKTAUFGABE_TESTING_H
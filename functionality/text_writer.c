@@ -0,0 +1,299 @@
+#include "text_writer.h"
+
+#include "memory.h"
+#include "scheduler.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// the rows formatted into one buffer, and the buffers of all threads formatted before they are written
+#define CHUNK_BYTES (256 * 1024)
+#define WINDOW_BYTES (32 * 1024 * 1024)
+
+// the significant digits of %.9e
+#define DIGITS 10
+// 5^44 * 2^24 is the largest product of a mantissa and a power of five below 2^128
+#define MAX_FIVE_POWER 44
+
+__extension__ typedef unsigned __int128 u_int128_t;
+
+static const char DIGIT_PAIRS[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+int format_index(u_int64_t value, char *out) {
+    char digits[20];
+    int i = 20;
+    while (value >= 100) {
+        i -= 2;
+        memcpy(digits + i, DIGIT_PAIRS + 2 * (value % 100), 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        i -= 2;
+        memcpy(digits + i, DIGIT_PAIRS + 2 * value, 2);
+    } else {
+        digits[--i] = (char) ('0' + value);
+    }
+    memcpy(out, digits + i, 20 - i);
+    return 20 - i;
+}
+
+static u_int128_t power_of_five(int exponent) {
+    u_int128_t power = 1;
+    u_int128_t base = 5;
+    for (; exponent; exponent >>= 1) {
+        if (exponent & 1) {
+            power *= base;
+        }
+        base *= base;
+    }
+    return power;
+}
+
+// the decimal digits of value, most significant first
+static int integer_digits(u_int128_t value, char *out) {
+    char digits[40];
+    int i = 40;
+    while (value > UINT64_MAX) {
+        u_int64_t low = (u_int64_t) (value % 10000000000000000000ULL);
+        value /= 10000000000000000000ULL;
+        for (int j = 0; j < 19; j++) {
+            digits[--i] = (char) ('0' + low % 10);
+            low /= 10;
+        }
+    }
+    char head[20];
+    int head_length = format_index((u_int64_t) value, head);
+    i -= head_length;
+    memcpy(digits + i, head, head_length);
+    memcpy(out, digits + i, 40 - i);
+    return 40 - i;
+}
+
+// values too small for the exact integer of 128 bits, infinities and NaN
+static int format_float_printf(float value, char *out) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.9e", value);
+    memcpy(out, text, length);
+    return length;
+}
+
+// the float is exactly mantissa * 2^exponent = digits * 10^-scale with an integer digits, its first 10 decimal digits
+// are rounded to nearest with ties to even on the exact remaining digits, like the printf of glibc
+int format_float(float value, char *out) {
+    u_int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    u_int32_t biased = (bits >> 23) & 0xff;
+    u_int64_t mantissa = bits & 0x7fffff;
+    if (biased == 0xff || (biased == 0 && mantissa == 0)) {
+        return format_float_printf(value, out);
+    }
+    int exponent = biased ? (int) biased - 150 : -149;
+    mantissa |= biased ? 1 << 23 : 0;
+    while (!(mantissa & 1) && exponent < 0) {
+        mantissa >>= 1;
+        exponent++;
+    }
+    if (-exponent > MAX_FIVE_POWER) {
+        return format_float_printf(value, out);
+    }
+    u_int128_t exact = exponent >= 0 ? (u_int128_t) mantissa << exponent
+                                            : mantissa * power_of_five(-exponent);
+    int scale = exponent >= 0 ? 0 : -exponent;
+
+    char digits[40];
+    int length = integer_digits(exact, digits);
+    int decimal_exponent = length - 1 - scale;
+    u_int64_t significand = 0;
+    for (int i = 0; i < DIGITS; i++) {
+        significand = significand * 10 + (i < length ? (u_int64_t) (digits[i] - '0') : 0);
+    }
+    if (length > DIGITS && digits[DIGITS] >= '5') {
+        bool above = digits[DIGITS] > '5';
+        for (int i = DIGITS + 1; i < length && !above; i++) {
+            above = digits[i] != '0';
+        }
+        if (above || significand % 2) {
+            significand++;
+        }
+        if (significand == 10000000000ULL) {
+            significand /= 10;
+            decimal_exponent++;
+        }
+    }
+
+    char *p = out;
+    if (bits >> 31) {
+        *p++ = '-';
+    }
+    char text[DIGITS];
+    format_index(significand, text);
+    *p++ = text[0];
+    *p++ = '.';
+    memcpy(p, text + 1, DIGITS - 1);
+    p += DIGITS - 1;
+    *p++ = 'e';
+    *p++ = decimal_exponent < 0 ? '-' : '+';
+    // floats have decimal exponents from -45 to 38
+    memcpy(p, DIGIT_PAIRS + 2 * (decimal_exponent < 0 ? -decimal_exponent : decimal_exponent), 2);
+    p += 2;
+    return (int) (p - out);
+}
+
+int format_entry(u_int64_t row, u_int64_t column, float value, int newline, char *out) {
+    char *p = out;
+    p += format_index(row, p);
+    *p++ = ';';
+    p += format_index(column, p);
+    *p++ = ';';
+    p += format_float(value, p);
+    if (newline) {
+        *p++ = '\n';
+    }
+    return (int) (p - out);
+}
+
+// writes all bytes unless the file fails
+static int pwrite_all(int fd, const char *buffer, u_int64_t length, u_int64_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, buffer, length, (off_t) offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return 0;
+        }
+        buffer += written;
+        length -= written;
+        offset += written;
+    }
+    return 1;
+}
+
+// writes all bytes at the position of a pipe unless it fails
+static int write_all(int fd, const char *buffer, u_int64_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return 0;
+        }
+        buffer += written;
+        length -= written;
+    }
+    return 1;
+}
+
+struct WriterContext {
+    const struct EllpackMatrix *matrix;
+    u_int64_t first_chunk; // of the window
+    u_int64_t chunk_rows;
+    u_int64_t chunk_bytes;
+    char *buffers; // chunk_bytes per chunk of the window
+    u_int64_t *lengths;
+    u_int64_t *offsets;
+    int fd;
+    atomic_int failed;
+};
+
+static void format_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct WriterContext *c = context;
+    const struct EllpackMatrix *x = c->matrix;
+    for (u_int64_t chunk = task->begin; chunk < task->end; chunk++) {
+        char *p = c->buffers + chunk * c->chunk_bytes;
+        u_int64_t begin = (c->first_chunk + chunk) * c->chunk_rows;
+        u_int64_t end = begin + c->chunk_rows < x->height ? begin + c->chunk_rows : x->height;
+        for (u_int64_t row = begin; row < end; row++) {
+            for (u_int64_t col = 0; col < x->width; col++) {
+                float value = x->values[row * x->width + col];
+                if (value == 0) {
+                    continue;
+                }
+                p += format_entry(row, x->indices[row * x->width + col], value,
+                                  row < x->height - 1 || col < x->width - 1, p);
+            }
+        }
+        c->lengths[chunk] = p - (c->buffers + chunk * c->chunk_bytes);
+    }
+}
+
+static void write_task(void *context, const struct RowTask *task, int thread) {
+    (void) thread;
+    struct WriterContext *c = context;
+    for (u_int64_t chunk = task->begin; chunk < task->end; chunk++) {
+        if (!pwrite_all(c->fd, c->buffers + chunk * c->chunk_bytes, c->lengths[chunk], c->offsets[chunk])) {
+            atomic_store(&c->failed, 1);
+        }
+    }
+}
+
+int write_matrix_text_fd(const struct EllpackMatrix *matrix, int fd) {
+    char header[2 * 20 + 3];
+    u_int64_t offset = 0;
+    offset += format_index(matrix->height, header + offset);
+    header[offset++] = '\n';
+    offset += format_index(matrix->real_width, header + offset);
+    header[offset++] = '\n';
+    header[offset++] = '\n';
+    // pipes and fifos cannot be written at offsets, their chunks are written in order by this thread
+    int seekable = lseek(fd, 0, SEEK_CUR) >= 0 || errno != ESPIPE;
+    if (!(seekable ? pwrite_all(fd, header, offset, 0) : write_all(fd, header, offset))) {
+        return 0;
+    }
+    if (matrix->width == 0 || matrix->height == 0) {
+        return 1;
+    }
+
+    u_int64_t row_bytes = matrix->width * ENTRY_TEXT_LENGTH;
+    u_int64_t chunk_rows = row_bytes < CHUNK_BYTES ? CHUNK_BYTES / row_bytes : 1;
+    u_int64_t chunk_bytes = chunk_rows * row_bytes;
+    u_int64_t chunks = (matrix->height + chunk_rows - 1) / chunk_rows;
+    // under a memory limit the buffers take at most half of what is left
+    u_int64_t window_bytes = WINDOW_BYTES;
+    if (memory_limit() && (memory_limit() - memory_current()) / 2 < window_bytes) {
+        window_bytes = memory_current() < memory_limit() ? (memory_limit() - memory_current()) / 2 : 0;
+    }
+    u_int64_t window = window_bytes / chunk_bytes > 0 ? window_bytes / chunk_bytes : 1;
+    window = window < chunks ? window : chunks;
+
+    struct WriterContext c = {matrix, 0, chunk_rows, chunk_bytes, malloc(window * chunk_bytes),
+                              calloc(window, sizeof(u_int64_t)), calloc(window, sizeof(u_int64_t)), fd, 0};
+    u_int64_t *costs = calloc(window, sizeof(u_int64_t));
+    if (!c.buffers || !c.lengths || !c.offsets || !costs) {
+        error(1, 0, "Error: Not enough memory for writing the matrix");
+    }
+    for (; c.first_chunk < chunks && !atomic_load(&c.failed); c.first_chunk += window) {
+        u_int64_t count = chunks - c.first_chunk < window ? chunks - c.first_chunk : window;
+        for (u_int64_t chunk = 0; chunk < count; chunk++) {
+            costs[chunk] = chunk_rows * matrix->width;
+        }
+        schedule_rows(count, costs, 1, format_task, &c, "format text");
+        if (!seekable) {
+            for (u_int64_t chunk = 0; chunk < count && !atomic_load(&c.failed); chunk++) {
+                if (!write_all(fd, c.buffers + chunk * chunk_bytes, c.lengths[chunk])) {
+                    atomic_store(&c.failed, 1);
+                }
+            }
+            continue;
+        }
+        for (u_int64_t chunk = 0; chunk < count; chunk++) {
+            c.offsets[chunk] = offset;
+            offset += c.lengths[chunk];
+            costs[chunk] = c.lengths[chunk] + 1;
+        }
+        schedule_rows(count, costs, 1, write_task, &c, "write text");
+    }
+    free(c.buffers);
+    free(c.lengths);
+    free(c.offsets);
+    free(costs);
+    return !atomic_load(&c.failed);
+}
@@ -0,0 +1,26 @@
+#ifndef PROJEKTAUFGABE_TEXT_WRITER_H
+#define PROJEKTAUFGABE_TEXT_WRITER_H
+
+#include "ellpack_utility.h"
+
+/** the longest text of format_float, a sign, 10 digits, the point and an exponent like e-45 */
+#define FLOAT_TEXT_LENGTH 16
+/** the longest line of the text format, two indices of 20 digits, the value, two semicolons and the line break */
+#define ENTRY_TEXT_LENGTH (2 * 20 + FLOAT_TEXT_LENGTH + 3)
+
+/** writes the characters printf("%.9e") prints for value without a terminating 0, returns their number */
+int format_float(float value, char *out);
+/** writes the decimal digits of value without a terminating 0, returns their number */
+int format_index(u_int64_t value, char *out);
+/** writes the line row;column;value of the text format, the line break only if newline, returns its length */
+int format_entry(u_int64_t row, u_int64_t column, float value, int newline, char *out);
+
+/**
+ * writes the matrix in the text format of write_matrix to the file descriptor, which is written from its start:
+ * windows of rows are formatted by the scheduler threads into buffers of a chunk of rows each,
+ * the chunks are placed by the prefix sum of their lengths and written with pwrite by the threads again,
+ * to a pipe or fifo they are written in order by the calling thread, returns 0 if a write failed
+ */
+int write_matrix_text_fd(const struct EllpackMatrix *matrix, int fd);
+
+#endif //PROJEKTAUFGABE_TEXT_WRITER_H
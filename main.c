@@ -9,12 +9,34 @@
 #include <unistd.h>
 #include <error.h>
 #include <stdbool.h>
+#include <time.h>
+#include <math.h>
 
 #include "functionality/ellpack_utility.h"
 #include "functionality/multiplication.h"
 #include "functionality/testing.h"
 #include "functionality/benchmarking.h"
 #include "functionality/parser.h"
+#include "functionality/scheduler.h"
+#include "functionality/half_precision.h"
+#include "functionality/precision.h"
+#include "functionality/service.h"
+#include "functionality/batch.h"
+#include "functionality/reorder.h"
+#include "functionality/elementwise.h"
+#include "functionality/analyze.h"
+#include "functionality/compressed.h"
+#include "functionality/blocked.h"
+#include "functionality/pipeline.h"
+#include "functionality/reproducible.h"
+#include "functionality/differential.h"
+#include "functionality/pruning.h"
+#include "functionality/fixed_width.h"
+#include "functionality/rowwise.h"
+#include "functionality/autotune.h"
+#include "functionality/memory.h"
+#include "functionality/dense.h"
+#include "functionality/distributed.h"
 
 const char *argp_program_version = "ELLMUL version v0.1.0-dev";
 static char doc[] = "ellmul: fast multiplication of ellpack matrices";
@@ -22,26 +44,82 @@ __attribute__((unused)) const char *argp_program_bug_address = "p.assmann@tum.de
 
 static char args_doc[] = "";
 
+// options without a short name
+enum {
+    ALPHA_KEY = 0x100, BETA_KEY, ANALYZE_KEY, PIPELINE_KEY, REPRODUCIBLE_KEY, DROP_KEY, DROP_RELATIVE_KEY, TOP_K_KEY,
+    FUZZ_KEY, FUZZ_SIZE_KEY, FUZZ_DENSITY_KEY, FUZZ_TOLERANCE_KEY, MEM_LIMIT_KEY,
+    DENSE_KEY, DENSE_ELLPACK_KEY, AUTO_KEY, PAGES_KEY, WORKERS_KEY, WORKER_KEY
+};
+
 static struct argp_option options[] = {
         {"verbose", 'v', 0, 0, "Produce verbose output", 3},
         {"help", 'h', 0, 0, "Give this help list", 3},
         {"impl", 'V', "int", 0, "Which implementation to run", 2},
         {"benchmark", 'B', "int", OPTION_ARG_OPTIONAL, "Benchmark with iterations", 2},
-        {"test", 'T', "int", 0, "Test an implementation", 2},
+        {"auto", AUTO_KEY, "file", OPTION_ARG_OPTIONAL, "Time the float implementations on sampled rows of Matrix A and run the fastest, the choice is cached in the file (default: " AUTOTUNE_CACHE ")", 2},
+        {"test", 'T', "int", 0, "Test an implementation, 14 tests the features around them", 2},
+        {"threads", 't', "int", 0, "Worker threads of the parallel implementation (default: all cpus)", 2},
+        {"workers", WORKERS_KEY, "int", 0, "Multiply in this many local worker processes, each with a block of rows of Matrix A and the threads divided among them, Matrix B is shared read only", 2},
+        {"worker", WORKER_KEY, "socket,file", OPTION_HIDDEN, "Multiply the rows of Matrix A received on the socket with Matrix B shared in the file, as a worker of --workers", 2},
+        {"pages", PAGES_KEY, "policy", 0, "Pages of the large matrix arrays: small, transparent or explicit huge pages, falling back to transparent ones (default: transparent)", 2},
+        {"mem-limit", MEM_LIMIT_KEY, "MiB", 0, "Fail allocations above this many MiB, implementations 0, 3 and 12 multiply in row panels written one at a time if the whole result would not fit", 2},
+        {"reproducible", REPRODUCIBLE_KEY, "sum", OPTION_ARG_OPTIONAL, "Sum the products of every entry in a fixed order, the same bits for every thread count and vector width: pairwise, compensated (default: pairwise)", 2},
+        {"dense", DENSE_KEY, "when", OPTION_ARG_OPTIONAL, "Accumulate the product in a dense buffer and write it dense, auto if the estimated output density is at least a third, always (default: auto)", 2},
+        {"dense-ellpack", DENSE_ELLPACK_KEY, 0, 0, "Convert the dense result of --dense back to ELLPACK before writing it", 2},
+        {"drop", DROP_KEY, "float", 0, "Drop result entries smaller in magnitude while they are accumulated (implementations 0 and 3)", 2},
+        {"drop-relative", DROP_RELATIVE_KEY, "float", 0, "Drop result entries smaller than this fraction of the euclidean norm of their row", 2},
+        {"top-k", TOP_K_KEY, "int", 0, "Keep only the k largest result entries of every row", 2},
+        {"analyze", ANALYZE_KEY, 0, 0, "Report the structure of A, B and A * B and recommend a format, implementation and thread count", 2},
+        {"elementwise", 'E', "op", 0, "Instead of multiplying compute alpha * A + beta * B (add), alpha * A * B entry by entry (hadamard) or alpha * A (scale)", 2},
+        {"alpha", ALPHA_KEY, "float", 0, "Factor of the product or of Matrix A (default: 1)", 2},
+        {"beta", BETA_KEY, "float", 0, "Factor of Matrix C or of Matrix B (default: 1)", 2},
+        {"reorder", 'R', "order", 0, "Reorder the rows of Matrix A before the multiplication: none, rcm, degree, cluster", 2},
         {"amatrix", 'a', "file", 0, "Path to input Matrix A", 1},
         {"bmatrix", 'b', "file", 0, "Path to input Matrix B", 1},
+        {"cmatrix", 'c', "file", 0, "Path to input Matrix C, the result becomes alpha * A * B + beta * C", 1},
         {"output", 'o', "file", 0, "Path to output Matrix", 1},
+        {"binary", 'x', 0, 0, "Write the output Matrix in the binary format", 1},
+        {"pipeline", PIPELINE_KEY, "rows", OPTION_ARG_OPTIONAL, "Stream panels of rows of Matrix A through loading, multiplying and writing at the same time (default: 1024 rows)", 1},
+        {"batch", 'M', "manifest", 0, "Multiply every \"<a> <b> <output>\" line of the manifest as one batch", 1},
+        {"serve", 'S', "socket", 0, "Run as a service keeping matrices loaded, see client", 4},
+        {"cache-limit", 'C', "MiB", 0, "Memory limit of the matrices cached by the service (default: 1024)", 4},
+        {"fuzz", FUZZ_KEY, "cases", OPTION_ARG_OPTIONAL, "Multiply random matrices with every implementation and compare against a dense reference (default: 100 cases)", 5},
+        {"fuzz-size", FUZZ_SIZE_KEY, "int", 0, "Largest dimension of the random matrices (default: 64)", 5},
+        {"fuzz-density", FUZZ_DENSITY_KEY, "float", 0, "Chance of an entry in the random matrices (default: 0.1)", 5},
+        {"fuzz-tolerance", FUZZ_TOLERANCE_KEY, "float", 0, "Largest error of an entry relative to the sum of its absolute products (default: 1e-4)", 5},
         {0}
 };
 
 struct arguments {
-    int verbose, version, benchmark, test, help;
+    int verbose, version, benchmark, test, help, threads, binary, analyze;
+    int reproducible; // an enum Summation, -1 for the fast order of the implementation
+    int dense; // an enum DenseMode, -1 to always build the result in ELLPACK
+    int dense_ellpack;
+    int workers; // processes of --workers, 0 to multiply in this one
+    int worker_socket, worker_b; // descriptors of --worker, -1 unless this is a worker
+    char *autotune; // cache file of --auto, NULL to run the implementation given with -V
     char *amatrix;
     char *bmatrix;
     char *output;
+    char *cmatrix;
+    char *socket;
+    char *manifest;
+    u_int64_t cache_limit;
+    u_int64_t mem_limit; // bytes, 0 for no limit
+    enum PagePolicy pages; // of the large matrix arrays
+    u_int64_t pipeline; // rows per panel, 0 runs the stages one after another
+    enum RowOrder reorder;
+    enum ElementwiseOp elementwise;
+    float alpha, beta;
+    struct DifferentialConfig fuzz; // no cases unless requested
+    struct PruneRule prune;
 };
 
-static const int MAX_IMPL = 3;
+static const int MAX_IMPL = 14;
+// the testing target after the implementations
+static const int FEATURE_TESTS = 14;
+// rows looked back for the column reuse of the reordering report
+static const u_int64_t REUSE_WINDOW = 8;
 
 static error_t parse_opt (int key, char *arg, struct argp_state *state) {
     struct arguments *arguments = state->input;
@@ -54,6 +132,12 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 'v':
             arguments->verbose = 1;
             break;
+        case 'x':
+            arguments->binary = 1;
+            break;
+        case ANALYZE_KEY:
+            arguments->analyze = 1;
+            break;
         case 'V':
             ;
             errno = 0;
@@ -92,11 +176,193 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
             if (errno != 0 || *arg == '\0' || *end_ptr != '\0') {
                 argp_failure(state, 1, 0, "not a valid testing target: %s", arg);
             }
-            if (test < 0 || test >= MAX_IMPL) {
+            if (test < 0 || test > FEATURE_TESTS) {
                 argp_failure(state, 1, 0, "not a valid testing target: %s", arg);
             }
             arguments->test = test;
             break;
+        case 't':
+            ;
+            errno = 0;
+            int threads = (int) strtol(arg, &end_ptr, 10);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0') {
+                argp_failure(state, 1, 0, "not a valid thread count: %s", arg);
+            }
+            if (threads <= 0 || threads > 4096) {
+                argp_failure(state, 1, 0, "not a valid thread count (out of bounds): %s", arg);
+            }
+            arguments->threads = threads;
+            break;
+        case 'M':
+            ;
+            if (access(arg, R_OK) == 0) {
+                arguments->manifest = arg;
+            } else {
+                argp_failure(state, 1, 0, "manifest file does not exist or missing read permission: %s", arg);
+            }
+            break;
+        case 'E':
+            ;
+            int op = elementwise_op_from_name(arg);
+            if (op < 0) {
+                argp_failure(state, 1, 0, "not a valid element wise operation: %s", arg);
+            }
+            arguments->elementwise = op;
+            break;
+        case PIPELINE_KEY:
+            ;
+            long panel_rows = DEFAULT_PANEL_ROWS;
+            if (arg) {
+                errno = 0;
+                panel_rows = strtol(arg, &end_ptr, 10);
+                if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || panel_rows <= 0) {
+                    argp_failure(state, 1, 0, "not a valid panel size: %s", arg);
+                }
+            }
+            arguments->pipeline = (u_int64_t) panel_rows;
+            break;
+        case REPRODUCIBLE_KEY:
+            ;
+            int summation = arg ? summation_from_name(arg) : SUM_PAIRWISE;
+            if (summation < 0) {
+                argp_failure(state, 1, 0, "not a valid summation: %s", arg);
+            }
+            arguments->reproducible = summation;
+            break;
+        case DENSE_KEY:
+            ;
+            int dense = arg ? dense_mode_from_name(arg) : DENSE_AUTO;
+            if (dense < 0) {
+                argp_failure(state, 1, 0, "not a valid dense mode: %s", arg);
+            }
+            arguments->dense = dense;
+            break;
+        case DENSE_ELLPACK_KEY:
+            arguments->dense_ellpack = 1;
+            break;
+        case PAGES_KEY:
+            ;
+            int policy = page_policy_from_name(arg);
+            if (policy < 0) {
+                argp_failure(state, 1, 0, "not a valid page policy: %s", arg);
+            }
+            arguments->pages = policy;
+            break;
+        case AUTO_KEY:
+            arguments->autotune = arg ? arg : AUTOTUNE_CACHE;
+            break;
+        case WORKERS_KEY:
+            ;
+            errno = 0;
+            int workers = (int) strtol(arg, &end_ptr, 10);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || workers <= 0 || workers > MAX_WORKERS) {
+                argp_failure(state, 1, 0, "not a valid worker count: %s", arg);
+            }
+            arguments->workers = workers;
+            break;
+        case WORKER_KEY:
+            if (sscanf(arg, "%d,%d", &arguments->worker_socket, &arguments->worker_b) != 2
+                || arguments->worker_socket < 0 || arguments->worker_b < 0) {
+                argp_failure(state, 1, 0, "not a valid worker: %s", arg);
+            }
+            break;
+        case DROP_KEY:
+        case DROP_RELATIVE_KEY:
+            ;
+            errno = 0;
+            float tolerance = strtof(arg, &end_ptr);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || !(tolerance > 0) || !isfinite(tolerance)) {
+                argp_failure(state, 1, 0, "not a valid drop tolerance: %s", arg);
+            }
+            if (key == DROP_KEY) {
+                arguments->prune.absolute = tolerance;
+            } else {
+                arguments->prune.relative = tolerance;
+            }
+            break;
+        case TOP_K_KEY:
+            ;
+            errno = 0;
+            long top_k = strtol(arg, &end_ptr, 10);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || top_k <= 0) {
+                argp_failure(state, 1, 0, "not a valid entry count: %s", arg);
+            }
+            arguments->prune.top_k = (u_int64_t) top_k;
+            break;
+        case FUZZ_KEY:
+        case FUZZ_SIZE_KEY:
+            ;
+            long count = 100;
+            if (arg) {
+                errno = 0;
+                count = strtol(arg, &end_ptr, 10);
+                if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || count <= 0) {
+                    argp_failure(state, 1, 0, "not a valid %s: %s", key == FUZZ_KEY ? "case count" : "size", arg);
+                }
+            }
+            if (key == FUZZ_KEY) {
+                arguments->fuzz.cases = (u_int64_t) count;
+            } else {
+                arguments->fuzz.max_size = (u_int64_t) count;
+            }
+            break;
+        case FUZZ_DENSITY_KEY:
+        case FUZZ_TOLERANCE_KEY:
+            ;
+            errno = 0;
+            double fraction = strtod(arg, &end_ptr);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || !(fraction > 0) || (key == FUZZ_DENSITY_KEY && fraction > 1)) {
+                argp_failure(state, 1, 0, "not a valid %s: %s", key == FUZZ_DENSITY_KEY ? "density" : "tolerance", arg);
+            }
+            if (key == FUZZ_DENSITY_KEY) {
+                arguments->fuzz.density = fraction;
+            } else {
+                arguments->fuzz.tolerance = fraction;
+            }
+            break;
+        case ALPHA_KEY:
+        case BETA_KEY:
+            ;
+            errno = 0;
+            float factor = strtof(arg, &end_ptr);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || !isfinite(factor)) {
+                argp_failure(state, 1, 0, "not a valid factor: %s", arg);
+            }
+            if (key == ALPHA_KEY) {
+                arguments->alpha = factor;
+            } else {
+                arguments->beta = factor;
+            }
+            break;
+        case 'R':
+            ;
+            int reorder = row_order_from_name(arg);
+            if (reorder < 0) {
+                argp_failure(state, 1, 0, "not a valid row order: %s", arg);
+            }
+            arguments->reorder = reorder;
+            break;
+        case 'S':
+            arguments->socket = arg;
+            break;
+        case 'C':
+            ;
+            errno = 0;
+            long cache_limit = strtol(arg, &end_ptr, 10);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || cache_limit <= 0) {
+                argp_failure(state, 1, 0, "not a valid cache limit: %s", arg);
+            }
+            arguments->cache_limit = (u_int64_t) cache_limit << 20;
+            break;
+        case MEM_LIMIT_KEY:
+            ;
+            errno = 0;
+            long mem_limit = strtol(arg, &end_ptr, 10);
+            if (errno != 0 || *arg == '\0' || *end_ptr != '\0' || mem_limit <= 0) {
+                argp_failure(state, 1, 0, "not a valid memory limit: %s", arg);
+            }
+            arguments->mem_limit = (u_int64_t) mem_limit << 20;
+            break;
         case 'a':
             ;
             if (access(arg, R_OK) == 0) {
@@ -113,6 +379,14 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
                 argp_failure(state, 1, 0, "bmatrix file does not exist or missing read permission: %s", arg);
             }
             break;
+        case 'c':
+            ;
+            if (access(arg, R_OK) == 0) {
+                arguments->cmatrix = arg;
+            } else {
+                argp_failure(state, 1, 0, "cmatrix file does not exist or missing read permission: %s", arg);
+            }
+            break;
         case 'o':
             ;
             fopen(arg, "w");
@@ -140,6 +414,498 @@ void dump_inputs(struct EllpackMatrix* amatrix, struct EllpackMatrix* bmatrix) {
     printf("\n");
 }
 
+// loads both matrices with 16 bit values, the result is computed in float
+static void run_half(struct arguments *arguments, enum HalfFormat format) {
+    printf("[LOAD] Loading Matrix A ...\n");
+    struct EllpackMatrixHalf* amatrix = parse_matrix_half(arguments->amatrix, format);
+    printf("[DONE] Matrix A loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", amatrix->width, amatrix->real_width, amatrix->height);
+
+    printf("[LOAD] Loading Matrix B ...\n");
+    struct EllpackMatrixHalf* bmatrix = parse_matrix_half(arguments->bmatrix, format);
+
+    if(amatrix->height != bmatrix->real_width) {
+        u_int64_t a_height = amatrix->height;
+        u_int64_t b_real_width = bmatrix->real_width;
+        free_ellpack_half(amatrix);
+        free_ellpack_half(bmatrix);
+        error(1, 0, "Error: Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu", a_height, b_real_width);
+    }
+
+    printf("[DONE] Matrix B loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", bmatrix->width, bmatrix->real_width, bmatrix->height);
+    printf("[LOAD_COMPLETE] Ready for multiplication\n");
+    printf("\n[MUL] Multiplication in progress ...\n");
+
+    struct EllpackMatrix* result = calloc(1, sizeof(*result));
+    if(arguments->benchmark != -1) {
+        benchmark(arguments->version, arguments->benchmark, amatrix, bmatrix, result);
+    } else {
+        matr_mult_ellpack_half(amatrix, bmatrix, result);
+    }
+
+    printf("\n[SAVE] Writing result matrix %s\n", arguments->output);
+    if (arguments->binary) {
+        // keep the storage format of the inputs
+        struct EllpackMatrixHalf *half_result = half_from_ellpack(result, format);
+        write_matrix_half_binary(half_result, arguments->output);
+        free_ellpack_half(half_result);
+    } else {
+        write_matrix(result, arguments->output);
+    }
+    printf("[FREE] Freeing used memory ...\n");
+    free_ellpack_half(amatrix);
+    free_ellpack_half(bmatrix);
+    free_ellpack(result);
+}
+
+// reorders the rows of A and reports the locality before and after, with a benchmark both orders are timed once
+static u_int64_t *reorder_a(struct arguments *arguments, struct EllpackMatrix *amatrix, struct EllpackMatrix *bmatrix,
+                            struct EllpackMatrix **reordered) {
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    u_int64_t *order = row_order(amatrix, arguments->reorder);
+    *reordered = permute_rows(amatrix, order, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[REORDER] %s order of Matrix A computed in %f secs\n", row_order_name(arguments->reorder),
+           end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec));
+    printf("[REORDER] Bandwidth %lu -> %lu, column reuse within %lu rows %.1f%% -> %.1f%%\n",
+           bandwidth_ellpack(amatrix), bandwidth_ellpack(*reordered), REUSE_WINDOW,
+           100 * column_reuse_ellpack(amatrix, REUSE_WINDOW), 100 * column_reuse_ellpack(*reordered, REUSE_WINDOW));
+    if (arguments->benchmark != -1) {
+        double times[2];
+        struct EllpackMatrix *inputs[2] = {amatrix, *reordered};
+        for (int i = 0; i < 2; i++) {
+            struct EllpackMatrix *result = calloc(1, sizeof(*result));
+            times[i] = benchmark_once(arguments->version, inputs[i], bmatrix, result);
+            free_ellpack(result);
+        }
+        printf("[BENCHMARK] Implementation %i: file order %f secs, %s order %f secs (%.2fx)\n", arguments->version,
+               times[0], row_order_name(arguments->reorder), times[1], times[1] > 0 ? times[0] / times[1] : 0.0);
+    }
+    return order;
+}
+
+// computes an element wise operation of A and B instead of their product
+static void run_elementwise(struct arguments *arguments) {
+    printf("[LOAD] Loading Matrix A ...\n");
+    struct EllpackMatrix* amatrix = parse_matrix(arguments->amatrix);
+    printf("[DONE] Matrix A loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", amatrix->width, amatrix->real_width, amatrix->height);
+    struct EllpackMatrix* bmatrix = NULL;
+    if (arguments->elementwise != ELEMENT_SCALE) {
+        printf("[LOAD] Loading Matrix B ...\n");
+        bmatrix = parse_matrix(arguments->bmatrix);
+        printf("[DONE] Matrix B loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", bmatrix->width, bmatrix->real_width, bmatrix->height);
+    }
+    printf("[LOAD_COMPLETE] Ready for the element wise operation\n");
+    printf("\n[MUL] Element wise operation in progress ...\n");
+    struct EllpackMatrix* result = calloc(1, sizeof(*result));
+    switch (arguments->elementwise) {
+        case ELEMENT_ADD:
+            matr_add_scaled_ellpack(arguments->alpha, amatrix, arguments->beta, bmatrix, result);
+            break;
+        case ELEMENT_HADAMARD:
+            matr_hadamard_ellpack(amatrix, bmatrix, result);
+            if (arguments->alpha != 1.0F) {
+                struct EllpackMatrix* scaled = calloc(1, sizeof(*scaled));
+                matr_scale_ellpack(arguments->alpha, result, scaled);
+                free_ellpack(result);
+                result = scaled;
+            }
+            break;
+        default:
+            matr_scale_ellpack(arguments->alpha, amatrix, result);
+            break;
+    }
+    printf("\n[SAVE] Writing result matrix %s\n", arguments->output);
+    if (arguments->binary) {
+        write_matrix_binary(result, arguments->output);
+    } else {
+        write_matrix(result, arguments->output);
+    }
+    printf("[FREE] Freeing used memory ...\n");
+    free_ellpack(amatrix);
+    if (bmatrix) {
+        free_ellpack(bmatrix);
+    }
+    free_ellpack(result);
+}
+
+// computes a double result, from double inputs or from float inputs with a double accumulator
+static void run_f64(struct arguments *arguments, int double_inputs) {
+    u_int64_t dimensions[2][3]; // width, real width, height of A and B
+    void *matrices[2];
+    char *paths[2] = {arguments->amatrix, arguments->bmatrix};
+    for (int i = 0; i < 2; i++) {
+        printf("[LOAD] Loading Matrix %c ...\n", 'A' + i);
+        if (double_inputs) {
+            struct EllpackMatrixF64 *matrix = parse_matrix_f64(paths[i]);
+            dimensions[i][0] = matrix->width;
+            dimensions[i][1] = matrix->real_width;
+            dimensions[i][2] = matrix->height;
+            matrices[i] = matrix;
+        } else {
+            struct EllpackMatrix *matrix = parse_matrix(paths[i]);
+            dimensions[i][0] = matrix->width;
+            dimensions[i][1] = matrix->real_width;
+            dimensions[i][2] = matrix->height;
+            matrices[i] = matrix;
+        }
+        if (i == 1 && dimensions[0][2] != dimensions[1][1]) {
+            error(1, 0, "Error: Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu", dimensions[0][2], dimensions[1][1]);
+        }
+        printf("[DONE] Matrix %c loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", 'A' + i, dimensions[i][0], dimensions[i][1], dimensions[i][2]);
+    }
+    printf("[LOAD_COMPLETE] Ready for multiplication\n");
+    printf("\n[MUL] Multiplication in progress ...\n");
+
+    struct EllpackMatrixF64* result = calloc(1, sizeof(*result));
+    if(arguments->benchmark != -1) {
+        benchmark(arguments->version, arguments->benchmark, matrices[0], matrices[1], result);
+    } else if (double_inputs) {
+        matr_mult_ellpack_f64(matrices[0], matrices[1], result);
+    } else {
+        matr_mult_ellpack_f32_acc64(matrices[0], matrices[1], result);
+    }
+
+    printf("\n[SAVE] Writing result matrix %s\n", arguments->output);
+    if (arguments->binary) {
+        write_matrix_f64_binary(result, arguments->output);
+    } else {
+        write_matrix_f64(result, arguments->output);
+    }
+    printf("[FREE] Freeing used memory ...\n");
+    for (int i = 0; i < 2; i++) {
+        if (double_inputs) {
+            free_ellpack_f64(matrices[i]);
+        } else {
+            free_ellpack(matrices[i]);
+        }
+    }
+    free_ellpack_f64(result);
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return end.tv_sec - start->tv_sec + 1e-9 * (end.tv_nsec - start->tv_nsec);
+}
+
+// multiplies with delta encoded and bit packed indices, a benchmark also compares A * vector with the plain indices
+static void run_compressed(struct arguments *arguments) {
+    struct CompressedEllpack* matrices[2];
+    char *paths[2] = {arguments->amatrix, arguments->bmatrix};
+    for (int i = 0; i < 2; i++) {
+        printf("[LOAD] Loading Matrix %c ...\n", 'A' + i);
+        matrices[i] = parse_matrix_compressed(paths[i]);
+        if (i == 1 && matrices[0]->height != matrices[1]->real_width) {
+            error(1, 0, "Error: Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu", matrices[0]->height, matrices[1]->real_width);
+        }
+        printf("[DONE] Matrix %c loaded, Dimensions: [%lu (formerly %lu) x %lu]\n", 'A' + i, matrices[i]->width, matrices[i]->real_width, matrices[i]->height);
+        u_int64_t plain_bytes = matrices[i]->height * matrices[i]->width * sizeof(u_int64_t);
+        u_int64_t compressed_bytes = compressed_index_bytes(matrices[i]);
+        printf("[COMPRESS] Matrix %c: indices take %lu instead of %lu bytes (%.2fx smaller)\n\n", 'A' + i, compressed_bytes, plain_bytes,
+               compressed_bytes > 0 ? (double) plain_bytes / compressed_bytes : 0.0);
+    }
+    printf("[LOAD_COMPLETE] Ready for multiplication\n");
+    printf("\n[MUL] Multiplication in progress ...\n");
+
+    struct EllpackMatrix* result = calloc(1, sizeof(*result));
+    if (arguments->benchmark != -1) {
+        benchmark(arguments->version, arguments->benchmark, matrices[0], matrices[1], result);
+        // x * vector is bound by the memory traffic, so the smaller indices should pay off most there
+        struct EllpackMatrix *plain = decompress_ellpack(matrices[0]);
+        float *vector = malloc(plain->real_width * sizeof(float));
+        float *product = malloc(plain->height * sizeof(float));
+        if (!vector || !product) {
+            error(1, 0, "an allocation has failed");
+        }
+        for (u_int64_t i = 0; i < plain->real_width; i++) {
+            vector[i] = 1.0F;
+        }
+        double times[2];
+        for (int compressed = 0; compressed < 2; compressed++) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int i = 0; i < arguments->benchmark; i++) {
+                if (compressed) {
+                    matr_vec_ellpack_compressed(matrices[0], vector, product);
+                } else {
+                    matr_vec_ellpack(plain, vector, product);
+                }
+            }
+            times[compressed] = seconds_since(&start) / arguments->benchmark;
+        }
+        printf("[BENCHMARK] Matrix A * vector: plain indices %f secs, compressed indices %f secs (%.2fx)\n",
+               times[0], times[1], times[1] > 0 ? times[0] / times[1] : 0.0);
+        free_ellpack(plain);
+        free(vector);
+        free(product);
+    } else {
+        matr_mult_ellpack_compressed(matrices[0], matrices[1], result);
+    }
+
+    printf("\n[SAVE] Writing result matrix %s\n", arguments->output);
+    if (arguments->binary) {
+        // keep the storage format of the inputs
+        struct CompressedEllpack *compressed_result = compress_ellpack(result);
+        write_matrix_compressed_binary(compressed_result, arguments->output);
+        free_compressed(compressed_result);
+    } else {
+        write_matrix(result, arguments->output);
+    }
+    printf("[FREE] Freeing used memory ...\n");
+    free_compressed(matrices[0]);
+    free_compressed(matrices[1]);
+    free_ellpack(result);
+}
+
+// multiplies with a fixed summation order, a benchmark compares it to the implementation in its fast order
+static void run_reproducible(struct arguments *arguments, const struct EllpackMatrix *amatrix, const struct EllpackMatrix *bmatrix,
+                             struct EllpackMatrix *result) {
+    enum Summation mode = arguments->reproducible;
+    if (arguments->benchmark == -1) {
+        matr_mult_ellpack_reproducible(amatrix, bmatrix, mode, 1, result);
+        return;
+    }
+    double times[2] = {0, 0};
+    for (int i = 0; i < arguments->benchmark; i++) {
+        struct EllpackMatrix *fast = calloc(1, sizeof(*fast));
+        if (!fast) {
+            error(1, 0, "an allocation has failed");
+        }
+        times[0] += benchmark_once(arguments->version, amatrix, bmatrix, fast);
+        free_ellpack(fast);
+        if (i > 0) {
+            free(result->values);
+            free(result->indices);
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        matr_mult_ellpack_reproducible(amatrix, bmatrix, mode, 1, result);
+        times[1] += seconds_since(&start);
+    }
+    times[0] /= arguments->benchmark;
+    times[1] /= arguments->benchmark;
+    printf("[BENCHMARK] Implementation %i: %f secs, reproducible %s sums: %f secs (%+.1f%% overhead)\n", arguments->version,
+           times[0], summation_name(mode), times[1], times[0] > 0 ? 100.0 * (times[1] / times[0] - 1.0) : 0.0);
+}
+
+// multiplies into a dense buffer if the estimated output density asks for it or --dense=always, a benchmark compares
+// it to the implementation writing ELLPACK, returns whether it multiplied and wrote the result
+static int run_dense(struct arguments *arguments, const struct EllpackMatrix *amatrix, const struct EllpackMatrix *bmatrix) {
+    struct ProductStats stats;
+    product_stats(amatrix, bmatrix, &stats);
+    if (arguments->dense == DENSE_AUTO && stats.output_density < DENSE_OUTPUT_FILL) {
+        printf("[DENSE] Estimated output density %.2f%% is below %.2f%%, the result is built in ELLPACK\n",
+               100 * stats.output_density, 100 * DENSE_OUTPUT_FILL);
+        return 0;
+    }
+    printf("[DENSE] Estimated output density %.2f%%, accumulating into a dense %lu x %lu buffer\n",
+           100 * stats.output_density, amatrix->height, bmatrix->real_width);
+    printf("\n[MUL] Multiplication in progress ...\n");
+    struct DenseMatrix *result = calloc(1, sizeof(*result));
+    if (!result) {
+        error(1, 0, "an allocation has failed");
+    }
+    if (arguments->benchmark == -1) {
+        matr_mult_ellpack_dense(amatrix, bmatrix, result);
+    } else {
+        double times[2] = {0, 0};
+        u_int64_t ellpack_width = 0;
+        for (int i = 0; i < arguments->benchmark; i++) {
+            struct EllpackMatrix *sparse = calloc(1, sizeof(*sparse));
+            if (!sparse) {
+                error(1, 0, "an allocation has failed");
+            }
+            times[0] += benchmark_once(arguments->version, amatrix, bmatrix, sparse);
+            ellpack_width = sparse->width;
+            free_ellpack(sparse);
+            if (i > 0) {
+                free(result->values);
+            }
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            matr_mult_ellpack_dense(amatrix, bmatrix, result);
+            times[1] += seconds_since(&start);
+        }
+        times[0] /= arguments->benchmark;
+        times[1] /= arguments->benchmark;
+        printf("[BENCHMARK] Implementation %i: %f secs for %lu bytes of ELLPACK, dense output: %f secs for %lu bytes (%.2fx)\n",
+               arguments->version, times[0], amatrix->height * ellpack_width * (sizeof(float) + sizeof(u_int64_t)), times[1],
+               result->height * result->width * sizeof(float), times[1] > 0 ? times[0] / times[1] : 0.0);
+    }
+    end_memory_phase();
+
+    begin_memory_phase("save");
+    printf("\n[SAVE] Writing result matrix %s\n", arguments->output);
+    if (arguments->dense_ellpack) {
+        struct EllpackMatrix *converted = ellpack_from_dense(result);
+        if (arguments->binary) {
+            write_matrix_binary(converted, arguments->output);
+        } else {
+            write_matrix(converted, arguments->output);
+        }
+        free_ellpack(converted);
+    } else if (arguments->binary) {
+        write_matrix_dense_binary(result, arguments->output);
+    } else {
+        write_matrix_dense(result, arguments->output);
+    }
+    end_memory_phase();
+    free_dense(result);
+    return 1;
+}
+
+static u_int64_t count_entries(const struct EllpackMatrix *x) {
+    u_int64_t entries = 0;
+    for (u_int64_t row = 0; row < x->height; row++) {
+        entries += rowlength_ellpack(x, row);
+    }
+    return entries;
+}
+
+// multiplies with the drop rule, a benchmark compares the result and the time of the next multiplication of a chain
+// with and without the rule
+static void run_pruned(struct arguments *arguments, const struct EllpackMatrix *amatrix, const struct EllpackMatrix *bmatrix,
+                       struct EllpackMatrix *result) {
+    if (arguments->benchmark == -1) {
+        benchmark_once(arguments->version, amatrix, bmatrix, result);
+        printf("[PRUNE] %lu entries dropped while accumulating, %lu kept in a width of %lu\n", take_pruned_entries(),
+               count_entries(result), result->width);
+        return;
+    }
+    // the next multiplication of a chain is result * B if the shapes allow it, otherwise result * result^T
+    int chained = amatrix->real_width == bmatrix->real_width;
+    double multiply[2] = {0, 0};
+    double downstream[2] = {0, 0};
+    u_int64_t entries[2];
+    u_int64_t widths[2];
+    for (int i = 0; i < arguments->benchmark; i++) {
+        for (int pruned = 0; pruned < 2; pruned++) {
+            set_prune_rule(pruned ? arguments->prune : (struct PruneRule) {0.0F, 0.0F, 0});
+            struct EllpackMatrix *r = pruned ? result : calloc(1, sizeof(*r));
+            if (!r) {
+                error(1, 0, "an allocation has failed");
+            }
+            if (pruned && i > 0) {
+                free(result->values);
+                free(result->indices);
+            }
+            multiply[pruned] += benchmark_once(arguments->version, amatrix, bmatrix, r);
+            entries[pruned] = count_entries(r);
+            widths[pruned] = r->width;
+            // the next multiplication runs without the rule on whatever the first one left
+            set_prune_rule((struct PruneRule) {0.0F, 0.0F, 0});
+            struct EllpackMatrix *rt = chained ? NULL : transpose_ellpack_parallel(r);
+            struct EllpackMatrix *next = calloc(1, sizeof(*next));
+            if (!next) {
+                error(1, 0, "an allocation has failed");
+            }
+            downstream[pruned] += benchmark_once(arguments->version, r, chained ? bmatrix : rt, next);
+            free_ellpack(next);
+            if (rt) {
+                free_ellpack(rt);
+            }
+            if (!pruned) {
+                free_ellpack(r);
+            }
+        }
+    }
+    set_prune_rule(arguments->prune);
+    take_pruned_entries();
+    printf("[PRUNE] nnz %lu instead of %lu (%.1f%% fewer), width %lu instead of %lu\n", entries[1], entries[0],
+           entries[0] > 0 ? 100.0 * (1.0 - (double) entries[1] / entries[0]) : 0.0, widths[1], widths[0]);
+    printf("[BENCHMARK] Implementation %i: multiply %f secs with the rule, %f secs without\n", arguments->version,
+           multiply[1] / arguments->benchmark, multiply[0] / arguments->benchmark);
+    printf("[BENCHMARK] Next multiplication result * %s: %f secs after pruning, %f secs without (%.2fx)\n",
+           chained ? "B" : "result^T", downstream[1] / arguments->benchmark, downstream[0] / arguments->benchmark,
+           downstream[1] > 0 ? downstream[0] / downstream[1] : 0.0);
+}
+
+// multiplies in dense blocks of the shape taking the least memory
+static void run_blocked(struct arguments *arguments) {
+    struct EllpackMatrix* matrices[2];
+    char *paths[2] = {arguments->amatrix, arguments->bmatrix};
+    for (int i = 0; i < 2; i++) {
+        printf("[LOAD] Loading Matrix %c ...\n", 'A' + i);
+        matrices[i] = parse_matrix(paths[i]);
+        if (i == 1 && matrices[0]->height != matrices[1]->real_width) {
+            error(1, 0, "Error: Dimensions mismatch: Matrix A (height) must equal Matrix B (width) for multiplication. %lu != %lu", matrices[0]->height, matrices[1]->real_width);
+        }
+        printf("[DONE] Matrix %c loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", 'A' + i, matrices[i]->width, matrices[i]->real_width, matrices[i]->height);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    u_int64_t shape[3];
+    block_shape_ellpack(matrices[0], matrices[1], shape);
+    struct BlockedEllpack* blocked[2] = {blocked_from_ellpack(matrices[0], shape[0], shape[1]),
+                                         blocked_from_ellpack(matrices[1], shape[1], shape[2])};
+    printf("[BLOCK] Blocks of %lu x %lu for Matrix A and %lu x %lu for Matrix B chosen and built in %f secs\n",
+           shape[0], shape[1], shape[1], shape[2], seconds_since(&start));
+    for (int i = 0; i < 2; i++) {
+        u_int64_t plain_bytes = matrices[i]->height * matrices[i]->width * (sizeof(float) + sizeof(u_int64_t));
+        u_int64_t blocked_size = blocked_bytes(matrices[i], blocked[i]->block_rows, blocked[i]->block_cols);
+        printf("[BLOCK] Matrix %c: %lu x %lu blocks take %lu instead of %lu bytes\n", 'A' + i, blocked[i]->block_height,
+               blocked[i]->width, blocked_size, plain_bytes);
+        free_ellpack(matrices[i]);
+    }
+    printf("[LOAD_COMPLETE] Ready for multiplication\n");
+    printf("\n[MUL] Multiplication in progress ...\n");
+
+    struct EllpackMatrix* result = calloc(1, sizeof(*result));
+    if (arguments->benchmark != -1) {
+        benchmark(arguments->version, arguments->benchmark, blocked[0], blocked[1], result);
+    } else {
+        matr_mult_ellpack_blocked(blocked[0], blocked[1], result);
+    }
+
+    printf("\n[SAVE] Writing result matrix %s\n", arguments->output);
+    if (arguments->binary) {
+        write_matrix_binary(result, arguments->output);
+    } else {
+        write_matrix(result, arguments->output);
+    }
+    printf("[FREE] Freeing used memory ...\n");
+    free_blocked(blocked[0]);
+    free_blocked(blocked[1]);
+    free_ellpack(result);
+}
+
+// with a memory limit the product is multiplied in row panels written one at a time if the whole result would not fit,
+// returns whether it did
+static int run_limited(struct arguments *arguments, struct EllpackMatrix *amatrix, struct EllpackMatrix *bmatrix) {
+    u_int64_t needed = multiply_bytes(amatrix, bmatrix);
+    u_int64_t in_use = memory_current();
+    u_int64_t left = arguments->mem_limit > in_use ? arguments->mem_limit - in_use : 0;
+    if (needed <= left) {
+        printf("[MEM] The multiplication needs at most %lu bytes, %lu are left below the limit\n", needed, left);
+        return 0;
+    }
+    if ((arguments->version != LINEAR && arguments->version != PARALLEL && arguments->version != FIXED_WIDTH) || arguments->binary
+        || arguments->benchmark != -1 || arguments->cmatrix || arguments->alpha != 1.0F
+        || arguments->reorder != ORDER_NONE || arguments->reproducible != -1) {
+        printf("[MEM] The multiplication needs up to %lu bytes, %lu are left below the limit, only implementations 0, 3 and 12 "
+               "writing text without other options can multiply in panels\n", needed, left);
+        return 0;
+    }
+    printf("[MEM] The multiplication needs up to %lu bytes, %lu are left below the limit, multiplying in row panels\n", needed, left);
+    printf("\n[MUL] Multiplying panels of Matrix A and writing them to %s ...\n", arguments->output);
+    FILE *out_file = fopen(arguments->output, "w");
+    if (!out_file) {
+        error(1, 0, "Error while opening matrix file %s, do you have the correct permissions?", arguments->output);
+    }
+    u_int64_t panels;
+    if (!multiply_in_panels(amatrix, bmatrix, left, out_file, &panels)) {
+        error(1, 0, "Error: %lu bytes below the memory limit are too few for the transpose of Matrix B and one result row", left);
+    }
+    if (ferror(out_file)) {
+        error(1, 0, "Error while writing matrix file %s", arguments->output);
+    }
+    fclose(out_file);
+    printf("[MUL] %lu panels multiplied and written\n", panels);
+    return 1;
+}
+
 int main (int argc, char** argv) {
     struct arguments arguments;
     arguments.verbose = 0;
@@ -149,8 +915,39 @@ int main (int argc, char** argv) {
     arguments.version = 0;
     arguments.benchmark = -1;
     arguments.test = -1;
+    arguments.threads = 0;
+    arguments.binary = 0;
+    arguments.analyze = 0;
+    arguments.socket = NULL;
+    arguments.manifest = NULL;
+    arguments.pipeline = 0;
+    arguments.reproducible = -1;
+    arguments.dense = -1;
+    arguments.dense_ellpack = 0;
+    arguments.autotune = NULL;
+    arguments.workers = 0;
+    arguments.worker_socket = -1;
+    arguments.worker_b = -1;
+    arguments.prune = (struct PruneRule) {0.0F, 0.0F, 0};
+    arguments.fuzz = (struct DifferentialConfig) {0, 64, 0.1, 1e-4, 1, true};
+    arguments.reorder = ORDER_NONE;
+    arguments.cmatrix = NULL;
+    arguments.elementwise = ELEMENT_NONE;
+    arguments.alpha = 1.0F;
+    arguments.beta = 1.0F;
+    arguments.cache_limit = (u_int64_t) 1024 << 20;
+    arguments.mem_limit = 0;
+    arguments.pages = PAGES_TRANSPARENT;
 
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    set_scheduler_threads(arguments.threads);
+    set_scheduler_verbose(arguments.verbose);
+    set_prune_rule(arguments.prune);
+    set_memory_limit(arguments.mem_limit);
+    set_page_policy(arguments.pages);
+    if (arguments.worker_socket != -1) {
+        return run_worker(arguments.worker_socket, arguments.worker_b, arguments.version);
+    }
 
     if(arguments.test != -1) {
         switch (arguments.test) {
@@ -163,12 +960,127 @@ int main (int argc, char** argv) {
             case 2:
                 testing(NAIVE, stdout);
                 break;
+            case 3:
+                testing(PARALLEL, stdout);
+                break;
+            case 4:
+                testing(HALF_FP16, stdout);
+                break;
+            case 5:
+                testing(HALF_BF16, stdout);
+                break;
+            case 6:
+                testing(GENERIC_F32, stdout);
+                break;
+            case 7:
+                testing(GENERIC_F64, stdout);
+                break;
+            case 8:
+                testing(MIXED_F32_F64, stdout);
+                break;
+            case 9:
+                testing(BATCHED, stdout);
+                break;
+            case 10:
+                testing(COMPRESSED, stdout);
+                break;
+            case 11:
+                testing(BLOCKED, stdout);
+                break;
+            case 12:
+                testing(FIXED_WIDTH, stdout);
+                break;
+            case 13:
+                testing(ROWWISE, stdout);
+                break;
+            case 14:
+                testing_features(stdout);
+                break;
         }
         return 0;
     }
 
     printf("%s\n\n", argp_program_version);
 
+    if (arguments.fuzz.cases) {
+        printf("[FUZZ] %lu cases of up to %lu x %lu with density %g against a dense reference, tolerance %g\n\n",
+               arguments.fuzz.cases, arguments.fuzz.max_size, arguments.fuzz.max_size, arguments.fuzz.density, arguments.fuzz.tolerance);
+        return run_differential(&arguments.fuzz, -1, stdout) ? 0 : 1;
+    }
+    if (arguments.autotune && (arguments.version != LINEAR || arguments.reproducible != -1 || prune_active() || arguments.cmatrix
+                               || arguments.alpha != 1.0F || arguments.elementwise != ELEMENT_NONE || arguments.analyze
+                               || arguments.dense != -1 || arguments.pipeline || arguments.manifest || arguments.socket)) {
+        error(1, 0, "Error: --auto picks one of the float implementations itself, -V and options restricting the implementation are not supported");
+    }
+    if (arguments.workers && (!float_ellpack_version(arguments.version) || arguments.benchmark != -1
+                              || arguments.reproducible != -1 || prune_active() || arguments.cmatrix || arguments.alpha != 1.0F
+                              || arguments.elementwise != ELEMENT_NONE || arguments.analyze || arguments.dense != -1
+                              || arguments.mem_limit || arguments.pipeline || arguments.manifest || arguments.socket)) {
+        error(1, 0, "Error: Workers multiply with one of the float implementations 0, 1, 2, 3, 6, 9, 12 and 13, options restricting the implementation are not supported");
+    }
+    if (arguments.socket) {
+        return run_service(arguments.socket, arguments.cache_limit);
+    }
+    if (arguments.manifest) {
+        return run_batch(arguments.manifest, arguments.benchmark, arguments.binary);
+    }
+
+    if (arguments.pipeline) {
+        if ((arguments.version != LINEAR && arguments.version != PARALLEL) || arguments.benchmark != -1 || arguments.binary
+            || arguments.reorder != ORDER_NONE || arguments.cmatrix || arguments.alpha != 1.0F || arguments.elementwise != ELEMENT_NONE
+            || arguments.reproducible != -1 || arguments.dense != -1) {
+            error(1, 0, "Error: The pipeline multiplies with the parallel merge of implementations 0 and 3 and writes text, other options are not supported");
+        }
+        return run_pipeline(arguments.amatrix, arguments.bmatrix, arguments.output, arguments.pipeline);
+    }
+    if ((arguments.reorder != ORDER_NONE || arguments.cmatrix || arguments.alpha != 1.0F) && !float_ellpack_version(arguments.version)) {
+        error(1, 0, "Error: Reordering and alpha * A * B + beta * C are only supported by the float implementations");
+    }
+    if (arguments.reproducible != -1 && (arguments.version > PARALLEL || arguments.cmatrix || arguments.alpha != 1.0F
+                                         || arguments.elementwise != ELEMENT_NONE || arguments.analyze)) {
+        error(1, 0, "Error: Reproducible sums are only supported by the float merges, implementations 0 to 3, without alpha and C");
+    }
+    if (prune_active() && ((arguments.version != LINEAR && arguments.version != PARALLEL) || arguments.reproducible != -1 || arguments.cmatrix
+                           || arguments.alpha != 1.0F || arguments.elementwise != ELEMENT_NONE || arguments.analyze)) {
+        error(1, 0, "Error: Drop rules are only supported by implementations 0 and 3 and the pipeline, without alpha and C");
+    }
+    if ((arguments.dense != -1 || arguments.dense_ellpack) && (arguments.dense == -1 || !float_ellpack_version(arguments.version)
+                                || arguments.reproducible != -1 || prune_active() || arguments.reorder != ORDER_NONE || arguments.cmatrix
+                                || arguments.alpha != 1.0F || arguments.elementwise != ELEMENT_NONE || arguments.analyze)) {
+        error(1, 0, "Error: The dense output is only supported next to the float implementations without other options, --dense-ellpack needs --dense");
+    }
+    if (arguments.analyze) {
+        printf("[LOAD] Loading Matrix A ...\n");
+        struct EllpackMatrix* amatrix = parse_matrix(arguments.amatrix);
+        printf("[LOAD] Loading Matrix B ...\n");
+        struct EllpackMatrix* bmatrix = parse_matrix(arguments.bmatrix);
+        printf("\n");
+        analyze_matrices(amatrix, bmatrix);
+        free_all((struct EllpackMatrix *[]){amatrix, bmatrix}, 2);
+        return 0;
+    }
+    if (arguments.elementwise != ELEMENT_NONE) {
+        run_elementwise(&arguments);
+        return 0;
+    }
+    if (arguments.version == HALF_FP16 || arguments.version == HALF_BF16) {
+        run_half(&arguments, arguments.version == HALF_FP16 ? FP16 : BF16);
+        return 0;
+    }
+    if (arguments.version == GENERIC_F64 || arguments.version == MIXED_F32_F64) {
+        run_f64(&arguments, arguments.version == GENERIC_F64);
+        return 0;
+    }
+    if (arguments.version == COMPRESSED) {
+        run_compressed(&arguments);
+        return 0;
+    }
+    if (arguments.version == BLOCKED) {
+        run_blocked(&arguments);
+        return 0;
+    }
+
+    begin_memory_phase("load");
     printf("[LOAD] Loading Matrix A ...\n");
     struct EllpackMatrix* amatrix = parse_matrix(arguments.amatrix);
     printf("[DONE] Matrix A loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", amatrix->width, amatrix->real_width, amatrix->height);
@@ -182,11 +1094,69 @@ int main (int argc, char** argv) {
     }
 
     printf("[DONE] Matrix B loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", bmatrix->width, bmatrix->real_width, bmatrix->height);
+
+    struct EllpackMatrix* cmatrix = NULL;
+    if (arguments.cmatrix) {
+        printf("[LOAD] Loading Matrix C ...\n");
+        cmatrix = parse_matrix(arguments.cmatrix);
+        printf("[DONE] Matrix C loaded, Dimensions: [%lu (formerly %lu) x %lu]\n\n", cmatrix->width, cmatrix->real_width, cmatrix->height);
+    }
     printf("[LOAD_COMPLETE] Ready for multiplication\n");
+    end_memory_phase();
+
+    begin_memory_phase("multiply");
+    if (arguments.dense != -1 && run_dense(&arguments, amatrix, bmatrix)) {
+        printf("[FREE] Freeing used memory ...\n");
+        free_all((struct EllpackMatrix *[]){amatrix, bmatrix}, 2);
+        return 0;
+    }
+    if (arguments.autotune) {
+        arguments.version = autotune_implementation(amatrix, bmatrix, arguments.autotune);
+    }
+    if (arguments.mem_limit && run_limited(&arguments, amatrix, bmatrix)) {
+        end_memory_phase();
+        printf("[FREE] Freeing used memory ...\n");
+        free_all((struct EllpackMatrix *[]){amatrix, bmatrix}, 2);
+        return 0;
+    }
+
+    // the rows of A are multiplied in the new order and the result is brought back to the file order
+    u_int64_t *order = NULL;
+    struct EllpackMatrix *reordered = NULL;
+    if (arguments.reorder != ORDER_NONE) {
+        order = reorder_a(&arguments, amatrix, bmatrix, &reordered);
+        free_ellpack(amatrix);
+        amatrix = reordered;
+        if (cmatrix) {
+            struct EllpackMatrix *reordered_c = permute_rows(cmatrix, order, 0);
+            free_ellpack(cmatrix);
+            cmatrix = reordered_c;
+        }
+    }
+    if (arguments.version == FIXED_WIDTH) {
+        if (fixed_width_kernel(amatrix)) {
+            printf("[FIXED] Matrix A has width %lu, the merge generated for it runs\n", amatrix->width);
+        } else {
+            printf("[FIXED] There is no kernel for width %lu, the parallel merge runs\n", amatrix->width);
+        }
+    }
+    if (arguments.workers) {
+        printf("[DIST] %d worker processes multiply blocks of rows of Matrix A with implementation %d, Matrix B is shared read only\n",
+               arguments.workers, arguments.version);
+    }
     printf("\n[MUL] Multiplication in progress ...\n");
 
     struct EllpackMatrix* result = calloc(1, sizeof(*result));
-    if(arguments.benchmark != -1) {
+    if (arguments.cmatrix || arguments.alpha != 1.0F) {
+        // every product row is merged with its row of C, the product is never stored on its own
+        matr_mult_add_ellpack(arguments.alpha, amatrix, bmatrix, arguments.beta, cmatrix, result);
+    } else if (arguments.reproducible != -1) {
+        run_reproducible(&arguments, amatrix, bmatrix, result);
+    } else if (prune_active()) {
+        run_pruned(&arguments, amatrix, bmatrix, result);
+    } else if (arguments.workers) {
+        matr_mult_ellpack_distributed(amatrix, bmatrix, arguments.workers, arguments.version, result);
+    } else if(arguments.benchmark != -1) {
         benchmark(arguments.version, arguments.benchmark, amatrix, bmatrix, result);
     } else {
         switch (arguments.version) {
@@ -199,11 +1169,44 @@ int main (int argc, char** argv) {
             case 2:
                 matr_mult_ellpack_naive(amatrix, bmatrix, result);
                 break;
+            case 3:
+                matr_mult_ellpack_parallel(amatrix, bmatrix, result);
+                break;
+            case 6:
+                matr_mult_ellpack_f32(amatrix, bmatrix, result);
+                break;
+            case 9:
+                matr_mult_ellpack_batched(amatrix, bmatrix, result);
+                break;
+            case 12:
+                matr_mult_ellpack_fixed(amatrix, bmatrix, result);
+                break;
+            case 13:
+                matr_mult_ellpack_rowwise(amatrix, bmatrix, result);
+                break;
         }
     }
 
+    if (order) {
+        struct EllpackMatrix *restored = permute_rows(result, order, 1);
+        free_ellpack(result);
+        result = restored;
+        free(order);
+    }
+
+    end_memory_phase();
+
+    begin_memory_phase("save");
     printf("\n[SAVE] Writing result matrix %s\n", arguments.output);
-    write_matrix(result, arguments.output);
+    if (arguments.binary) {
+        write_matrix_binary(result, arguments.output);
+    } else {
+        write_matrix(result, arguments.output);
+    }
+    end_memory_phase();
     printf("[FREE] Freeing used memory ...\n");
     free_all((struct EllpackMatrix *[]){amatrix, bmatrix, result}, 3);
+    if (cmatrix) {
+        free_ellpack(cmatrix);
+    }
 }